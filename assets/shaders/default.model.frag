@@ -1,8 +1,8 @@
 //This file was automatically generated 
 //DO NOT CHANGE !
-#version 420 core
+#version 430 core
 
-#define MAX_LIGHTS 10
+#define MAX_SHADOW_MAPS 10
 #define AMBIENT 0
 #define POINT_LIGHT 1
 #define DIRECTIONAL_LIGHT 2
@@ -53,31 +53,45 @@ struct Environment{
 	sampler2D specularBRDF_tex;
 };
 
+//Lights data, see Merlin::LightData
 struct Light {
     vec3 position;    // For point and spot lights
+    float cutOff;     // For spot lights
     vec3 direction;   // For directional and spot lights
+    float far_plane;
     vec3 ambient;
+    int type;
     vec3 diffuse;
+    int castShadow;
     vec3 specular;
+    float padding0;
     vec3 attenuation; //constant, linear, quadratic
-    float cutOff;     // For spot lights
-    int type;
+    float padding1;
     mat4 lightSpaceMatrix;
-    float far_plane;
-    int castShadow;
-    sampler2D shadowMap;
-    samplerCube omniShadowMap;
 };
 
+//Per frame data, see Merlin::FrameData
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	int numLights;
+	int useShadows;
+};
+
+layout(std430) readonly buffer LightBuffer {
+    Light lights[];
+};
+
+//shadow maps are indexed like the lights
+uniform sampler2D shadowMaps[MAX_SHADOW_MAPS];
+uniform samplerCube omniShadowMaps[MAX_SHADOW_MAPS];
+
 uniform samplerCube skybox;
 uniform int hasSkybox = 0;
 uniform Material material;
 uniform Environment environment;
-uniform Light lights[MAX_LIGHTS];
-uniform int numLights;
 
-uniform bool useShadows = false;
-uniform vec3 viewPos;
 uniform mat4 model;
 uniform bool use_vertex_color = false;
 
@@ -91,10 +105,11 @@ vec3 gridSamplingDisk[20] = vec3[]
    vec3(0, 1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0, 1, -1)
 );
 
-float computeShadow(Light li, vec4 fragPosLightSpace)
+float computeShadow(int index, vec4 fragPosLightSpace)
 {   
-    if(!useShadows) return 0.0;
-    if(li.castShadow == 0) return 0.0;
+    if(useShadows == 0) return 0.0;
+    if(index >= MAX_SHADOW_MAPS || lights[index].castShadow == 0) return 0.0;
+    Light li = lights[index];
     float shadow = 0.0;
 
     if(li.type == DIRECTIONAL_LIGHT || li.type == SPOT_LIGHT ){
@@ -103,19 +118,19 @@ float computeShadow(Light li, vec4 fragPosLightSpace)
         // transform to [0,1] range
         projCoords = projCoords * 0.5 + 0.5;
         // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-        float closestDepth = texture(li.shadowMap, projCoords.xy).r; 
+        float closestDepth = texture(shadowMaps[index], projCoords.xy).r; 
         // get depth of current fragment from light's perspective
         float currentDepth = projCoords.z;
         vec3 normal = normalize(vin.normal);
         vec3 lightDir = normalize(li.position - vin.position);
         float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
     
-        vec2 texelSize = 1.0 / textureSize(li.shadowMap, 0);
+        vec2 texelSize = 1.0 / textureSize(shadowMaps[index], 0);
         for(int x = -1; x <= 1; ++x)
         {
             for(int y = -1; y <= 1; ++y)
             {
-                float pcfDepth = texture(li.shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
+                float pcfDepth = texture(shadowMaps[index], projCoords.xy + vec2(x, y) * texelSize).r; 
                 shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
             }    
         }
@@ -136,7 +151,7 @@ float computeShadow(Light li, vec4 fragPosLightSpace)
 
         // Correctly sample the shadow map using 3D texture coordinates
         for (int i = 0; i < samples; ++i) {
-            float closestDepth = texture(li.omniShadowMap, fragToLight + gridSamplingDisk[i] * diskRadius).r;
+            float closestDepth = texture(omniShadowMaps[index], fragToLight + gridSamplingDisk[i] * diskRadius).r;
             closestDepth *= li.far_plane;  // undo mapping [0;1]
             if (currentDepth - bias > closestDepth) {
                 shadow += 1.0;
@@ -150,29 +165,31 @@ float computeShadow(Light li, vec4 fragPosLightSpace)
 }
 
 
-vec3 calculateDirectionalLight(Light light, vec3 normal, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor);
-vec3 calculatePointLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor);
-vec3 calculateSpotLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor);
-vec3 calculateAmbientLight(Light light, vec3 ambientColor);
-
-vec3 calculateLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor) {
-    if (light.type == POINT_LIGHT) {
-        return calculatePointLight(light, normal, fragPos, viewDir, ambientColor, diffuseColor, specularColor);
-    } else if (light.type == DIRECTIONAL_LIGHT) {
-        return calculateDirectionalLight(light, normal, viewDir, ambientColor, diffuseColor, specularColor);
-    } else if (light.type == SPOT_LIGHT) {
-        return calculateSpotLight(light, normal, fragPos, viewDir, ambientColor, diffuseColor, specularColor);
-    }else if (light.type == AMBIENT) {
-        return calculateAmbientLight(light, diffuseColor);
+vec3 calculateDirectionalLight(int index, vec3 normal, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor);
+vec3 calculatePointLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor);
+vec3 calculateSpotLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor);
+vec3 calculateAmbientLight(int index, vec3 ambientColor);
+
+vec3 calculateLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor) {
+    int type = lights[index].type;
+    if (type == POINT_LIGHT) {
+        return calculatePointLight(index, normal, fragPos, viewDir, ambientColor, diffuseColor, specularColor);
+    } else if (type == DIRECTIONAL_LIGHT) {
+        return calculateDirectionalLight(index, normal, viewDir, ambientColor, diffuseColor, specularColor);
+    } else if (type == SPOT_LIGHT) {
+        return calculateSpotLight(index, normal, fragPos, viewDir, ambientColor, diffuseColor, specularColor);
+    }else if (type == AMBIENT) {
+        return calculateAmbientLight(index, diffuseColor);
     }
     return vec3(0.0);
 }
 
-vec3 calculateAmbientLight(Light light, vec3 ambientColor) {
-    return light.ambient * ambientColor;
+vec3 calculateAmbientLight(int index, vec3 ambientColor) {
+    return lights[index].ambient * ambientColor;
 }
 
-vec3 calculateDirectionalLight(Light light, vec3 normal, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor) {
+vec3 calculateDirectionalLight(int index, vec3 normal, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor) {
+    Light light = lights[index];
     vec3 lightDir = -normalize(vin.tangentBasis * light.direction);
     
     float diff = max(dot(normal, lightDir), 0.0);
@@ -186,10 +203,11 @@ vec3 calculateDirectionalLight(Light light, vec3 normal, vec3 viewDir, vec3 ambi
     vec3 specular = light.specular * spec * specularColor;
 
     vec4 fragPosLightSpace = light.lightSpaceMatrix * vec4(vin.position, 1.0);
-    return ambient + (1.0 - computeShadow(light, fragPosLightSpace)) * (diffuse + specular);
+    return ambient + (1.0 - computeShadow(index, fragPosLightSpace)) * (diffuse + specular);
 }
 
-vec3 calculatePointLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor) {
+vec3 calculatePointLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor) {
+    Light light = lights[index];
     vec3 light_position = vin.tangentBasis * light.position;
     vec3 lightVec = light_position - fragPos;
     
@@ -208,12 +226,13 @@ vec3 calculatePointLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir, v
     vec3 diffuse = light.diffuse * diff * diffuseColor;
     vec3 specular = light.specular * spec * specularColor;
     vec4 fragPosLightSpace = light.lightSpaceMatrix * vec4(vin.position, 1.0);
-    float shadow_inv = (1.0 - computeShadow(light, fragPosLightSpace));
+    float shadow_inv = (1.0 - computeShadow(index, fragPosLightSpace));
    
     return ambient + attenuation * shadow_inv * (diffuse + specular);
 }
 
-vec3 calculateSpotLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor) {
+vec3 calculateSpotLight(int index, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ambientColor, vec3 diffuseColor, vec3 specularColor) {
+    Light light = lights[index];
     vec3 light_position = vin.tangentBasis * light.position;
     vec3 lightDir = normalize(light_position - fragPos);
     vec3 halfwayDir = normalize(lightDir + viewDir);
@@ -233,7 +252,7 @@ vec3 calculateSpotLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir, ve
     vec3 specular = light.specular * spec * specularColor;
 
     vec4 fragPosLightSpace = light.lightSpaceMatrix * vec4(vin.position, 1.0);
-    float shadow_inv = (1.0 - computeShadow(light, fragPosLightSpace));
+    float shadow_inv = (1.0 - computeShadow(index, fragPosLightSpace));
 
     return ambient + (intensity * attenuation * shadow_inv * (diffuse + specular));
 }
@@ -270,7 +289,7 @@ void main() {
 	else specularColor = material.specular_color + skyColor*0.1;
 
     for (int i = 0; i < numLights; ++i) {
-        finalColor += calculateLight(lights[i], N, vin.position, viewDir, ambientColor, diffuseColor, specularColor);
+        finalColor += calculateLight(i, N, vin.position, viewDir, ambientColor, diffuseColor, specularColor);
     }
     float gamma = 0.6;
     FragColor.rgb = pow(finalColor.rgb * (use_vertex_color ? vin.color.rgb : vec3(1.0)), vec3(1.0/gamma));
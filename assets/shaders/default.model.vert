@@ -6,10 +6,9 @@ layout (location = 0) in vec3 _position;
 layout (location = 1) in vec3 _normal;
 layout (location = 2) in vec3 _color;
 layout (location = 3) in vec2 _texcoord;
-layout (location = 4) in vec3 _tangent;
+layout (location = 4) in vec4 _tangent; //w holds the bitangent sign in the compact format
 layout (location = 5) in vec3 _bitangent;
 
-#define MAX_LIGHTS 10
 
 out VS_out{
 	vec3 position;
@@ -20,25 +19,55 @@ out VS_out{
 	mat3 tangentBasis;
 } vout;
 
-uniform mat4 view;
-uniform mat4 projection;
+//Per frame data, see Merlin::FrameData
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	int numLights;
+	int useShadows;
+};
+
 uniform mat4 model;
-uniform vec3 viewPos;
+
+//Mesh vertex formats, see Merlin::VertexFormat
+#define VERTEX_FULL 0
+#define VERTEX_POSITION 1
+#define VERTEX_POSITION_NORMAL 2
+#define VERTEX_COMPACT 3
+uniform int vertex_format;
+
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
 
 
 void main() {
 	vout.position = vec3(model * vec4(_position, 1.0f));
-	vout.color = _color;
-	vout.normal = _normal;
+	vec3 normal = _normal;
+	vec3 color = _color;
+	vec3 tangent = _tangent.xyz;
+	vec3 bitangent = _bitangent;
+	if (vertex_format != VERTEX_FULL) {
+		//compact formats only store an octahedral normal, the bitangent is rebuilt from its sign
+		normal = vertex_format == VERTEX_POSITION ? vec3(0) : octDecode(_normal.xy);
+		color = vec3(1);
+		bitangent = cross(normal, tangent) * (_tangent.w < 0.0 ? -1.0 : 1.0);
+	}
+
+	vout.color = color;
+	vout.normal = normal;
 	vout.texcoord = _texcoord;
 	vout.viewPos = viewPos;
 
-	if(length(_tangent) == 0 || length(_bitangent) == 0 || length(_normal) == 0){
+	if(length(tangent) == 0 || length(bitangent) == 0 || length(normal) == 0){
 		vout.tangentBasis = mat3(1);//set to identity
 	}else{
-		vec3 T = normalize(vec3(model * vec4(_tangent, 0.0)));
-		vec3 B = normalize(vec3(model * vec4(_bitangent, 0.0)));
-		vec3 N = normalize(vec3(model * vec4(_normal, 0.0)));
+		vec3 T = normalize(vec3(model * vec4(tangent, 0.0)));
+		vec3 B = normalize(vec3(model * vec4(bitangent, 0.0)));
+		vec3 N = normalize(vec3(model * vec4(normal, 0.0)));
 	
 		// re-orthogonalize T with respect to N
 		T = normalize(T - dot(T, N) * N);
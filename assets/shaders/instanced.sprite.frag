@@ -9,7 +9,14 @@ in mat4 mv;
 
 out vec4 FragColor;
 
-uniform vec3 viewPos;
+//Per frame data, see Merlin::FrameData
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	int numLights;
+	int useShadows;
+};
 uniform vec4 lightColor = vec4(1);
 
 uniform float pointRadius;
@@ -11,8 +11,15 @@ out vec4 screen_position;
 out vec4 color;
 out mat4 mv;
 
-uniform mat4 view;
-uniform mat4 projection;
+//Per frame data, see Merlin::FrameData
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	int numLights;
+	int useShadows;
+};
+
 uniform mat4 model;
 
 void main() {
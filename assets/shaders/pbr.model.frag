@@ -55,26 +55,38 @@ struct Environment{
 uniform Material material;
 uniform Environment environment;
 
-uniform vec3 cameraPosition;
 uniform vec3 lightPosition;
 uniform vec3 lightRadiance;
 
+//Per frame data, see Merlin::FrameData
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	int numLights;
+	int useShadows;
+};
 
-#define MAX_LIGHTS 10
-
+//Lights data, see Merlin::LightData
 struct Light {
     vec3 position;    // For point and spot lights
+    float cutOff;     // For spot lights
     vec3 direction;   // For directional and spot lights
+    float far_plane;
     vec3 ambient;
+    int type;         // 0: Ambient, 1: Point, 2: Directional, 3: Spot
     vec3 diffuse;
+    int castShadow;
     vec3 specular;
+    float padding0;
     vec3 attenuation; //constant, linear, quadratic
-    float cutOff;     // For spot lights
-    int type;         // 0: Directional, 1: Point, 2: Spot
+    float padding1;
+    mat4 lightSpaceMatrix;
 };
 
-uniform Light lights[MAX_LIGHTS];
-uniform int numLights = 0;
+layout(std430) readonly buffer LightBuffer {
+    Light lights[];
+};
 
 const vec3 Fdielectric = vec3(0.04);
 
@@ -102,7 +114,7 @@ void main()
 	// Get current fragment's normal and transform to world space.
 	vec3 N = normalRGB;
 	//N = normalize(vin.tangentBasis * N);
-	vec3 V = normalize(cameraPosition - vin.position);
+	vec3 V = normalize(viewPos - vin.position);
 
 	vec3 Lo = vec3(0);
 	for(int i = 0; i < numLights; ++i) 
@@ -2,11 +2,12 @@
 //DO NOT CHANGE !
 #version 440 core
 
+//Merlin::Vertex locations, shared by every VertexFormat
 layout(location=0) in vec3 position;
 layout(location=1) in vec3 normal;
-layout(location=2) in vec3 tangent;
-layout(location=3) in vec3 bitangent;
-layout(location=4) in vec2 texcoord;
+layout(location=3) in vec2 texcoord;
+layout(location=4) in vec4 tangent; //w holds the bitangent sign in the compact format
+layout(location=5) in vec3 bitangent;
 
 layout(location=0) out Vertex {
 	vec3 position;
@@ -15,14 +16,43 @@ layout(location=0) out Vertex {
 	mat3 tangentBasis;
 } vout;
 
-uniform mat4 view;
-uniform mat4 projection;
+//Per frame data, see Merlin::FrameData
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	int numLights;
+	int useShadows;
+};
+
 uniform mat4 model;
 
+//Mesh vertex formats, see Merlin::VertexFormat
+#define VERTEX_FULL 0
+#define VERTEX_POSITION 1
+#define VERTEX_POSITION_NORMAL 2
+#define VERTEX_COMPACT 3
+uniform int vertex_format;
+
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
 void main() {
+	vec3 N = normal;
+	vec3 T = tangent.xyz;
+	vec3 B = bitangent;
+	if (vertex_format != VERTEX_FULL) {
+		//compact formats only store an octahedral normal, the bitangent is rebuilt from its sign
+		N = vertex_format == VERTEX_POSITION ? vec3(0) : octDecode(normal.xy);
+		B = cross(N, T) * (tangent.w < 0.0 ? -1.0 : 1.0);
+	}
+
 	vout.position = vec3(model * vec4(position, 1.0));
 	vout.texcoord = vec2(texcoord.x, 1.0-texcoord.y);
-	vout.normal = normal;
-	vout.tangentBasis = mat3(model) * mat3(tangent, bitangent, normal);
+	vout.normal = N;
+	vout.tangentBasis = mat3(model) * mat3(T, B, N);
 	gl_Position = projection * view * vec4(vout.position, 1.0f);
 }
@@ -91,6 +91,12 @@ void AppLayer::setupPhysics() {
 	solver->use();
 	solver->setUInt("numParticles", position.size());
 
+	//the solver updates both fields in place, the renderer reads the positions from the storage block
+	physics = ComputeGraph::create("physics");
+	physics->addPass("solver", solver).readsWrites(*pos).readsWrites(*vel);
+	physics->output(*pos, ResourceUsage::STORAGE);
+	physics->output(*vel, ResourceUsage::STORAGE);
+
 	scene.add(ps);
 }
 
@@ -115,12 +121,7 @@ void AppLayer::onEvent(Event& event){
 }
 
 void AppLayer::onPhysicsUpdate(Timestep ts) {
-	solver->use();
-	for (int i = 0; i < 20; i++) {
-		solver->dispatch();
-		solver->barrier();
-	}
-
+	physics->execute(20); //storage barriers between the substeps only, derived by the graph
 }
 
 void AppLayer::onUpdate(Timestep ts){
@@ -25,6 +25,7 @@ private:
 
 	ParticleSystem_Ptr ps;
 	ComputeShader_Ptr solver;
+	ComputeGraph_Ptr physics;
 	//ParticleSystem_Ptr bs;
 
 	glm::vec3 model_matrix_translation = { 0.8f, 0.2f, 0.3f};
@@ -9,6 +9,12 @@
 #include "merlin/memory/frameBuffer.h"
 #include "merlin/memory/renderBuffer.h"
 #include "merlin/memory/ssbo.h"
+#include "merlin/memory/ubo.h"
+#include "merlin/memory/streamBuffer.h"
+#include "merlin/memory/readback.h"
+#include "merlin/memory/bufferArena.h"
+#include "merlin/memory/memoryTracker.h"
+#include "merlin/memory/blockLayout.h"
 
 #include "merlin/graphics/renderer.h"
 #include "merlin/graphics/deferredrenderer.h"
@@ -18,12 +24,22 @@
 
 #include "merlin/memory/bindingPointManager.h"
 #include "merlin/shaders/computeShader.h"
+#include "merlin/shaders/computeGraph.h"
+#include "merlin/shaders/shaderCache.h"
+#include "merlin/shaders/shaderPreprocessor.h"
+#include "merlin/shaders/shaderCompiler.h"
 #include "merlin/physics/particleSystem.h"
+#include "merlin/physics/checkpoint.h"
+#include "merlin/physics/fieldRecorder.h"
 
 
 #include "merlin/utils/modelLoader.h"
 #include "merlin/utils/primitives.h"
 #include "merlin/utils/voxelizer.h"
+#include "merlin/utils/gpuPrimitives.h"
+#include "merlin/utils/gpuProfiler.h"
+#include "merlin/utils/cpuProfiler.h"
+#include "merlin/utils/mappedFile.h"
 #include "merlin/utils/dialog.h"
 
 #include <imgui.h>
\ No newline at end of file
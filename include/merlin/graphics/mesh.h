@@ -22,6 +22,7 @@ namespace Merlin {
 
 		void draw() const;
 		void drawInstanced(GLsizeiptr instanced) const;
+		void drawIndirect(const AbstractBufferObject& args, GLintptr offset = 0) const; //Draw(Arrays|Elements)IndirectCommand written on the GPU
 
 		void voxelize(float size);
 		void voxelizeSurface(float size, float thickness);
@@ -33,9 +34,16 @@ namespace Merlin {
 		void removeUnusedVertices();
 		void applyMeshTransform();
 		void centerMeshOrigin();
-		void updateVAO();
+		void updateVAO(); //uploads vertices and indices in place, the buffers are only reallocated when they grow
+		void updateVertices(GLsizeiptr first = 0, GLsizeiptr count = -1); //uploads a range of the vertices after editing them
+		void updateVertices(GLsizeiptr first, const std::vector<Vertex>& vertices); //replaces a range of vertices and uploads it
+		void updateIndices();
+
+		void setVertexFormat(VertexFormat format); //AUTO picks the smallest format keeping the mesh data and re-evaluates it on every update
+		VertexFormat chooseVertexFormat() const;
 
 		inline void setDrawMode(GLuint mode) { m_drawMode = mode; }
+		inline void setIndirectArgs(AbstractBufferObject_Ptr args) { m_indirectArgs = args; } //draw() reads its counts from args, nullptr draws every element
 		inline void setShader(Shared<Shader> shader) { m_shader = shader; }
 		inline void setMaterial(Shared<MaterialBase> material) { m_material = material; }
 		inline void setShader(std::string shaderName) { m_shaderName = shaderName; }
@@ -46,8 +54,12 @@ namespace Merlin {
 		inline bool hasMaterial() const { return m_material != nullptr; }
 
 		inline GLuint getDrawMode() const { return m_drawMode; }
+		inline GLuint getElementCount() const { return m_elementCount; }
+		inline AbstractBufferObject_Ptr getIndirectArgs() const { return m_indirectArgs; }
+		inline VertexFormat getVertexFormat() const { return m_vertexFormat; }
 		inline const std::vector<int>& getVoxels() const { return m_voxels;  }
 		inline const std::vector<Vertex>& getVertices() const { return m_vertices;  }
+		inline std::vector<Vertex>& getVertices() { return m_vertices; } //call updateVertices after editing
 		inline const std::vector<GLuint>& getIndices() const{ return m_indices; }
 		inline const glm::mat4& getTransform() const { return m_transform; }
 		inline const Shared<Shader> getShader() const { return m_shader; }
@@ -62,8 +74,15 @@ namespace Merlin {
 		static Shared<Mesh> create(std::string name, std::vector<Vertex>& vertices, std::vector<GLuint>& indices, GLuint mode = GL_TRIANGLES);
 
 	private:
+		void createBuffers();
+
 		VAO_Ptr m_vao;
+		Shared<VBO<GLubyte>> m_vbo = nullptr;
+		IBO_Ptr m_ebo = nullptr;
 		GLuint m_drawMode;
+		AbstractBufferObject_Ptr m_indirectArgs = nullptr;
+		VertexFormat m_vertexFormat = VertexFormat::FULL;
+		bool m_autoVertexFormat = false;
 
 		GLuint m_elementCount = 0;
 		std::vector<Vertex> m_vertices;
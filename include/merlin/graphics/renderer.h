@@ -26,5 +26,9 @@ namespace Merlin {
 		void renderDepth(const Shared<RenderableObject>& object, Shared<Shader> shader);
 		void gatherLights(const Shared<RenderableObject>& object);
 
+		//Per frame data
+		void syncFrameData(const Camera& camera); //uploads the lights once per frame, the camera block when it changed
+		bool attachFrameData(Shader& shader, const Camera& camera); //false if the shader has no FrameData block (per draw uniforms)
+
 	};
 }
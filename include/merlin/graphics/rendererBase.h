@@ -3,12 +3,24 @@
 #include "merlin/scene/scene.h"
 #include "merlin/scene/camera.h"
 #include "merlin/scene/light.h"
+#include "merlin/memory/ubo.h"
+#include "merlin/memory/ssbo.h"
 
 #include <vector>
 #include <stack>
 
 namespace Merlin {
 
+	// std140 layout of the FrameData uniform block of the default shaders, uploaded once per frame
+	struct FrameData {
+		glm::mat4 view = glm::mat4(1);
+		glm::mat4 projection = glm::mat4(1);
+		glm::vec3 viewPos = glm::vec3(0);
+		GLint numLights = 0;
+		GLint useShadows = 0;
+		GLint padding[3] = { 0, 0, 0 };
+	};
+
 	class RendererBase {
 	public:
 		RendererBase();
@@ -90,6 +102,14 @@ namespace Merlin {
 
 		std::vector<Shared<Light>> m_activeLights;
 
+		//Per frame data (FrameData uniform block, LightBuffer storage block)
+		UBO_Ptr<FrameData> m_frameData = nullptr;
+		SSBO_Ptr<LightData> m_lightData = nullptr;
+		bool m_frameDataDirty = true; //lights or shadows changed since the last upload
+		FrameData m_frameDataCache; //last uploaded content
+		GLint m_shadowUnitBase = -1; //first of the texture units reserved for the shadow maps
+		std::unordered_map<GLuint, GLuint> m_shadowSamplers; //program -> generation whose shadow samplers point to the reserved units
+
 		//Matrix stack
 		glm::mat4 m_globalTransform = glm::mat4(1);
 		glm::mat4 m_currentTransform;
@@ -2,32 +2,77 @@
 #include "merlin/core/core.h"
 
 #include <unordered_map>
-#include <queue>
+#include <map>
 #include <vector>
 #include <algorithm>
-#include <stdexcept>
 
 #include "merlin/memory/bufferObject.h"
 
 namespace Merlin {
+    // Tracks indexed binding points and the GL binding state behind them.
+    // Slots are sized from the real GL_MAX_*_BINDINGS limits, the least recently used slot is recycled
+    // when a target runs out and binds that would not change the GL state are skipped.
     class BindingPointManager {
         SINGLETON(BindingPointManager)
-        BindingPointManager() { initializeAvailableBindingPoints(); }
-
+        BindingPointManager() { s_alive = true; }
 
     public:
-        GLuint allocateBindingPoint(BufferTarget bufferTarget, GLuint bufferID);
-        void releaseBindingPoint(BufferTarget bufferTarget, GLuint bindingPoint);
-        const std::vector<GLuint>& getUsedBindingPoints(BufferTarget bufferTarget) const;
+        ~BindingPointManager() { s_alive = false; }
+
+        struct Stats {
+            size_t bindCalls = 0;           //glBindBufferBase/Range issued
+            size_t bindSkipped = 0;         //redundant binds skipped
+            size_t blockBindingCalls = 0;   //glShaderStorageBlockBinding/glUniformBlockBinding issued
+            size_t blockBindingSkipped = 0; //redundant block bindings skipped
+            size_t evictions = 0;           //slots recycled because the target ran out of binding points
+        };
+
+        GLuint allocateBindingPoint(BufferTarget bufferTarget, GLuint bufferID, GLintptr offset = 0);
+        void releaseBindingPoint(BufferTarget bufferTarget, GLuint bufferID, GLintptr offset = 0);
+        bool remapBuffer(GLuint oldBufferID, GLintptr oldOffset, GLuint newBufferID, GLintptr newOffset); //keep the binding point when a buffer storage is reallocated, false if the buffer had none
+
+        void bind(BufferTarget bufferTarget, GLuint bindingPoint, GLuint bufferID, GLintptr offset = 0, GLsizeiptr size = 0); //size = 0 binds the whole buffer
+        void bindBlock(GLuint programID, GLuint blockIndex, GLuint bindingPoint, BufferTarget bufferTarget = BufferTarget::Shader_Storage_Buffer); //storage or uniform block
+
+        void forgetBuffer(GLuint bufferID);   //buffer deleted, GL reverted its bindings to 0
+        void forgetProgram(GLuint programID); //program deleted, its name can be reused
+
+        //safe to call from destructors running after the manager was destroyed (static resources)
+        static void onBufferDeleted(GLuint bufferID);
+        static void onBufferReleased(BufferTarget bufferTarget, GLuint bufferID, GLintptr offset);
+        static void onProgramDeleted(GLuint programID);
+
+        std::vector<GLuint> getUsedBindingPoints(BufferTarget bufferTarget) const;
+        GLuint maxBindingPoints(BufferTarget bufferTarget);
         void resetBindings();
 
+        inline const Stats& stats() const { return m_stats; }
+        inline void resetStats() { m_stats = Stats(); }
+        void printStats() const;
+
     private:
-        void initializeAvailableBindingPoints();
+        struct Slot {
+            //owner of the slot
+            bool used = false;
+            GLuint owner = 0;
+            GLintptr ownerOffset = 0;
+            size_t lastUse = 0;
+
+            //what is actually bound in GL
+            GLuint buffer = 0;
+            GLintptr offset = 0;
+            GLsizeiptr size = 0;
+        };
 
-        std::unordered_map<BufferTarget, std::queue<GLuint>> availableBindingPoints;
-        std::unordered_map<BufferTarget, std::vector<GLuint>> usedBindingPoints;
-        std::unordered_map<GLuint, GLuint> bufferToBindingPoint; // Maps buffer ID to binding point
+        std::vector<Slot>& slots(BufferTarget bufferTarget);
 
+        std::unordered_map<BufferTarget, std::vector<Slot>> m_slots;
+        std::map<std::pair<GLuint, GLintptr>, std::pair<BufferTarget, GLuint>> m_owners; // Maps buffer ID and offset (sub-allocated buffers share IDs) to binding point
+        std::unordered_map<GLuint, std::map<std::pair<BufferTarget, GLuint>, GLuint>> m_blockBindings; // program -> (block interface, block index) -> binding point
+
+        size_t m_clock = 0;
+        Stats m_stats;
+
+        static inline bool s_alive = false;
     };
 }
-
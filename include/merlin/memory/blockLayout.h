@@ -0,0 +1,63 @@
+#pragma once
+#include "merlin/core/core.h"
+
+#include <string>
+#include <vector>
+
+namespace Merlin {
+
+    // One variable of a shader storage block
+    struct BlockMember {
+        std::string name;       //without the runtime array prefix ("particles[0].position" -> "position")
+        GLenum type = GL_FLOAT; //GL_FLOAT, GL_FLOAT_VEC3, GL_FLOAT_MAT4...
+        GLint offset = 0;       //relative to the start of the element for runtime arrays
+        GLint arraySize = 1;
+        GLint arrayStride = 0;
+        GLint matrixStride = 0;
+    };
+
+    // Memory layout of a shader storage block, either reflected from a linked program or computed
+    // from a GLSL struct declaration with the std430 rules. Used to check that C++ structs match what
+    // the shaders expect and to find a member order that wastes less memory in padding.
+    class BlockLayout {
+    public:
+        BlockLayout() = default;
+
+        static BlockLayout reflect(GLuint programID, const std::string& blockName);
+        static BlockLayout fromGLSL(const std::string& structSrc); //"struct Particle { vec3 position; float mass; ... };"
+
+        inline bool valid() const { return m_valid; }
+        inline const std::string& name() const { return m_name; }
+        inline GLint size() const { return m_size; }     //size of the fixed part of the block, or of the struct
+        inline GLint stride() const { return m_stride; } //size of one element of the runtime array, 0 if there is none
+        inline GLint elementSize() const { return m_stride > 0 ? m_stride : m_size; }
+        inline const std::vector<BlockMember>& members() const { return m_members; }
+
+        GLint dataSize() const; //bytes actually holding data in one element
+        GLint padding() const;  //bytes lost to alignment in one element
+
+        bool validate(size_t cppElementSize) const; //logs the layout and a better packing when sizes differ
+
+        BlockLayout packed() const; //same members reordered to minimize std430 padding
+        std::string toGLSL() const;
+        std::string toCpp() const;  //glm struct with explicit padding, matches the std430 layout byte for byte
+        void print() const;
+
+        static GLint typeSize(GLenum type);
+        static GLint typeAlignment(GLenum type); //std430 base alignment
+        static const char* typeToGLSL(GLenum type);
+        static const char* typeToCpp(GLenum type);
+        static GLenum typeFromGLSL(const std::string& type);
+
+    private:
+        static GLint memberSize(const BlockMember& member);
+        static GLint memberAlignment(const BlockMember& member);
+        void layoutStd430(); //recompute offsets and sizes from the member order
+
+        std::string m_name;
+        std::vector<BlockMember> m_members;
+        GLint m_size = 0;
+        GLint m_stride = 0;
+        bool m_valid = false;
+    };
+}
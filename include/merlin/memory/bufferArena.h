@@ -0,0 +1,60 @@
+#pragma once
+#include "merlin/core/core.h"
+#include "merlin/memory/bufferObject.h"
+
+#include <map>
+#include <vector>
+
+namespace Merlin {
+
+    // Sub-allocator handing out aligned ranges of a few large GL buffers.
+    // Each block keeps a first-fit free list (offset -> size) that is coalesced on release,
+    // empty blocks (except the first one) are given back to the driver.
+    class BufferArena {
+    public:
+        static constexpr GLsizeiptr DEFAULT_BLOCK_SIZE = 16 * 1024 * 1024; //16Mo
+
+        struct Stats {
+            size_t blocks = 0;        //number of GL buffers
+            size_t allocations = 0;   //live ranges
+            GLsizeiptr reserved = 0;  //bytes allocated on the GPU
+            GLsizeiptr used = 0;      //bytes handed out
+            GLsizeiptr largestFree = 0; //largest contiguous free range
+            size_t freeRanges = 0;    //number of holes, high count with low largestFree means fragmentation
+        };
+
+        BufferArena(BufferTarget target = BufferTarget::Shader_Storage_Buffer, GLsizeiptr blockSize = DEFAULT_BLOCK_SIZE);
+        ~BufferArena();
+
+        BufferRange allocate(GLsizeiptr size);
+        void release(const BufferRange& range);
+
+        inline BufferTarget target() const { return m_target; }
+        inline GLint alignment() const { return m_alignment; }
+        inline GLsizeiptr blockSize() const { return m_blockSize; }
+
+        Stats stats() const;
+        void printStats() const;
+
+        static Shared<BufferArena> create(BufferTarget target = BufferTarget::Shader_Storage_Buffer, GLsizeiptr blockSize = DEFAULT_BLOCK_SIZE);
+        static Shared<BufferArena> defaultArena(); //shared arena for small shader storage buffers
+
+    private:
+        struct Block {
+            Shared<ImmutableBufferObject<GLubyte>> buffer;
+            std::map<GLintptr, GLsizeiptr> freeRanges;
+            GLsizeiptr size = 0;
+            size_t allocations = 0;
+        };
+
+        Block& createBlock(GLsizeiptr size);
+        GLsizeiptr align(GLsizeiptr size) const;
+
+        BufferTarget m_target;
+        GLsizeiptr m_blockSize;
+        GLint m_alignment = 256;
+        std::vector<Block> m_blocks;
+    };
+
+    typedef Shared<BufferArena> BufferArena_Ptr;
+}
@@ -4,6 +4,8 @@
 
 
 #include <vector>
+#include <map>
+#include <cstring>
 #include <glm/glm.hpp>
 #include <glad/gl.h>
 
@@ -30,6 +32,10 @@ namespace Merlin {
         ClientStorage = GL_CLIENT_STORAGE_BIT
     };
 
+    inline BufferStorageFlags operator|(BufferStorageFlags a, BufferStorageFlags b) {
+        return static_cast<BufferStorageFlags>(static_cast<GLbitfield>(a) | static_cast<GLbitfield>(b));
+    }
+
     enum class BufferTarget : GLenum {
         Array_Buffer = GL_ARRAY_BUFFER,
         Atomic_Counter_Buffer = GL_ATOMIC_COUNTER_BUFFER,
@@ -47,12 +53,46 @@ namespace Merlin {
         Transform_Feedback_Buffer = GL_TRANSFORM_FEEDBACK_BUFFER
     };
 
+    template <typename T>
+    class Readback;
+    class BufferArena;
+
+    // Range of a GL buffer, used by sub-allocated buffers
+    struct BufferRange {
+        GLuint buffer = 0;
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+    };
+
+    // Commands read by glDispatchComputeIndirect (GL_DISPATCH_INDIRECT_BUFFER) and glDraw*Indirect (GL_DRAW_INDIRECT_BUFFER)
+    struct DispatchIndirectCommand {
+        GLuint x = 0, y = 1, z = 1;
+    };
+
+    struct DrawArraysIndirectCommand {
+        GLuint count = 0;
+        GLuint instanceCount = 1;
+        GLuint first = 0;
+        GLuint baseInstance = 0;
+    };
+
+    struct DrawElementsIndirectCommand {
+        GLuint count = 0;
+        GLuint instanceCount = 1;
+        GLuint firstIndex = 0;
+        GLint baseVertex = 0;
+        GLuint baseInstance = 0;
+    };
+
     // Base class for buffer objects
     class AbstractBufferObject : public GLObject<>{
     public:
         AbstractBufferObject(BufferTarget target);
+        AbstractBufferObject(BufferTarget target, Shared<BufferArena> arena); //storage is a range of one of the arena blocks
+        virtual ~AbstractBufferObject();
 
         void* map(GLenum access) const;
+        void* mapRange(GLintptr offset, GLsizeiptr length, GLbitfield access) const;
         void unmap() const;
 
         inline void bind() const { glBindBuffer(static_cast<GLenum>(m_target), id()); }
@@ -63,9 +103,13 @@ namespace Merlin {
         void allocateImmutableBuffer(GLsizeiptr size, const void* data, BufferStorageFlags flags);
 
         void writeBuffer(GLsizeiptr size, const void* data);
+        void writeBuffer(GLintptr offset, GLsizeiptr size, const void* data);
         void readBuffer(GLsizeiptr size, void* data) const;
+        void readBuffer(GLintptr offset, GLsizeiptr size, void* data) const;
 
-        void resizeBuffer(GLsizeiptr size);
+        void resizeBuffer(GLsizeiptr size); //keeps the content, grows the capacity geometrically
+        void reserveBuffer(GLsizeiptr capacity); //grows the storage to at least capacity bytes, keeps the content
+        void shrinkBuffer(); //reallocates the storage to the current size
         void clearBuffer() const;
 
         inline BufferUsage usage() const { return m_usage; }
@@ -77,12 +121,30 @@ namespace Merlin {
         void releaseBindingPoint();
 
         inline GLsizeiptr size() const { return m_size; }
+        inline GLsizeiptr capacity() const { return m_capacity; }
+        inline GLintptr offset() const { return m_offset; } //offset of the storage in the GL buffer, non zero for arena buffers
+        inline bool isSubAllocated() const { return m_arena != nullptr; }
         inline GLuint type() const { return m_type; }
         inline GLsizeiptr elements() const { return m_elements; }
 
         inline void setType(GLuint typeSize) { m_type = typeSize; }
         inline void setElements(GLsizeiptr elements) { m_elements = elements; }
 
+        //Streaming mode : writes go through the persistent-mapped StreamBuffer ring instead of glNamedBufferSubData
+        inline void setStreaming(bool state) { m_streaming = state; }
+        inline bool isStreaming() const { return m_streaming; }
+
+        //Host shadow copy : edits are made on the CPU copy, overlapping or touching dirty spans are merged and uploaded once by flush()
+        //The shadow is not updated by GPU writes (kernels, copies), call syncShadowCopy() after any of them or the next flush uploads stale data
+        void enableShadowCopy(bool state = true);
+        inline bool hasShadowCopy() const { return m_shadowEnabled; }
+        inline GLubyte* shadowData() { return m_shadowEnabled ? m_shadow.data() : nullptr; }
+        void syncShadowCopy(); //read the GPU content back into the shadow copy (after GPU side writes)
+        void markDirty(GLintptr offset, GLsizeiptr size);
+        inline bool isDirty() const { return !m_dirty.empty(); }
+        void flush();
+        static void flushAll(); //flush every buffer with pending edits, called once per frame
+
     protected:
         BufferUsage m_usage;
         BufferTarget m_target;
@@ -91,15 +153,32 @@ namespace Merlin {
 
         bool m_isMutable = true;
         bool m_isAllocated = false;
+        bool m_streaming = false;
 
     private:
         GLsizeiptr m_size = 0;      //buffer size in bytes
+        GLsizeiptr m_capacity = 0;  //allocated storage in bytes
         GLsizeiptr m_elements = 0;  //nb of element size in buffer
         GLuint m_type = 1;  //size of elements in bytes
 
+        Shared<BufferArena> m_arena = nullptr;
+        GLintptr m_offset = 0;
+
+        bool m_shadowEnabled = false;
+        std::vector<GLubyte> m_shadow;
+        std::map<GLintptr, GLintptr> m_dirty; //dirty spans [begin, end) in bytes, kept disjoint and merged
+
         void checkMutable() const;
+        void registerMemory();
+        void trackMemory() const;
+        void allocateRange(GLsizeiptr size);
+        void reallocate(GLsizeiptr capacity);
+        void streamBuffer(GLintptr offset, GLsizeiptr size, const void* data);
+        void uploadBuffer(GLintptr offset, GLsizeiptr size, const void* data);
+        void resizeShadow();
         GLuint create();
         static void destroy(GLuint id);
+        static void destroyRange(GLuint id) {} //ranges are given back to the arena by the destructor
     };
 
     typedef Shared<AbstractBufferObject> AbstractBufferObject_Ptr;
@@ -108,6 +187,7 @@ namespace Merlin {
     class BufferObject : public AbstractBufferObject {
     public:
         BufferObject(BufferTarget target);
+        BufferObject(BufferTarget target, Shared<BufferArena> arena);
 
         void allocate(GLsizeiptr size, BufferUsage usage);
         void allocate(GLsizeiptr size, T* data, BufferUsage usage);
@@ -115,10 +195,22 @@ namespace Merlin {
 
         void write(const std::vector<T>& data);
         void write(const T* data, GLsizeiptr size);
+        void writeRange(GLsizeiptr first, const T* data, GLsizeiptr count);
+        void writeRange(GLsizeiptr first, const std::vector<T>& data);
         void clear();
 
+        //shadow copy edits, uploaded on flush()
+        T* shadow();
+        void set(GLsizeiptr index, const T& value);
+
+        void reserve(GLsizeiptr count);
+        void resize(GLsizeiptr count);
+        inline GLsizeiptr capacityElements() const { return capacity() / sizeof(T); }
+
         void read(std::vector<T>& data) const;
         std::vector<T> read() const;
+        std::vector<T> read(GLsizeiptr first, GLsizeiptr count) const;
+        Shared<Readback<T>> readAsync(GLsizeiptr first = 0, GLsizeiptr count = -1) const;
     };
 
 
@@ -126,14 +218,26 @@ namespace Merlin {
     class ImmutableBufferObject : public AbstractBufferObject {
     public:
         ImmutableBufferObject(BufferTarget target);
+        ImmutableBufferObject(BufferTarget target, Shared<BufferArena> arena);
 
         void allocate(GLsizeiptr size, BufferStorageFlags flags);
         void allocate(GLsizeiptr size, T* data, BufferStorageFlags flags);
         void allocate(std::vector<T> data, BufferStorageFlags flags);
         void clear();
 
+        //in place updates, the storage must have been created with BufferStorageFlags::DynamicStorage
+        void write(const std::vector<T>& data);
+        void writeRange(GLsizeiptr first, const T* data, GLsizeiptr count);
+        void writeRange(GLsizeiptr first, const std::vector<T>& data);
+
+        void reserve(GLsizeiptr count);
+        void resize(GLsizeiptr count); //reallocates a new storage with the same flags when growing past the capacity
+        inline GLsizeiptr capacityElements() const { return capacity() / sizeof(T); }
+
         void read(std::vector<T>& data) const;
         std::vector<T> read() const;
+        std::vector<T> read(GLsizeiptr first, GLsizeiptr count) const;
+        Shared<Readback<T>> readAsync(GLsizeiptr first = 0, GLsizeiptr count = -1) const;
     };
 }
 
@@ -2,7 +2,8 @@
 
 namespace Merlin {
     // Base class for buffer objects
-    inline AbstractBufferObject::AbstractBufferObject(BufferTarget target) : GLObject(create(), destroy), m_target(target) {}
+    inline AbstractBufferObject::AbstractBufferObject(BufferTarget target) : GLObject(create(), destroy), m_target(target) { registerMemory(); }
+    inline AbstractBufferObject::AbstractBufferObject(BufferTarget target, Shared<BufferArena> arena) : GLObject(0, destroyRange), m_target(target), m_arena(arena) { registerMemory(); }
 
     inline GLuint AbstractBufferObject::create() {
         GLuint ID;
@@ -10,58 +11,102 @@ namespace Merlin {
         return ID;
     }
 
-    inline void AbstractBufferObject::destroy(GLuint ID) {
-        glDeleteBuffers(1, &ID);
-    }
-
     inline void* AbstractBufferObject::map(GLenum access) const {
+        if (m_arena) {
+            GLbitfield bits = access == GL_READ_ONLY ? GL_MAP_READ_BIT : access == GL_WRITE_ONLY ? GL_MAP_WRITE_BIT : GL_MAP_READ_BIT | GL_MAP_WRITE_BIT;
+            return mapRange(0, m_size, bits);
+        }
         return glMapNamedBuffer(id(), access);
     }
 
+    inline void* AbstractBufferObject::mapRange(GLintptr offset, GLsizeiptr length, GLbitfield access) const {
+        return glMapNamedBufferRange(id(), m_offset + offset, length, access);
+    }
+
     inline void AbstractBufferObject::unmap() const {
         glUnmapNamedBuffer(id());
     }
 
     inline void AbstractBufferObject::allocateBuffer(GLsizeiptr size, const void* data, BufferUsage usage) {
         m_isMutable = true;
-        m_size = size;
         m_usage = usage;
-        glNamedBufferData(id(), size, nullptr, static_cast<GLenum>(usage));
+        if (m_arena) allocateRange(size);
+        else glNamedBufferData(id(), size, nullptr, static_cast<GLenum>(usage));
+        m_size = m_capacity = size;
+        trackMemory();
+        resizeShadow();
         clearBuffer();
-        writeBuffer(size, data);
+        if (data) writeBuffer(size, data);
     }
 
     inline void AbstractBufferObject::allocateImmutableBuffer(GLsizeiptr size, const void* data, BufferStorageFlags flags) {
         m_isMutable = false;
-        m_size = size;
         m_flags = flags;
-        glNamedBufferStorage(id(), size, data, static_cast<GLbitfield>(flags));
+        if (m_arena) {
+            allocateRange(size);
+            if (data) glNamedBufferSubData(id(), m_offset, size, data);
+        }
+        else glNamedBufferStorage(id(), size, data, static_cast<GLbitfield>(flags));
+        m_size = m_capacity = size;
+        trackMemory();
+        resizeShadow();
+        if (m_shadowEnabled && data) memcpy(m_shadow.data(), data, size);
     }
 
     inline void AbstractBufferObject::resizeBuffer(GLsizeiptr size) {
-        checkMutable();
+        if (size > m_capacity) reserveBuffer(std::max(size, m_capacity * 2));
         m_size = size;
-        glNamedBufferData(id(), size, nullptr, static_cast<GLenum>(m_usage));
+        m_elements = size / m_type;
+        resizeShadow();
+    }
+
+    inline void AbstractBufferObject::reserveBuffer(GLsizeiptr capacity) {
+        if (capacity <= m_capacity) return;
+        reallocate(capacity);
+    }
+
+    inline void AbstractBufferObject::shrinkBuffer() {
+        if (m_size == m_capacity || m_size == 0) return;
+        reallocate(m_size);
     }
 
     inline void AbstractBufferObject::writeBuffer(GLsizeiptr size, const void* data) {
+        writeBuffer(0, size, data);
+    }
+
+    inline void AbstractBufferObject::writeBuffer(GLintptr offset, GLsizeiptr size, const void* data) {
+        if (m_shadowEnabled && data && offset + size <= GLsizeiptr(m_shadow.size())) memcpy(m_shadow.data() + offset, data, size);
+        uploadBuffer(offset, size, data);
+    }
+
+    inline void AbstractBufferObject::uploadBuffer(GLintptr offset, GLsizeiptr size, const void* data) {
+        if (m_streaming) {
+            streamBuffer(offset, size, data);
+            return;
+        }
         checkMutable();
-        glNamedBufferSubData(id(), 0, size, data);
+        glNamedBufferSubData(id(), m_offset + offset, size, data);
     }
 
     inline void AbstractBufferObject::readBuffer(GLsizeiptr size, void* data) const {
-        glGetNamedBufferSubData(id(), 0, size, data);
+        glGetNamedBufferSubData(id(), m_offset, size, data);
+    }
+
+    inline void AbstractBufferObject::readBuffer(GLintptr offset, GLsizeiptr size, void* data) const {
+        glGetNamedBufferSubData(id(), m_offset + offset, size, data);
     }
 
 
     inline void AbstractBufferObject::clearBuffer() const {
         checkMutable();
         GLubyte val = 0;
-        glClearNamedBufferData(id(), GL_R8UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &val);
+        if (m_arena) glClearNamedBufferSubData(id(), GL_R8UI, m_offset, m_size, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &val);
+        else glClearNamedBufferData(id(), GL_R8UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &val);
     }
 
     inline void AbstractBufferObject::checkMutable() const {
-        if (!m_isMutable) {
+        //immutable storage can still be updated in place when it was created with the dynamic storage bit
+        if (!m_isMutable && !(static_cast<GLbitfield>(m_flags) & GL_DYNAMIC_STORAGE_BIT)) {
             throw std::runtime_error("Cannot modify an immutable buffer");
         }
     }
@@ -73,6 +118,9 @@ namespace Merlin {
     template <typename T>
     inline BufferObject<T>::BufferObject(BufferTarget target) : AbstractBufferObject(target) {}
 
+    template <typename T>
+    inline BufferObject<T>::BufferObject(BufferTarget target, Shared<BufferArena> arena) : AbstractBufferObject(target, arena) {}
+
     template <typename T>
     inline void BufferObject<T>::allocate(GLsizeiptr size, BufferUsage usage) {
         allocateBuffer(size * sizeof(T), nullptr, usage);
@@ -104,11 +152,47 @@ namespace Merlin {
         writeBuffer(size * sizeof(T), data);
     }
 
+    template <typename T>
+    inline void BufferObject<T>::writeRange(GLsizeiptr first, const T* data, GLsizeiptr count) {
+        writeBuffer(first * sizeof(T), count * sizeof(T), data);
+    }
+
+    template <typename T>
+    inline void BufferObject<T>::writeRange(GLsizeiptr first, const std::vector<T>& data) {
+        writeBuffer(first * sizeof(T), data.size() * sizeof(T), data.data());
+    }
+
+    template <typename T>
+    inline T* BufferObject<T>::shadow() {
+        return reinterpret_cast<T*>(shadowData());
+    }
+
+    template <typename T>
+    inline void BufferObject<T>::set(GLsizeiptr index, const T& value) {
+        if (!hasShadowCopy()) {
+            writeRange(index, &value, 1);
+            return;
+        }
+        shadow()[index] = value;
+        markDirty(index * sizeof(T), sizeof(T));
+    }
+
     template <typename T>
     inline void BufferObject<T>::clear() {
         clearBuffer();
     }
 
+    template <typename T>
+    inline void BufferObject<T>::reserve(GLsizeiptr count) {
+        reserveBuffer(count * sizeof(T));
+    }
+
+    template <typename T>
+    inline void BufferObject<T>::resize(GLsizeiptr count) {
+        setType(sizeof(T));
+        resizeBuffer(count * sizeof(T));
+    }
+
     template <typename T>
     inline void BufferObject<T>::read(std::vector<T>& data) const {
         readBuffer(data.size() * sizeof(T), data.data());
@@ -116,30 +200,81 @@ namespace Merlin {
 
     template <typename T>
     inline std::vector<T> BufferObject<T>::read() const {
-        GLint bufferSize;
-        glGetNamedBufferParameteriv(id(), GL_BUFFER_SIZE, &bufferSize);
-        std::vector<T> data(bufferSize / sizeof(T));
-        readBuffer(bufferSize, data.data());
+        std::vector<T> data(size() / sizeof(T));
+        readBuffer(data.size() * sizeof(T), data.data());
+        return data;
+    }
+
+    template <typename T>
+    inline std::vector<T> BufferObject<T>::read(GLsizeiptr first, GLsizeiptr count) const {
+        GLsizeiptr available = size() / sizeof(T);
+        first = std::clamp(first, GLsizeiptr(0), available);
+        count = std::clamp(count, GLsizeiptr(0), available - first);
+        std::vector<T> data(count);
+        readBuffer(first * sizeof(T), count * sizeof(T), data.data());
         return data;
     }
 
+    template <typename T>
+    inline Shared<Readback<T>> BufferObject<T>::readAsync(GLsizeiptr first, GLsizeiptr count) const {
+        GLsizeiptr available = size() / sizeof(T);
+        first = std::clamp(first, GLsizeiptr(0), available);
+        if (count < 0 || first + count > available) count = available - first;
+        return createShared<Readback<T>>(id(), offset(), first, count);
+    }
+
     // Templated class for immutable buffer objects
     template <typename T>
     inline ImmutableBufferObject<T>::ImmutableBufferObject(BufferTarget target) : AbstractBufferObject(target) {}
 
+    template <typename T>
+    inline ImmutableBufferObject<T>::ImmutableBufferObject(BufferTarget target, Shared<BufferArena> arena) : AbstractBufferObject(target, arena) {}
+
     template <typename T>
     inline void ImmutableBufferObject<T>::allocate(GLsizeiptr size, BufferStorageFlags flags) {
         allocateImmutableBuffer(size * sizeof(T), nullptr, flags);
+        setElements(size);
+        setType(sizeof(T));
     }
 
     template <typename T>
     inline void ImmutableBufferObject<T>::allocate(GLsizeiptr size, T* data, BufferStorageFlags flags) {
         allocateImmutableBuffer(size * sizeof(T), data, flags);
+        setElements(size);
+        setType(sizeof(T));
     }
 
     template <typename T>
     inline void ImmutableBufferObject<T>::allocate(std::vector<T> data, BufferStorageFlags flags) {
         allocateImmutableBuffer(data.size() * sizeof(T), data.data(), flags);
+        setElements(data.size());
+        setType(sizeof(T));
+    }
+
+    template <typename T>
+    inline void ImmutableBufferObject<T>::write(const std::vector<T>& data) {
+        writeBuffer(data.size() * sizeof(T), data.data());
+    }
+
+    template <typename T>
+    inline void ImmutableBufferObject<T>::writeRange(GLsizeiptr first, const T* data, GLsizeiptr count) {
+        writeBuffer(first * sizeof(T), count * sizeof(T), data);
+    }
+
+    template <typename T>
+    inline void ImmutableBufferObject<T>::writeRange(GLsizeiptr first, const std::vector<T>& data) {
+        writeBuffer(first * sizeof(T), data.size() * sizeof(T), data.data());
+    }
+
+    template <typename T>
+    inline void ImmutableBufferObject<T>::reserve(GLsizeiptr count) {
+        reserveBuffer(count * sizeof(T));
+    }
+
+    template <typename T>
+    inline void ImmutableBufferObject<T>::resize(GLsizeiptr count) {
+        setType(sizeof(T));
+        resizeBuffer(count * sizeof(T));
     }
 
     template <typename T>
@@ -154,10 +289,28 @@ namespace Merlin {
 
     template <typename T>
     inline std::vector<T> ImmutableBufferObject<T>::read() const {
-        GLint bufferSize;
-        glGetNamedBufferParameteriv(id(), GL_BUFFER_SIZE, &bufferSize);
-        std::vector<T> data(bufferSize / sizeof(T));
-        readBuffer(bufferSize, data.data());
+        std::vector<T> data(size() / sizeof(T));
+        readBuffer(data.size() * sizeof(T), data.data());
+        return data;
+    }
+
+    template <typename T>
+    inline std::vector<T> ImmutableBufferObject<T>::read(GLsizeiptr first, GLsizeiptr count) const {
+        GLsizeiptr available = size() / sizeof(T);
+        first = std::clamp(first, GLsizeiptr(0), available);
+        count = std::clamp(count, GLsizeiptr(0), available - first);
+        std::vector<T> data(count);
+        readBuffer(first * sizeof(T), count * sizeof(T), data.data());
         return data;
     }
-}
\ No newline at end of file
+
+    template <typename T>
+    inline Shared<Readback<T>> ImmutableBufferObject<T>::readAsync(GLsizeiptr first, GLsizeiptr count) const {
+        GLsizeiptr available = size() / sizeof(T);
+        first = std::clamp(first, GLsizeiptr(0), available);
+        if (count < 0 || first + count > available) count = available - first;
+        return createShared<Readback<T>>(id(), offset(), first, count);
+    }
+}
+
+#include "readback.h"
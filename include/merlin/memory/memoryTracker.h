@@ -0,0 +1,99 @@
+#pragma once
+#include "merlin/core/core.h"
+
+#include <functional>
+#include <source_location>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Merlin {
+
+    enum class MemoryCategory {
+        BUFFER,
+        BUFFER_RANGE, //sub-allocated from an arena, already counted in the arena block
+        TEXTURE,
+        RENDERBUFFER,
+        FRAMEBUFFER
+    };
+
+    struct MemoryRecord {
+        MemoryCategory category;
+        std::function<std::string()> name; //resolved on report, objects are often renamed after allocation
+        GLuint id = 0;
+        size_t bytes = 0;
+        std::string usage;
+        std::string site;  //MERLIN_MEMORY_SCOPE label active at creation
+        size_t frame = 0;  //frame of creation
+    };
+
+    struct MemoryFrameStats {
+        size_t allocated = 0; //bytes allocated during the frame
+        size_t freed = 0;     //bytes freed during the frame
+        size_t allocations = 0;
+        size_t releases = 0;
+    };
+
+    // Registry of every live GPU allocation made through the engine objects.
+    class MemoryTracker {
+        SINGLETON(MemoryTracker)
+        MemoryTracker() { s_alive = true; }
+
+    public:
+        ~MemoryTracker();
+
+        void track(const void* owner, MemoryCategory category, GLuint id, std::function<std::string()> name);
+        void update(const void* owner, GLuint id, size_t bytes, const std::string& usage = "");
+        void untrack(const void* owner);
+
+        void newFrame();
+
+        size_t totalBytes() const { return m_total; }
+        size_t highWaterMark() const { return m_highWater; }
+        size_t liveObjects() const { return m_records.size(); }
+        const MemoryFrameStats& lastFrame() const { return m_lastFrame; }
+
+        void onImGuiRender(bool* open = nullptr);
+        bool exportCSV(const std::string& path) const;
+        bool exportJSON(const std::string& path) const;
+        void reportLeaks() const;
+
+        void pushScope(const std::string& label);
+        void popScope();
+
+        static size_t bytesPerTexel(GLenum internalFormat);
+        static const char* categoryToString(MemoryCategory category);
+
+        //safe to call from destructors running after the tracker was destroyed (static resources)
+        static void onRelease(const void* owner);
+
+    private:
+        std::vector<std::pair<const void*, const MemoryRecord*>> sortedRecords() const;
+        std::string currentSite() const;
+
+        std::unordered_map<const void*, MemoryRecord> m_records;
+        std::vector<std::string> m_scopes;
+
+        size_t m_total = 0;
+        size_t m_highWater = 0;
+        size_t m_frame = 0;
+
+        MemoryFrameStats m_currentFrame;
+        MemoryFrameStats m_lastFrame;
+        std::vector<float> m_history; //total MB per frame
+        std::vector<float> m_churnHistory; //allocated + freed MB per frame
+
+        static inline bool s_alive = false;
+    };
+
+    // Labels every allocation made in the enclosing scope
+    class MemoryScope {
+    public:
+        MemoryScope(const std::string& label, std::source_location location = std::source_location::current());
+        ~MemoryScope();
+    };
+}
+
+#define MERLIN_MEMORY_CONCAT_(a, b) a##b
+#define MERLIN_MEMORY_CONCAT(a, b) MERLIN_MEMORY_CONCAT_(a, b)
+#define MERLIN_MEMORY_SCOPE(label) ::Merlin::MemoryScope MERLIN_MEMORY_CONCAT(memoryScope_, __LINE__)(label)
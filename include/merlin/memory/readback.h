@@ -0,0 +1,71 @@
+#pragma once
+#include "merlin/core/core.h"
+#include "merlin/memory/bufferObject.h"
+
+#include <vector>
+
+namespace Merlin {
+
+    // Non-blocking GPU -> CPU transfer. The requested range is copied into a private staging buffer
+    // and fenced, the CPU side can then poll ready() and fetch the data once the copy is done.
+    class AbstractReadback {
+    public:
+        AbstractReadback(GLuint source, GLintptr offset, GLsizeiptr size);
+        virtual ~AbstractReadback();
+
+        bool ready();
+        void wait();
+
+        inline GLintptr offset() const { return m_offset; }
+        inline GLsizeiptr size() const { return m_size; }
+
+    protected:
+        void fetch(void* data);
+
+    private:
+        ImmutableBufferObject<GLubyte> m_staging;
+        GLsync m_fence = nullptr;
+        GLintptr m_offset = 0;
+        GLsizeiptr m_size = 0;
+        bool m_ready = false;
+        bool m_flushed = false;
+    };
+
+    template <typename T>
+    class Readback : public AbstractReadback {
+    public:
+        Readback(GLuint source, GLintptr base, GLsizeiptr first, GLsizeiptr count);
+
+        inline GLsizeiptr first() const { return m_first; }
+        inline GLsizeiptr count() const { return size() / sizeof(T); }
+
+        bool tryGet(std::vector<T>& data); //returns false without blocking if the copy is not finished yet
+        std::vector<T> get(); //blocks until the copy is finished
+
+    private:
+        GLsizeiptr m_first;
+    };
+
+    template <typename T>
+    using Readback_Ptr = Shared<Readback<T>>;
+
+
+    template <typename T>
+    inline Readback<T>::Readback(GLuint source, GLintptr base, GLsizeiptr first, GLsizeiptr count) : AbstractReadback(source, base + first * sizeof(T), count * sizeof(T)), m_first(first) {}
+
+    template <typename T>
+    inline bool Readback<T>::tryGet(std::vector<T>& data) {
+        if (!ready()) return false;
+        data.resize(count());
+        fetch(data.data());
+        return true;
+    }
+
+    template <typename T>
+    inline std::vector<T> Readback<T>::get() {
+        wait();
+        std::vector<T> data(count());
+        fetch(data.data());
+        return data;
+    }
+}
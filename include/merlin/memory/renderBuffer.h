@@ -22,6 +22,8 @@ namespace Merlin {
         GLuint _samples;
         GLenum _format;
 
+        void trackMemory(GLsizei width, GLsizei height) const;
+
     };
     typedef RenderBuffer RBO;
 }
@@ -7,6 +7,7 @@
 #include "merlin/core/core.h"
 #include "merlin/shaders/shaderBase.h"
 #include "merlin/memory/bufferObject.h"
+#include "merlin/memory/bufferArena.h"
 
 namespace Merlin {
 
@@ -19,6 +20,8 @@ namespace Merlin {
         ShaderStorageBuffer(const std::string& name, GLsizeiptr size, T* data, BufferUsage usage = BufferUsage::StaticDraw);
         ShaderStorageBuffer(const std::string& name, GLsizeiptr count, BufferUsage usage = BufferUsage::StaticDraw);
         ShaderStorageBuffer(const std::string& name, std::vector<T>data, BufferUsage usage = BufferUsage::StaticDraw);
+        ShaderStorageBuffer(const std::string& name, GLsizeiptr count, BufferArena_Ptr arena, BufferUsage usage = BufferUsage::StaticDraw);
+        ShaderStorageBuffer(const std::string& name, std::vector<T>data, BufferArena_Ptr arena, BufferUsage usage = BufferUsage::StaticDraw);
 
         virtual ~ShaderStorageBuffer();
 
@@ -30,6 +33,8 @@ namespace Merlin {
         static std::shared_ptr<ShaderStorageBuffer<T>> create(const std::string& name, GLsizeiptr count, BufferUsage usage = BufferUsage::StaticDraw);
         static std::shared_ptr<ShaderStorageBuffer<T>> create(const std::string& name, GLsizeiptr count, T* data, BufferUsage usage = BufferUsage::StaticDraw);
         static std::shared_ptr<ShaderStorageBuffer<T>> create(const std::string& name, std::vector<T>data, BufferUsage usage = BufferUsage::StaticDraw);
+        static std::shared_ptr<ShaderStorageBuffer<T>> create(const std::string& name, GLsizeiptr count, BufferArena_Ptr arena, BufferUsage usage = BufferUsage::StaticDraw);
+        static std::shared_ptr<ShaderStorageBuffer<T>> create(const std::string& name, std::vector<T>data, BufferArena_Ptr arena, BufferUsage usage = BufferUsage::StaticDraw);
     };
 
     template<class T>
@@ -65,6 +70,20 @@ namespace Merlin {
         this->rename(name);
     }
 
+    template <class T>
+    inline ShaderStorageBuffer<T>::ShaderStorageBuffer(const std::string& name, GLsizeiptr count, BufferArena_Ptr arena, BufferUsage usage)
+        : BufferObject<T>(BufferTarget::Shader_Storage_Buffer, arena) {
+        this->allocate(count, usage);
+        this->rename(name);
+    }
+
+    template <class T>
+    inline ShaderStorageBuffer<T>::ShaderStorageBuffer(const std::string& name, std::vector<T> data, BufferArena_Ptr arena, BufferUsage usage)
+        : BufferObject<T>(BufferTarget::Shader_Storage_Buffer, arena) {
+        this->allocate(data, usage);
+        this->rename(name);
+    }
+
     template <class T>
     inline ShaderStorageBuffer<T>::~ShaderStorageBuffer() {}
 
@@ -96,18 +115,29 @@ namespace Merlin {
         return std::make_shared<ShaderStorageBuffer>(name, data, usage);
     }
 
+    template <class T>
+    inline std::shared_ptr<ShaderStorageBuffer<T>> ShaderStorageBuffer<T>::create(const std::string& name, GLsizeiptr count, BufferArena_Ptr arena, BufferUsage usage) {
+        return std::make_shared<ShaderStorageBuffer>(name, count, arena, usage);
+    }
+
+    template <class T>
+    inline std::shared_ptr<ShaderStorageBuffer<T>> ShaderStorageBuffer<T>::create(const std::string& name, std::vector<T> data, BufferArena_Ptr arena, BufferUsage usage) {
+        return std::make_shared<ShaderStorageBuffer>(name, data, arena, usage);
+    }
+
     template<typename T>
     void ShaderStorageBuffer<T>::print() const{
-        //bind();
-        std::vector<T> cpuBuffer = ShaderStorageBuffer<T>::read();
+        //only fetch what is displayed, reading the whole buffer forces a full sync on large buffers
+        const GLsizeiptr count = ShaderStorageBuffer<T>::size() / sizeof(T);
+        std::vector<T> cpuBuffer = ShaderStorageBuffer<T>::read(0, std::min(count, GLsizeiptr(100)));
 
-        Console::info("Buffer") << ShaderStorageBuffer<T>::name() << " = (" << cpuBuffer.size() << ")[";
-        for (GLuint i = 0; i < std::min(int(cpuBuffer.size()), 100); ++i) {
+        Console::info("Buffer") << ShaderStorageBuffer<T>::name() << " = (" << size_t(count) << ")[";
+        for (GLuint i = 0; i < cpuBuffer.size(); ++i) {
             Console::print() << cpuBuffer[i] << ", ";
         }
-        if (cpuBuffer.size() > 100) {
+        if (count > 100) {
             Console::print() << "..., ";
-            Console::print() << cpuBuffer[cpuBuffer.size() - 1];
+            Console::print() << ShaderStorageBuffer<T>::read(count - 1, 1)[0];
         }
         else if (cpuBuffer.empty()) Console::print() << "empty";
         Console::print() << "]" << Console::endl << Console::endl;
@@ -0,0 +1,57 @@
+#pragma once
+#include "merlin/core/core.h"
+#include "merlin/memory/bufferObject.h"
+
+#include <array>
+
+namespace Merlin {
+
+    // Persistent-mapped staging ring used by streaming buffers.
+    // Uploads are memcpy'd into the mapped ring then copied on the GPU into the destination buffer,
+    // so the CPU never waits on the driver unless the GPU is still reading the segment we want to reuse.
+    class StreamBuffer {
+        SINGLETON(StreamBuffer)
+        StreamBuffer() = default;
+
+    public:
+        static constexpr int SEGMENTS = 3; //triple buffered
+        static constexpr GLsizeiptr DEFAULT_SEGMENT_SIZE = 4 * 1024 * 1024; //4Mo per segment
+
+        struct Stats {
+            size_t writes = 0;  //number of uploads
+            size_t bytes = 0;   //bytes uploaded
+            size_t wraps = 0;   //number of segment switches
+            size_t stalls = 0;  //segment switches where the GPU was still using the segment
+            size_t resizes = 0; //number of ring reallocations
+        };
+
+        ~StreamBuffer();
+
+        void reserve(GLsizeiptr segmentSize);
+        void upload(GLuint destination, GLintptr offset, GLsizeiptr size, const void* data);
+        void endFrame();
+        void shutdown(); //waits for the pending copies and deletes the ring, call while the context is alive
+
+        inline const Stats& stats() const { return m_stats; }
+        inline void resetStats() { m_stats = Stats(); }
+        void printStats() const;
+
+        inline GLsizeiptr segmentSize() const { return m_segmentSize; }
+
+    private:
+        void fence();
+        void nextSegment();
+        void release();
+
+        Shared<ImmutableBufferObject<GLubyte>> m_ring = nullptr;
+        GLubyte* m_ptr = nullptr;
+
+        GLsizeiptr m_segmentSize = 0;
+        GLsizeiptr m_head = 0;  //write offset in current segment
+        int m_segment = 0;      //current segment
+        std::array<GLsync, SEGMENTS> m_fences = { nullptr, nullptr, nullptr };
+
+        Stats m_stats;
+        bool m_shutdown = false; //the ring was released with the context alive, the destructor leaves GL alone
+    };
+}
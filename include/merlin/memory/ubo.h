@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "merlin/core/core.h"
+#include "merlin/memory/bufferObject.h"
+
+namespace Merlin {
+
+    // Uniform Buffer Object holding a std140 block, T must match the block layout (padding included)
+    template<class T>
+    class UniformBuffer : public BufferObject<T> {
+    public:
+        UniformBuffer();
+        UniformBuffer(const std::string& name, GLsizeiptr count = 1, BufferUsage usage = BufferUsage::DynamicDraw);
+
+        virtual ~UniformBuffer();
+
+        using BufferObject<T>::write;
+        inline void write(const T& value) { this->writeBuffer(sizeof(T), &value); } //whole block
+
+        static std::shared_ptr<UniformBuffer<T>> create(const std::string& name, GLsizeiptr count = 1, BufferUsage usage = BufferUsage::DynamicDraw);
+    };
+
+    template<class T>
+    using UBO = UniformBuffer<T>; // Shorter alias
+    template<class T>
+    using UBO_Ptr = std::shared_ptr<UniformBuffer<T>>; // Shorter alias
+
+    // Implementation
+    template <class T>
+    inline UniformBuffer<T>::UniformBuffer() : BufferObject<T>(BufferTarget::Uniform_Buffer) {}
+
+    template <class T>
+    inline UniformBuffer<T>::UniformBuffer(const std::string& name, GLsizeiptr count, BufferUsage usage)
+        : BufferObject<T>(BufferTarget::Uniform_Buffer) {
+        this->allocate(count, usage);
+        this->rename(name);
+    }
+
+    template <class T>
+    inline UniformBuffer<T>::~UniformBuffer() {}
+
+    template <class T>
+    inline std::shared_ptr<UniformBuffer<T>> UniformBuffer<T>::create(const std::string& name, GLsizeiptr count, BufferUsage usage) {
+        return std::make_shared<UniformBuffer>(name, count, usage);
+    }
+
+} // namespace Merlin
@@ -48,10 +48,11 @@ namespace Merlin {
 
         for (unsigned int i = 0; i < elements.size(); i++) {
             const auto& element = elements[i];
-            glEnableVertexArrayAttrib(id(), i);
-            glVertexArrayAttribFormat(id(), i, element.count, element.type, element.normalized, offset);
-            glVertexArrayAttribBinding(id(), i, vb.bindingPoint());
-            offset += element.count * VertexBufferElement::getTypeSize(element.type);
+            GLuint location = element.location >= 0 ? element.location : i;
+            glEnableVertexArrayAttrib(id(), location);
+            glVertexArrayAttribFormat(id(), location, element.count, element.type, element.normalized, offset);
+            glVertexArrayAttribBinding(id(), location, vb.bindingPoint());
+            offset += element.size();
         }
 
         bindBuffer<T>(vb, layout);
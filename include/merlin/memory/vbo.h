@@ -37,7 +37,7 @@ namespace Merlin {
 
     template<class T>
     inline VertexBuffer<T>::VertexBuffer(const std::string& name, const std::vector<T>& vertices) : ImmutableBufferObject<T>(BufferTarget::Array_Buffer) {
-        this->allocate(vertices.size(), vertices, BufferStorageFlags::DynamicStorage);
+        this->allocate(vertices, BufferStorageFlags::DynamicStorage);
         this->rename(name);
         Console::trace("VertexBuffer") << "VertexBuffer " << name << " " << this->id() << " allocated. " << Console::endl;
     }
@@ -9,12 +9,26 @@ namespace Merlin {
         unsigned int type;
         unsigned int count;
         unsigned char normalized;
+        int location = -1; //explicit attribute location, -1 uses the element index
+
+        // Bytes taken by the element in the vertex, packed types hold all their components in one word
+        inline unsigned int size() const {
+            if (type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV) return 4;
+            return count * getTypeSize(type);
+        }
 
         static unsigned int getTypeSize(unsigned int type) {
             switch (type) {
             case GL_FLOAT:          return 4;
             case GL_UNSIGNED_INT:   return 4;
+            case GL_INT:            return 4;
+            case GL_HALF_FLOAT:     return 2;
+            case GL_SHORT:          return 2;
+            case GL_UNSIGNED_SHORT: return 2;
+            case GL_BYTE:           return 1;
             case GL_UNSIGNED_BYTE:  return 1;
+            case GL_INT_2_10_10_10_REV:             return 4;
+            case GL_UNSIGNED_INT_2_10_10_10_REV:    return 4;
             }
             return 0;
         }
@@ -44,7 +58,14 @@ namespace Merlin {
         template<>
         void push<unsigned char>(unsigned int count) {
             m_Elements.push_back({ GL_UNSIGNED_BYTE, count, GL_TRUE });
-            m_Stride += VertexBufferElement::getTypeSize(GL_BYTE) * count;
+            m_Stride += VertexBufferElement::getTypeSize(GL_UNSIGNED_BYTE) * count;
+        }
+
+        // Attribute bound to a fixed shader location, used by the compact vertex formats that skip some attributes
+        void pushAttribute(int location, unsigned int type, unsigned int count, bool normalized = false) {
+            VertexBufferElement element{ type, count, normalized ? (unsigned char)GL_TRUE : (unsigned char)GL_FALSE, location };
+            m_Elements.push_back(element);
+            m_Stride += element.size();
         }
 
         inline const std::vector<VertexBufferElement>& getElements() const { return m_Elements; }
@@ -77,6 +98,46 @@ namespace Merlin {
 	};
     typedef std::vector<Vertex> Vertices;
 
+	// GPU storage of the mesh vertices. The CPU side always keeps full Vertex data, only the uploaded buffer is compacted.
+	// Attribute locations stay the same as Vertex (0 position, 1 normal, 2 color, 3 uv, 4 tangent, 5 bitangent),
+	// shaders supporting the compact formats read the vertex_format uniform to decode them.
+	enum class VertexFormat {
+		FULL,				//68 bytes, every attribute in fp32
+		POSITION,			//12 bytes, position only
+		POSITION_NORMAL,	//16 bytes, position + octahedral normal (snorm16x2)
+		COMPACT,			//24 bytes, position + octahedral normal + half float uv + snorm 10:10:10:2 tangent (bitangent sign in w)
+		AUTO				//pick the smallest format that keeps the mesh data, see Mesh::chooseVertexFormat
+	};
+
+	struct VertexP {
+		glm::vec3 position;
+	};
+
+	struct VertexPN {
+		glm::vec3 position;
+		GLuint normal;		//octahedral encoding, packSnorm2x16
+	};
+
+	struct VertexCompact {
+		glm::vec3 position;
+		GLuint normal;		//octahedral encoding, packSnorm2x16
+		GLuint texCoord;	//packHalf2x16
+		GLuint tangent;		//packSnorm3x10_1x2, w is the bitangent sign
+	};
+
+	VertexBufferLayout getVertexLayout(VertexFormat format);
+	GLuint vertexSize(VertexFormat format);
+	const char* vertexFormatToString(VertexFormat format);
+
+	// Pack the vertices in the given format (AUTO is not valid here), returns the raw vertex buffer content
+	std::vector<GLubyte> packVertices(const Vertex* vertices, size_t count, VertexFormat format);
+	inline std::vector<GLubyte> packVertices(const std::vector<Vertex>& vertices, VertexFormat format) {
+		return packVertices(vertices.data(), vertices.size(), format);
+	}
+
+	GLuint octEncode(const glm::vec3& normal);
+	glm::vec3 octDecode(GLuint encoded);
+
 
 	inline VertexBufferLayout Vertex::getLayout() {
 		VertexBufferLayout layout;
@@ -0,0 +1,135 @@
+#pragma once
+#include "merlin/core/core.h"
+#include "merlin/memory/readback.h"
+#include "merlin/physics/fieldPrecision.h"
+#include "merlin/utils/mappedFile.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Merlin {
+
+	// Checkpoint file layout (native endianness) :
+	// [CheckpointHeader][CheckpointEntry x entryCount][names] then every blob aligned on CHECKPOINT_ALIGNMENT.
+	// Blobs are the raw GPU storage of the buffers, a restart maps the file and uploads them as they are.
+	// Link entries are named after the shader, their blob lists the linked names, each one null terminated.
+	static constexpr char CHECKPOINT_MAGIC[8] = { 'M', 'R', 'L', 'N', 'C', 'K', 'P', 'T' };
+	static constexpr uint32_t CHECKPOINT_VERSION = 1;
+	static constexpr uint64_t CHECKPOINT_ALIGNMENT = 4096;
+	static constexpr uint32_t CHECKPOINT_NOT_QUANTIZED = 0xFFFFFFFFu;
+
+	enum class CheckpointEntryKind : uint32_t {
+		FIELD,
+		BUFFER,
+		LINK
+	};
+
+	struct CheckpointHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t entryCount;
+		uint64_t instancesCount;
+		uint64_t activeInstancesCount;
+		uint64_t fileSize;
+		uint64_t namesOffset;
+		uint64_t namesSize;
+	};
+
+	struct CheckpointEntry {
+		CheckpointEntryKind kind;
+		uint32_t typeSize;		//element size in bytes
+		uint64_t offset;		//blob position in the file
+		uint64_t size;			//blob size in bytes
+		uint32_t nameOffset;	//in the names table
+		uint32_t nameLength;
+		uint32_t precision;		//FieldPrecision of quantized fields, CHECKPOINT_NOT_QUANTIZED otherwise
+		uint32_t components;
+	};
+
+	static_assert(sizeof(CheckpointHeader) == 56 && sizeof(CheckpointEntry) == 40, "checkpoint records must not contain padding");
+
+	// Snapshot being saved : the buffers are copied on the GPU when they are added, the host only waits for the fences.
+	class Checkpoint {
+	public:
+		Checkpoint(const std::string& path, size_t instancesCount, size_t activeInstancesCount);
+
+		void addBuffer(CheckpointEntryKind kind, const AbstractBufferObject& buffer, const FieldFormat* format = nullptr);
+		void addLink(const std::string& shader, const std::set<std::string>& entries);
+
+		bool ready(); //every copy has landed in the staging buffers, does not block
+		void fetch(); //moves the staging content to host memory, GL thread only, blocks until ready
+		bool write(); //lays out and writes the file, safe on any thread once fetched
+
+		inline const std::string& path() const { return m_path; }
+		inline size_t bytes() const { return m_bytes; }
+		inline bool isFetched() const { return m_fetched; }
+
+	private:
+		void addEntry(CheckpointEntryKind kind, const std::string& name, uint32_t typeSize, uint64_t size, const FieldFormat* format);
+
+		std::string m_path;
+		CheckpointHeader m_header;
+		std::vector<CheckpointEntry> m_entries;
+		std::string m_names;
+		std::vector<Shared<Readback<GLubyte>>> m_readbacks; //one per entry, null for the link entries
+		std::vector<std::vector<GLubyte>> m_blobs;
+		size_t m_bytes = 0;
+		bool m_fetched = false;
+	};
+
+	typedef Shared<Checkpoint> Checkpoint_Ptr;
+
+	// Read only view of a checkpoint file, the entries and blobs point straight into the mapping
+	class CheckpointFile {
+	public:
+		bool open(const std::string& path); //maps the file and validates the header and the entry table
+
+		inline const CheckpointHeader& header() const { return *reinterpret_cast<const CheckpointHeader*>(m_file.data()); }
+		inline uint32_t entryCount() const { return header().entryCount; }
+		inline const CheckpointEntry& entry(uint32_t index) const { return reinterpret_cast<const CheckpointEntry*>(m_file.data() + sizeof(CheckpointHeader))[index]; }
+		std::string name(const CheckpointEntry& entry) const;
+		inline const void* data(const CheckpointEntry& entry) const { return m_file.data() + entry.offset; }
+		std::set<std::string> links(const CheckpointEntry& entry) const;
+
+	private:
+		MappedFile m_file;
+	};
+
+	// Keeps the pending snapshots alive, polled once per frame by the application.
+	// Snapshots are fetched on the GL thread once their copies are done and written to disk by a background thread,
+	// the file is written next to its destination and renamed when complete so an interrupted save never leaves a truncated checkpoint.
+	class CheckpointWriter {
+		SINGLETON(CheckpointWriter)
+		CheckpointWriter() = default;
+
+	public:
+		~CheckpointWriter();
+
+		void submit(Checkpoint_Ptr checkpoint);
+		void poll(); //fetches the finished snapshots and reports the written files
+		void wait(); //blocks until every pending snapshot is on disk
+
+		inline size_t pending() const { return m_pending.size() + m_queued; }
+
+	private:
+		void run();
+		void report();
+
+		std::vector<Checkpoint_Ptr> m_pending; //waiting for the GPU copies
+		size_t m_queued = 0; //handed to the writer thread, not reported yet
+
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::condition_variable m_written;
+		std::deque<Checkpoint_Ptr> m_queue;
+		std::vector<std::pair<Checkpoint_Ptr, bool>> m_done;
+		bool m_stop = false;
+	};
+}
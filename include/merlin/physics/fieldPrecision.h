@@ -0,0 +1,54 @@
+#pragma once
+#include "merlin/core/core.h"
+
+#include <string>
+#include <vector>
+
+namespace Merlin {
+
+	// Storage precision of a particle field. The value seen by shaders and by the CPU is always float based
+	// (float, vec2, vec3 or vec4), only the GPU storage is quantized.
+	enum class FieldPrecision {
+		FP32,				//full precision, vec3 padded to vec4
+		FP16,				//half floats, 2 bytes per component
+		SNORM16,			//[-1, 1] on 16 bits per component
+		UNORM8,				//[0, 1] on 8 bits per component, one uint per element
+		UNORM10_10_10_2		//[0, 1] xyz on 10 bits, w on 2 bits, one uint per element (vec3 and vec4 only)
+	};
+
+	// Layout of a quantized field : storage size, GLSL accessors and matching CPU packing
+	class FieldFormat {
+	public:
+		FieldFormat(FieldPrecision precision = FieldPrecision::FP32, GLuint components = 4);
+
+		inline FieldPrecision precision() const { return m_precision; }
+		inline GLuint components() const { return m_components; }
+
+		GLuint storageSize() const; //bytes per element on the GPU
+		const char* storageType() const; //GLSL type of one stored element
+		const char* valueType() const; //GLSL type seen by the shaders
+
+		// Storage block named after the field and the load_<name>(uint i) / store_<name>(uint i, value) accessors
+		std::string accessors(const std::string& name) const;
+
+		void pack(const float* values, void* storage, size_t count) const;
+		void unpack(const void* storage, float* values, size_t count) const;
+
+		static const char* toString(FieldPrecision precision);
+
+	private:
+		FieldPrecision m_precision;
+		GLuint m_components;
+	};
+
+	struct FieldBenchmarkResult {
+		FieldPrecision precision;
+		GLuint bytesPerElement = 0;
+		double milliseconds = 0;	//GPU time of one load/modify/store pass
+		double bandwidth = 0;		//effective GB/s (read + write)
+		float maxError = 0;			//worst round trip error on values in [0, 1]
+	};
+
+	// Times a bandwidth bound load/modify/store kernel over count elements for every precision and logs the trade-off
+	std::vector<FieldBenchmarkResult> benchmarkFieldPrecision(size_t count = 1 << 22, GLuint components = 3, GLuint iterations = 20);
+}
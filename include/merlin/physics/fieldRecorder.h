@@ -0,0 +1,152 @@
+#pragma once
+#include "merlin/core/core.h"
+#include "merlin/memory/readback.h"
+#include "merlin/physics/particleSystem.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Merlin {
+
+	// Recording file layout (native endianness) :
+	// [RecordingHeader][name length, name, quantization step] x fieldCount
+	// then one chunk per recorded step : [RecordingFrame][RecordingColumn, encoded words] x columns
+	// and a trailer : [frame offsets][RecordingFooter].
+	// Columns are 32 bits words : temporal delta (xor, or zigzag difference of the quantized values), byte shuffled, then run length encoded.
+	// Every keyframe interval the delta restarts from zero so a frame only depends on the frames of its chunk.
+	static constexpr char RECORDING_MAGIC[8] = { 'M', 'R', 'L', 'N', 'R', 'E', 'C', 'D' };
+	static constexpr uint32_t RECORDING_VERSION = 1;
+
+	enum RecordingColumnFlags : uint32_t {
+		RECORDING_KEYFRAME = 1,		//not a delta
+		RECORDING_QUANTIZED = 2		//float values rounded to a multiple of the field quantization step
+	};
+
+	struct RecordingHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t fieldCount;
+		uint32_t cadence;
+		uint32_t keyframeInterval;
+	};
+
+	struct RecordingFrame {
+		uint64_t step;
+		uint32_t frame;
+		uint32_t columns;
+	};
+
+	struct RecordingColumn {
+		uint32_t field;
+		uint32_t flags;
+		uint64_t words;
+		uint64_t encodedSize;
+	};
+
+	struct RecordingFooter {
+		uint64_t indexOffset;
+		uint64_t frameCount;
+		char magic[8];
+	};
+
+	// Records selected fields of a particle system every cadence steps.
+	// The GL thread only issues fenced copies and collects the finished ones, encoding and disk writes are done by a background thread.
+	class FieldRecorder {
+	public:
+		FieldRecorder(ParticleSystem_Ptr system, const std::string& path, GLuint cadence = 1);
+		~FieldRecorder();
+
+		void record(const std::string& field, float quantization = 0); //quantization > 0 stores float fields rounded to that step (lossy)
+		inline void setCadence(GLuint cadence) { m_cadence = std::max(cadence, 1u); }
+		inline void setKeyframeInterval(GLuint interval) { if (!m_recording) m_keyframeInterval = std::max(interval, 1u); } //fixed while recording, stored in the header
+		inline void setMaxPendingFrames(GLuint count) { m_maxPending = std::max(count, 1u); } //older copies are waited on when exceeded
+
+		bool start();
+		void step(); //call once per solver step : captures on cadence and hands finished copies to the writer
+		void stop(); //waits for the pending frames and writes the trailer
+
+		inline bool isRecording() const { return m_recording; }
+		inline uint64_t rawBytes() const { return m_rawBytes; }
+		inline uint64_t writtenBytes() const { return m_writtenBytes; }
+
+		static Shared<FieldRecorder> create(ParticleSystem_Ptr system, const std::string& path, GLuint cadence = 1);
+
+	private:
+		struct Field {
+			std::string name;
+			float quantization = 0;
+			std::vector<GLuint> previous; //writer thread only
+		};
+
+		struct Frame {
+			uint64_t step = 0;
+			std::vector<Shared<Readback<GLuint>>> readbacks;
+			std::vector<std::vector<GLuint>> columns;
+		};
+
+		void capture();
+		void collect(bool blocking);
+		void run();
+		void encode(Frame& frame);
+
+		ParticleSystem_Ptr m_system;
+		std::string m_path;
+		std::vector<Field> m_fields;
+		GLuint m_cadence = 1;
+		GLuint m_keyframeInterval = 32;
+		GLuint m_maxPending = 4;
+		uint64_t m_step = 0;
+		bool m_recording = false;
+
+		std::deque<Shared<Frame>> m_pending; //copies in flight, GL thread only
+
+		std::ofstream m_file;
+		std::vector<uint64_t> m_index; //frame offsets, writer thread only
+		std::atomic<uint64_t> m_rawBytes = 0; //updated by the writer thread
+		std::atomic<uint64_t> m_writtenBytes = 0;
+
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::condition_variable m_written;
+		std::deque<Shared<Frame>> m_queue;
+		bool m_writing = false;
+		bool m_stop = false;
+	};
+
+	typedef Shared<FieldRecorder> FieldRecorder_Ptr;
+
+	// Sequential decoder of a recording
+	class FieldRecording {
+	public:
+		bool open(const std::string& path);
+
+		inline size_t frameCount() const { return m_index.size(); }
+		inline size_t fieldCount() const { return m_names.size(); }
+		inline const std::string& fieldName(size_t field) const { return m_names[field]; }
+		int fieldIndex(const std::string& name) const;
+		inline GLuint cadence() const { return m_header.cadence; }
+
+		bool read(size_t frame, uint64_t& step, std::vector<std::vector<GLuint>>& columns); //raw words of every field, decodes from the last keyframe
+		std::vector<float> readFloats(size_t frame, const std::string& field); //float fields, dequantized
+
+	private:
+		bool readFrame(size_t frame, uint64_t& step, std::vector<std::vector<GLuint>>& columns, std::vector<uint32_t>& flags);
+
+		std::ifstream m_file;
+		RecordingHeader m_header;
+		std::vector<std::string> m_names;
+		std::vector<float> m_quantization;
+		std::vector<uint64_t> m_index;
+
+		std::vector<std::vector<GLuint>> m_state; //last decoded frame, sequential reads don't restart from the keyframe
+		size_t m_stateFrame = size_t(-1);
+	};
+}
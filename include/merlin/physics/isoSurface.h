@@ -50,6 +50,8 @@ namespace Merlin {
 
 		ImmutableSSBO_Ptr<glm::vec4> buffer_vertices;
 		ImmutableSSBO_Ptr<glm::vec4> buffer_normals;
+		SSBO_Ptr<GLuint> buffer_triangle_count; //appended by the marching cubes kernel
+		SSBO_Ptr<GLuint> buffer_draw_args;
 
 		inline static ImmutableSSBO_Ptr<GLint> buffer_triangle_table;
 		inline static ImmutableSSBO_Ptr<GLint> buffer_configuration_table;
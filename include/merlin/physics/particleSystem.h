@@ -8,6 +8,7 @@
 #include "merlin/shaders/computeShader.h"
 #include "merlin/core/timestep.h"
 #include "merlin/graphics/mesh.h"
+#include "merlin/physics/fieldPrecision.h"
 
 #include "glm/gtc/random.hpp"
 #include <set>
@@ -27,14 +28,21 @@ namespace Merlin {
 		void draw() const; //draw the mesh
 		void setInstancesCount(size_t count);
 		void setActiveInstancesCount(size_t count);
+		void setActiveCounter(AbstractBufferObject_Ptr counter, GLuint index = 0); //active instances read from counter[index] on the GPU, nullptr goes back to the CPU count
+		inline AbstractBufferObject_Ptr getActiveCounter() const { return m_activeCounter; }
+		void updateDrawArgs() const; //indirect draw arguments from the active counter, before binding the shader drawing the system
+		void dispatchActive(ComputeShader& program); //one thread per active instance along x, the kernel checks gl_GlobalInvocationID.x against the counter
 
 		AbstractBufferObject_Ptr getField(const std::string& name) const;
 		AbstractBufferObject_Ptr getBuffer(const std::string& name) const;
 		
 		void addField(AbstractBufferObject_Ptr buf);
+		void addField(const std::string& name, FieldFormat format); //quantized field, shaders use the injected load_<name>/store_<name> accessors
 		void addBuffer(AbstractBufferObject_Ptr buf);
 		bool hasField(const std::string& name) const;
 		bool hasBuffer(const std::string& name) const;
+		bool hasFieldFormat(const std::string& name) const;
+		const FieldFormat& getFieldFormat(const std::string& name) const;
 
 		void clearField(const std::string& name);
 		void clearBuffer(const std::string& name);
@@ -48,6 +56,13 @@ namespace Merlin {
 		template<typename T>
 		void writeBuffer(const std::string& name, std::vector<T> data);
 
+		template<typename T>
+		std::vector<T> readField(const std::string& name);
+
+		//checkpoint/restart : every field, buffer, the instance counts and the link graph in one memory mappable file
+		void saveCheckpoint(const std::string& path); //returns right away, the file is written once the GPU copies are done
+		bool loadCheckpoint(const std::string& path); //maps the file and uploads the blobs straight into the buffers
+
 		void addProgram(ComputeShader_Ptr program);
 		bool hasProgram(const std::string& name) const;
 		
@@ -67,6 +82,7 @@ namespace Merlin {
 		void link(const std::string& shader, const std::string& field);
 		void detach(Shared<ShaderBase>);
 		void solveLink(Shared<ShaderBase>);
+		void injectFields(Shared<ShaderBase>); //inject the accessors of the quantized fields linked to the shader, recompiles it if needed
 		bool hasLink(const std::string& name) const;
 
 		inline void setMesh(Shared<Mesh> geometry) { m_geometry = geometry; }
@@ -79,6 +95,9 @@ namespace Merlin {
 		template<typename T>
 		void addField(const std::string& name);
 
+		template<typename T>
+		void addField(const std::string& name, FieldPrecision precision); //T is the type seen by shaders : float, vec2, vec3 or vec4
+
 		template<typename T>
 		void addBuffer(const std::string& name, GLsizei size = 0);
 
@@ -97,6 +116,10 @@ namespace Merlin {
 		Mesh_Ptr m_geometry = nullptr;
 		size_t m_instancesCount = 1;
 		size_t m_active_instancesCount = 1; //for rendering
+		AbstractBufferObject_Ptr m_activeCounter = nullptr; //GPU side active count, overrides m_active_instancesCount
+		GLuint m_activeCounterIndex = 0;
+		SSBO_Ptr<GLuint> m_drawArgs = nullptr;
+		SSBO_Ptr<GLuint> m_dispatchArgs = nullptr;
 		ParticleSystemDisplayMode m_displayMode = ParticleSystemDisplayMode::POINT_SPRITE;
 
 
@@ -107,6 +130,15 @@ namespace Merlin {
 		std::map<std::string, std::set<std::string>> m_links;
 
 		std::string m_currentProgram = "";
+
+		//Quantized fields
+		std::map<std::string, FieldFormat> m_formats;
+		std::map<std::string, std::set<std::string>> m_injected; //shader -> fields already injected
+
+		void drawGeometry() const;
+		Shared<ShaderBase> findProgram(const std::string& name) const;
+		void writePackedField(const std::string& name, const float* values, size_t floats);
+		std::vector<float> readPackedField(const std::string& name);
 	};
 
 	typedef Shared<ParticleSystem> ParticleSystem_Ptr;
@@ -124,6 +156,12 @@ namespace Merlin {
 		}
 	}
 
+	template<typename T>
+	void ParticleSystem::addField(const std::string& name, FieldPrecision precision) {
+		static_assert(sizeof(T) % sizeof(float) == 0 && sizeof(T) <= 4 * sizeof(float), "quantized fields hold 1 to 4 float components");
+		addField(name, FieldFormat(precision, sizeof(T) / sizeof(float)));
+	}
+
 	template<typename T>
 	void ParticleSystem::addBuffer(const std::string& name, GLsizei size) {
 		if (hasBuffer(name)) {
@@ -139,7 +177,8 @@ namespace Merlin {
 
 	template<typename T>
 	void ParticleSystem::writeField(const std::string& name, std::vector<T> data) {
-		if (hasField(name)) {
+		if (hasFieldFormat(name)) writePackedField(name, reinterpret_cast<const float*>(data.data()), data.size() * sizeof(T) / sizeof(float));
+		else if (hasField(name)) {
 			if (m_fields[name]->elements() < data.size()) {
 				//Console::error("ParticleSystem") << "Field hasn't been allocated" << Console::endl;
 				m_fields[name]->allocateBuffer(data.size() * sizeof(T), data.data(), BufferUsage::StaticDraw);
@@ -160,4 +199,20 @@ namespace Merlin {
 		}
 		else Console::error("ParticleSystem") << name << " is not registered in the particle system." << Console::endl;
 	}
+
+	template<typename T>
+	std::vector<T> ParticleSystem::readField(const std::string& name) {
+		std::vector<T> data;
+		if (hasFieldFormat(name)) {
+			std::vector<float> values = readPackedField(name);
+			data.resize(values.size() * sizeof(float) / sizeof(T));
+			memcpy(data.data(), values.data(), data.size() * sizeof(T));
+		}
+		else if (hasField(name)) {
+			data.resize(m_fields[name]->size() / sizeof(T));
+			m_fields[name]->readBuffer(data.size() * sizeof(T), data.data());
+		}
+		else Console::error("ParticleSystem") << name << " is not registered in the particle system." << Console::endl;
+		return data;
+	}
 }
@@ -18,6 +18,25 @@ namespace Merlin {
         
     };
 
+    static constexpr int MAX_SHADOW_MAPS = 10; //size of the shadow sampler arrays of the default shaders
+
+    // One element of the std430 light array read by the default shaders (LightBuffer block)
+    struct LightData {
+        glm::vec3 position = glm::vec3(0);      //point and spot lights
+        float cutOff = 0;                       //spot lights, degrees
+        glm::vec3 direction = glm::vec3(0);     //directional and spot lights
+        float far_plane = 0;                    //point lights shadows
+        glm::vec3 ambient = glm::vec3(0);
+        GLint type = 0;
+        glm::vec3 diffuse = glm::vec3(0);
+        GLint castShadow = 0;                   //the shadow map is bound at the light index
+        glm::vec3 specular = glm::vec3(0);
+        float padding0 = 0;
+        glm::vec3 attenuation = glm::vec3(0);   //constant, linear, quadratic
+        float padding1 = 0;
+        glm::mat4 lightSpaceMatrix = glm::mat4(1);
+    };
+
 	class Light : public RenderableObject{
     public:
         Light(const std::string& name, LightType type, const glm::vec3& ambient = glm::vec3(0.05), const glm::vec3& diffuse = glm::vec3(0.7), const glm::vec3& specular = glm::vec3(0.5))
@@ -45,7 +64,8 @@ namespace Merlin {
         }
 
 
-        virtual void attach(int id, Shader& shader) = 0;
+        virtual void attach(int id, Shader& shader) = 0; //legacy path, lights[id] uniforms
+        virtual void pack(LightData& data); //light buffer path
         virtual void detach() {};
         virtual void attachShadow(Shader&, float scale = 10){}
 
@@ -114,6 +134,7 @@ namespace Merlin {
         const glm::vec3& direction() const { return direction_; }
 
         void attach(int id, Shader&) override;
+        void pack(LightData& data) override;
         void detach() override;
         void attachShadow(Shader&, float scale = 10) override;
         inline Shared<FBO> shadowFBO() override { return m_shadowFBO; }
@@ -168,6 +189,7 @@ namespace Merlin {
         void generateShadowMap();
         void detach() override;
         void attach(int id, Shader&) override;
+        void pack(LightData& data) override;
         void attachShadow(Shader&, float scale = 10) override;
         void setShadowResolution(GLuint res) override;
         inline Shared<FBO> shadowFBO() override { return m_shadowFBO; }
@@ -206,6 +228,7 @@ namespace Merlin {
             : Light(name, LightType::Ambient, ambient) {}
 
         void attach(int id, Shader&) override;
+        void pack(LightData& data) override;
 
         static Shared<AmbientLight> create(const std::string& name) {
             return createShared<AmbientLight>(name);
@@ -241,6 +264,7 @@ namespace Merlin {
         float cutOff() const { return cutOff_; }
 
         void attach(int id, Shader&) override;
+        void pack(LightData& data) override;
         void detach() override;
 
         void attachShadow(Shader&, float scale = 10) override;
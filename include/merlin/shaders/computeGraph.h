@@ -0,0 +1,117 @@
+#pragma once
+#include "merlin/core/core.h"
+#include "merlin/shaders/computeShader.h"
+#include "merlin/memory/bufferObject.h"
+#include "merlin/textures/texture.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Merlin {
+
+	// How a pass (or whatever runs after the graph) consumes a resource, selects the barrier bit making earlier writes visible to it
+	enum class ResourceUsage {
+		STORAGE,		//shader storage block				GL_SHADER_STORAGE_BARRIER_BIT
+		IMAGE,			//imageLoad/imageStore				GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+		TEXTURE,		//sampler fetch						GL_TEXTURE_FETCH_BARRIER_BIT
+		UNIFORM,		//uniform block						GL_UNIFORM_BARRIER_BIT
+		ATOMIC_COUNTER,	//atomic counter buffer				GL_ATOMIC_COUNTER_BARRIER_BIT
+		INDIRECT,		//dispatch or draw arguments		GL_COMMAND_BARRIER_BIT
+		VERTEX,			//vertex attributes					GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+		INDEX,			//element array						GL_ELEMENT_ARRAY_BARRIER_BIT
+		TRANSFER		//copies, readbacks and mapping		GL_BUFFER_UPDATE_BARRIER_BIT
+	};
+
+	GLbitfield barrierBit(ResourceUsage usage);
+
+	class ComputeGraph;
+
+	// One dispatch of the graph, declares the resources it reads and writes.
+	// Declared storage buffers are attached to the blocks of the same name before the dispatch.
+	class ComputePass {
+	public:
+		ComputePass(const std::string& name, ComputeShader_Ptr shader);
+
+		ComputePass& reads(AbstractBufferObject& buffer, ResourceUsage usage = ResourceUsage::STORAGE);
+		ComputePass& writes(AbstractBufferObject& buffer, ResourceUsage usage = ResourceUsage::STORAGE);
+		ComputePass& readsWrites(AbstractBufferObject& buffer, ResourceUsage usage = ResourceUsage::STORAGE);
+		ComputePass& reads(TextureBase& texture, ResourceUsage usage = ResourceUsage::TEXTURE);
+		ComputePass& writes(TextureBase& texture, ResourceUsage usage = ResourceUsage::IMAGE);
+		ComputePass& readsWrites(TextureBase& texture, ResourceUsage usage = ResourceUsage::IMAGE);
+
+		ComputePass& setup(std::function<void(ComputeShader&)> callback); //uniforms, before every dispatch
+		ComputePass& layout(glm::uvec3 groups); //fixed workgroup count, the shader layout is used otherwise
+		ComputePass& run(std::function<void(ComputeShader&)> callback); //replaces the dispatch (indirect or several dispatches)
+
+		inline const std::string& name() const { return m_name; }
+		inline ComputeShader& shader() { return *m_shader; }
+
+	private:
+		friend class ComputeGraph;
+
+		struct Access {
+			const void* resource;
+			AbstractBufferObject* buffer; //null for textures
+			ResourceUsage usage;
+			bool read;
+			bool write;
+		};
+
+		ComputePass& access(const void* resource, AbstractBufferObject* buffer, ResourceUsage usage, bool read, bool write);
+		void execute();
+
+		std::string m_name;
+		ComputeShader_Ptr m_shader;
+		std::vector<Access> m_accesses;
+		std::function<void(ComputeShader&)> m_setup;
+		std::function<void(ComputeShader&)> m_run;
+		glm::uvec3 m_layout = glm::uvec3(0);
+		ComputeGraph* m_graph = nullptr;
+	};
+
+	// Ordered list of compute passes replayed as a whole (a solver step).
+	// The barriers are derived from the declared accesses : a pass waits only for the writes it consumes,
+	// with the bits of the way it consumes them, merged into a single glMemoryBarrier before the pass.
+	// The plan is recorded once (and again after any change) for the steady state : the writes of the previous replay
+	// are accounted for, the graph runs in a loop without a barrier at every pass. The CPU never waits for the GPU.
+	class ComputeGraph {
+	public:
+		ComputeGraph(const std::string& name);
+
+		ComputePass& addPass(const std::string& name, ComputeShader_Ptr shader);
+		//one pass per stage of a staged shader, declare() gives the accesses of each stage
+		void addStages(StagedComputeShader_Ptr shader, std::function<void(ComputePass&, GLuint stage)> declare);
+		void output(AbstractBufferObject& buffer, ResourceUsage usage); //consumed after the graph (rendering, readback)
+		void output(TextureBase& texture, ResourceUsage usage);
+
+		void record(); //derives the barriers, called by execute() when the graph changed
+		void execute(GLuint iterations = 1);
+		void clear();
+		inline void invalidate() { m_recorded = false; }
+
+		inline const std::string& name() const { return m_name; }
+		inline size_t passCount() const { return m_passes.size(); }
+		inline size_t barrierCount() const { return m_barrierCount; } //per replay, the final one included
+		void print() const; //the recorded plan
+
+		static Shared<ComputeGraph> create(const std::string& name);
+
+	private:
+		struct Output {
+			const void* resource;
+			ResourceUsage usage;
+		};
+
+		std::string m_name;
+		std::vector<Shared<ComputePass>> m_passes;
+		std::vector<Output> m_outputs;
+
+		std::vector<GLbitfield> m_barriers; //before each pass
+		GLbitfield m_finalBarrier = 0; //after the last pass, for the outputs
+		size_t m_barrierCount = 0;
+		bool m_recorded = false;
+	};
+
+	typedef Shared<ComputeGraph> ComputeGraph_Ptr;
+}
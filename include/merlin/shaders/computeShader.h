@@ -3,6 +3,8 @@
 #include "merlin/shaders/shaderBase.h"
 #include "merlin/graphics/ressourceManager.h"
 
+#include <functional>
+
 namespace Merlin{
 
 	class ComputeShader : public ShaderBase {
@@ -11,7 +13,8 @@ namespace Merlin{
 		~ComputeShader();
 
 		void destroy() override;
-		void compile();
+		void compile() override;
+		void reload() override;
 
 		void readFile(const std::string& file_path);
 		void compileFromFile(const std::string& file_path);
@@ -19,8 +22,19 @@ namespace Merlin{
 		
 		void dispatch(); //execute using the default WorkgroupLayout
 		void dispatch(GLuint width, GLuint height = 1, GLuint layers = 1); //execute using the given WorkgroupLayout
+		void dispatchIndirect(const AbstractBufferObject& args, GLintptr offset = 0); //workgroup count read from a DispatchIndirectCommand written on the GPU
 		void SetWorkgroupLayout(GLuint width, GLuint height = 1, GLuint layers = 1); // Set current workgroup Layout
 		void SetWorkgroupLayout(glm::uvec3); // Set current workgroup Layout
+		void SetDomain(GLuint width, GLuint height = 1, GLuint layers = 1); // Threads to run, the workgroup layout follows the workgroup size
+		void SetDomain(glm::uvec3); // Threads to run, the workgroup layout follows the workgroup size
+
+		glm::uvec3 workgroupSize() const; //local size of the active program
+		void setWorkgroupSize(glm::uvec3 size); //overrides the local_size declared by the kernel, built as a new permutation
+
+		// Times the candidate local sizes (GL_TIME_ELAPSED) on the domain set with SetDomain and keeps the fastest.
+		// The kernel runs several times per candidate : run (default dispatch()) must be safe to repeat, tune solver steps on scratch data.
+		// Winners are stored per device and kernel in the shader cache directory, a known kernel is not timed again.
+		glm::uvec3 autotune(const std::vector<glm::uvec3>& candidates = {}, std::function<void()> run = nullptr);
 
 		void wait();
 		void barrier(GLbitfield barrier = GL_ALL_BARRIER_BITS);
@@ -33,9 +47,18 @@ namespace Merlin{
 
 
 	protected:
+		std::vector<ShaderStage> prepareStages() override;
+
+		uint64_t tuningKey();
+		void updateLayout();
+
 		glm::uvec3 m_wkgrpLayout;
-		GLuint m_shaderID = 0;
+		glm::uvec3 m_domain = glm::uvec3(0); //0 : the layout is set by hand
+		glm::uvec3 m_localSize = glm::uvec3(0); //0 : declared by the kernel
+		GLuint m_layoutGeneration = 0; //program the layout was computed for
 		std::string m_shaderSrc; 
+		std::string m_path;
+		uint64_t m_sourceKey = 0;
 	};
 
 	class StagedComputeShader : public ComputeShader {
@@ -20,9 +20,7 @@ namespace Merlin {
 		~Shader();
 
 		void destroy() override;
-
-		
-		void compile();
+		void reload() override;
 
 		void readFile(const std::string& vertex_file_path,
 			const std::string& fragment_file_path,
@@ -48,26 +46,29 @@ namespace Merlin {
 		inline bool supportLights() const		{ return _supportLights; }
 		inline bool supportShadows() const		{ return _supportShadows; }
 		inline bool supportEnvironment() const	{ return _supportEnvironment; }
+		inline bool supportVertexFormats() const { return _supportVertexFormats; } //decodes the compact Mesh vertex formats (vertex_format uniform)
 
 		inline void supportTexture(bool state) { _supportTexture = state; }
 		inline void supportMaterial(bool state) { _supportMaterial = state; }
 		inline void supportLights(bool state) { _supportLights = state; }
 		inline void supportShadows(bool state) { _supportShadows = state; }
 		inline void supportEnvironment(bool state) { _supportEnvironment = state; }
+		inline void supportVertexFormats(bool state) { _supportVertexFormats = state; }
 
 
 	protected:
-
+		std::vector<ShaderStage> prepareStages() override;
 
 		bool _supportLights = false;
 		bool _supportTexture = false;
 		bool _supportShadows = false;
 		bool _supportMaterial = false;
 		bool _supportEnvironment = false;
+		bool _supportVertexFormats = false;
 
-		GLuint vertexShaderID = 0;
-		GLuint fragmentShaderID = 0;
-		GLuint geometryShaderID = 0;
+		std::string m_vertexPath;
+		std::string m_fragmentPath;
+		std::string m_geometryPath;
 
 		std::string VertexShaderSrc = "";
 		std::string FragmentShaderSrc = "";
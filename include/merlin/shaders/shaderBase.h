@@ -1,10 +1,17 @@
 #pragma once
 #include "merlin/core/core.h"
 #include "merlin/memory/bufferObject.h"
+#include "merlin/memory/blockLayout.h"
+#include "merlin/shaders/shaderCompiler.h"
 
 #include <string>
 #include <memory>
+#include <map>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 namespace Merlin {
 	class Merlin::AbstractBufferObject;
@@ -25,28 +32,30 @@ namespace Merlin {
 		virtual void use() const;
 		virtual void destroy();
 
-		GLuint getUniformLocation(const char*) const;
-
-		void setInt(const std::string name, GLint value) const;
-		void setUInt(const std::string name, GLuint value) const;
-		void setFloat(const std::string name, GLfloat value) const;
-		void setDouble(const std::string name, GLdouble value) const;
-		void setVec2(const std::string name, glm::vec2 value) const;
-		void setVec3(const std::string name, glm::vec3 value) const;
-		void setVec4(const std::string name, glm::vec4 value) const;
-		void setUVec2(const std::string name, glm::uvec2 value) const;
-		void setUVec3(const std::string name, glm::uvec3 value) const;
-		void setUVec4(const std::string name, glm::uvec4 value) const;
-		void setIVec2(const std::string name, glm::ivec2 value) const;
-		void setIVec3(const std::string name, glm::ivec3 value) const;
-		void setIVec4(const std::string name, glm::ivec4 value) const;
-		void setDVec2(const std::string name, glm::dvec2 value) const;
-		void setDVec3(const std::string name, glm::dvec3 value) const;
-		void setDVec4(const std::string name, glm::dvec4 value) const;
-		void setMat3(const std::string name, glm::mat3 mat) const;
-		void setMat4(const std::string name, glm::mat4 mat) const;
-
-		void setIntArray(const std::string name, GLint* values, uint32_t count) const;
+		GLint getUniformLocation(const std::string& uniform) const; //cached, misses are reported once
+		GLint getUniformLocation(const char* uniform) const;
+		bool hasUniform(const std::string& uniform) const; //active in the program, misses are not reported
+
+		void setInt(const std::string& name, GLint value) const;
+		void setUInt(const std::string& name, GLuint value) const;
+		void setFloat(const std::string& name, GLfloat value) const;
+		void setDouble(const std::string& name, GLdouble value) const;
+		void setVec2(const std::string& name, const glm::vec2& value) const;
+		void setVec3(const std::string& name, const glm::vec3& value) const;
+		void setVec4(const std::string& name, const glm::vec4& value) const;
+		void setUVec2(const std::string& name, const glm::uvec2& value) const;
+		void setUVec3(const std::string& name, const glm::uvec3& value) const;
+		void setUVec4(const std::string& name, const glm::uvec4& value) const;
+		void setIVec2(const std::string& name, const glm::ivec2& value) const;
+		void setIVec3(const std::string& name, const glm::ivec3& value) const;
+		void setIVec4(const std::string& name, const glm::ivec4& value) const;
+		void setDVec2(const std::string& name, const glm::dvec2& value) const;
+		void setDVec3(const std::string& name, const glm::dvec3& value) const;
+		void setDVec4(const std::string& name, const glm::dvec4& value) const;
+		void setMat3(const std::string& name, const glm::mat3& mat) const;
+		void setMat4(const std::string& name, const glm::mat4& mat) const;
+
+		void setIntArray(const std::string& name, const GLint* values, uint32_t count) const;
 
 
 		void setConstInt(const std::string name, GLint value);
@@ -71,43 +80,111 @@ namespace Merlin {
 		void setConstDMat4(const std::string name, glm::dmat4 mat);
 
 		void define(const std::string& name, const std::string& value);
+		bool inject(const std::string& key, const std::string& code); //code inserted after the #version line at the next compile, true if it changed
+
+		virtual void compile(); //blocks until the program is linked, switches instantly to a permutation already built
+		void compileAsync(); //returns at once, the program is swapped in by ShaderCompiler::poll() once linked
+		void recompile(); //build the current permutation again (constants, defines and injections are applied)
+		virtual void reload() {} //reads the source files again and compiles them in the background (hot reload)
 
 		bool hasConstant(const std::string&) const;
 
+		// Every set of constants, defines and injections is a permutation with its own program.
+		// Programs are kept once built : changing the constants back switches without compiling,
+		// a permutation not built yet is compiled at the next use() (in the background for the graphics shaders).
+		uint64_t permutationKey() const; //hash of the current constants, defines and injections
+		bool selectPermutation(); //activates the program of the current permutation, false if it isn't built
+		inline size_t permutationCount() const { return m_permutations.size(); }
+		void clearPermutations(); //deletes the programs of the inactive permutations
+
 		void attach(AbstractBufferObject& buf);
+		void attach(AbstractBufferObject& buf, const std::string& blockName); //bind a buffer to a block with a different name
 		void detach(AbstractBufferObject& buf);
 
+		GLint blockIndex(const std::string& blockName, BufferTarget target = BufferTarget::Shader_Storage_Buffer) const; //cached, -1 if the program has no such block
+		inline bool hasStorageBlock(const std::string& blockName) const { return blockIndex(blockName, BufferTarget::Shader_Storage_Buffer) != -1; }
+		inline bool hasUniformBlock(const std::string& blockName) const { return blockIndex(blockName, BufferTarget::Uniform_Buffer) != -1; }
+
+		BlockLayout getBlockLayout(const std::string& blockName) const; //std430 layout of a storage block as seen by the linker
+
 		inline const GLuint id() const { return m_programID; }
-		inline void setID(GLuint _id_) { m_programID = _id_; };
+		inline void setID(GLuint _id_) { m_programID = _id_; m_generation = ++s_generations; m_blockIndices.clear(); m_uniformBlockIndices.clear(); m_uniformLocations.clear(); m_missingUniforms.clear(); };
+		inline GLuint generation() const { return m_generation; } //changes with every new program, cached locations must be resolved again
 
 		inline const std::string name() const { return m_name; }
 		inline const bool isCompiled() const { return m_compiled; }
+		inline bool isPending() const { return ShaderCompiler::instance().isPending(*this); } //a build is in progress
+		inline const std::vector<std::string>& dependencies() const { return m_dependencies; } //source files and their includes
 
 		//static std::shared_ptr<ShaderBase> create(const std::string& name);
-		static std::string readSrc(const std::string& filename);
+		static std::string readSrc(const std::string& filename, std::vector<std::string>* dependencies = nullptr);
 	
 	protected:
+		friend class ShaderCompiler;
+		virtual std::vector<ShaderStage> prepareStages() { return {}; } //precompiles the sources, one entry per stage
+		void swapProgram(GLuint program, uint64_t key); //stores a linked program, active if its permutation is the current one
+		void activate(GLuint program, uint64_t key); //previous program deleted unless a permutation holds it
+		void invalidatePermutations(); //the sources changed, every permutation has to be built again
+		void setConstant(const std::string& name, const std::string& declaration);
+
 		void precompileSrc(std::string& src);
-		static bool compileShader(const std::string& name, const std::string& src, GLuint id);
 		std::string updateConstants(const std::string& originalSrc);
 		std::string updateDefines(const std::string& originalSrc);
+		std::string updateInjections(const std::string& originalSrc);
+		void reflectUniforms(); //fills the location cache from the program introspection, call after a successful link
+		void defer(const std::string& name, std::function<void()> apply) const; //uniform set while no program is ready
 
 
 		std::string m_name;
 		bool m_compiled = false;
 		std::unordered_map<std::string, std::string> m_constants;
 		std::unordered_map<std::string, std::string> m_defines;
+		std::map<std::string, std::string> m_injections;
+		std::vector<std::string> m_dependencies;
+		std::unordered_map<uint64_t, GLuint> m_permutations; //permutation key -> linked program
+		uint64_t m_permutation = 0; //key of the active program
+		mutable uint64_t m_permutationKey = 0;
+		mutable bool m_permutationDirty = true;
 
 		static int shader_instances;
 
 	private:
 		GLuint m_programID = 0;
 		ShaderType m_type = ShaderType::ABSTRACT;
+		mutable std::unordered_map<std::string, GLint> m_blockIndices; //storage block indices, queried once per link
+		mutable std::unordered_map<std::string, GLint> m_uniformBlockIndices; //uniform block indices
+		mutable std::unordered_map<std::string, GLint> m_uniformLocations; //-1 for the names known to be missing
+		mutable std::unordered_set<std::string> m_missingUniforms; //already reported
+		mutable std::unordered_map<std::string, std::function<void()>> m_deferredUniforms; //applied by activate(), last value per name
+		GLuint m_generation = 0;
+		static GLuint s_generations;
 	};
 
 	typedef Shared<ShaderBase> GenericShader_Ptr;	
 
 
+	// glProgramUniform* overloads used by the typed handles
+	inline void programUniform(GLuint program, GLint location, GLint value) { glProgramUniform1i(program, location, value); }
+	inline void programUniform(GLuint program, GLint location, GLuint value) { glProgramUniform1ui(program, location, value); }
+	inline void programUniform(GLuint program, GLint location, GLfloat value) { glProgramUniform1f(program, location, value); }
+	inline void programUniform(GLuint program, GLint location, GLdouble value) { glProgramUniform1d(program, location, value); }
+	inline void programUniform(GLuint program, GLint location, const glm::vec2& value) { glProgramUniform2fv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::ivec2& value) { glProgramUniform2iv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::uvec2& value) { glProgramUniform2uiv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::dvec2& value) { glProgramUniform2dv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::vec3& value) { glProgramUniform3fv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::ivec3& value) { glProgramUniform3iv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::uvec3& value) { glProgramUniform3uiv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::dvec3& value) { glProgramUniform3dv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::vec4& value) { glProgramUniform4fv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::ivec4& value) { glProgramUniform4iv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::uvec4& value) { glProgramUniform4uiv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::dvec4& value) { glProgramUniform4dv(program, location, 1, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::mat3& value) { glProgramUniformMatrix3fv(program, location, 1, GL_FALSE, glm::value_ptr(value)); }
+	inline void programUniform(GLuint program, GLint location, const glm::mat4& value) { glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, glm::value_ptr(value)); }
+
+
+	// Typed uniform handle, the location is resolved once per program and reused by every sync
 	template <class T>
 	class Uniform {
 	public:
@@ -120,6 +197,7 @@ namespace Merlin {
 		void sync(ShaderBase& shader);
 
 		inline const std::string name() {return m_name;}
+		inline GLint location() const { return m_location; }
 
 		void operator=(T data);
 		T& operator()();
@@ -127,6 +205,9 @@ namespace Merlin {
 	private:
 		T m_data;
 		std::string m_name;
+		GLint m_location = -1;
+		GLuint m_program = 0;
+		GLuint m_generation = 0;
 	};
 
 	template<typename T>
@@ -139,88 +220,16 @@ namespace Merlin {
 		return m_data;
 	}
 
-	template<>
-	inline void Uniform<int>::sync(ShaderBase& shader) {
-		shader.setInt(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<float>::sync(ShaderBase& shader) {
-		shader.setFloat(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<double>::sync(ShaderBase& shader) {
-		shader.setDouble(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<GLuint>::sync(ShaderBase& shader) {
-		shader.setUInt(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<glm::vec2>::sync(ShaderBase& shader) {
-		shader.setVec2(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<glm::ivec2>::sync(ShaderBase& shader) {
-		shader.setIVec2(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<glm::uvec2>::sync(ShaderBase& shader) {
-		shader.setUVec2(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<glm::dvec2>::sync(ShaderBase& shader) {
-		shader.setDVec2(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<glm::vec3>::sync(ShaderBase& shader) {
-		shader.setVec3(m_name, m_data);
-	}
-	template<>
-	inline void Uniform<glm::ivec3>::sync(ShaderBase& shader) {
-		shader.setIVec3(m_name, m_data);
-	}
-	template<>
-	inline void Uniform<glm::uvec3>::sync(ShaderBase& shader) {
-		shader.setUVec3(m_name, m_data);
-	}
-	template<>
-	inline void Uniform<glm::dvec3>::sync(ShaderBase& shader) {
-		shader.setDVec3(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<glm::vec4>::sync(ShaderBase& shader) {
-		shader.setVec4(m_name, m_data);
-	}
-	template<>
-	inline void Uniform<glm::ivec4>::sync(ShaderBase& shader) {
-		shader.setIVec4(m_name, m_data);
-	}
-	template<>
-	inline void Uniform<glm::uvec4>::sync(ShaderBase& shader) {
-		shader.setUVec4(m_name, m_data);
-	}
-	template<>
-	inline void Uniform<glm::dvec4>::sync(ShaderBase& shader) {
-		shader.setDVec4(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<glm::mat4>::sync(ShaderBase& shader) {
-		shader.setMat4(m_name, m_data);
-	}
-
-	template<>
-	inline void Uniform<glm::mat3>::sync(ShaderBase& shader) {
-		shader.setMat3(m_name, m_data);
+	template<typename T>
+	inline void Uniform<T>::sync(ShaderBase& shader) {
+		if (!shader.isCompiled()) return;
+		//program ids can be recycled after a recompile, the generation tells the programs apart
+		if (m_program != shader.id() || m_generation != shader.generation()) {
+			m_location = shader.getUniformLocation(m_name);
+			m_program = shader.id();
+			m_generation = shader.generation();
+		}
+		if (m_location != -1) programUniform(m_program, m_location, m_data);
 	}
 
 
@@ -0,0 +1,51 @@
+#pragma once
+#include "merlin/core/core.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Merlin {
+
+	struct ShaderCacheStats {
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t rejected = 0;	//binaries refused by the driver (driver update, corrupted file), counted in the misses
+		size_t stored = 0;
+	};
+
+	// On-disk cache of linked program binaries.
+	// Entries are keyed by a hash of the preprocessed sources (constants, defines and injections applied)
+	// and of the GL vendor, renderer and version strings, a driver change simply misses.
+	class ShaderCache {
+		SINGLETON(ShaderCache)
+		ShaderCache() = default;
+
+	public:
+		inline void setEnabled(bool state) { m_enabled = state; }
+		bool isEnabled();
+		inline void setDirectory(const std::string& directory) { m_directory = directory; }
+		inline const std::string& directory() const { return m_directory; }
+
+		uint64_t key(const std::vector<std::string>& sources); //sources of every stage, in a fixed order
+
+		bool load(GLuint program, uint64_t key); //true if the program is linked from the cached binary
+		void prepare(GLuint program); //call before glLinkProgram so the binary can be retrieved
+		void store(GLuint program, uint64_t key); //call once the program is successfully linked
+
+		void clear(); //removes every cached binary
+		void printStats() const;
+		inline const ShaderCacheStats& stats() const { return m_stats; }
+
+	private:
+		std::string path(uint64_t key) const;
+		uint64_t driverHash();
+
+		std::string m_directory = "./cache/shaders/";
+		bool m_enabled = true;
+		bool m_supported = false;
+		bool m_checked = false;
+		uint64_t m_driverHash = 0;
+		ShaderCacheStats m_stats;
+	};
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "merlin/core/core.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct GLFWwindow;
+
+namespace Merlin {
+	class ShaderBase;
+
+	enum class ShaderCompilerMode {
+		UNINITIALIZED,
+		PARALLEL,		//KHR/ARB_parallel_shader_compile, the driver compiles and links on its own threads
+		WORKER,			//compiled and linked by a thread owning a context shared with the main one
+		SYNCHRONOUS		//no way to compile off the main thread, submitted programs are built at once
+	};
+
+	struct ShaderCompilerStats {
+		size_t built = 0;		//programs swapped in
+		size_t failed = 0;		//builds that did not link, the previous program was kept
+		size_t cancelled = 0;	//builds superseded by a newer one or whose shader was destroyed
+		size_t reloads = 0;		//hot reloads triggered by a modified source file
+	};
+
+	struct ShaderStage {
+		GLenum type;
+		std::string name;	//"Vertex", "Fragment", ... for the logs
+		std::string src;	//precompiled
+	};
+
+	// Builds the shader programs off the main thread.
+	// A build never touches the program in use : the new program is linked aside and swapped in by poll()
+	// once it's done, with the uniform values and block bindings of the previous one. A failed build keeps the previous program.
+	// Compute programs are waited for at their first use (a solver step can't be skipped), draws are skipped until their program is ready.
+	// The source files of the shaders (and their includes) are watched, a modified file rebuilds every shader using it.
+	class ShaderCompiler {
+		SINGLETON(ShaderCompiler)
+		ShaderCompiler() { s_alive = true; }
+
+	public:
+		~ShaderCompiler();
+
+		void initialize(); //picks the mode, called by the first build (the context must be current)
+		void shutdown(); //stops the worker thread, call while the main context is alive
+		inline ShaderCompilerMode mode() const { return m_mode; }
+
+		void compile(ShaderBase& shader); //blocks until the program is swapped in (or failed)
+		void submit(ShaderBase& shader); //returns at once, a pending build of the same shader is cancelled
+		void finish(const ShaderBase& shader); //blocks on the pending build of this shader, if any
+		void poll(); //swaps the finished programs in and checks the watched files, never blocks
+		void wait(); //finishes every pending build
+
+		bool isPending(const ShaderBase& shader) const;
+		inline size_t pending() const { return m_builds.size(); }
+
+		void watch(ShaderBase& shader); //the dependencies of the shader are checked for the hot reload
+		inline void setHotReload(bool state) { m_hotReload = state; }
+		inline bool hotReload() const { return m_hotReload; }
+		inline void setWatchInterval(double seconds) { m_watchInterval = seconds; }
+
+		inline const ShaderCompilerStats& stats() const { return m_stats; }
+
+		static void transferState(GLuint from, GLuint to); //uniform values and block bindings, matched by name
+
+		//safe to call from destructors running after the compiler was destroyed (static resources)
+		static void onShaderDestroyed(const ShaderBase& shader);
+
+	private:
+		struct Build {
+			ShaderBase* shader = nullptr; //null once cancelled, the objects are deleted when the build completes
+			std::vector<ShaderStage> stages;
+			std::vector<GLuint> shaders;
+			GLuint program = 0;
+			uint64_t key = 0; //binary cache
+			uint64_t permutation = 0; //constants, defines and injections of the shader at submission
+			bool cached = false; //linked from the binary cache
+			std::atomic<bool> linked = false; //set by the worker thread
+			double start = 0;
+		};
+
+		void cancel(const ShaderBase& shader);
+		Shared<Build> begin(ShaderBase& shader, bool async);
+		bool isComplete(const Build& build) const;
+		void finish(Build& build); //blocking
+		void complete(Build& build); //swaps the program in, the build must be linked
+		void checkFiles();
+
+		static void link(Build& build);
+		void run();
+
+		ShaderCompilerMode m_mode = ShaderCompilerMode::UNINITIALIZED;
+		std::vector<Shared<Build>> m_builds;
+		ShaderCompilerStats m_stats;
+
+		//worker mode
+		GLFWwindow* m_context = nullptr;
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::condition_variable m_linked;
+		std::deque<Shared<Build>> m_queue;
+		bool m_stop = false;
+
+		//hot reload
+		std::unordered_map<ShaderBase*, std::vector<std::string>> m_watched; //shader -> files
+		std::unordered_map<std::string, std::filesystem::file_time_type> m_times;
+		bool m_hotReload = true;
+		double m_watchInterval = 0.5;
+		double m_lastCheck = 0;
+
+		static inline bool s_alive = false;
+	};
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "merlin/core/core.h"
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Merlin {
+
+	struct ShaderPreprocessorStats {
+		size_t hits = 0;	//included files served from the cache
+		size_t misses = 0;	//files read from the disk (first use or modified since)
+	};
+
+	// Expands the #include directives of a GLSL file in one pass over its lines.
+	// Files are read once, stripped from their comments (line count preserved) and cached until they change on disk.
+	// #pragma once and whole file include guards make a file expand only once per shader source.
+	// Every file gets a stable source number, #line directives are emitted around the included code
+	// so the driver reports the original line and mapLog() translates the source number back into the file path.
+	class ShaderPreprocessor {
+		SINGLETON(ShaderPreprocessor)
+		ShaderPreprocessor() = default;
+
+	public:
+		std::string load(const std::string& path, std::vector<std::string>* dependencies = nullptr); //expanded source, "error" if the file can't be read. dependencies receives the file and its includes
+		std::string mapLog(const std::string& log) const; //replaces the source numbers of a compiler log by the file paths
+
+		void addIncludeDirectory(const std::string& directory); //searched after the directory of the including file
+		void invalidate(const std::string& path);
+		void clearCache();
+
+		const std::string& fileName(GLuint source) const; //empty for unknown source numbers (0 is the code not loaded from a file)
+		inline const ShaderPreprocessorStats& stats() const { return m_stats; }
+
+		static std::string stripComments(const std::string& src); //newlines are kept, line numbers don't change
+		static std::string lineDirective(const std::string& src, size_t pos); //#line restoring the numbering of src at pos, for code inserted there
+
+	private:
+		struct File {
+			std::string path;
+			GLuint source = 0;
+			std::filesystem::file_time_type time;
+			Shared<const std::string> text; //without comments
+			bool once = false; //#pragma once or include guard
+		};
+
+		const File* fetch(const std::string& path);
+		std::string resolve(const std::string& include, const std::string& from) const;
+		void expand(const File& file, bool main, std::string& out, std::unordered_set<GLuint>& included, std::vector<GLuint>& stack, std::vector<std::string>* dependencies);
+
+		std::unordered_map<std::string, File> m_files;
+		std::vector<std::string> m_sources = { "" }; //source number -> path
+		std::vector<std::string> m_directories;
+		ShaderPreprocessorStats m_stats;
+	};
+}
@@ -64,6 +64,8 @@ namespace Merlin {
 		inline GLuint depth() { return m_depth; }
 
 	protected:
+		void trackMemory(GLuint layers = 1, bool mipmaps = false) const; //report the storage size to the MemoryTracker
+
 		GLuint m_width = 0, m_height = 0, m_depth = 0;
 		GLenum m_format, m_internalFormat, m_dataType;
 		TextureType m_type = TextureType::ALBEDO;
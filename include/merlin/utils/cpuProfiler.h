@@ -0,0 +1,111 @@
+#pragma once
+#include "merlin/core/core.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Merlin {
+
+	struct CPUZoneRecord {
+		const char* name = nullptr; //literal or interned, stable for the whole run
+		GLuint thread = 0;	//CPUProfiler::threadName
+		GLuint depth = 0;	//nesting level in its thread
+		int64_t start = 0;	//ns on the steady clock, the GPU profiler uses the same clock
+		int64_t end = 0;
+	};
+
+	struct CPUFrameRecord {
+		size_t frame = 0;
+		int64_t start = 0;
+		int64_t end = 0;
+		std::vector<CPUZoneRecord> zones; //ended during the frame, every thread
+	};
+
+	struct CPUZoneStats {
+		double average = 0;	//ms per frame, running average
+		double last = 0;	//ms in the last frame
+		double max = 0;		//ms, worst frame
+		size_t calls = 0;	//in the last frame
+	};
+
+	// Wall clock time of named zones, on every thread.
+	// A zone ending appends one event to the buffer of its thread, the buffers are gathered once per frame by newFrame().
+	// MERLIN_PROFILE_SCOPE and MERLIN_GPU_ZONE compile to nothing when MERLIN_DISABLE_PROFILING is defined.
+	class CPUProfiler {
+		SINGLETON(CPUProfiler)
+		CPUProfiler() = default;
+
+	public:
+		void newFrame(); //gathers the events of every thread and starts the next frame, called by Application::run
+
+		inline void setEnabled(bool state) { m_enabled = state; }
+		inline bool isEnabled() const { return m_enabled; }
+
+		void setThreadName(const std::string& name); //of the calling thread, "Thread n" otherwise
+		std::string threadName(GLuint thread) const;
+		std::vector<std::string> threadNames() const; //indexed by CPUZoneRecord::thread
+
+		inline const std::deque<CPUFrameRecord>& frames() const { return m_frames; } //oldest first
+		inline const std::unordered_map<std::string_view, CPUZoneStats>& stats() const { return m_stats; }
+
+		void onImGuiRender(bool* open = nullptr);
+		bool exportChromeTrace(const std::string& path, bool gpu = true) const; //with the GPU zones of the same frames when gpu is set
+
+		const char* intern(const std::string& name); //stable copy of a zone name built at runtime
+
+		static constexpr size_t HISTORY_SIZE = 240; //frames kept for the breakdown and the trace
+		static constexpr double AVERAGE_WEIGHT = 0.05; //weight of the newest frame in the running averages
+
+	private:
+		friend class CPUZone;
+
+		struct ThreadBuffer {
+			GLuint id = 0;
+			GLuint depth = 0; //open zones, only touched by the owning thread
+			std::mutex mutex; //the owner appends, newFrame swaps
+			std::vector<CPUZoneRecord> events;
+		};
+
+		ThreadBuffer& buffer(); //of the calling thread, registered on first use
+
+		mutable std::mutex m_mutex; //threads, names
+		std::vector<std::shared_ptr<ThreadBuffer>> m_threads; //kept after their thread exits, the last events are still gathered
+		std::vector<std::string> m_threadNames;
+		std::unordered_set<std::string> m_interned;
+
+		std::deque<CPUFrameRecord> m_frames;
+		std::unordered_map<std::string_view, CPUZoneStats> m_stats;
+		std::vector<float> m_history; //main thread ms per frame
+		size_t m_frame = 0;
+		int64_t m_frameStart = 0;
+
+		bool m_enabled = true;
+	};
+
+	// Times the enclosing scope on the calling thread
+	class CPUZone {
+	public:
+		CPUZone(const char* name);
+		CPUZone(const std::string& name) : CPUZone(CPUProfiler::instance().intern(name)) {}
+		~CPUZone();
+
+	private:
+		const char* m_name;
+		int64_t m_start = 0;
+	};
+}
+
+#ifdef MERLIN_DISABLE_PROFILING
+#define MERLIN_PROFILE_SCOPE(name)
+#else
+#define MERLIN_PROFILE_CONCAT_(a, b) a##b
+#define MERLIN_PROFILE_CONCAT(a, b) MERLIN_PROFILE_CONCAT_(a, b)
+#define MERLIN_PROFILE_SCOPE(name) ::Merlin::CPUZone MERLIN_PROFILE_CONCAT(cpuZone_, __LINE__)(name)
+#endif
@@ -0,0 +1,204 @@
+#pragma once
+#include "merlin/core/core.h"
+#include "merlin/memory/ssbo.h"
+#include "merlin/shaders/computeShader.h"
+
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Merlin {
+
+	// Element types handled by the kernels, every primitive works on 32 bits scalars
+	enum class ScalarType {
+		UINT,
+		INT,
+		FLOAT
+	};
+
+	enum class ReduceOp {
+		SUM,
+		MIN,
+		MAX
+	};
+
+	template<typename T>
+	constexpr ScalarType scalarTypeOf() {
+		static_assert(std::is_same_v<T, GLuint> || std::is_same_v<T, GLint> || std::is_same_v<T, GLfloat>, "GPU primitives only support GLuint, GLint and GLfloat elements");
+		if constexpr (std::is_same_v<T, GLint>) return ScalarType::INT;
+		else if constexpr (std::is_same_v<T, GLfloat>) return ScalarType::FLOAT;
+		else return ScalarType::UINT;
+	}
+
+	// Reusable parallel algorithms on shader storage buffers : scan, reduction, key-value radix sort and stream compaction.
+	// Written for plain GL 4.3 compute (shared memory and barriers only, no subgroup operations).
+	// Kernels are compiled on first use for each element type, scratch buffers are kept and only grow.
+	// Every call ends with a shader storage barrier, the results can be used by the next dispatch right away.
+	class GPUPrimitives {
+		SINGLETON(GPUPrimitives)
+		GPUPrimitives() = default;
+
+	public:
+		// Buffer level API, count is in elements
+		void scan(AbstractBufferObject& input, AbstractBufferObject& output, GLuint count, ScalarType type, bool inclusive = false);
+		void reduce(AbstractBufferObject& input, AbstractBufferObject& result, GLuint count, ScalarType type, ReduceOp op); //result in result[0]
+		void sort(AbstractBufferObject& keys, AbstractBufferObject* values, GLuint count, ScalarType keyType, GLuint keyBits = 32); //stable, in place, sorts the low keyBits bits (4 per pass)
+		void compact(AbstractBufferObject& input, AbstractBufferObject& flags, AbstractBufferObject& output, GLuint count, ScalarType type); //number of kept elements in counter()
+
+		// Typed API, a count of 0 uses the whole input buffer
+		template<typename T> void exclusiveScan(SSBO<T>& input, SSBO<T>& output, GLuint count = 0);
+		template<typename T> void inclusiveScan(SSBO<T>& input, SSBO<T>& output, GLuint count = 0);
+		template<typename T> T reduce(SSBO<T>& input, ReduceOp op = ReduceOp::SUM, GLuint count = 0);
+		template<typename T> T sum(SSBO<T>& input, GLuint count = 0) { return reduce(input, ReduceOp::SUM, count); }
+		template<typename T> T min(SSBO<T>& input, GLuint count = 0) { return reduce(input, ReduceOp::MIN, count); }
+		template<typename T> T max(SSBO<T>& input, GLuint count = 0) { return reduce(input, ReduceOp::MAX, count); }
+		template<typename K> void sort(SSBO<K>& keys, GLuint count = 0, GLuint keyBits = 32);
+		template<typename K, typename V> void sort(SSBO<K>& keys, SSBO<V>& values, GLuint count = 0, GLuint keyBits = 32);
+		template<typename T> GLuint compact(SSBO<T>& input, SSBO<GLuint>& flags, SSBO<T>& output, GLuint count = 0); //flags are 0 or 1, reads the count back
+
+		inline SSBO<GLuint>& counter() { return *m_counter; } //kept elements of the last compaction, stays on the GPU
+
+		// Indirect arguments from a count that stays on the GPU (counter(), a count written with atomics...), read from counter[counterIndex].
+		// Both end with a command barrier : args can be passed to ComputeShader::dispatchIndirect or Mesh::drawIndirect right away.
+		void dispatchArgs(AbstractBufferObject& counter, AbstractBufferObject& args, GLuint groupSize, GLuint counterIndex = 0, GLuint scale = 1); //DispatchIndirectCommand, ceil(count * scale / groupSize) groups on a 2D grid past maxGroupCount()
+		void drawArgs(AbstractBufferObject& counter, AbstractBufferObject& args, bool indexed, GLuint elementCount = 0, GLuint counterIndex = 0, GLuint scale = 1); //elementCount > 0 : count instances of elementCount vertices, a single instance of count * scale vertices otherwise
+
+		static GLuint maxGroupCount(); //GL_MAX_COMPUTE_WORK_GROUP_COUNT along x, more groups go on a 2D grid
+
+		static constexpr GLuint WORKGROUP_SIZE = 256;
+		static constexpr GLuint SCAN_ITEMS = 4;		//elements per thread, 1024 per tile
+		static constexpr GLuint REDUCE_ITEMS = 16;	//elements per thread, 4096 per tile
+		static constexpr GLuint SORT_ITEMS = 4;		//keys per thread, 1024 per tile
+
+	private:
+		ComputeShader_Ptr kernel(const std::string& file, const std::string& entry, ScalarType type, const std::string& options = "", GLuint items = 1);
+		SSBO<GLuint>& scratch(const std::string& name, GLuint count);
+		void dispatch(ComputeShader& shader, GLuint groups, GLuint count);
+		void scanLevel(AbstractBufferObject& input, AbstractBufferObject& output, GLuint count, ScalarType type, bool inclusive, GLuint level);
+
+		std::unordered_map<std::string, ComputeShader_Ptr> m_kernels;
+		std::unordered_map<std::string, SSBO_Ptr<GLuint>> m_scratch;
+		SSBO_Ptr<GLuint> m_counter = nullptr;
+		SSBO_Ptr<GLuint> m_result = nullptr;
+	};
+
+	template<typename T>
+	void GPUPrimitives::exclusiveScan(SSBO<T>& input, SSBO<T>& output, GLuint count) {
+		scan(input, output, count ? count : GLuint(input.elements()), scalarTypeOf<T>(), false);
+	}
+
+	template<typename T>
+	void GPUPrimitives::inclusiveScan(SSBO<T>& input, SSBO<T>& output, GLuint count) {
+		scan(input, output, count ? count : GLuint(input.elements()), scalarTypeOf<T>(), true);
+	}
+
+	template<typename T>
+	T GPUPrimitives::reduce(SSBO<T>& input, ReduceOp op, GLuint count) {
+		if (!m_result) m_result = SSBO<GLuint>::create("primitives_result", 1, BufferUsage::DynamicRead);
+		reduce(input, *m_result, count ? count : GLuint(input.elements()), scalarTypeOf<T>(), op);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		T value;
+		m_result->readBuffer(sizeof(T), &value);
+		return value;
+	}
+
+	template<typename K>
+	void GPUPrimitives::sort(SSBO<K>& keys, GLuint count, GLuint keyBits) {
+		sort(keys, nullptr, count ? count : GLuint(keys.elements()), scalarTypeOf<K>(), keyBits);
+	}
+
+	template<typename K, typename V>
+	void GPUPrimitives::sort(SSBO<K>& keys, SSBO<V>& values, GLuint count, GLuint keyBits) {
+		static_assert(sizeof(V) == 4, "sorted values must be 32 bits (an index or a packed payload)");
+		sort(keys, &values, count ? count : GLuint(keys.elements()), scalarTypeOf<K>(), keyBits);
+	}
+
+	template<typename T>
+	GLuint GPUPrimitives::compact(SSBO<T>& input, SSBO<GLuint>& flags, SSBO<T>& output, GLuint count) {
+		compact(input, flags, output, count ? count : GLuint(input.elements()), scalarTypeOf<T>());
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		GLuint kept = 0;
+		m_counter->readBuffer(sizeof(GLuint), &kept);
+		return kept;
+	}
+
+
+	// Sequential versions of the primitives, reference results for the GPU kernels
+	namespace CPUPrimitives {
+
+		template<typename T>
+		std::vector<T> exclusiveScan(const std::vector<T>& input) {
+			std::vector<T> output(input.size());
+			std::exclusive_scan(input.begin(), input.end(), output.begin(), T(0));
+			return output;
+		}
+
+		template<typename T>
+		std::vector<T> inclusiveScan(const std::vector<T>& input) {
+			std::vector<T> output(input.size());
+			std::inclusive_scan(input.begin(), input.end(), output.begin());
+			return output;
+		}
+
+		template<typename T>
+		T reduce(const std::vector<T>& input, ReduceOp op) {
+			if (input.empty()) return T(0);
+			switch (op) {
+			case ReduceOp::MIN: return *std::min_element(input.begin(), input.end());
+			case ReduceOp::MAX: return *std::max_element(input.begin(), input.end());
+			default: return std::accumulate(input.begin(), input.end(), T(0));
+			}
+		}
+
+		// Same order preserving encoding as the GPU sort
+		template<typename K>
+		GLuint encodeKey(K key) {
+			GLuint bits;
+			memcpy(&bits, &key, sizeof(GLuint));
+			if constexpr (std::is_same_v<K, GLfloat>) return bits ^ ((bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u);
+			else if constexpr (std::is_same_v<K, GLint>) return bits ^ 0x80000000u;
+			else return bits;
+		}
+
+		// Stable LSD radix sort (8 bits per pass), values follow their keys.
+		// keyBits is rounded up to a multiple of 4 like the GPU sort.
+		template<typename K, typename V = GLuint>
+		void sort(std::vector<K>& keys, std::vector<V>* values = nullptr, GLuint keyBits = 32) {
+			keyBits = std::min((keyBits + 3) / 4 * 4, 32u);
+			std::vector<K> keysTmp(keys.size());
+			std::vector<V> valuesTmp(values ? values->size() : 0);
+			for (GLuint shift = 0; shift < keyBits; shift += 8) {
+				GLuint mask = (1u << std::min(8u, keyBits - shift)) - 1;
+				size_t offsets[257] = {};
+				for (const K& key : keys) offsets[((encodeKey(key) >> shift) & mask) + 1]++;
+				for (int i = 0; i < 256; i++) offsets[i + 1] += offsets[i];
+				for (size_t i = 0; i < keys.size(); i++) {
+					size_t destination = offsets[(encodeKey(keys[i]) >> shift) & mask]++;
+					keysTmp[destination] = keys[i];
+					if (values) valuesTmp[destination] = (*values)[i];
+				}
+				keys.swap(keysTmp);
+				if (values) values->swap(valuesTmp);
+			}
+		}
+
+		template<typename T>
+		std::vector<T> compact(const std::vector<T>& input, const std::vector<GLuint>& flags) {
+			std::vector<T> output;
+			for (size_t i = 0; i < input.size(); i++) if (flags[i]) output.push_back(input[i]);
+			return output;
+		}
+	}
+
+	struct PrimitiveBenchmarkResult {
+		std::string primitive;
+		GLuint count = 0;
+		double milliseconds = 0;	//GPU time of one call
+		double throughput = 0;		//millions of elements per second
+		bool valid = false;			//matches the CPU reference
+	};
+
+	// Times every primitive on uint data for each size, checks the results against the CPU reference and logs the throughput
+	std::vector<PrimitiveBenchmarkResult> benchmarkGPUPrimitives(const std::vector<GLuint>& sizes = { 1000000, 10000000, 100000000 }, GLuint iterations = 5);
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include "merlin/core/core.h"
+
+#include <array>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Merlin {
+
+	struct GPUZoneRecord {
+		GLuint name = 0;	//GPUProfiler::zoneName
+		GLuint depth = 0;	//nesting level in the frame
+		int64_t start = 0;	//ns on the steady clock, the GPU timestamps are shifted onto the CPU clock
+		int64_t end = 0;
+	};
+
+	struct GPUFrameRecord {
+		size_t frame = 0;
+		int64_t start = 0; //first zone of the frame
+		int64_t end = 0; //last zone of the frame
+		std::vector<GPUZoneRecord> zones;
+	};
+
+	struct GPUZoneStats {
+		double average = 0;	//ms per frame, running average
+		double last = 0;	//ms in the last frame read back
+		double max = 0;		//ms, worst frame
+		size_t calls = 0;	//in the last frame read back
+		size_t frame = 0;	//last frame read back with this zone
+	};
+
+	// GPU time of named zones, measured with GL_TIMESTAMP queries written at both ends of a zone.
+	// Each frame in flight has its own pool of queries, the frames are read back FRAME_LATENCY frames later.
+	// A frame whose queries are still not available when its pool comes around again is dropped, the CPU never waits for the GPU.
+	// Zones are recorded from the thread owning the main context only.
+	class GPUProfiler {
+		SINGLETON(GPUProfiler)
+		GPUProfiler() = default;
+
+	public:
+		bool begin(const std::string& name); //false when the zone is not recorded (disabled, other thread)
+		void end();
+		void newFrame(); //closes the frame and reads back the frames the GPU is done with, called by Application::run
+		void shutdown(); //deletes the queries, call while the context is alive
+
+		inline void setEnabled(bool state) { m_enabled = state; }
+		inline bool isEnabled() const { return m_enabled; }
+
+		inline const std::deque<GPUFrameRecord>& frames() const { return m_frames; } //oldest first
+		inline const std::string& zoneName(GLuint id) const { return m_names[id]; }
+		inline const std::vector<GPUZoneStats>& stats() const { return m_stats; } //indexed by zone name
+		inline size_t dropped() const { return m_dropped; }
+
+		void onImGuiRender(bool* open = nullptr);
+		bool exportChromeTrace(const std::string& path) const;
+		void writeTraceEvents(std::ostream& out, int64_t origin, bool& first) const; //"X" events of the GPU track, times relative to origin (ns)
+
+		static int64_t now(); //ns on the steady clock
+
+		static constexpr GLuint FRAME_LATENCY = 4;
+		static constexpr size_t HISTORY_SIZE = 240; //frames kept for the timeline and the trace
+		static constexpr double AVERAGE_WEIGHT = 0.05; //weight of the newest frame in the running averages
+
+	private:
+		struct PendingZone {
+			GLuint name;
+			GLuint depth;
+			GLuint begin; //query indices in the frame pool
+			GLuint end;
+		};
+
+		struct FramePool {
+			std::vector<GLuint> queries;
+			GLuint used = 0;
+			std::vector<PendingZone> zones;
+			size_t frame = 0;
+			int64_t offset = 0; //CPU minus GPU clock when the frame was recorded
+			bool pending = false;
+		};
+
+		void initialize();
+		void calibrate();
+		GLuint query(FramePool& pool);
+		GLuint nameId(const std::string& name);
+		bool collect(FramePool& pool); //false while the GPU is not done with the frame
+
+		std::array<FramePool, FRAME_LATENCY> m_pools;
+		GLuint m_current = 0;
+		std::vector<GLuint> m_stack; //open zones of the current frame
+
+		std::vector<std::string> m_names;
+		std::unordered_map<std::string, GLuint> m_ids;
+		std::vector<GPUZoneStats> m_stats;
+		std::deque<GPUFrameRecord> m_frames;
+		std::vector<float> m_history; //GPU ms per frame
+
+		size_t m_frame = 0;
+		size_t m_calibrated = 0; //frame of the last calibration
+		size_t m_dropped = 0;
+		int64_t m_offset = 0;
+		std::thread::id m_thread;
+
+		bool m_enabled = true;
+		bool m_initialized = false;
+	};
+
+	// Times the GPU work issued in the enclosing scope
+	class GPUZone {
+	public:
+		GPUZone(const std::string& name) : m_active(GPUProfiler::instance().begin(name)) {}
+		~GPUZone() { if (m_active) GPUProfiler::instance().end(); }
+
+	private:
+		bool m_active;
+	};
+}
+
+#ifdef MERLIN_DISABLE_PROFILING
+#define MERLIN_GPU_ZONE(name)
+#else
+#define MERLIN_GPU_CONCAT_(a, b) a##b
+#define MERLIN_GPU_CONCAT(a, b) MERLIN_GPU_CONCAT_(a, b)
+#define MERLIN_GPU_ZONE(name) ::Merlin::GPUZone MERLIN_GPU_CONCAT(gpuZone_, __LINE__)(name)
+#endif
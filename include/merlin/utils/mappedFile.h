@@ -0,0 +1,46 @@
+#pragma once
+#include "merlin/core/core.h"
+
+#include <cstdint>
+#include <string>
+
+namespace Merlin {
+
+	// File mapped in the address space of the process. Reads are served by the OS page cache,
+	// nothing is copied or parsed until the pages are touched.
+	class MappedFile {
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::string& path); //read only mapping of an existing file
+		bool create(const std::string& path, size_t size); //creates (or truncates) the file with the given size, mapped read write
+		bool flush(); //writes the dirty pages back to the file
+		void close();
+
+		inline bool isOpen() const { return m_data != nullptr; }
+		inline bool isWritable() const { return m_writable; }
+		inline size_t size() const { return m_size; }
+		inline const uint8_t* data() const { return m_data; }
+		inline uint8_t* data() { return m_writable ? m_data : nullptr; }
+		inline const std::string& path() const { return m_path; }
+
+		static size_t pageSize();
+
+	private:
+		std::string m_path;
+		uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+		bool m_writable = false;
+
+#ifdef GLCORE_PLATFORM_WINDOWS
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#else
+		int m_file = -1;
+#endif
+	};
+}
@@ -4,6 +4,13 @@
 #include "merlin/core/log.h"
 #include "merlin/core/input.h"
 #include "merlin/graphics/ressourceManager.h"
+#include "merlin/memory/streamBuffer.h"
+#include "merlin/memory/memoryTracker.h"
+#include "merlin/memory/bufferObject.h"
+#include "merlin/physics/checkpoint.h"
+#include "merlin/shaders/shaderCompiler.h"
+#include "merlin/utils/gpuProfiler.h"
+#include "merlin/utils/cpuProfiler.h"
 #include <glfw/glfw3.h>
 
 
@@ -22,6 +29,7 @@ namespace Merlin {
  
 		GLCORE_ASSERT(!s_Instance, "Application", "Application already exists!");
 		s_Instance = this;
+		CPUProfiler::instance().setThreadName("Main");
 
 
 		initWindow(name, width, height, vsync, multisampling, fullscreen);
@@ -106,17 +114,45 @@ namespace Merlin {
 			Timestep timestep = time - m_LastFrameTime;
 			m_LastFrameTime = time;
 
-			for (Layer* layer : m_LayerStack)
-				layer->onUpdate(timestep);
-
-			m_ImGuiLayer->begin();
-			for (Layer* layer : m_LayerStack)
-				layer->onImGuiRender();
-			m_ImGuiLayer->end();
+			{
+				MERLIN_PROFILE_SCOPE("Application::flush");
+				AbstractBufferObject::flushAll(); //upload the shadow copy edits made since the last frame
+			}
 
-			m_Window->onUpdate();
+			for (Layer* layer : m_LayerStack) {
+				MERLIN_PROFILE_SCOPE(layer->getName());
+				layer->onUpdate(timestep);
+			}
+
+			{
+				MERLIN_PROFILE_SCOPE("Application::imgui");
+				m_ImGuiLayer->begin();
+				for (Layer* layer : m_LayerStack)
+					layer->onImGuiRender();
+				m_ImGuiLayer->end();
+			}
+
+			{
+				MERLIN_PROFILE_SCOPE("Application::endFrame");
+				StreamBuffer::instance().endFrame();
+				MemoryTracker::instance().newFrame();
+				GPUProfiler::instance().newFrame(); //reads back the timings of the frames the GPU is done with
+				CheckpointWriter::instance().poll(); //hands the snapshots whose GPU copies are done to the writer thread
+				ShaderCompiler::instance().poll(); //swaps the programs built in the background in, hot reload
+			}
+			{
+				MERLIN_PROFILE_SCOPE("Application::present");
+				m_Window->onUpdate();
+			}
+			CPUProfiler::instance().newFrame(); //gathers the zones of every thread, last so the whole frame is in
 
 		}
+
+		//the context is still alive, finish the pending checkpoints before leaving
+		CheckpointWriter::instance().wait();
+		ShaderCompiler::instance().shutdown();
+		GPUProfiler::instance().shutdown();
+		StreamBuffer::instance().shutdown();
 	}
 
 	bool Application::onWindowClose(WindowCloseEvent& e)
@@ -2,6 +2,8 @@
 #include "merlin/graphics/mesh.h"
 #include "merlin/memory/ibo.h"
 #include "merlin/utils/voxelizer.h"
+#include "merlin/utils/cpuProfiler.h"
+#include "merlin/memory/memoryTracker.h"
 
 #include <unordered_map>
 #include <vector>
@@ -29,9 +31,7 @@ namespace Merlin {
 		m_vertices.push_back({ glm::vec3(0,0,0) });
 		m_elementCount = 1;
 
-		m_vao = createShared<VAO>();
-		VBO vbo(m_vertices);
-		m_vao->addBuffer(vbo, Vertex::getLayout());
+		createBuffers();
 
 		computeBoundingBox();
 		Console::trace("Mesh") << "Loaded " << m_vertices.size() << " vertices." << Console::endl;
@@ -60,11 +60,7 @@ namespace Merlin {
 		m_drawMode = mode;
 		m_vertices = vertices;
 		m_elementCount = m_vertices.size();
-		m_vao = createShared<VAO>();
-		VBO vbo(m_vertices);
-		EBO ebo(m_indices);
-		m_vao->addBuffer(vbo, Vertex::getLayout());
-		m_vao->bindBuffer(ebo);
+		createBuffers();
 		computeBoundingBox();
 		Console::info("Mesh") << "Loaded " << m_vertices.size() << " vertices." << Console::endl;
 	}
@@ -76,12 +72,7 @@ namespace Merlin {
 		m_indices = indices;
 		m_elementCount = m_indices.size();
 		// Create VAO, VBO, EBO
-		m_vao = createShared<VAO>();
-		VBO vbo(m_vertices);
-		EBO ebo(m_indices);
-		// Add VBO and EBO to VAO using DSA
-		m_vao->addBuffer(vbo, Vertex::getLayout());
-		m_vao->bindBuffer(ebo);
+		createBuffers();
 		computeBoundingBox();
 		Console::info("Mesh") << "Loaded " << m_vertices.size() << " vertices." << Console::endl;
 	}
@@ -106,6 +97,10 @@ namespace Merlin {
 
 
 	void Mesh::draw() const {
+		if (m_indirectArgs) {
+			drawIndirect(*m_indirectArgs);
+			return;
+		}
 		glBindVertexArray(m_vao->id());
 		if (m_indices.size() > 0) glDrawElements(m_drawMode, m_elementCount, GL_UNSIGNED_INT, 0); //draw elements using EBO
 		else glDrawArrays(m_drawMode, 0, m_elementCount); //draw
@@ -119,9 +114,20 @@ namespace Merlin {
 		glBindVertexArray(0);
 	}
 
+	void Mesh::drawIndirect(const AbstractBufferObject& args, GLintptr offset) const {
+		glBindVertexArray(m_vao->id());
+		args.bindAs(GL_DRAW_INDIRECT_BUFFER);
+		const void* command = reinterpret_cast<const void*>(args.offset() + offset);
+		if (m_indices.size() > 0) glDrawElementsIndirect(m_drawMode, GL_UNSIGNED_INT, command); //DrawElementsIndirectCommand
+		else glDrawArraysIndirect(m_drawMode, command); //DrawArraysIndirectCommand
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+
 
 
 	void Mesh::smoothNormals() {
+		MERLIN_PROFILE_SCOPE("Mesh::smoothNormals");
 		// Clear any existing normals in the vertex data
 		for (auto& vertex : m_vertices) {
 			vertex.normal = glm::vec3(0.0f);
@@ -154,19 +160,22 @@ namespace Merlin {
 			vertex.normal = glm::normalize(normalMap[vertex.position]);
 		}
 
-		// Update the Vertex Array Object (VAO) with the new normals
-		updateVAO();
+		// Upload the new normals, the indices did not change
+		updateVertices();
 	}
 
 	void Mesh::voxelize(float size) {
+		MERLIN_PROFILE_SCOPE("Mesh::voxelize");
 		m_voxels = Voxelizer::voxelize(*this, size);
 	}
 
 	void Mesh::voxelizeSurface(float size, float thickness){
+		MERLIN_PROFILE_SCOPE("Mesh::voxelizeSurface");
 		m_voxels = Voxelizer::voxelizeSurface(*this, size, thickness);
 	}
 
 	void Mesh::computeBoundingBox() {
+		MERLIN_PROFILE_SCOPE("Mesh::computeBoundingBox");
 		glm::mat4 modelMat = globalTransform();
 		glm::vec3 min(FLT_MAX), max(-FLT_MAX);
 		for (const auto& vertex : m_vertices) {
@@ -191,6 +200,7 @@ namespace Merlin {
 
 
 	void Mesh::computeNormals(){
+		MERLIN_PROFILE_SCOPE("Mesh::computeNormals");
 		// Initialize all normals to zero
 		for (auto& vertex : m_vertices) {
 			vertex.normal = glm::vec3(0);
@@ -224,14 +234,12 @@ namespace Merlin {
 			vertex.normal = glm::normalize(vertex.normal);
 		}
 
-		//Update VAO, VBO
-		VBO vbo(m_vertices);
-		EBO ebo(m_indices);
-		m_vao->bindBuffer(ebo);
-		m_vao->addBuffer(vbo, Vertex::getLayout());
+		//Upload the new normals, the indices did not change
+		updateVertices();
 	}
 
 	void Mesh::calculateIndices() {
+		MERLIN_PROFILE_SCOPE("Mesh::calculateIndices");
 		Console::info("Mesh") << "Recomputing Mesh indices and removing duplicate vertices.." << Console::endl;
 
 		Vertices newVertices;
@@ -269,16 +277,125 @@ namespace Merlin {
 
 
 
+	void Mesh::createBuffers() {
+		MERLIN_MEMORY_SCOPE("Mesh " + name());
+		//a new VAO, attributes of a previous format must not stay enabled
+		m_vao = createShared<VAO>();
+		m_vbo = nullptr;
+		m_ebo = nullptr;
+
+		if (!m_vertices.empty()) {
+			m_vbo = createShared<VBO<GLubyte>>(packVertices(m_vertices, m_vertexFormat));
+			m_vbo->rename(name() + "_vbo");
+			m_vao->addBuffer(*m_vbo, getVertexLayout(m_vertexFormat));
+		}
+		if (!m_indices.empty()) {
+			m_ebo = createShared<IBO>(m_indices);
+			m_ebo->rename(name() + "_ebo");
+			m_vao->bindBuffer(*m_ebo);
+		}
+	}
+
 	void Mesh::updateVAO() {
-		//Update VAO, VBO
-		VBO vbo(m_vertices);
-		EBO ebo(m_indices);
-		m_vao->bindBuffer(ebo);
-		m_vao->addBuffer(vbo, Vertex::getLayout());
+		MERLIN_PROFILE_SCOPE("Mesh::updateVAO");
+		if (!m_vertices.empty()) m_elementCount = hasIndices() ? m_indices.size() : m_vertices.size();
+		if (m_autoVertexFormat) {
+			VertexFormat format = chooseVertexFormat();
+			if (format != m_vertexFormat) {
+				m_vertexFormat = format;
+				createBuffers();
+				return;
+			}
+		}
+
+		updateVertices();
+		updateIndices();
+	}
+
+	void Mesh::updateVertices(GLsizeiptr first, GLsizeiptr count) {
+		GLsizeiptr total = m_vertices.size();
+		first = std::clamp(first, GLsizeiptr(0), total);
+		if (count < 0 || first + count > total) count = total - first;
+
+		//the automatic format is only re-evaluated on full updates, a partial update keeps the current one
+		VertexFormat format = m_autoVertexFormat && first == 0 && count == total ? chooseVertexFormat() : m_vertexFormat;
+		if (!m_vbo || format != m_vertexFormat) {
+			m_vertexFormat = format;
+			if (total > 0) createBuffers();
+			return;
+		}
+
+		GLsizeiptr stride = vertexSize(m_vertexFormat);
+		if (m_vbo->size() != total * stride) {
+			//the vertex count changed, the storage only gets reallocated when it grows past its capacity
+			GLuint previous = m_vbo->id();
+			m_vbo->resize(total * stride);
+			if (m_vbo->id() != previous) m_vao->bindBuffer(*m_vbo, getVertexLayout(m_vertexFormat));
+			first = 0;
+			count = total;
+		}
+		if (count == 0) return;
+
+		m_vbo->writeRange(first * stride, packVertices(m_vertices.data() + first, count, m_vertexFormat));
+	}
+
+	void Mesh::updateVertices(GLsizeiptr first, const std::vector<Vertex>& vertices) {
+		if (first < 0) return;
+		if (first + vertices.size() > m_vertices.size()) m_vertices.resize(first + vertices.size());
+		std::copy(vertices.begin(), vertices.end(), m_vertices.begin() + first);
+		updateVertices(first, vertices.size());
+	}
+
+	void Mesh::updateIndices() {
+		if (m_indices.empty()) return;
+		if (!m_ebo) {
+			MERLIN_MEMORY_SCOPE("Mesh " + name());
+			m_ebo = createShared<IBO>(m_indices);
+			m_ebo->rename(name() + "_ebo");
+			m_vao->bindBuffer(*m_ebo);
+			return;
+		}
+
+		GLuint previous = m_ebo->id();
+		if (m_ebo->size() != GLsizeiptr(m_indices.size() * sizeof(GLuint))) m_ebo->resize(m_indices.size());
+		if (m_ebo->id() != previous) m_vao->bindBuffer(*m_ebo);
+		m_ebo->write(m_indices);
+	}
+
+	void Mesh::setVertexFormat(VertexFormat format) {
+		m_autoVertexFormat = format == VertexFormat::AUTO;
+		VertexFormat resolved = m_autoVertexFormat ? chooseVertexFormat() : format;
+		if (resolved == m_vertexFormat) return;
+		m_vertexFormat = resolved;
+		if (m_vertices.empty()) return; //built from an external buffer, nothing to repack
+
+		createBuffers();
+		Console::info("Mesh") << name() << " uses " << vertexFormatToString(m_vertexFormat) << " vertices ("
+			<< vertexSize(m_vertexFormat) * m_vertices.size() / 1024 << " KB instead of " << sizeof(Vertex) * m_vertices.size() / 1024 << " KB)" << Console::endl;
+	}
+
+	VertexFormat Mesh::chooseVertexFormat() const {
+		//half floats keep a sub texel precision on 1024 textures up to |uv| = 2
+		static constexpr float maxCompactTexCoord = 2.0f;
+
+		bool hasNormals = false, hasTexCoords = false, hasTangents = false;
+		float maxTexCoord = 0.0f;
+		for (const Vertex& vertex : m_vertices) {
+			if (vertex.color != glm::vec3(1.0f)) return VertexFormat::FULL; //vertex colors are only stored in the full format
+			hasNormals |= vertex.normal != glm::vec3(0.0f);
+			hasTexCoords |= vertex.texCoord != glm::vec2(0.0f);
+			hasTangents |= vertex.tangent != glm::vec3(0.0f);
+			maxTexCoord = glm::max(maxTexCoord, glm::max(glm::abs(vertex.texCoord.x), glm::abs(vertex.texCoord.y)));
+		}
+
+		if (hasTexCoords || hasTangents) return maxTexCoord <= maxCompactTexCoord ? VertexFormat::COMPACT : VertexFormat::FULL;
+		if (hasNormals) return VertexFormat::POSITION_NORMAL;
+		return VertexFormat::POSITION;
 	}
 
 
 	void Mesh::removeUnusedVertices() {
+		MERLIN_PROFILE_SCOPE("Mesh::removeUnusedVertices");
 		Console::info("Mesh") << "Removing unused vertices.." << Console::endl;
 
 		std::vector<bool> usedVertices(m_vertices.size(), false);
@@ -307,21 +424,23 @@ namespace Merlin {
 	}
 
 	void Mesh::applyMeshTransform(){
+		MERLIN_PROFILE_SCOPE("Mesh::applyMeshTransform");
 		for (auto& vertex : m_vertices) {
 			vertex.position = transform() * glm::vec4(vertex.position,1.0);
 			vertex.normal = transform() * glm::vec4(vertex.normal,0.0);
 		}
 		computeBoundingBox();
-		updateVAO();
+		updateVertices();
 		setTransform(glm::mat4(1));
 	}
 
 	void Mesh::centerMeshOrigin(){
+		MERLIN_PROFILE_SCOPE("Mesh::centerMeshOrigin");
 		computeBoundingBox();
 		for (auto& vertex : m_vertices) {
 			vertex.position -= m_bbox.centroid;
 		}
-		updateVAO();
+		updateVertices();
 		setTransform(glm::mat4(1));
 		translate(m_bbox.centroid);
 		computeBoundingBox();
@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "merlin/core/core.h"
 #include "merlin/graphics/renderer.h"
+#include "merlin/utils/gpuProfiler.h"
+#include "merlin/utils/cpuProfiler.h"
+#include "merlin/memory/memoryTracker.h"
 
 
 
@@ -35,13 +38,15 @@ namespace Merlin {
 	}
 
 	void Renderer::renderScene(const Scene& scene, const Camera& camera) {
+		MERLIN_PROFILE_SCOPE("Renderer::renderScene");
 		if (debug)Console::info() << "Rendering scene" << Console::endl;
 
 		//Gather lights
-	
-
-		for (const auto& node : scene.nodes()) {
-			if (!node->isHidden()) gatherLights(node);
+		{
+			MERLIN_PROFILE_SCOPE("Renderer::gatherLights");
+			for (const auto& node : scene.nodes()) {
+				if (!node->isHidden()) gatherLights(node);
+			}
 		}
 
 		if(debug)Console::info() << "Rendering scene shadows" << Console::endl;
@@ -54,6 +59,7 @@ namespace Merlin {
 		}
 
 		if (use_shadows) {
+			MERLIN_PROFILE_SCOPE("Renderer::shadows");
 			if (useFaceCulling()) glDisable(GL_CULL_FACE);
 			for (const auto& light : m_activeLights) {
 				if (!light->castShadow()) continue;
@@ -61,14 +67,19 @@ namespace Merlin {
 			}
 			if (useFaceCulling()) glEnable(GL_CULL_FACE);
 		}
+		m_frameDataDirty = true; //lights gathered, light space matrices updated
 		
 		camera.restoreViewport();
 		//Render the scene
 		if (debug)Console::info() << "Rendering scene objects" << Console::endl;
-		for (const auto& node : scene.nodes()) {
-			if(!node->isHidden()) render(node, camera);
+		{
+			MERLIN_PROFILE_SCOPE("Renderer::objects");
+			for (const auto& node : scene.nodes()) {
+				if(!node->isHidden()) render(node, camera);
+			}
 		}
 
+		MERLIN_PROFILE_SCOPE("Renderer::environment");
 		if (scene.hasEnvironment()) {
 			m_currentEnvironment = scene.getEnvironment();
 			renderEnvironment(*m_currentEnvironment, camera);
@@ -79,6 +90,69 @@ namespace Merlin {
 	}
 
 
+	void Renderer::syncFrameData(const Camera& camera) {
+		bool created = !m_frameData;
+		if (created) {
+			MERLIN_MEMORY_SCOPE("Renderer frame data");
+			m_frameData = UBO<FrameData>::create("FrameData");
+			m_lightData = SSBO<LightData>::create("LightBuffer", 1, BufferUsage::DynamicDraw);
+
+			//the last units are kept for the shadow maps, materials are given units from 0
+			GLint units = 0;
+			glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &units);
+			m_shadowUnitBase = std::max(units - 2 * MAX_SHADOW_MAPS, 0);
+		}
+
+		if (m_frameDataDirty) {
+			m_frameDataDirty = false;
+			std::vector<LightData> lights(std::max<size_t>(m_activeLights.size(), 1));
+			for (int i = 0; i < m_activeLights.size(); i++) {
+				m_activeLights[i]->pack(lights[i]);
+				if (i >= MAX_SHADOW_MAPS) lights[i].castShadow = 0;
+
+				//bound for the whole frame, 2D maps first then cube maps
+				Shared<TextureBase> shadowMap = m_activeLights[i]->shadowMap();
+				if (lights[i].castShadow && shadowMap) {
+					bool cube = shadowMap->textureClass() == TextureClass::CUBE_MAP;
+					shadowMap->bind(m_shadowUnitBase + i + (cube ? MAX_SHADOW_MAPS : 0));
+				}
+			}
+			m_lightData->resize(lights.size());
+			m_lightData->write(lights);
+		}
+
+		//the camera may change between two render calls of the same frame, the block is only written when it does
+		FrameData frame;
+		frame.view = camera.getViewMatrix();
+		frame.projection = camera.getProjectionMatrix();
+		frame.viewPos = camera.getPosition();
+		frame.numLights = GLint(m_activeLights.size());
+		frame.useShadows = use_shadows;
+		if (created || memcmp(&frame, &m_frameDataCache, sizeof(FrameData)) != 0) {
+			m_frameData->write(frame);
+			m_frameDataCache = frame;
+		}
+	}
+
+	bool Renderer::attachFrameData(Shader& shader, const Camera& camera) {
+		if (!shader.hasUniformBlock("FrameData")) return false;
+		syncFrameData(camera);
+		shader.attach(*m_frameData);
+		if (!shader.hasStorageBlock("LightBuffer")) return true;
+		shader.attach(*m_lightData);
+
+		//the sampler arrays always point to the reserved units, set once per program
+		auto synced = m_shadowSamplers.find(shader.id());
+		if (synced == m_shadowSamplers.end() || synced->second != shader.generation()) {
+			GLint units[2 * MAX_SHADOW_MAPS];
+			for (int i = 0; i < 2 * MAX_SHADOW_MAPS; i++) units[i] = m_shadowUnitBase + i;
+			if (shader.hasUniform("shadowMaps")) shader.setIntArray("shadowMaps", units, MAX_SHADOW_MAPS);
+			if (shader.hasUniform("omniShadowMaps")) shader.setIntArray("omniShadowMaps", units + MAX_SHADOW_MAPS, MAX_SHADOW_MAPS);
+			m_shadowSamplers[shader.id()] = shader.generation();
+		}
+		return true;
+	}
+
 	void Renderer::renderEnvironment(const Environment& env, const Camera& camera){
 		if(debug)Console::info() << "Rendering Environment" << Console::endl;
 		if (!use_environment) return;
@@ -87,6 +161,7 @@ namespace Merlin {
 			Console::error("Renderer") << "Renderer failed to gather materials and shaders" << Console::endl;
 			return;
 		}
+		if (!shader->isCompiled()) return; //still building in the background
 		glDepthFunc(GL_LEQUAL);
 		if(useFaceCulling())glDisable(GL_CULL_FACE);
 		shader->use();
@@ -132,6 +207,7 @@ namespace Merlin {
 			Console::error("Renderer") << "Renderer failed to gather materials and shaders" << Console::endl;
 			return;
 		}
+		if (!shader->isCompiled()) return; //still building in the background
 		//Texture2D::resetTextureUnits();
 		shader->use();
 		shader->setVec3("light_color", li.diffuse() + li.ambient() + li.specular());
@@ -168,11 +244,17 @@ namespace Merlin {
 			Console::error("Renderer") << "Renderer failed to gather materials and shaders" << Console::endl;
 			return;
 		}
+		if (!shader->isCompiled()) return; //still building in the background
+		MERLIN_GPU_ZONE(mesh.name());
 
 		Texture2D::resetTextureUnits();
 		shader->use();
 
-		if (shader->supportLights()) {
+		//camera and lights come from the per frame buffers, shaders without the blocks get them as uniforms
+		const bool frameData = attachFrameData(*shader, camera);
+		const bool lightUniforms = !frameData && shader->supportLights();
+
+		if (lightUniforms) {
 			for (int i = 0; i < m_activeLights.size(); i++) {
 				m_activeLights[i]->attach(i, *shader);
 			}
@@ -184,16 +266,25 @@ namespace Merlin {
 			m_currentEnvironment->attach(*shader);
 		else m_defaultEnvironment->attach(*shader);
 
-		if (shader->supportLights()) shader->setVec3("viewPos", camera.getPosition()); //sync model matrix with GPU
 		shader->setMat4("model", m_currentTransform); //sync model matrix with GPU
-		shader->setMat4("view", camera.getViewMatrix()); //sync model matrix with GPU
 		if(shader->supportLights()) shader->setInt("use_flat_shading", mesh.useFlatShading());
-		if(shader->supportShadows()) shader->setInt("useShadows", use_shadows);
 
-		shader->setMat4("projection", camera.getProjectionMatrix()); //sync model matrix with GPU
-		if (shader->supportLights()) shader->setInt("numLights", m_activeLights.size());
+		if (!frameData) {
+			if (shader->supportLights()) shader->setVec3("viewPos", camera.getPosition());
+			shader->setMat4("view", camera.getViewMatrix());
+			shader->setMat4("projection", camera.getProjectionMatrix());
+			if (shader->supportShadows()) shader->setInt("useShadows", use_shadows);
+			if (shader->supportLights()) shader->setInt("numLights", m_activeLights.size());
+		}
 
 		if (shader->supportMaterial()) shader->setInt("use_vertex_color", mesh.useVertexColors());
+		//shaders declaring the vertex_format uniform decode the compact formats (pbr.model.vert), flagged or not
+		if (shader->supportVertexFormats() || shader->hasUniform("vertex_format")) shader->setInt("vertex_format", int(mesh.getVertexFormat()));
+		else if (mesh.getVertexFormat() != VertexFormat::FULL) {
+			static std::unordered_set<std::string> warned;
+			if (warned.insert(mesh.name()).second)
+				Console::warn("Renderer") << "shader " << shader->name() << " cannot decode the " << vertexFormatToString(mesh.getVertexFormat()) << " vertices of mesh " << mesh.name() << Console::endl;
+		}
 
 		mesh.draw();
 		mat->detach();
@@ -204,7 +295,7 @@ namespace Merlin {
 			else m_defaultEnvironment->detach();
 		}
 
-		if(shader->supportLights()) {
+		if(lightUniforms) {
 			for (int i = 0; i < m_activeLights.size(); i++) {
 				m_activeLights[i]->detach();
 			}
@@ -228,6 +319,8 @@ namespace Merlin {
 			Console::error("Renderer") << "Renderer failed to gather ressoureces for shadows (shader, framebuffer or texture)" << Console::endl;
 			return;
 		}
+		if (!shader->isCompiled()) return; //still building in the background
+		MERLIN_GPU_ZONE("castShadow");
 
 		glViewport(0, 0, light->shadowResolution(), light->shadowResolution());
 		fbo->bind();
@@ -250,6 +343,7 @@ namespace Merlin {
 	
 	void Renderer::renderParticleSystem(const ParticleSystem& ps, const Camera& camera) {
 		if (debug)Console::info() << "Rendering Particle System" << Console::endl;
+		ps.updateDrawArgs(); //GPU side active count, runs a kernel : before the shader is bound
 		if (ps.getDisplayMode() != ParticleSystemDisplayMode::MESH) {
 			Shader_Ptr shader = nullptr;
 
@@ -266,12 +360,15 @@ namespace Merlin {
 				Console::error("Renderer") << "Renderer failed to gather materials and shaders" << Console::endl;
 				return;
 			}
+			if (!shader->isCompiled()) return; //still building in the background
 
 			shader->use();
-			shader->setVec3("viewPos", camera.getPosition()); //sync model matrix with GPU
 			shader->setMat4("model", m_currentTransform); //sync model matrix with GPU
-			shader->setMat4("view", camera.getViewMatrix()); //sync model matrix with GPU
-			shader->setMat4("projection", camera.getProjectionMatrix()); //sync model matrix with GPU
+			if (!attachFrameData(*shader, camera)) {
+				shader->setVec3("viewPos", camera.getPosition());
+				shader->setMat4("view", camera.getViewMatrix());
+				shader->setMat4("projection", camera.getProjectionMatrix());
+			}
 
 			if (ps.hasField("position")) {
 				AbstractBufferObject_Ptr pos = ps.getField("position");
@@ -295,11 +392,15 @@ namespace Merlin {
 				Console::error("Renderer") << "Renderer failed to gather materials and shaders" << Console::endl;
 				return;
 			}
+			if (!shader->isCompiled()) return; //still building in the background
 
 			Texture2D::resetTextureUnits();
 			shader->use();
 
-			if(shader->supportLights())
+			const bool frameData = attachFrameData(*shader, camera);
+			const bool lightUniforms = !frameData && shader->supportLights();
+
+			if(lightUniforms)
 			for (int i = 0; i < m_activeLights.size(); i++) {
 				m_activeLights[i]->attach(i, *shader);
 			}
@@ -312,13 +413,15 @@ namespace Merlin {
 				else m_defaultEnvironment->attach(*shader);
 			}
 
-			if (shader->supportLights()) shader->setVec3("viewPos", camera.getPosition()); //sync model matrix with GPU
 			shader->setMat4("model", m_currentTransform); //sync model matrix with GPU
-			shader->setMat4("view", camera.getViewMatrix()); //sync model matrix with GPU
-			if (shader->supportShadows())shader->setInt("useShadows", use_shadows);
 
-			shader->setMat4("projection", camera.getProjectionMatrix()); //sync model matrix with GPU
-			if (shader->supportLights()) shader->setInt("numLights", m_activeLights.size());
+			if (!frameData) {
+				if (shader->supportLights()) shader->setVec3("viewPos", camera.getPosition());
+				shader->setMat4("view", camera.getViewMatrix());
+				shader->setMat4("projection", camera.getProjectionMatrix());
+				if (shader->supportShadows()) shader->setInt("useShadows", use_shadows);
+				if (shader->supportLights()) shader->setInt("numLights", m_activeLights.size());
+			}
 
 			ps.draw();
 			mat->detach();
@@ -329,7 +432,7 @@ namespace Merlin {
 				else m_defaultEnvironment->detach();
 			}
 
-			if (shader->supportLights())
+			if (lightUniforms)
 			for (int i = 0; i < m_activeLights.size(); i++) {
 				m_activeLights[i]->detach();
 			}
@@ -33,6 +33,7 @@ namespace Merlin {
 
 		resetMatrix();
 		m_activeLights.clear();
+		m_frameDataDirty = true;
 		Texture2D::resetTextureUnits();
 	}
 
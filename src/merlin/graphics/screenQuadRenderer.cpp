@@ -12,6 +12,7 @@ namespace Merlin {
 
 	void ScreenQuadRenderer::render() {
 		if (!m_shader) return;
+		if (!m_shader->isCompiled()) return; //still building in the background
 		m_shader->use(); //Activate shader
 		glBindVertexArray(m_vao.id());
 		glDisable(GL_DEPTH_TEST);
@@ -22,6 +23,7 @@ namespace Merlin {
 
 	void ScreenQuadRenderer::render(const Shared<TextureBase>& tex) {
 		if (!m_shader) return;
+		if (!m_shader->isCompiled()) return; //still building in the background
 		tex->bind(); //bind texture
 		m_shader->use(); //Activate shader
 
@@ -3,80 +3,190 @@
 
 namespace Merlin {
 
-    GLuint BindingPointManager::allocateBindingPoint(BufferTarget bufferType, GLuint bufferID) {
+    GLuint BindingPointManager::maxBindingPoints(BufferTarget bufferType) {
+        GLint count = 0;
+        switch (bufferType) {
+        case BufferTarget::Shader_Storage_Buffer:
+            glGetIntegerv(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS, &count);
+            break;
+        case BufferTarget::Uniform_Buffer:
+            glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &count);
+            break;
+        case BufferTarget::Atomic_Counter_Buffer:
+            glGetIntegerv(GL_MAX_ATOMIC_COUNTER_BUFFER_BINDINGS, &count);
+            break;
+        case BufferTarget::Transform_Feedback_Buffer:
+            glGetIntegerv(GL_MAX_TRANSFORM_FEEDBACK_BUFFERS, &count);
+            break;
+        case BufferTarget::Array_Buffer:
+            glGetIntegerv(GL_MAX_VERTEX_ATTRIB_BINDINGS, &count);
+            break;
+        default:
+            count = 16; // Arbitrary limit for non indexed targets
+            break;
+        }
+        return count > 0 ? count : 16;
+    }
+
+    std::vector<BindingPointManager::Slot>& BindingPointManager::slots(BufferTarget bufferType) {
+        auto it = m_slots.find(bufferType);
+        if (it != m_slots.end()) return it->second;
+
+        GLuint count = maxBindingPoints(bufferType);
+        Console::trace("BindingPointManager") << count << " binding points available for target " << GLuint(bufferType) << Console::endl;
+        return m_slots[bufferType] = std::vector<Slot>(count);
+    }
+
+    GLuint BindingPointManager::allocateBindingPoint(BufferTarget bufferType, GLuint bufferID, GLintptr offset) {
+        m_clock++;
+
         // Check if the buffer is already assigned a binding point
-        if (bufferToBindingPoint.find(bufferID) != bufferToBindingPoint.end()) {
-            return bufferToBindingPoint[bufferID];
+        auto owner = m_owners.find(std::make_pair(bufferID, offset));
+        if (owner != m_owners.end() && owner->second.first == bufferType) {
+            slots(bufferType)[owner->second.second].lastUse = m_clock;
+            return owner->second.second;
+        }
+
+        std::vector<Slot>& targetSlots = slots(bufferType);
+
+        // Prefer a free slot already holding this buffer, then any free slot, then the least recently used one
+        GLuint bindingPoint = GLuint(-1);
+        for (GLuint i = 0; i < targetSlots.size(); i++) {
+            const Slot& slot = targetSlots[i];
+            if (slot.used) continue;
+            if (slot.buffer == bufferID && slot.offset == offset) { bindingPoint = i; break; }
+            if (bindingPoint == GLuint(-1)) bindingPoint = i;
         }
 
-        if (availableBindingPoints[bufferType].empty()) {
-            Console::error("BindingPointManager") << "No available binding points for the given buffer type" << Console::endl;
-            throw std::runtime_error("No available binding points for the given buffer type");
+        if (bindingPoint == GLuint(-1)) {
+            bindingPoint = 0;
+            for (GLuint i = 1; i < targetSlots.size(); i++) {
+                if (targetSlots[i].lastUse < targetSlots[bindingPoint].lastUse) bindingPoint = i;
+            }
+            Slot& evicted = targetSlots[bindingPoint];
+            Console::trace("BindingPointManager") << "binding point " << bindingPoint << " recycled from buffer " << evicted.owner << Console::endl;
+            m_owners.erase(std::make_pair(evicted.owner, evicted.ownerOffset));
+            m_stats.evictions++;
         }
 
-        GLuint bindingPoint = availableBindingPoints[bufferType].front();
-        availableBindingPoints[bufferType].pop();
-        usedBindingPoints[bufferType].push_back(bindingPoint);
-        bufferToBindingPoint[bufferID] = bindingPoint;
+        Slot& slot = targetSlots[bindingPoint];
+        slot.used = true;
+        slot.owner = bufferID;
+        slot.ownerOffset = offset;
+        slot.lastUse = m_clock;
+        m_owners[std::make_pair(bufferID, offset)] = std::make_pair(bufferType, bindingPoint);
 
         Console::trace("BindingPointManager") << bindingPoint << " allocated for buffer " << bufferID << Console::endl;
         return bindingPoint;
     }
 
-    void BindingPointManager::releaseBindingPoint(BufferTarget bufferType, GLuint bufferID) {
-        if (bufferToBindingPoint.find(bufferID) == bufferToBindingPoint.end()) {
+    void BindingPointManager::releaseBindingPoint(BufferTarget bufferType, GLuint bufferID, GLintptr offset) {
+        auto owner = m_owners.find(std::make_pair(bufferID, offset));
+        if (owner == m_owners.end()) {
             Console::trace("BindingPointManager") << "Attempt to release a binding point for a buffer that was not allocated" << Console::endl;
             return;
         }
 
-        GLuint bindingPoint = bufferToBindingPoint[bufferID];
-        bufferToBindingPoint.erase(bufferID);
+        GLuint bindingPoint = owner->second.second;
+        Slot& slot = slots(owner->second.first)[bindingPoint];
+        slot.used = false; //the GL binding is kept, binding the same buffer again later is free
+        m_owners.erase(owner);
+
+        Console::trace("BindingPointManager") << bindingPoint << " freed from buffer " << bufferID << Console::endl;
+    }
 
-        auto& points = usedBindingPoints[bufferType];
-        points.erase(std::remove(points.begin(), points.end(), bindingPoint), points.end());
+    bool BindingPointManager::remapBuffer(GLuint oldBufferID, GLintptr oldOffset, GLuint newBufferID, GLintptr newOffset) {
+        auto owner = m_owners.find(std::make_pair(oldBufferID, oldOffset));
+        if (owner == m_owners.end()) return false;
+        auto binding = owner->second;
+        m_owners.erase(owner);
+        m_owners[std::make_pair(newBufferID, newOffset)] = binding;
+
+        Slot& slot = slots(binding.first)[binding.second];
+        slot.owner = newBufferID;
+        slot.ownerOffset = newOffset;
+        return true;
+    }
 
-        std::queue<GLuint> tempQueue;
-        tempQueue.push(bindingPoint);
-        while (!availableBindingPoints[bufferType].empty()) {
-            tempQueue.push(availableBindingPoints[bufferType].front());
-            availableBindingPoints[bufferType].pop();
+    void BindingPointManager::bind(BufferTarget bufferType, GLuint bindingPoint, GLuint bufferID, GLintptr offset, GLsizeiptr size) {
+        std::vector<Slot>& targetSlots = slots(bufferType);
+        if (bindingPoint < targetSlots.size()) {
+            Slot& slot = targetSlots[bindingPoint];
+            if (slot.buffer == bufferID && slot.offset == offset && slot.size == size) {
+                m_stats.bindSkipped++;
+                return;
+            }
+            slot.buffer = bufferID;
+            slot.offset = offset;
+            slot.size = size;
         }
-        availableBindingPoints[bufferType] = tempQueue;
 
-        Console::trace("BindingPointManager") << bindingPoint << " freed from buffer " << bufferID << Console::endl;
+        if (size > 0) glBindBufferRange(static_cast<GLenum>(bufferType), bindingPoint, bufferID, offset, size);
+        else glBindBufferBase(static_cast<GLenum>(bufferType), bindingPoint, bufferID);
+        m_stats.bindCalls++;
+    }
+
+    void BindingPointManager::bindBlock(GLuint programID, GLuint blockIndex, GLuint bindingPoint, BufferTarget bufferType) {
+        //uniform and storage blocks are numbered independently
+        auto& blocks = m_blockBindings[programID];
+        auto key = std::make_pair(bufferType, blockIndex);
+        auto it = blocks.find(key);
+        if (it != blocks.end() && it->second == bindingPoint) {
+            m_stats.blockBindingSkipped++;
+            return;
+        }
+        blocks[key] = bindingPoint;
+        if (bufferType == BufferTarget::Uniform_Buffer) glUniformBlockBinding(programID, blockIndex, bindingPoint);
+        else glShaderStorageBlockBinding(programID, blockIndex, bindingPoint);
+        m_stats.blockBindingCalls++;
     }
 
-    const std::vector<GLuint>& BindingPointManager::getUsedBindingPoints(BufferTarget bufferType) const {
-        return usedBindingPoints.at(bufferType);
+    void BindingPointManager::forgetBuffer(GLuint bufferID) {
+        for (auto& target : m_slots) {
+            for (Slot& slot : target.second) {
+                if (slot.buffer != bufferID) continue;
+                slot.buffer = 0;
+                slot.offset = 0;
+                slot.size = 0;
+            }
+        }
     }
 
-    void BindingPointManager::resetBindings(){
-        availableBindingPoints.clear();
-        initializeAvailableBindingPoints();
-        usedBindingPoints.clear();
-        bufferToBindingPoint.clear();
+    void BindingPointManager::forgetProgram(GLuint programID) {
+        m_blockBindings.erase(programID);
     }
 
-    void BindingPointManager::initializeAvailableBindingPoints() {
-        const int maxSSBOBindings = 16; // Typically 16
-        const int maxUBOBindings = 16; // Typically 16
-        const int maxVBOBindings = 16; // Arbitrary limit for VBOs
-        const int maxEBOBindings = 16; // Arbitrary limit for EBOs
+    void BindingPointManager::onBufferDeleted(GLuint bufferID) {
+        if (s_alive) instance().forgetBuffer(bufferID);
+    }
 
-        for (int i = 0; i < maxSSBOBindings; ++i) {
-            availableBindingPoints[BufferTarget::Shader_Storage_Buffer].push(i);
-        }
-        for (int i = 0; i < maxUBOBindings; ++i) {
-            availableBindingPoints[BufferTarget::Uniform_Buffer].push(i);
-        }
-        for (int i = 0; i < maxVBOBindings; ++i) {
-            availableBindingPoints[BufferTarget::Array_Buffer].push(i);
-        }
-        for (int i = 0; i < maxEBOBindings; ++i) {
-            availableBindingPoints[BufferTarget::Element_Array_Buffer].push(i);
+    void BindingPointManager::onBufferReleased(BufferTarget bufferType, GLuint bufferID, GLintptr offset) {
+        if (s_alive) instance().releaseBindingPoint(bufferType, bufferID, offset);
+    }
+
+    void BindingPointManager::onProgramDeleted(GLuint programID) {
+        if (s_alive) instance().forgetProgram(programID);
+    }
+
+    std::vector<GLuint> BindingPointManager::getUsedBindingPoints(BufferTarget bufferType) const {
+        std::vector<GLuint> points;
+        auto it = m_slots.find(bufferType);
+        if (it == m_slots.end()) return points;
+        for (GLuint i = 0; i < it->second.size(); i++) {
+            if (it->second[i].used) points.push_back(i);
         }
-        // Add other buffer types if needed
+        return points;
     }
 
+    void BindingPointManager::resetBindings(){
+        m_slots.clear();
+        m_owners.clear();
+        m_blockBindings.clear();
+    }
 
-}
\ No newline at end of file
+    void BindingPointManager::printStats() const {
+        Console::info("BindingPointManager") << "binds: " << m_stats.bindCalls << " (" << m_stats.bindSkipped << " skipped), "
+            << "block bindings: " << m_stats.blockBindingCalls << " (" << m_stats.blockBindingSkipped << " skipped), "
+            << "evictions: " << m_stats.evictions << Console::endl;
+    }
+}
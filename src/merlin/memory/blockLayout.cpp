@@ -0,0 +1,318 @@
+#include "pch.h"
+#include "merlin/memory/blockLayout.h"
+
+#include <regex>
+#include <sstream>
+#include <climits>
+
+namespace Merlin {
+
+    struct GLSLTypeInfo {
+        GLenum type;
+        const char* glsl;
+        const char* cpp;
+        GLint size;      //std430 size
+        GLint alignment; //std430 base alignment
+        GLint data;      //bytes actually holding data
+    };
+
+    static const GLSLTypeInfo s_types[] = {
+        { GL_FLOAT,             "float",  "float",        4,   4,   4 },
+        { GL_FLOAT_VEC2,        "vec2",   "glm::vec2",    8,   8,   8 },
+        { GL_FLOAT_VEC3,        "vec3",   "glm::vec3",    12,  16,  12 },
+        { GL_FLOAT_VEC4,        "vec4",   "glm::vec4",    16,  16,  16 },
+        { GL_INT,               "int",    "GLint",        4,   4,   4 },
+        { GL_INT_VEC2,          "ivec2",  "glm::ivec2",   8,   8,   8 },
+        { GL_INT_VEC3,          "ivec3",  "glm::ivec3",   12,  16,  12 },
+        { GL_INT_VEC4,          "ivec4",  "glm::ivec4",   16,  16,  16 },
+        { GL_UNSIGNED_INT,      "uint",   "GLuint",       4,   4,   4 },
+        { GL_UNSIGNED_INT_VEC2, "uvec2",  "glm::uvec2",   8,   8,   8 },
+        { GL_UNSIGNED_INT_VEC3, "uvec3",  "glm::uvec3",   12,  16,  12 },
+        { GL_UNSIGNED_INT_VEC4, "uvec4",  "glm::uvec4",   16,  16,  16 },
+        { GL_BOOL,              "bool",   "GLuint",       4,   4,   4 },
+        { GL_BOOL_VEC2,         "bvec2",  "glm::uvec2",   8,   8,   8 },
+        { GL_BOOL_VEC3,         "bvec3",  "glm::uvec3",   12,  16,  12 },
+        { GL_BOOL_VEC4,         "bvec4",  "glm::uvec4",   16,  16,  16 },
+        { GL_DOUBLE,            "double", "double",       8,   8,   8 },
+        { GL_DOUBLE_VEC2,       "dvec2",  "glm::dvec2",   16,  16,  16 },
+        { GL_DOUBLE_VEC3,       "dvec3",  "glm::dvec3",   24,  32,  24 },
+        { GL_DOUBLE_VEC4,       "dvec4",  "glm::dvec4",   32,  32,  32 },
+        { GL_FLOAT_MAT2,        "mat2",   "glm::mat2",    16,  8,   16 },
+        { GL_FLOAT_MAT3,        "mat3",   "glm::mat3x4",  48,  16,  36 }, //columns are padded to vec4
+        { GL_FLOAT_MAT4,        "mat4",   "glm::mat4",    64,  16,  64 },
+        { GL_DOUBLE_MAT4,       "dmat4",  "glm::dmat4",   128, 32,  128 },
+    };
+
+    static const GLSLTypeInfo* typeInfo(GLenum type) {
+        for (const GLSLTypeInfo& info : s_types) {
+            if (info.type == type) return &info;
+        }
+        return nullptr;
+    }
+
+    static GLint roundUp(GLint value, GLint alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    //arrays of 3 components vectors have a 16 bytes stride, the matching glm type is the 4 components one
+    static GLenum paddedArrayType(GLenum type) {
+        switch (type) {
+        case GL_FLOAT_VEC3: return GL_FLOAT_VEC4;
+        case GL_INT_VEC3: return GL_INT_VEC4;
+        case GL_UNSIGNED_INT_VEC3: return GL_UNSIGNED_INT_VEC4;
+        case GL_BOOL_VEC3: return GL_BOOL_VEC4;
+        case GL_DOUBLE_VEC3: return GL_DOUBLE_VEC4;
+        default: return type;
+        }
+    }
+
+    GLint BlockLayout::typeSize(GLenum type) {
+        const GLSLTypeInfo* info = typeInfo(type);
+        return info ? info->size : 4;
+    }
+
+    GLint BlockLayout::typeAlignment(GLenum type) {
+        const GLSLTypeInfo* info = typeInfo(type);
+        return info ? info->alignment : 4;
+    }
+
+    const char* BlockLayout::typeToGLSL(GLenum type) {
+        const GLSLTypeInfo* info = typeInfo(type);
+        return info ? info->glsl : "unknown";
+    }
+
+    const char* BlockLayout::typeToCpp(GLenum type) {
+        const GLSLTypeInfo* info = typeInfo(type);
+        return info ? info->cpp : "unknown";
+    }
+
+    GLenum BlockLayout::typeFromGLSL(const std::string& type) {
+        for (const GLSLTypeInfo& info : s_types) {
+            if (type == info.glsl) return info.type;
+        }
+        return GL_NONE;
+    }
+
+    GLint BlockLayout::memberAlignment(const BlockMember& member) {
+        return typeAlignment(member.type);
+    }
+
+    GLint BlockLayout::memberSize(const BlockMember& member) {
+        if (member.arraySize > 1) return member.arraySize * roundUp(typeSize(member.type), typeAlignment(member.type));
+        return typeSize(member.type);
+    }
+
+    BlockLayout BlockLayout::reflect(GLuint programID, const std::string& blockName) {
+        BlockLayout layout;
+        layout.m_name = blockName;
+
+        GLuint blockIndex = glGetProgramResourceIndex(programID, GL_SHADER_STORAGE_BLOCK, blockName.c_str());
+        if (blockIndex == GL_INVALID_INDEX) return layout;
+
+        const GLenum blockProps[] = { GL_BUFFER_DATA_SIZE, GL_NUM_ACTIVE_VARIABLES };
+        GLint blockValues[2] = { 0, 0 };
+        glGetProgramResourceiv(programID, GL_SHADER_STORAGE_BLOCK, blockIndex, 2, blockProps, 2, nullptr, blockValues);
+
+        std::vector<GLint> variables(blockValues[1]);
+        const GLenum activeVariables = GL_ACTIVE_VARIABLES;
+        if (!variables.empty())
+            glGetProgramResourceiv(programID, GL_SHADER_STORAGE_BLOCK, blockIndex, 1, &activeVariables, GLsizei(variables.size()), nullptr, variables.data());
+
+        const GLenum props[] = { GL_NAME_LENGTH, GL_TYPE, GL_OFFSET, GL_ARRAY_SIZE, GL_ARRAY_STRIDE, GL_MATRIX_STRIDE, GL_TOP_LEVEL_ARRAY_SIZE, GL_TOP_LEVEL_ARRAY_STRIDE };
+        std::vector<BlockMember> fixed, element;
+        GLint elementBase = INT_MAX;
+
+        for (GLint variable : variables) {
+            GLint values[8] = {};
+            glGetProgramResourceiv(programID, GL_BUFFER_VARIABLE, variable, 8, props, 8, nullptr, values);
+
+            std::string name(std::max(values[0], 1), '\0');
+            glGetProgramResourceName(programID, GL_BUFFER_VARIABLE, variable, values[0], nullptr, name.data());
+            name.resize(std::max(values[0] - 1, 0));
+
+            BlockMember member;
+            member.type = values[1];
+            member.offset = values[2];
+            member.arraySize = values[3];
+            member.arrayStride = values[4];
+            member.matrixStride = values[5];
+
+            if (values[6] == 0) { //member of the runtime sized array
+                layout.m_stride = values[7] > 0 ? values[7] : values[4];
+                elementBase = std::min(elementBase, member.offset);
+
+                size_t prefix = name.find("].");
+                if (prefix != std::string::npos) name = name.substr(prefix + 2);
+                else if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+                    name.resize(name.size() - 3); //runtime array of a basic type
+                    member.arraySize = 1;
+                }
+                member.name = name;
+                element.push_back(member);
+            }
+            else {
+                member.name = name;
+                fixed.push_back(member);
+            }
+        }
+
+        if (!element.empty()) {
+            for (BlockMember& member : element) member.offset -= elementBase;
+            layout.m_members = element;
+            layout.m_size = elementBase;
+        }
+        else {
+            layout.m_members = fixed;
+            layout.m_size = blockValues[0];
+        }
+
+        std::sort(layout.m_members.begin(), layout.m_members.end(), [](const BlockMember& a, const BlockMember& b) { return a.offset < b.offset; });
+        layout.m_valid = true;
+        return layout;
+    }
+
+    BlockLayout BlockLayout::fromGLSL(const std::string& structSrc) {
+        BlockLayout layout;
+        std::string src = std::regex_replace(structSrc, std::regex(R"(//[^\n]*)"), "");
+
+        std::smatch match;
+        if (std::regex_search(src, match, std::regex(R"(struct\s+(\w+))"))) layout.m_name = match[1].str();
+        else layout.m_name = "Struct";
+
+        size_t begin = src.find('{');
+        size_t end = src.rfind('}');
+        if (begin != std::string::npos && end != std::string::npos && end > begin) src = src.substr(begin + 1, end - begin - 1);
+
+        std::regex fieldRegex(R"((\w+)\s+(\w+)\s*(?:\[\s*(\d+)\s*\])?\s*;)");
+        for (auto it = std::sregex_iterator(src.begin(), src.end(), fieldRegex); it != std::sregex_iterator(); ++it) {
+            BlockMember member;
+            member.type = typeFromGLSL((*it)[1].str());
+            member.name = (*it)[2].str();
+            member.arraySize = (*it)[3].matched ? std::stoi((*it)[3].str()) : 1;
+
+            if (member.type == GL_NONE) {
+                Console::error("BlockLayout") << "unsupported type " << (*it)[1].str() << " for member " << member.name << " of " << layout.m_name << Console::endl;
+                return layout;
+            }
+            layout.m_members.push_back(member);
+        }
+
+        layout.layoutStd430();
+        layout.m_valid = !layout.m_members.empty();
+        return layout;
+    }
+
+    void BlockLayout::layoutStd430() {
+        GLint offset = 0;
+        GLint maxAlignment = 4;
+        for (BlockMember& member : m_members) {
+            GLint alignment = memberAlignment(member);
+            offset = roundUp(offset, alignment);
+            member.offset = offset;
+            member.arrayStride = member.arraySize > 1 ? roundUp(typeSize(member.type), alignment) : 0;
+            offset += memberSize(member);
+            maxAlignment = std::max(maxAlignment, alignment);
+        }
+
+        GLint size = roundUp(offset, maxAlignment);
+        if (m_stride > 0) m_stride = size;
+        else m_size = size;
+    }
+
+    GLint BlockLayout::dataSize() const {
+        GLint size = 0;
+        for (const BlockMember& member : m_members) {
+            const GLSLTypeInfo* info = typeInfo(member.type);
+            size += (info ? info->data : 4) * std::max(member.arraySize, 1);
+        }
+        return size;
+    }
+
+    GLint BlockLayout::padding() const {
+        return elementSize() - dataSize();
+    }
+
+    bool BlockLayout::validate(size_t cppElementSize) const {
+        if (!m_valid || elementSize() == 0 || GLint(cppElementSize) == elementSize()) return true;
+
+        Console::error("BlockLayout") << "block " << m_name << " elements are " << elementSize() << " bytes in the shader but "
+            << cppElementSize << " bytes on the CPU side" << Console::endl;
+        print();
+        return false;
+    }
+
+    BlockLayout BlockLayout::packed() const {
+        BlockLayout layout = *this;
+        layout.m_members.clear();
+
+        //greedy : always take the member that needs the least padding at the current offset, largest alignment first on ties
+        std::vector<BlockMember> remaining = m_members;
+        GLint offset = 0;
+        while (!remaining.empty()) {
+            size_t best = 0;
+            GLint bestPadding = INT_MAX;
+            for (size_t i = 0; i < remaining.size(); i++) {
+                GLint alignment = memberAlignment(remaining[i]);
+                GLint padding = roundUp(offset, alignment) - offset;
+                if (padding < bestPadding || (padding == bestPadding && alignment > memberAlignment(remaining[best]))) {
+                    best = i;
+                    bestPadding = padding;
+                }
+            }
+            offset += bestPadding + memberSize(remaining[best]);
+            layout.m_members.push_back(remaining[best]);
+            remaining.erase(remaining.begin() + best);
+        }
+
+        layout.layoutStd430();
+        return layout;
+    }
+
+    std::string BlockLayout::toGLSL() const {
+        std::stringstream ss;
+        ss << "struct " << m_name << " {\n";
+        for (const BlockMember& member : m_members) {
+            ss << "\t" << typeToGLSL(member.type) << " " << member.name;
+            if (member.arraySize > 1) ss << "[" << member.arraySize << "]";
+            ss << "; //offset " << member.offset << "\n";
+        }
+        ss << "}; //" << elementSize() << " bytes\n";
+        return ss.str();
+    }
+
+    std::string BlockLayout::toCpp() const {
+        std::stringstream ss;
+        ss << "struct " << m_name << " {\n";
+        GLint offset = 0;
+        int pad = 0;
+        for (const BlockMember& member : m_members) {
+            if (member.offset > offset) ss << "\tGLuint _pad" << pad++ << "[" << (member.offset - offset) / 4 << "];\n";
+            if (member.arraySize > 1) ss << "\t" << typeToCpp(paddedArrayType(member.type)) << " " << member.name << "[" << member.arraySize << "];\n";
+            else ss << "\t" << typeToCpp(member.type) << " " << member.name << ";\n";
+            offset = member.offset + memberSize(member);
+        }
+        if (elementSize() > offset) ss << "\tGLuint _pad" << pad++ << "[" << (elementSize() - offset) / 4 << "];\n";
+        ss << "}; //" << elementSize() << " bytes\n";
+        return ss.str();
+    }
+
+    void BlockLayout::print() const {
+        if (!m_valid) {
+            Console::warn("BlockLayout") << "block " << m_name << " not found" << Console::endl;
+            return;
+        }
+
+        Console::info("BlockLayout") << m_name << " : " << elementSize() << " bytes per element, " << padding() << " bytes of padding" << Console::endl;
+        for (const BlockMember& member : m_members) {
+            ConsoleStream line = Console::info("BlockLayout") << "  " << member.offset << "\t" << typeToGLSL(member.type) << " " << member.name;
+            if (member.arraySize > 1) line << "[" << member.arraySize << "]";
+            line << Console::endl;
+        }
+
+        BlockLayout better = packed();
+        if (better.elementSize() < elementSize()) {
+            Console::info("BlockLayout") << "reordering the members saves " << elementSize() - better.elementSize() << " bytes per element :" << Console::endl;
+            Console::print() << better.toGLSL() << Console::endl;
+        }
+    }
+}
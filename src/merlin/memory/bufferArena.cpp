@@ -0,0 +1,135 @@
+#include "pch.h"
+#include "merlin/memory/bufferArena.h"
+
+namespace Merlin {
+
+    BufferArena::BufferArena(BufferTarget target, GLsizeiptr blockSize) : m_target(target), m_blockSize(blockSize) {
+        if (target == BufferTarget::Uniform_Buffer) glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m_alignment);
+        else if (target == BufferTarget::Shader_Storage_Buffer) glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &m_alignment);
+        else m_alignment = 16;
+        if (m_alignment <= 0) m_alignment = 256;
+    }
+
+    BufferArena::~BufferArena() {
+        for (const Block& block : m_blocks) {
+            if (block.allocations != 0)
+                Console::warn("BufferArena") << block.allocations << " range(s) still allocated in " << block.buffer->name() << Console::endl;
+        }
+    }
+
+    Shared<BufferArena> BufferArena::create(BufferTarget target, GLsizeiptr blockSize) {
+        return createShared<BufferArena>(target, blockSize);
+    }
+
+    Shared<BufferArena> BufferArena::defaultArena() {
+        static Shared<BufferArena> arena = createShared<BufferArena>(BufferTarget::Shader_Storage_Buffer);
+        return arena;
+    }
+
+    GLsizeiptr BufferArena::align(GLsizeiptr size) const {
+        return ((size + m_alignment - 1) / m_alignment) * m_alignment;
+    }
+
+    BufferArena::Block& BufferArena::createBlock(GLsizeiptr size) {
+        Block block;
+        block.size = size;
+        block.buffer = createShared<ImmutableBufferObject<GLubyte>>(m_target);
+        block.buffer->rename("arena_block" + std::to_string(m_blocks.size()));
+        block.buffer->allocate(size, BufferStorageFlags::DynamicStorage | BufferStorageFlags::MapRead | BufferStorageFlags::MapWrite);
+        block.freeRanges[0] = size;
+        m_blocks.push_back(block);
+
+        Console::trace("BufferArena") << "new block of " << size_t(size) << " bytes" << Console::endl;
+        return m_blocks.back();
+    }
+
+    BufferRange BufferArena::allocate(GLsizeiptr size) {
+        GLsizeiptr alignedSize = align(std::max(size, GLsizeiptr(1)));
+
+        //first fit, offsets and sizes in the free lists are always aligned
+        for (Block& block : m_blocks) {
+            for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); it++) {
+                if (it->second < alignedSize) continue;
+
+                GLintptr offset = it->first;
+                GLsizeiptr remaining = it->second - alignedSize;
+                block.freeRanges.erase(it);
+                if (remaining > 0) block.freeRanges[offset + alignedSize] = remaining;
+                block.allocations++;
+                return { block.buffer->id(), offset, size };
+            }
+        }
+
+        //no room left, oversized requests get a dedicated block
+        Block& block = createBlock(std::max(m_blockSize, alignedSize));
+        GLsizeiptr remaining = block.size - alignedSize;
+        block.freeRanges.clear();
+        if (remaining > 0) block.freeRanges[alignedSize] = remaining;
+        block.allocations++;
+        return { block.buffer->id(), 0, size };
+    }
+
+    void BufferArena::release(const BufferRange& range) {
+        if (range.buffer == 0) return;
+
+        auto block = std::find_if(m_blocks.begin(), m_blocks.end(), [&](const Block& b) { return b.buffer->id() == range.buffer; });
+        if (block == m_blocks.end()) {
+            Console::error("BufferArena") << "range does not belong to this arena" << Console::endl;
+            return;
+        }
+
+        GLintptr offset = range.offset;
+        GLsizeiptr size = align(std::max(range.size, GLsizeiptr(1)));
+
+        //coalesce with the next free range
+        auto next = block->freeRanges.find(offset + size);
+        if (next != block->freeRanges.end()) {
+            size += next->second;
+            block->freeRanges.erase(next);
+        }
+
+        //coalesce with the previous free range
+        auto prev = block->freeRanges.lower_bound(offset);
+        if (prev != block->freeRanges.begin()) {
+            prev--;
+            if (prev->first + prev->second == offset) {
+                offset = prev->first;
+                size += prev->second;
+                block->freeRanges.erase(prev);
+            }
+        }
+
+        block->freeRanges[offset] = size;
+        block->allocations--;
+
+        if (block->allocations == 0 && block != m_blocks.begin()) {
+            Console::trace("BufferArena") << "releasing empty block " << block->buffer->name() << Console::endl;
+            m_blocks.erase(block);
+        }
+    }
+
+    BufferArena::Stats BufferArena::stats() const {
+        Stats s;
+        s.blocks = m_blocks.size();
+        for (const Block& block : m_blocks) {
+            s.allocations += block.allocations;
+            s.reserved += block.size;
+            GLsizeiptr freeBytes = 0;
+            for (const auto& range : block.freeRanges) {
+                freeBytes += range.second;
+                s.largestFree = std::max(s.largestFree, range.second);
+            }
+            s.freeRanges += block.freeRanges.size();
+            s.used += block.size - freeBytes;
+        }
+        return s;
+    }
+
+    void BufferArena::printStats() const {
+        Stats s = stats();
+        Console::info("BufferArena") << s.blocks << " block(s), "
+            << s.allocations << " range(s), "
+            << size_t(s.used / 1024) << "/" << size_t(s.reserved / 1024) << " Ko used, "
+            << s.freeRanges << " hole(s), largest " << size_t(s.largestFree / 1024) << " Ko" << Console::endl;
+    }
+}
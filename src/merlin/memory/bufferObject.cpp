@@ -1,10 +1,193 @@
 #include "pch.h"
 #include "merlin/memory/bufferObject.h"
 #include "merlin/memory/bindingPointManager.h"
+#include "merlin/memory/streamBuffer.h"
+#include "merlin/memory/bufferArena.h"
+#include "merlin/memory/memoryTracker.h"
 
 namespace Merlin {
+    void AbstractBufferObject::destroy(GLuint ID) {
+        BindingPointManager::onBufferDeleted(ID);
+        glDeleteBuffers(1, &ID);
+    }
+
+    void AbstractBufferObject::registerMemory() {
+        MemoryTracker::instance().track(this, m_arena ? MemoryCategory::BUFFER_RANGE : MemoryCategory::BUFFER, id(), [this]() { return name(); });
+    }
+
+    void AbstractBufferObject::trackMemory() const {
+        std::string usage;
+        if (m_isMutable) {
+            switch (m_usage) {
+            case BufferUsage::StreamDraw: usage = "StreamDraw"; break;
+            case BufferUsage::StreamRead: usage = "StreamRead"; break;
+            case BufferUsage::StreamCopy: usage = "StreamCopy"; break;
+            case BufferUsage::StaticDraw: usage = "StaticDraw"; break;
+            case BufferUsage::StaticRead: usage = "StaticRead"; break;
+            case BufferUsage::StaticCopy: usage = "StaticCopy"; break;
+            case BufferUsage::DynamicDraw: usage = "DynamicDraw"; break;
+            case BufferUsage::DynamicRead: usage = "DynamicRead"; break;
+            case BufferUsage::DynamicCopy: usage = "DynamicCopy"; break;
+            }
+        }
+        else {
+            GLbitfield flags = static_cast<GLbitfield>(m_flags);
+            usage = "Immutable";
+            if (flags & GL_DYNAMIC_STORAGE_BIT) usage += " | DynamicStorage";
+            if (flags & GL_MAP_READ_BIT) usage += " | MapRead";
+            if (flags & GL_MAP_WRITE_BIT) usage += " | MapWrite";
+            if (flags & GL_MAP_PERSISTENT_BIT) usage += " | MapPersistent";
+            if (flags & GL_MAP_COHERENT_BIT) usage += " | MapCoherent";
+            if (flags & GL_CLIENT_STORAGE_BIT) usage += " | ClientStorage";
+        }
+        if (m_arena) usage += " (arena)";
+        MemoryTracker::instance().update(this, id(), m_capacity, usage);
+    }
+
+    // Buffers with pending shadow edits, flushed once per frame
+    static std::unordered_set<AbstractBufferObject*>& dirtyBuffers() {
+        static std::unordered_set<AbstractBufferObject*> buffers;
+        return buffers;
+    }
+
+    void AbstractBufferObject::enableShadowCopy(bool state) {
+        if (state == m_shadowEnabled) return;
+        m_shadowEnabled = state;
+        if (state) {
+            resizeShadow();
+            syncShadowCopy();
+        }
+        else {
+            flush();
+            m_shadow.clear();
+            m_shadow.shrink_to_fit();
+        }
+    }
+
+    void AbstractBufferObject::resizeShadow() {
+        if (!m_shadowEnabled) return;
+        m_shadow.resize(m_size);
+        if (!m_dirty.empty() && m_dirty.rbegin()->second > m_size) {
+            //drop the spans past the new end
+            for (auto it = m_dirty.begin(); it != m_dirty.end();) {
+                if (it->first >= m_size) it = m_dirty.erase(it);
+                else { it->second = std::min(it->second, GLintptr(m_size)); it++; }
+            }
+        }
+    }
+
+    void AbstractBufferObject::syncShadowCopy() {
+        if (!m_shadowEnabled || m_size == 0) return;
+        m_dirty.clear();
+        readBuffer(0, m_size, m_shadow.data());
+    }
+
+    void AbstractBufferObject::markDirty(GLintptr offset, GLsizeiptr size) {
+        if (size <= 0) return;
+        GLintptr begin = offset;
+        GLintptr end = offset + size;
+
+        //absorb every span overlapping or touching [begin, end]
+        //spans with a gap stay apart, the bytes in between may hold GPU writes the shadow doesn't have
+        auto it = m_dirty.upper_bound(begin);
+        if (it != m_dirty.begin()) {
+            auto prev = std::prev(it);
+            if (prev->second >= begin) it = prev;
+        }
+        while (it != m_dirty.end() && it->first <= end) {
+            begin = std::min(begin, it->first);
+            end = std::max(end, it->second);
+            it = m_dirty.erase(it);
+        }
+        m_dirty[begin] = end;
+        dirtyBuffers().insert(this);
+    }
+
+    void AbstractBufferObject::flush() {
+        dirtyBuffers().erase(this);
+        if (m_dirty.empty()) return;
+
+        if (m_shadowEnabled) {
+            for (const auto& span : m_dirty) {
+                GLintptr end = std::min(span.second, GLintptr(m_shadow.size()));
+                if (end > span.first) uploadBuffer(span.first, end - span.first, m_shadow.data() + span.first);
+            }
+        }
+        m_dirty.clear();
+    }
+
+    void AbstractBufferObject::flushAll() {
+        //flush() removes the buffer from the set
+        while (!dirtyBuffers().empty()) {
+            (*dirtyBuffers().begin())->flush();
+        }
+    }
+
+    AbstractBufferObject::~AbstractBufferObject() {
+        dirtyBuffers().erase(this);
+        MemoryTracker::onRelease(this);
+        if (m_bindingPoint != GLuint(-1)) BindingPointManager::onBufferReleased(m_target, id(), m_offset);
+        if (m_arena && m_capacity > 0) m_arena->release({ id(), m_offset, m_capacity });
+    }
+
+    void AbstractBufferObject::allocateRange(GLsizeiptr size) {
+        GLuint oldID = id();
+        GLintptr oldOffset = m_offset;
+        if (m_capacity > 0) m_arena->release({ oldID, m_offset, m_capacity });
+
+        BufferRange range = m_arena->allocate(size);
+        recreate(range.buffer);
+        m_offset = range.offset;
+        m_size = m_capacity = size;
+
+        if (m_bindingPoint != GLuint(-1) && BindingPointManager::instance().remapBuffer(oldID, oldOffset, id(), m_offset)) {
+            setBindingPoint(m_bindingPoint);
+        }
+    }
+
+    void AbstractBufferObject::streamBuffer(GLintptr offset, GLsizeiptr size, const void* data) {
+        if (!data || size <= 0) return;
+        StreamBuffer::instance().upload(id(), m_offset + offset, size, data);
+    }
+
+    void AbstractBufferObject::reallocate(GLsizeiptr capacity) {
+        GLuint oldID = id();
+        GLintptr oldOffset = m_offset;
+        GLsizeiptr kept = std::min(m_size, capacity);
+
+        if (m_arena) {
+            //the old range is released after the copy so both ranges can't overlap
+            BufferRange range = m_arena->allocate(capacity);
+            if (kept > 0) glCopyNamedBufferSubData(oldID, range.buffer, oldOffset, range.offset, kept);
+            if (m_capacity > 0) m_arena->release({ oldID, oldOffset, m_capacity });
+            recreate(range.buffer);
+            m_offset = range.offset;
+        }
+        else {
+            GLuint newID = create();
+            if (m_isMutable) glNamedBufferData(newID, capacity, nullptr, static_cast<GLenum>(m_usage));
+            else glNamedBufferStorage(newID, capacity, nullptr, static_cast<GLbitfield>(m_flags));
+
+            //the copy stays on the GPU, no round trip through the CPU
+            if (kept > 0) glCopyNamedBufferSubData(oldID, newID, 0, 0, kept);
+
+            recreate(newID);
+            destroy(oldID);
+        }
+        m_capacity = capacity;
+        m_size = kept;
+        trackMemory();
+        resizeShadow();
+
+        if (m_bindingPoint != GLuint(-1) && BindingPointManager::instance().remapBuffer(oldID, oldOffset, id(), m_offset)) {
+            setBindingPoint(m_bindingPoint);
+        }
+
+        Console::trace("BufferObject") << name() << " reallocated (" << size_t(capacity) << " bytes)" << Console::endl;
+    }
+
     void AbstractBufferObject::releaseBindingPoint() {
-        if(m_bindingPoint < 16) BindingPointManager::instance().releaseBindingPoint(m_target, m_bindingPoint);
+        if(m_bindingPoint != GLuint(-1)) BindingPointManager::instance().releaseBindingPoint(m_target, id(), m_offset);
         m_bindingPoint = -1;
         return;
     }
@@ -18,7 +201,10 @@ namespace Merlin {
             case BufferTarget::Transform_Feedback_Buffer:
             case BufferTarget::Uniform_Buffer:
             case BufferTarget::Shader_Storage_Buffer:
-                glBindBufferBase(static_cast<GLenum>(m_target), m_bindingPoint, id());
+                if (m_arena) {
+                    if (m_size > 0) BindingPointManager::instance().bind(m_target, m_bindingPoint, id(), m_offset, m_size);
+                }
+                else BindingPointManager::instance().bind(m_target, m_bindingPoint, id());
             break;
         }
     }
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "merlin/memory/frameBuffer.h"
+#include "merlin/memory/memoryTracker.h"
 
 
 namespace Merlin {
@@ -18,9 +19,13 @@ namespace Merlin {
 
         // Generate and bind the framebuffer object
         glGenFramebuffers(1, &_FrameBufferID);
+
+        //the storage belongs to the attachments, the FBO is tracked so leaks show up in the report
+        MemoryTracker::instance().track(this, MemoryCategory::FRAMEBUFFER, _FrameBufferID, [this]() { return "FBO " + std::to_string(_FrameBufferID) + " (" + std::to_string(_width) + "x" + std::to_string(_height) + ")"; });
     }
 
     FrameBuffer::~FrameBuffer(){
+        MemoryTracker::onRelease(this);
         glDeleteFramebuffers(1, &_FrameBufferID);
     }
 
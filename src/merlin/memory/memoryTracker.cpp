@@ -0,0 +1,263 @@
+#include "pch.h"
+#include "merlin/memory/memoryTracker.h"
+
+#include <fstream>
+#include <iomanip>
+#include <filesystem>
+
+namespace Merlin {
+
+    static constexpr size_t HISTORY_SIZE = 240;
+
+    MemoryTracker::~MemoryTracker() {
+        reportLeaks();
+        s_alive = false;
+    }
+
+    void MemoryTracker::track(const void* owner, MemoryCategory category, GLuint id, std::function<std::string()> name) {
+        MemoryRecord& record = m_records[owner];
+        record.category = category;
+        record.name = name;
+        record.id = id;
+        record.site = currentSite();
+        record.frame = m_frame;
+    }
+
+    void MemoryTracker::update(const void* owner, GLuint id, size_t bytes, const std::string& usage) {
+        auto it = m_records.find(owner);
+        if (it == m_records.end()) return;
+        MemoryRecord& record = it->second;
+        record.id = id;
+        if (!usage.empty()) record.usage = usage;
+
+        if (record.category != MemoryCategory::BUFFER_RANGE) {
+            if (record.bytes > 0) {
+                m_total -= record.bytes;
+                m_currentFrame.freed += record.bytes;
+                m_currentFrame.releases++;
+            }
+            if (bytes > 0) {
+                m_total += bytes;
+                m_currentFrame.allocated += bytes;
+                m_currentFrame.allocations++;
+            }
+            m_highWater = std::max(m_highWater, m_total);
+        }
+        record.bytes = bytes;
+    }
+
+    void MemoryTracker::untrack(const void* owner) {
+        auto it = m_records.find(owner);
+        if (it == m_records.end()) return;
+        if (it->second.category != MemoryCategory::BUFFER_RANGE && it->second.bytes > 0) {
+            m_total -= it->second.bytes;
+            m_currentFrame.freed += it->second.bytes;
+            m_currentFrame.releases++;
+        }
+        m_records.erase(it);
+    }
+
+    void MemoryTracker::onRelease(const void* owner) {
+        if (s_alive) instance().untrack(owner);
+    }
+
+    void MemoryTracker::newFrame() {
+        m_lastFrame = m_currentFrame;
+        m_currentFrame = MemoryFrameStats();
+        m_frame++;
+
+        if (m_history.size() >= HISTORY_SIZE) {
+            m_history.erase(m_history.begin());
+            m_churnHistory.erase(m_churnHistory.begin());
+        }
+        m_history.push_back(m_total / (1024.0f * 1024.0f));
+        m_churnHistory.push_back((m_lastFrame.allocated + m_lastFrame.freed) / (1024.0f * 1024.0f));
+    }
+
+    void MemoryTracker::pushScope(const std::string& label) {
+        m_scopes.push_back(label);
+    }
+
+    void MemoryTracker::popScope() {
+        if (!m_scopes.empty()) m_scopes.pop_back();
+    }
+
+    std::string MemoryTracker::currentSite() const {
+        if (m_scopes.empty()) return "unscoped";
+        std::string site;
+        for (const std::string& scope : m_scopes) {
+            if (!site.empty()) site += " > ";
+            site += scope;
+        }
+        return site;
+    }
+
+    std::vector<std::pair<const void*, const MemoryRecord*>> MemoryTracker::sortedRecords() const {
+        std::vector<std::pair<const void*, const MemoryRecord*>> records;
+        records.reserve(m_records.size());
+        for (const auto& entry : m_records) records.push_back({ entry.first, &entry.second });
+        std::sort(records.begin(), records.end(), [](const auto& a, const auto& b) { return a.second->bytes > b.second->bytes; });
+        return records;
+    }
+
+    const char* MemoryTracker::categoryToString(MemoryCategory category) {
+        switch (category) {
+        case MemoryCategory::BUFFER: return "Buffer";
+        case MemoryCategory::BUFFER_RANGE: return "BufferRange";
+        case MemoryCategory::TEXTURE: return "Texture";
+        case MemoryCategory::RENDERBUFFER: return "RenderBuffer";
+        case MemoryCategory::FRAMEBUFFER: return "FrameBuffer";
+        }
+        return "Unknown";
+    }
+
+    size_t MemoryTracker::bytesPerTexel(GLenum internalFormat) {
+        switch (internalFormat) {
+        case GL_R8: case GL_R8I: case GL_R8UI: case GL_R8_SNORM: case GL_RED: case GL_STENCIL_INDEX8:
+            return 1;
+        case GL_R16: case GL_R16F: case GL_R16I: case GL_R16UI: case GL_RG8: case GL_RG8I: case GL_RG8UI: case GL_RG:
+        case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RGB8: case GL_RGB8I: case GL_RGB8UI: case GL_SRGB8: case GL_RGB: case GL_DEPTH_COMPONENT24:
+            return 3;
+        case GL_R32F: case GL_R32I: case GL_R32UI: case GL_RG16: case GL_RG16F: case GL_RG16I: case GL_RG16UI:
+        case GL_RGBA8: case GL_RGBA8I: case GL_RGBA8UI: case GL_SRGB8_ALPHA8: case GL_RGBA: case GL_RGB10_A2: case GL_R11F_G11F_B10F:
+        case GL_DEPTH_COMPONENT32: case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8: case GL_DEPTH_COMPONENT:
+            return 4;
+        case GL_RGB16: case GL_RGB16F: case GL_RGB16I: case GL_RGB16UI:
+            return 6;
+        case GL_RG32F: case GL_RG32I: case GL_RG32UI: case GL_RGBA16: case GL_RGBA16F: case GL_RGBA16I: case GL_RGBA16UI:
+        case GL_DEPTH32F_STENCIL8:
+            return 8;
+        case GL_RGB32F: case GL_RGB32I: case GL_RGB32UI:
+            return 12;
+        case GL_RGBA32F: case GL_RGBA32I: case GL_RGBA32UI:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+
+    void MemoryTracker::onImGuiRender(bool* open) {
+        if (!ImGui::Begin("GPU Memory", open)) {
+            ImGui::End();
+            return;
+        }
+
+        ImGui::Text("Live objects : %zu", m_records.size());
+        ImGui::Text("Allocated    : %.2f MB (peak %.2f MB)", m_total / (1024.0 * 1024.0), m_highWater / (1024.0 * 1024.0));
+        ImGui::Text("Last frame   : +%.2f MB / -%.2f MB (%zu allocations, %zu releases)",
+            m_lastFrame.allocated / (1024.0 * 1024.0), m_lastFrame.freed / (1024.0 * 1024.0), m_lastFrame.allocations, m_lastFrame.releases);
+
+        if (!m_history.empty()) {
+            ImGui::PlotLines("Total (MB)", m_history.data(), int(m_history.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+            ImGui::PlotHistogram("Churn (MB)", m_churnHistory.data(), int(m_churnHistory.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+        }
+
+        if (ImGui::Button("Export CSV")) exportCSV("gpu_memory.csv");
+        ImGui::SameLine();
+        if (ImGui::Button("Export JSON")) exportJSON("gpu_memory.json");
+
+        if (ImGui::BeginTable("gpu_memory_records", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable)) {
+            ImGui::TableSetupColumn("Name");
+            ImGui::TableSetupColumn("Type");
+            ImGui::TableSetupColumn("ID");
+            ImGui::TableSetupColumn("Size (KB)");
+            ImGui::TableSetupColumn("Usage");
+            ImGui::TableSetupColumn("Site");
+            ImGui::TableHeadersRow();
+
+            for (const auto& entry : sortedRecords()) {
+                const MemoryRecord& record = *entry.second;
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(record.name ? record.name().c_str() : "");
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(categoryToString(record.category));
+                ImGui::TableNextColumn(); ImGui::Text("%u", record.id);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", record.bytes / 1024.0);
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(record.usage.c_str());
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(record.site.c_str());
+            }
+            ImGui::EndTable();
+        }
+        ImGui::End();
+    }
+
+    bool MemoryTracker::exportCSV(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            Console::error("MemoryTracker") << "cannot open " << path << Console::endl;
+            return false;
+        }
+
+        file << "name,type,id,bytes,usage,site,frame\n";
+        for (const auto& entry : sortedRecords()) {
+            const MemoryRecord& record = *entry.second;
+            file << '"' << (record.name ? record.name() : "") << "\","
+                << categoryToString(record.category) << ','
+                << record.id << ','
+                << record.bytes << ",\""
+                << record.usage << "\",\""
+                << record.site << "\","
+                << record.frame << '\n';
+        }
+        Console::info("MemoryTracker") << "memory report exported to " << path << Console::endl;
+        return true;
+    }
+
+    static std::string escapeJSON(const std::string& str) {
+        std::string out;
+        for (char c : str) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    bool MemoryTracker::exportJSON(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            Console::error("MemoryTracker") << "cannot open " << path << Console::endl;
+            return false;
+        }
+
+        file << "{\n";
+        file << "  \"total\": " << m_total << ",\n";
+        file << "  \"highWaterMark\": " << m_highWater << ",\n";
+        file << "  \"frame\": " << m_frame << ",\n";
+        file << "  \"objects\": [\n";
+        auto records = sortedRecords();
+        for (size_t i = 0; i < records.size(); i++) {
+            const MemoryRecord& record = *records[i].second;
+            file << "    { \"name\": \"" << escapeJSON(record.name ? record.name() : "") << "\""
+                << ", \"type\": \"" << categoryToString(record.category) << "\""
+                << ", \"id\": " << record.id
+                << ", \"bytes\": " << record.bytes
+                << ", \"usage\": \"" << escapeJSON(record.usage) << "\""
+                << ", \"site\": \"" << escapeJSON(record.site) << "\""
+                << ", \"frame\": " << record.frame << " }"
+                << (i + 1 < records.size() ? ",\n" : "\n");
+        }
+        file << "  ]\n}\n";
+        Console::info("MemoryTracker") << "memory report exported to " << path << Console::endl;
+        return true;
+    }
+
+    void MemoryTracker::reportLeaks() const {
+        if (m_records.empty()) return;
+
+        Console::warn("MemoryTracker") << m_records.size() << " GPU object(s) still alive (" << m_total / 1024 << " KB), peak usage was " << m_highWater / 1024 << " KB" << Console::endl;
+        for (const auto& entry : sortedRecords()) {
+            const MemoryRecord& record = *entry.second;
+            Console::warn("MemoryTracker") << categoryToString(record.category) << " '" << (record.name ? record.name() : "") << "' (id " << record.id << ", "
+                << record.bytes / 1024 << " KB) created in " << record.site << " at frame " << record.frame << Console::endl;
+        }
+    }
+
+    MemoryScope::MemoryScope(const std::string& label, std::source_location location) {
+        MemoryTracker::instance().pushScope(label + " (" + std::filesystem::path(location.file_name()).filename().string() + ":" + std::to_string(location.line()) + ")");
+    }
+
+    MemoryScope::~MemoryScope() {
+        MemoryTracker::instance().popScope();
+    }
+}
@@ -0,0 +1,60 @@
+#include "pch.h"
+#include "merlin/memory/readback.h"
+
+#include <cstring>
+
+namespace Merlin {
+
+    AbstractReadback::AbstractReadback(GLuint source, GLintptr offset, GLsizeiptr size) :
+        m_staging(BufferTarget::Copy_Write_Buffer), m_offset(offset), m_size(size) {
+
+        m_staging.rename("Readback");
+        if (m_size <= 0) {
+            m_ready = true;
+            return;
+        }
+
+        m_staging.allocate(m_size, BufferStorageFlags::MapRead);
+        glCopyNamedBufferSubData(source, m_staging.id(), m_offset, 0, m_size);
+        m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    AbstractReadback::~AbstractReadback() {
+        if (m_fence) glDeleteSync(m_fence);
+    }
+
+    bool AbstractReadback::ready() {
+        if (m_ready) return true;
+
+        //flush once so the fence is guaranteed to reach the GPU, later polls don't touch the command queue
+        GLenum status = glClientWaitSync(m_fence, m_flushed ? 0 : GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        m_flushed = true;
+
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED) {
+            if (status == GL_WAIT_FAILED) Console::error("Readback") << "fence wait failed" << Console::endl;
+            glDeleteSync(m_fence);
+            m_fence = nullptr;
+            m_ready = true;
+        }
+        return m_ready;
+    }
+
+    void AbstractReadback::wait() {
+        while (!m_ready) {
+            if (m_fence) glClientWaitSync(m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            m_flushed = true;
+            ready();
+        }
+    }
+
+    void AbstractReadback::fetch(void* data) {
+        if (m_size <= 0) return;
+        void* ptr = m_staging.mapRange(0, m_size, GL_MAP_READ_BIT);
+        if (!ptr) {
+            Console::error("Readback") << "failed to map staging buffer" << Console::endl;
+            return;
+        }
+        memcpy(data, ptr, m_size);
+        m_staging.unmap();
+    }
+}
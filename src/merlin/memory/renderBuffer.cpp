@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "merlin/memory/renderBuffer.h"
+#include "merlin/memory/memoryTracker.h"
 
 namespace Merlin {
 	RenderBuffer::RenderBuffer(int samples) : _samples(samples){
@@ -9,9 +10,11 @@ namespace Merlin {
 
 		// bind the renderbuffer object to the GL_RENDERBUFFER target
 		glBindRenderbuffer(GL_RENDERBUFFER, _RenderbufferID);
+		MemoryTracker::instance().track(this, MemoryCategory::RENDERBUFFER, _RenderbufferID, [this]() { return "RBO " + std::to_string(_RenderbufferID); });
 	}
 
 	RenderBuffer::~RenderBuffer() {
+		MemoryTracker::onRelease(this);
 		// Delete the renderbuffer object
 		glDeleteRenderbuffers(1, &_RenderbufferID);
 	}
@@ -32,6 +35,7 @@ namespace Merlin {
 			glRenderbufferStorageMultisample(GL_RENDERBUFFER, _samples, _format, width, height);
 		else
 			glRenderbufferStorage(GL_RENDERBUFFER, _format, width, height);
+		trackMemory(width, height);
 	}
 
 	void RenderBuffer::reserve(GLsizei width, GLsizei height, GLenum format) {
@@ -41,5 +45,11 @@ namespace Merlin {
 			glRenderbufferStorageMultisample(GL_RENDERBUFFER, _samples, format, width, height);
 		else
 			glRenderbufferStorage(GL_RENDERBUFFER, format, width, height);
+		trackMemory(width, height);
+	}
+
+	void RenderBuffer::trackMemory(GLsizei width, GLsizei height) const {
+		size_t bytes = size_t(width) * size_t(height) * std::max(_samples, GLuint(1)) * MemoryTracker::bytesPerTexel(_format);
+		MemoryTracker::instance().update(this, _RenderbufferID, bytes);
 	}
 }
\ No newline at end of file
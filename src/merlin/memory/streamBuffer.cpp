@@ -0,0 +1,115 @@
+#include "pch.h"
+#include "merlin/memory/streamBuffer.h"
+
+#include <cstring>
+
+namespace Merlin {
+
+    StreamBuffer::~StreamBuffer() {
+        if (!m_shutdown) release(); //static destruction, the context may already be gone
+    }
+
+    void StreamBuffer::shutdown() {
+        release();
+        m_shutdown = true;
+    }
+
+    void StreamBuffer::reserve(GLsizeiptr segmentSize) {
+        if (m_ring && segmentSize <= m_segmentSize) return;
+        if (m_ring) m_stats.resizes++;
+        release();
+
+        m_segmentSize = segmentSize;
+        m_ring = createShared<ImmutableBufferObject<GLubyte>>(BufferTarget::Copy_Read_Buffer);
+        m_ring->rename("StreamBuffer");
+        m_ring->allocate(m_segmentSize * SEGMENTS, BufferStorageFlags::MapWrite | BufferStorageFlags::MapPersistent | BufferStorageFlags::MapCoherent);
+        m_ptr = static_cast<GLubyte*>(m_ring->mapRange(0, m_segmentSize * SEGMENTS, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT));
+
+        if (!m_ptr) {
+            Console::error("StreamBuffer") << "failed to map the staging ring" << Console::endl;
+            m_ring = nullptr;
+            m_segmentSize = 0;
+            return;
+        }
+
+        m_segment = 0;
+        m_head = 0;
+        Console::trace("StreamBuffer") << "staging ring allocated (" << SEGMENTS << "x" << size_t(m_segmentSize) << " bytes)" << Console::endl;
+    }
+
+    void StreamBuffer::upload(GLuint destination, GLintptr offset, GLsizeiptr size, const void* data) {
+        if (size > m_segmentSize) {
+            GLsizeiptr segmentSize = std::max(m_segmentSize, DEFAULT_SEGMENT_SIZE);
+            while (segmentSize < size) segmentSize *= 2;
+            reserve(segmentSize);
+            if (!m_ptr) {
+                glNamedBufferSubData(destination, offset, size, data);
+                return;
+            }
+        }
+
+        if (m_head + size > m_segmentSize) nextSegment();
+
+        GLintptr source = m_segment * m_segmentSize + m_head;
+        memcpy(m_ptr + source, data, size);
+        glCopyNamedBufferSubData(m_ring->id(), destination, source, offset, size);
+
+        m_head += (size + 15) & ~GLsizeiptr(15); //keep uploads 16 bytes aligned
+        m_stats.writes++;
+        m_stats.bytes += size;
+    }
+
+    void StreamBuffer::endFrame() {
+        if (!m_ring || m_head == 0) return;
+        nextSegment();
+    }
+
+    void StreamBuffer::fence() {
+        if (m_fences[m_segment]) glDeleteSync(m_fences[m_segment]);
+        m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void StreamBuffer::nextSegment() {
+        fence();
+        m_segment = (m_segment + 1) % SEGMENTS;
+        m_head = 0;
+        m_stats.wraps++;
+
+        GLsync sync = m_fences[m_segment];
+        if (!sync) return;
+
+        GLenum status = glClientWaitSync(sync, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            //The GPU is still copying from this segment, a plain SubData upload would have stalled here too
+            m_stats.stalls++;
+            while (status == GL_TIMEOUT_EXPIRED) {
+                status = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            }
+        }
+        glDeleteSync(sync);
+        m_fences[m_segment] = nullptr;
+    }
+
+    void StreamBuffer::release() {
+        for (GLsync& sync : m_fences) {
+            if (!sync) continue;
+            glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(sync);
+            sync = nullptr;
+        }
+
+        if (m_ring && m_ptr) m_ring->unmap();
+        m_ptr = nullptr;
+        m_ring = nullptr;
+        m_head = 0;
+        m_segment = 0;
+    }
+
+    void StreamBuffer::printStats() const {
+        Console::info("StreamBuffer") << "writes: " << m_stats.writes
+            << ", uploaded: " << m_stats.bytes / 1024 << " Ko"
+            << ", wraps: " << m_stats.wraps
+            << ", stalls: " << m_stats.stalls
+            << ", resizes: " << m_stats.resizes << Console::endl;
+    }
+}
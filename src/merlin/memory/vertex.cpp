@@ -0,0 +1,120 @@
+#include "pch.h"
+#include "merlin/memory/vertex.h"
+
+#include <glm/gtc/packing.hpp>
+#include <cstring>
+
+namespace Merlin {
+
+    static inline float signNotZero(float v) {
+        return v >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    GLuint octEncode(const glm::vec3& normal) {
+        float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (l1 == 0.0f) return glm::packSnorm2x16(glm::vec2(0.0f));
+
+        glm::vec2 e = glm::vec2(normal.x, normal.y) / l1;
+        if (normal.z < 0.0f) {
+            e = glm::vec2((1.0f - std::abs(e.y)) * signNotZero(e.x), (1.0f - std::abs(e.x)) * signNotZero(e.y));
+        }
+        return glm::packSnorm2x16(e);
+    }
+
+    glm::vec3 octDecode(GLuint encoded) {
+        glm::vec2 e = glm::unpackSnorm2x16(encoded);
+        glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+        if (n.z < 0.0f) {
+            n.x = (1.0f - std::abs(e.y)) * signNotZero(e.x);
+            n.y = (1.0f - std::abs(e.x)) * signNotZero(e.y);
+        }
+        return glm::normalize(n);
+    }
+
+    static GLuint packTangent(const Vertex& vertex) {
+        if (glm::length(vertex.tangent) == 0.0f) return glm::packSnorm3x10_1x2(glm::vec4(0.0f));
+        //the shader rebuilds the bitangent as cross(normal, tangent), only its handedness is stored
+        float handedness = glm::dot(glm::cross(vertex.normal, vertex.tangent), vertex.bitangent) < 0.0f ? -1.0f : 1.0f;
+        return glm::packSnorm3x10_1x2(glm::vec4(glm::normalize(vertex.tangent), handedness));
+    }
+
+    VertexBufferLayout getVertexLayout(VertexFormat format) {
+        VertexBufferLayout layout;
+        switch (format) {
+        case VertexFormat::POSITION:
+            layout.pushAttribute(0, GL_FLOAT, 3); //Vertex pos
+            break;
+        case VertexFormat::POSITION_NORMAL:
+            layout.pushAttribute(0, GL_FLOAT, 3); //Vertex pos
+            layout.pushAttribute(1, GL_SHORT, 2, true); //octahedral normal
+            break;
+        case VertexFormat::COMPACT:
+            layout.pushAttribute(0, GL_FLOAT, 3); //Vertex pos
+            layout.pushAttribute(1, GL_SHORT, 2, true); //octahedral normal
+            layout.pushAttribute(3, GL_HALF_FLOAT, 2); //Texture coordinates
+            layout.pushAttribute(4, GL_INT_2_10_10_10_REV, 4, true); //tangent + bitangent sign
+            break;
+        default:
+            layout = Vertex::getLayout();
+            break;
+        }
+        return layout;
+    }
+
+    GLuint vertexSize(VertexFormat format) {
+        switch (format) {
+        case VertexFormat::POSITION: return sizeof(VertexP);
+        case VertexFormat::POSITION_NORMAL: return sizeof(VertexPN);
+        case VertexFormat::COMPACT: return sizeof(VertexCompact);
+        default: return sizeof(Vertex);
+        }
+    }
+
+    const char* vertexFormatToString(VertexFormat format) {
+        switch (format) {
+        case VertexFormat::FULL: return "full";
+        case VertexFormat::POSITION: return "position";
+        case VertexFormat::POSITION_NORMAL: return "position_normal";
+        case VertexFormat::COMPACT: return "compact";
+        case VertexFormat::AUTO: return "auto";
+        }
+        return "unknown";
+    }
+
+    std::vector<GLubyte> packVertices(const Vertex* vertices, size_t count, VertexFormat format) {
+        std::vector<GLubyte> data(count * vertexSize(format));
+
+        switch (format) {
+        case VertexFormat::POSITION: {
+            VertexP* dst = reinterpret_cast<VertexP*>(data.data());
+            for (size_t i = 0; i < count; i++) dst[i].position = vertices[i].position;
+            break;
+        }
+        case VertexFormat::POSITION_NORMAL: {
+            VertexPN* dst = reinterpret_cast<VertexPN*>(data.data());
+            for (size_t i = 0; i < count; i++) {
+                dst[i].position = vertices[i].position;
+                dst[i].normal = octEncode(vertices[i].normal);
+            }
+            break;
+        }
+        case VertexFormat::COMPACT: {
+            VertexCompact* dst = reinterpret_cast<VertexCompact*>(data.data());
+            for (size_t i = 0; i < count; i++) {
+                dst[i].position = vertices[i].position;
+                dst[i].normal = octEncode(vertices[i].normal);
+                dst[i].texCoord = glm::packHalf2x16(vertices[i].texCoord);
+                dst[i].tangent = packTangent(vertices[i]);
+            }
+            break;
+        }
+        case VertexFormat::AUTO:
+            Console::warn("Vertex") << "cannot pack vertices in AUTO format, falling back to FULL" << Console::endl;
+            [[fallthrough]];
+        default:
+            if (count > 0) memcpy(data.data(), vertices, data.size());
+            break;
+        }
+        return data;
+    }
+}
@@ -0,0 +1,244 @@
+#include "pch.h"
+#include "merlin/physics/checkpoint.h"
+#include "merlin/utils/cpuProfiler.h"
+
+#include <cstring>
+#include <filesystem>
+
+namespace Merlin {
+
+	static uint64_t alignCheckpoint(uint64_t offset) {
+		return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+	}
+
+	Checkpoint::Checkpoint(const std::string& path, size_t instancesCount, size_t activeInstancesCount) : m_path(path) {
+		memset(&m_header, 0, sizeof(CheckpointHeader));
+		memcpy(m_header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+		m_header.version = CHECKPOINT_VERSION;
+		m_header.instancesCount = instancesCount;
+		m_header.activeInstancesCount = activeInstancesCount;
+	}
+
+	void Checkpoint::addEntry(CheckpointEntryKind kind, const std::string& name, uint32_t typeSize, uint64_t size, const FieldFormat* format) {
+		CheckpointEntry entry;
+		memset(&entry, 0, sizeof(CheckpointEntry));
+		entry.kind = kind;
+		entry.typeSize = typeSize;
+		entry.size = size;
+		entry.nameOffset = uint32_t(m_names.size());
+		entry.nameLength = uint32_t(name.size());
+		entry.precision = format ? uint32_t(format->precision()) : CHECKPOINT_NOT_QUANTIZED;
+		entry.components = format ? format->components() : 0;
+
+		m_names += name;
+		m_entries.push_back(entry);
+		m_bytes += size;
+	}
+
+	void Checkpoint::addBuffer(CheckpointEntryKind kind, const AbstractBufferObject& buffer, const FieldFormat* format) {
+		addEntry(kind, buffer.name(), buffer.type(), buffer.size(), format);
+		m_readbacks.push_back(createShared<Readback<GLubyte>>(buffer.id(), buffer.offset(), 0, buffer.size()));
+		m_blobs.emplace_back();
+	}
+
+	void Checkpoint::addLink(const std::string& shader, const std::set<std::string>& entries) {
+		std::vector<GLubyte> blob;
+		for (const std::string& entry : entries) {
+			blob.insert(blob.end(), entry.begin(), entry.end());
+			blob.push_back(0);
+		}
+		addEntry(CheckpointEntryKind::LINK, shader, 1, blob.size(), nullptr);
+		m_readbacks.push_back(nullptr);
+		m_blobs.push_back(std::move(blob));
+	}
+
+	bool Checkpoint::ready() {
+		for (auto& readback : m_readbacks) {
+			if (readback && !readback->ready()) return false;
+		}
+		return true;
+	}
+
+	void Checkpoint::fetch() {
+		if (m_fetched) return;
+		for (size_t i = 0; i < m_readbacks.size(); i++) {
+			if (!m_readbacks[i]) continue;
+			m_blobs[i] = m_readbacks[i]->get();
+			m_readbacks[i] = nullptr; //the staging buffer is released as soon as its content is on the host
+		}
+		m_fetched = true;
+	}
+
+	bool Checkpoint::write() {
+		if (!m_fetched) return false;
+
+		//layout : header, entry table, names, then the page aligned blobs
+		m_header.entryCount = uint32_t(m_entries.size());
+		m_header.namesOffset = sizeof(CheckpointHeader) + m_entries.size() * sizeof(CheckpointEntry);
+		m_header.namesSize = m_names.size();
+
+		uint64_t offset = alignCheckpoint(m_header.namesOffset + m_header.namesSize);
+		for (CheckpointEntry& entry : m_entries) {
+			entry.offset = offset;
+			offset = alignCheckpoint(offset + entry.size);
+		}
+		m_header.fileSize = offset;
+
+		std::string temporary = m_path + ".tmp";
+		MappedFile file;
+		if (!file.create(temporary, size_t(m_header.fileSize))) return false;
+
+		uint8_t* data = file.data();
+		memcpy(data, &m_header, sizeof(CheckpointHeader));
+		if (!m_entries.empty()) memcpy(data + sizeof(CheckpointHeader), m_entries.data(), m_entries.size() * sizeof(CheckpointEntry));
+		if (!m_names.empty()) memcpy(data + m_header.namesOffset, m_names.data(), m_names.size());
+		for (size_t i = 0; i < m_entries.size(); i++) {
+			if (!m_blobs[i].empty()) memcpy(data + m_entries[i].offset, m_blobs[i].data(), m_blobs[i].size());
+			std::vector<GLubyte>().swap(m_blobs[i]);
+		}
+
+		bool flushed = file.flush();
+		file.close();
+		if (!flushed) return false;
+
+		std::error_code error;
+		std::filesystem::rename(temporary, m_path, error);
+		return !error;
+	}
+
+
+
+	bool CheckpointFile::open(const std::string& path) {
+		if (!m_file.open(path)) {
+			Console::error("Checkpoint") << "cannot map " << path << Console::endl;
+			return false;
+		}
+
+		if (m_file.size() < sizeof(CheckpointHeader) || memcmp(header().magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+			Console::error("Checkpoint") << path << " is not a checkpoint file" << Console::endl;
+			m_file.close();
+			return false;
+		}
+
+		const CheckpointHeader& h = header();
+		if (h.version != CHECKPOINT_VERSION) {
+			Console::error("Checkpoint") << path << " has version " << h.version << ", expected " << CHECKPOINT_VERSION << Console::endl;
+			m_file.close();
+			return false;
+		}
+
+		//only the table is validated, the blobs are uploaded without being touched on the CPU
+		bool valid = h.fileSize == m_file.size()
+			&& h.namesOffset == sizeof(CheckpointHeader) + uint64_t(h.entryCount) * sizeof(CheckpointEntry)
+			&& h.namesOffset + h.namesSize <= m_file.size();
+		for (uint32_t i = 0; valid && i < h.entryCount; i++) {
+			const CheckpointEntry& e = entry(i);
+			valid = e.offset % CHECKPOINT_ALIGNMENT == 0 && e.offset + e.size <= m_file.size()
+				&& uint64_t(e.nameOffset) + e.nameLength <= h.namesSize && e.typeSize > 0;
+		}
+
+		if (!valid) {
+			Console::error("Checkpoint") << path << " is truncated or corrupted" << Console::endl;
+			m_file.close();
+			return false;
+		}
+		return true;
+	}
+
+	std::string CheckpointFile::name(const CheckpointEntry& entry) const {
+		const char* names = reinterpret_cast<const char*>(m_file.data() + header().namesOffset);
+		return std::string(names + entry.nameOffset, entry.nameLength);
+	}
+
+	std::set<std::string> CheckpointFile::links(const CheckpointEntry& entry) const {
+		std::set<std::string> result;
+		const char* begin = static_cast<const char*>(data(entry));
+		const char* end = begin + entry.size;
+		while (begin < end) {
+			size_t length = strnlen(begin, end - begin);
+			result.insert(std::string(begin, length));
+			begin += length + 1;
+		}
+		return result;
+	}
+
+
+
+	CheckpointWriter::~CheckpointWriter() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_condition.notify_all();
+		if (m_thread.joinable()) m_thread.join();
+	}
+
+	void CheckpointWriter::submit(Checkpoint_Ptr checkpoint) {
+		if (!m_thread.joinable()) m_thread = std::thread(&CheckpointWriter::run, this);
+		m_pending.push_back(checkpoint);
+	}
+
+	void CheckpointWriter::poll() {
+		for (auto it = m_pending.begin(); it != m_pending.end();) {
+			if (!(*it)->ready()) {
+				++it;
+				continue;
+			}
+			(*it)->fetch();
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queue.push_back(*it);
+			}
+			m_condition.notify_one();
+			m_queued++;
+			it = m_pending.erase(it);
+		}
+		report();
+	}
+
+	void CheckpointWriter::wait() {
+		for (auto& checkpoint : m_pending) checkpoint->fetch();
+		poll();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_written.wait(lock, [this] { return m_queue.empty() && m_done.size() == m_queued; });
+		lock.unlock();
+		report();
+	}
+
+	void CheckpointWriter::report() {
+		std::vector<std::pair<Checkpoint_Ptr, bool>> done;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			done.swap(m_done);
+		}
+		m_queued -= done.size();
+
+		for (auto& result : done) {
+			if (result.second) Console::info("Checkpoint") << "saved " << result.first->path() << " (" << result.first->bytes() / (1024.0 * 1024.0) << " MB)" << Console::endl;
+			else Console::error("Checkpoint") << "failed to write " << result.first->path() << Console::endl;
+		}
+	}
+
+	void CheckpointWriter::run() {
+		CPUProfiler::instance().setThreadName("CheckpointWriter");
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true) {
+			m_condition.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+			if (m_queue.empty()) return; //stopped once everything was written
+
+			Checkpoint_Ptr checkpoint = m_queue.front();
+			lock.unlock();
+			bool written;
+			{
+				MERLIN_PROFILE_SCOPE("CheckpointWriter::write");
+				written = checkpoint->write();
+			}
+			lock.lock();
+
+			m_queue.pop_front();
+			m_done.push_back({ checkpoint, written });
+			m_written.notify_all();
+		}
+	}
+}
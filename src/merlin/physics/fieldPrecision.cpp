@@ -0,0 +1,249 @@
+#include "pch.h"
+#include "merlin/physics/fieldPrecision.h"
+#include "merlin/memory/ssbo.h"
+#include "merlin/shaders/computeShader.h"
+
+#include <glm/gtc/packing.hpp>
+#include <sstream>
+#include <random>
+
+namespace Merlin {
+
+	FieldFormat::FieldFormat(FieldPrecision precision, GLuint components) : m_precision(precision), m_components(std::clamp(components, 1u, 4u)) {
+		if (m_precision == FieldPrecision::UNORM10_10_10_2 && m_components < 3) {
+			Console::warn("FieldFormat") << "10:10:10:2 packing needs 3 or 4 components, falling back to UNORM8" << Console::endl;
+			m_precision = FieldPrecision::UNORM8;
+		}
+	}
+
+	const char* FieldFormat::toString(FieldPrecision precision) {
+		switch (precision) {
+		case FieldPrecision::FP32: return "fp32";
+		case FieldPrecision::FP16: return "fp16";
+		case FieldPrecision::SNORM16: return "snorm16";
+		case FieldPrecision::UNORM8: return "unorm8";
+		case FieldPrecision::UNORM10_10_10_2: return "unorm10_10_10_2";
+		}
+		return "unknown";
+	}
+
+	GLuint FieldFormat::storageSize() const {
+		switch (m_precision) {
+		case FieldPrecision::FP32: return m_components == 3 ? 16 : m_components * 4;
+		case FieldPrecision::FP16:
+		case FieldPrecision::SNORM16: return m_components <= 2 ? 4 : 8;
+		default: return 4;
+		}
+	}
+
+	const char* FieldFormat::storageType() const {
+		switch (storageSize()) {
+		case 4: return m_precision == FieldPrecision::FP32 ? "float" : "uint";
+		case 8: return m_precision == FieldPrecision::FP32 ? "vec2" : "uvec2";
+		default: return "vec4";
+		}
+	}
+
+	const char* FieldFormat::valueType() const {
+		static const char* types[] = { "float", "vec2", "vec3", "vec4" };
+		return types[m_components - 1];
+	}
+
+	std::string FieldFormat::accessors(const std::string& name) const {
+		static const char* swizzles[] = { ".x", ".xy", ".xyz", "" };
+		static const char* widen[] = { "vec4(v, 0.0, 0.0, 0.0)", "vec4(v, 0.0, 0.0)", "vec4(v, 0.0)", "v" };
+
+		//every format goes through vec4 <name>_unpack(storage) / storage <name>_pack(vec4)
+		std::string pack, unpack;
+		switch (m_precision) {
+		case FieldPrecision::FP32:
+			if (m_components == 3) { unpack = "p"; pack = "v"; }
+			else {
+				static const char* fromStorage[] = { "vec4(p, 0.0, 0.0, 0.0)", "vec4(p, 0.0, 0.0)", "", "p" };
+				static const char* toStorage[] = { "v.x", "v.xy", "", "v" };
+				unpack = fromStorage[m_components - 1];
+				pack = toStorage[m_components - 1];
+			}
+			break;
+		case FieldPrecision::FP16:
+		case FieldPrecision::SNORM16: {
+			std::string fn = m_precision == FieldPrecision::FP16 ? "Half2x16" : "Snorm2x16";
+			if (storageSize() == 4) {
+				unpack = "vec4(unpack" + fn + "(p), 0.0, 0.0)";
+				pack = "pack" + fn + "(v.xy)";
+			}
+			else {
+				unpack = "vec4(unpack" + fn + "(p.x), unpack" + fn + "(p.y))";
+				pack = "uvec2(pack" + fn + "(v.xy), pack" + fn + "(v.zw))";
+			}
+			break;
+		}
+		case FieldPrecision::UNORM8:
+			unpack = "unpackUnorm4x8(p)";
+			pack = "packUnorm4x8(v)";
+			break;
+		case FieldPrecision::UNORM10_10_10_2:
+			unpack = "vec4(p & 1023u, (p >> 10) & 1023u, (p >> 20) & 1023u, p >> 30) / vec4(1023.0, 1023.0, 1023.0, 3.0)";
+			pack = "merlin_pack1010102(v)";
+			break;
+		}
+
+		std::stringstream ss;
+		ss << "layout(std430) buffer " << name << " { " << storageType() << " " << name << "_data[]; };\n";
+		if (m_precision == FieldPrecision::UNORM10_10_10_2) {
+			//several fields can share the packing function, guard it
+			ss << "#ifndef MERLIN_PACK_1010102\n#define MERLIN_PACK_1010102\n";
+			ss << "uint merlin_pack1010102(vec4 v) { uvec4 q = uvec4(round(clamp(v, 0.0, 1.0) * vec4(1023.0, 1023.0, 1023.0, 3.0)));"
+				<< " return q.x | (q.y << 10) | (q.z << 20) | (q.w << 30); }\n";
+			ss << "#endif\n";
+		}
+		ss << "vec4 " << name << "_unpack(" << storageType() << " p) { return " << unpack << "; }\n";
+		ss << storageType() << " " << name << "_pack(vec4 v) { return " << pack << "; }\n";
+		ss << valueType() << " load_" << name << "(uint i) { return " << name << "_unpack(" << name << "_data[i])" << swizzles[m_components - 1] << "; }\n";
+		ss << "void store_" << name << "(uint i, " << valueType() << " v) { " << name << "_data[i] = " << name << "_pack(" << widen[m_components - 1] << "); }\n";
+		return ss.str();
+	}
+
+	static GLuint pack1010102(const glm::vec4& v) {
+		glm::uvec4 q = glm::uvec4(glm::round(glm::clamp(v, glm::vec4(0.0f), glm::vec4(1.0f)) * glm::vec4(1023.0f, 1023.0f, 1023.0f, 3.0f)));
+		return q.x | (q.y << 10) | (q.z << 20) | (q.w << 30);
+	}
+
+	static glm::vec4 unpack1010102(GLuint p) {
+		return glm::vec4(p & 1023u, (p >> 10) & 1023u, (p >> 20) & 1023u, p >> 30) / glm::vec4(1023.0f, 1023.0f, 1023.0f, 3.0f);
+	}
+
+	void FieldFormat::pack(const float* values, void* storage, size_t count) const {
+		GLubyte* dst = static_cast<GLubyte*>(storage);
+		for (size_t i = 0; i < count; i++, dst += storageSize()) {
+			glm::vec4 v(0.0f);
+			for (GLuint c = 0; c < m_components; c++) v[c] = values[i * m_components + c];
+
+			GLuint* words = reinterpret_cast<GLuint*>(dst);
+			switch (m_precision) {
+			case FieldPrecision::FP32:
+				memcpy(dst, &v, storageSize());
+				break;
+			case FieldPrecision::FP16:
+				words[0] = glm::packHalf2x16(glm::vec2(v.x, v.y));
+				if (storageSize() == 8) words[1] = glm::packHalf2x16(glm::vec2(v.z, v.w));
+				break;
+			case FieldPrecision::SNORM16:
+				words[0] = glm::packSnorm2x16(glm::vec2(v.x, v.y));
+				if (storageSize() == 8) words[1] = glm::packSnorm2x16(glm::vec2(v.z, v.w));
+				break;
+			case FieldPrecision::UNORM8:
+				words[0] = glm::packUnorm4x8(v);
+				break;
+			case FieldPrecision::UNORM10_10_10_2:
+				words[0] = pack1010102(v);
+				break;
+			}
+		}
+	}
+
+	void FieldFormat::unpack(const void* storage, float* values, size_t count) const {
+		const GLubyte* src = static_cast<const GLubyte*>(storage);
+		for (size_t i = 0; i < count; i++, src += storageSize()) {
+			glm::vec4 v(0.0f);
+			const GLuint* words = reinterpret_cast<const GLuint*>(src);
+			switch (m_precision) {
+			case FieldPrecision::FP32:
+				memcpy(&v, src, storageSize());
+				break;
+			case FieldPrecision::FP16: {
+				glm::vec2 xy = glm::unpackHalf2x16(words[0]);
+				glm::vec2 zw = storageSize() == 8 ? glm::unpackHalf2x16(words[1]) : glm::vec2(0.0f);
+				v = glm::vec4(xy.x, xy.y, zw.x, zw.y);
+				break;
+			}
+			case FieldPrecision::SNORM16: {
+				glm::vec2 xy = glm::unpackSnorm2x16(words[0]);
+				glm::vec2 zw = storageSize() == 8 ? glm::unpackSnorm2x16(words[1]) : glm::vec2(0.0f);
+				v = glm::vec4(xy.x, xy.y, zw.x, zw.y);
+				break;
+			}
+			case FieldPrecision::UNORM8:
+				v = glm::unpackUnorm4x8(words[0]);
+				break;
+			case FieldPrecision::UNORM10_10_10_2:
+				v = unpack1010102(words[0]);
+				break;
+			}
+			for (GLuint c = 0; c < m_components; c++) values[i * m_components + c] = v[c];
+		}
+	}
+
+	std::vector<FieldBenchmarkResult> benchmarkFieldPrecision(size_t count, GLuint components, GLuint iterations) {
+		std::vector<FieldBenchmarkResult> results;
+		iterations = std::max(iterations, 1u);
+
+		std::mt19937 rng(42);
+		std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+		std::vector<float> values(count * components);
+		for (float& value : values) value = dist(rng);
+
+		const FieldPrecision precisions[] = { FieldPrecision::FP32, FieldPrecision::FP16, FieldPrecision::SNORM16, FieldPrecision::UNORM8, FieldPrecision::UNORM10_10_10_2 };
+		for (FieldPrecision precision : precisions) {
+			FieldFormat format(precision, components);
+			if (format.precision() != precision) continue;
+
+			FieldBenchmarkResult result;
+			result.precision = precision;
+			result.bytesPerElement = format.storageSize();
+
+			std::vector<GLubyte> storage(count * format.storageSize());
+			std::vector<float> roundTrip(values.size());
+			format.pack(values.data(), storage.data(), count);
+			format.unpack(storage.data(), roundTrip.data(), count);
+			for (size_t i = 0; i < values.size(); i++) result.maxError = std::max(result.maxError, std::abs(roundTrip[i] - values[i]));
+
+			SSBO<GLubyte> field("bench_field", storage, BufferUsage::DynamicCopy);
+
+			ComputeShader kernel("field_benchmark", "", false);
+			kernel.inject("field:bench_field", format.accessors("bench_field"));
+			kernel.compileFromSrc(std::string("#version 430\n")
+				+ "layout(local_size_x = 64) in;\n"
+				+ "uniform uint count;\n"
+				+ "void main() {\n"
+				+ "	uint i = gl_GlobalInvocationID.x;\n"
+				+ "	if (i >= count) return;\n"
+				+ "	store_bench_field(i, load_bench_field(i) * 0.999 + 0.0005);\n"
+				+ "}\n");
+			if (!kernel.isCompiled()) continue;
+
+			kernel.use();
+			kernel.setUInt("count", GLuint(count));
+			kernel.attach(field);
+			GLuint groups = GLuint((count + 63) / 64);
+
+			kernel.dispatch(groups); //warm up
+			kernel.barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			GLuint query = 0;
+			glGenQueries(1, &query);
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			for (GLuint i = 0; i < iterations; i++) {
+				kernel.dispatch(groups);
+				kernel.barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			glDeleteQueries(1, &query);
+			kernel.detach(field);
+
+			result.milliseconds = elapsed / 1e6 / iterations;
+			result.bandwidth = result.milliseconds > 0 ? 2.0 * count * format.storageSize() / (result.milliseconds * 1e6) : 0;
+			results.push_back(result);
+		}
+
+		Console::info("FieldPrecision") << count << " elements of " << components << " components, " << iterations << " iterations" << Console::endl;
+		for (const FieldBenchmarkResult& result : results) {
+			Console::info("FieldPrecision") << FieldFormat::toString(result.precision) << "\t" << result.bytesPerElement << " B\t"
+				<< result.milliseconds << " ms\t" << result.bandwidth << " GB/s\tmax error " << result.maxError << Console::endl;
+		}
+		return results;
+	}
+}
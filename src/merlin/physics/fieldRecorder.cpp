@@ -0,0 +1,451 @@
+#include "pch.h"
+#include "merlin/physics/fieldRecorder.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace Merlin {
+
+	//Codec : temporal delta, byte shuffle and PackBits run length encoding on 32 bits words
+
+	static inline GLuint zigzag(GLuint difference) {
+		return (difference << 1) ^ GLuint(GLint(difference) >> 31);
+	}
+
+	static inline GLuint unzigzag(GLuint value) {
+		return (value >> 1) ^ (0u - (value & 1u));
+	}
+
+	static inline GLuint quantize(GLuint bits, float step) {
+		float value;
+		memcpy(&value, &bits, sizeof(float));
+		double q = std::round(double(value) / step);
+		if (!(q == q)) q = 0; //NaN
+		q = std::max(std::min(q, 2147483647.0), -2147483648.0);
+		return GLuint(GLint(q));
+	}
+
+	//previous is empty for keyframes
+	static void deltaEncode(std::vector<GLuint>& words, const std::vector<GLuint>& previous, bool quantized) {
+		for (size_t i = 0; i < words.size(); i++) {
+			GLuint reference = previous.empty() ? 0u : previous[i];
+			words[i] = quantized ? zigzag(words[i] - reference) : words[i] ^ reference;
+		}
+	}
+
+	static void deltaDecode(std::vector<GLuint>& words, const std::vector<GLuint>& previous, bool quantized) {
+		for (size_t i = 0; i < words.size(); i++) {
+			GLuint reference = previous.empty() ? 0u : previous[i];
+			words[i] = quantized ? unzigzag(words[i]) + reference : words[i] ^ reference;
+		}
+	}
+
+	//groups the bytes by significance, the high bytes of small deltas become long zero runs
+	static std::vector<uint8_t> shuffle(const std::vector<GLuint>& words) {
+		size_t count = words.size();
+		std::vector<uint8_t> planes(count * 4);
+		for (size_t i = 0; i < count; i++) {
+			GLuint word = words[i];
+			planes[i] = uint8_t(word);
+			planes[count + i] = uint8_t(word >> 8);
+			planes[2 * count + i] = uint8_t(word >> 16);
+			planes[3 * count + i] = uint8_t(word >> 24);
+		}
+		return planes;
+	}
+
+	static std::vector<GLuint> unshuffle(const std::vector<uint8_t>& planes, size_t count) {
+		std::vector<GLuint> words(count);
+		for (size_t i = 0; i < count; i++) {
+			words[i] = GLuint(planes[i]) | GLuint(planes[count + i]) << 8 | GLuint(planes[2 * count + i]) << 16 | GLuint(planes[3 * count + i]) << 24;
+		}
+		return words;
+	}
+
+	//control byte c < 128 : c + 1 literal bytes follow, c >= 128 : the next byte is repeated c - 125 times (3 to 130)
+	static std::vector<uint8_t> runLengthEncode(const std::vector<uint8_t>& input) {
+		std::vector<uint8_t> output;
+		output.reserve(input.size() / 4 + 16);
+		size_t i = 0, literal = 0;
+		size_t size = input.size();
+
+		auto flushLiteral = [&](size_t end) {
+			while (literal < end) {
+				size_t length = std::min<size_t>(end - literal, 128);
+				output.push_back(uint8_t(length - 1));
+				output.insert(output.end(), input.begin() + literal, input.begin() + literal + length);
+				literal += length;
+			}
+		};
+
+		while (i < size) {
+			size_t run = 1;
+			while (i + run < size && run < 130 && input[i + run] == input[i]) run++;
+			if (run >= 3) {
+				flushLiteral(i);
+				output.push_back(uint8_t(run + 125));
+				output.push_back(input[i]);
+				i += run;
+				literal = i;
+			}
+			else i += run;
+		}
+		flushLiteral(size);
+		return output;
+	}
+
+	static bool runLengthDecode(const uint8_t* input, size_t size, std::vector<uint8_t>& output, size_t expected) {
+		output.clear();
+		output.reserve(expected);
+		size_t i = 0;
+		while (i < size) {
+			uint8_t control = input[i++];
+			if (control < 128) {
+				size_t length = size_t(control) + 1;
+				if (i + length > size) return false;
+				output.insert(output.end(), input + i, input + i + length);
+				i += length;
+			}
+			else {
+				if (i >= size) return false;
+				output.insert(output.end(), size_t(control) - 125, input[i++]);
+			}
+		}
+		return output.size() == expected;
+	}
+
+
+
+	Shared<FieldRecorder> FieldRecorder::create(ParticleSystem_Ptr system, const std::string& path, GLuint cadence) {
+		return createShared<FieldRecorder>(system, path, cadence);
+	}
+
+	FieldRecorder::FieldRecorder(ParticleSystem_Ptr system, const std::string& path, GLuint cadence) : m_system(system), m_path(path), m_cadence(std::max(cadence, 1u)) {}
+
+	FieldRecorder::~FieldRecorder() {
+		if (m_recording) stop();
+	}
+
+	void FieldRecorder::record(const std::string& field, float quantization) {
+		if (m_recording) {
+			Console::error("FieldRecorder") << "cannot add " << field << " while recording" << Console::endl;
+			return;
+		}
+		if (!m_system->hasField(field) && !m_system->hasBuffer(field)) {
+			Console::error("FieldRecorder") << field << " is not registered in " << m_system->name() << Console::endl;
+			return;
+		}
+		if (quantization > 0 && m_system->hasFieldFormat(field)) {
+			Console::warn("FieldRecorder") << field << " is already stored quantized, it is recorded losslessly" << Console::endl;
+			quantization = 0;
+		}
+
+		Field entry;
+		entry.name = field;
+		entry.quantization = std::max(quantization, 0.0f);
+		m_fields.push_back(entry);
+	}
+
+	bool FieldRecorder::start() {
+		if (m_recording) return true;
+		if (m_fields.empty()) {
+			Console::error("FieldRecorder") << "no field to record" << Console::endl;
+			return false;
+		}
+
+		m_file.open(m_path, std::ios::binary | std::ios::trunc);
+		if (!m_file) {
+			Console::error("FieldRecorder") << "cannot open " << m_path << Console::endl;
+			return false;
+		}
+
+		RecordingHeader header;
+		memcpy(header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+		header.version = RECORDING_VERSION;
+		header.fieldCount = uint32_t(m_fields.size());
+		header.cadence = m_cadence;
+		header.keyframeInterval = m_keyframeInterval;
+		m_file.write(reinterpret_cast<const char*>(&header), sizeof(RecordingHeader));
+
+		for (Field& field : m_fields) {
+			uint32_t length = uint32_t(field.name.size());
+			m_file.write(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+			m_file.write(field.name.data(), length);
+			m_file.write(reinterpret_cast<const char*>(&field.quantization), sizeof(float));
+			field.previous.clear();
+		}
+
+		m_index.clear();
+		m_rawBytes = 0;
+		m_writtenBytes = 0;
+		m_step = 0;
+		m_stop = false;
+		m_recording = true;
+		m_thread = std::thread(&FieldRecorder::run, this);
+
+		Console::info("FieldRecorder") << "recording " << m_fields.size() << " fields of " << m_system->name() << " every " << m_cadence << " steps to " << m_path << Console::endl;
+		return true;
+	}
+
+	void FieldRecorder::step() {
+		if (!m_recording) return;
+		if (m_step++ % m_cadence == 0) capture();
+		collect(false);
+	}
+
+	void FieldRecorder::capture() {
+		//the copies are ordered after the dispatches already issued, nothing waits here
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		Shared<Frame> frame = createShared<Frame>();
+		frame->step = m_step - 1;
+		for (Field& field : m_fields) {
+			AbstractBufferObject_Ptr buffer = m_system->hasField(field.name) ? m_system->getField(field.name) : m_system->hasBuffer(field.name) ? m_system->getBuffer(field.name) : nullptr;
+			if (buffer) frame->readbacks.push_back(createShared<Readback<GLuint>>(buffer->id(), buffer->offset(), 0, buffer->size() / sizeof(GLuint)));
+			else frame->readbacks.push_back(nullptr);
+		}
+		m_pending.push_back(frame);
+	}
+
+	void FieldRecorder::collect(bool blocking) {
+		while (!m_pending.empty()) {
+			Shared<Frame> frame = m_pending.front();
+
+			//frames are collected in order, the oldest one is waited on once too many copies are in flight
+			if (!blocking && m_pending.size() <= m_maxPending) {
+				bool ready = true;
+				for (auto& readback : frame->readbacks) ready = ready && (!readback || readback->ready());
+				if (!ready) break;
+			}
+
+			frame->columns.resize(frame->readbacks.size());
+			for (size_t i = 0; i < frame->readbacks.size(); i++) {
+				if (frame->readbacks[i]) frame->columns[i] = frame->readbacks[i]->get();
+			}
+			frame->readbacks.clear();
+			m_pending.pop_front();
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queue.push_back(frame);
+			}
+			m_condition.notify_one();
+		}
+	}
+
+	void FieldRecorder::stop() {
+		if (!m_recording) return;
+		collect(true);
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_written.wait(lock, [this] { return m_queue.empty() && !m_writing; });
+			m_stop = true;
+		}
+		m_condition.notify_all();
+		m_thread.join();
+
+		RecordingFooter footer;
+		footer.indexOffset = uint64_t(m_file.tellp());
+		footer.frameCount = m_index.size();
+		memcpy(footer.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+		if (!m_index.empty()) m_file.write(reinterpret_cast<const char*>(m_index.data()), m_index.size() * sizeof(uint64_t));
+		m_file.write(reinterpret_cast<const char*>(&footer), sizeof(RecordingFooter));
+		bool failed = !m_file;
+		m_file.close();
+		m_recording = false;
+
+		if (failed) Console::error("FieldRecorder") << "failed to write " << m_path << Console::endl;
+		else Console::info("FieldRecorder") << m_index.size() << " frames written to " << m_path << ", "
+			<< m_rawBytes / (1024.0 * 1024.0) << " MB raw, " << m_writtenBytes / (1024.0 * 1024.0) << " MB on disk (x"
+			<< (m_writtenBytes ? double(m_rawBytes) / double(m_writtenBytes) : 0.0) << ")" << Console::endl;
+	}
+
+	void FieldRecorder::run() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true) {
+			m_condition.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+			if (m_queue.empty()) return;
+
+			Shared<Frame> frame = m_queue.front();
+			m_queue.pop_front();
+			m_writing = true;
+			lock.unlock();
+			encode(*frame);
+			lock.lock();
+			m_writing = false;
+			m_written.notify_all();
+		}
+	}
+
+	void FieldRecorder::encode(Frame& frame) {
+		uint32_t index = uint32_t(m_index.size());
+		bool keyframe = index % m_keyframeInterval == 0;
+		m_index.push_back(uint64_t(m_file.tellp()));
+
+		RecordingFrame header;
+		header.step = frame.step;
+		header.frame = index;
+		header.columns = uint32_t(frame.columns.size());
+		m_file.write(reinterpret_cast<const char*>(&header), sizeof(RecordingFrame));
+
+		for (size_t i = 0; i < frame.columns.size(); i++) {
+			Field& field = m_fields[i];
+			std::vector<GLuint>& words = frame.columns[i];
+			bool quantized = field.quantization > 0;
+
+			if (quantized) {
+				for (GLuint& word : words) word = quantize(word, field.quantization);
+			}
+
+			//a resized field restarts from a keyframe
+			bool key = keyframe || field.previous.size() != words.size();
+			std::vector<GLuint> current = words;
+			deltaEncode(words, key ? std::vector<GLuint>() : field.previous, quantized);
+			field.previous.swap(current);
+
+			std::vector<uint8_t> encoded = runLengthEncode(shuffle(words));
+
+			RecordingColumn column;
+			column.field = uint32_t(i);
+			column.flags = (key ? RECORDING_KEYFRAME : 0u) | (quantized ? RECORDING_QUANTIZED : 0u);
+			column.words = words.size();
+			column.encodedSize = encoded.size();
+			m_file.write(reinterpret_cast<const char*>(&column), sizeof(RecordingColumn));
+			m_file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+
+			m_rawBytes += words.size() * sizeof(GLuint);
+			m_writtenBytes += encoded.size() + sizeof(RecordingColumn);
+		}
+	}
+
+
+
+	bool FieldRecording::open(const std::string& path) {
+		m_file.open(path, std::ios::binary);
+		if (!m_file) {
+			Console::error("FieldRecording") << "cannot open " << path << Console::endl;
+			return false;
+		}
+
+		m_file.read(reinterpret_cast<char*>(&m_header), sizeof(RecordingHeader));
+		if (!m_file || memcmp(m_header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0 || m_header.version != RECORDING_VERSION) {
+			Console::error("FieldRecording") << path << " is not a field recording" << Console::endl;
+			return false;
+		}
+
+		m_names.resize(m_header.fieldCount);
+		m_quantization.resize(m_header.fieldCount);
+		for (uint32_t i = 0; i < m_header.fieldCount; i++) {
+			uint32_t length = 0;
+			m_file.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
+			m_names[i].resize(length);
+			m_file.read(m_names[i].data(), length);
+			m_file.read(reinterpret_cast<char*>(&m_quantization[i]), sizeof(float));
+		}
+
+		RecordingFooter footer;
+		m_file.seekg(-std::streamoff(sizeof(RecordingFooter)), std::ios::end);
+		m_file.read(reinterpret_cast<char*>(&footer), sizeof(RecordingFooter));
+		if (!m_file || memcmp(footer.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0) {
+			Console::error("FieldRecording") << path << " has no frame index, the recording was not stopped" << Console::endl;
+			return false;
+		}
+
+		m_index.resize(footer.frameCount);
+		m_file.seekg(std::streamoff(footer.indexOffset));
+		m_file.read(reinterpret_cast<char*>(m_index.data()), m_index.size() * sizeof(uint64_t));
+		m_state.clear();
+		m_stateFrame = size_t(-1);
+		return bool(m_file);
+	}
+
+	int FieldRecording::fieldIndex(const std::string& name) const {
+		for (size_t i = 0; i < m_names.size(); i++) {
+			if (m_names[i] == name) return int(i);
+		}
+		return -1;
+	}
+
+	bool FieldRecording::readFrame(size_t frame, uint64_t& step, std::vector<std::vector<GLuint>>& columns, std::vector<uint32_t>& flags) {
+		m_file.seekg(std::streamoff(m_index[frame]));
+		RecordingFrame header;
+		m_file.read(reinterpret_cast<char*>(&header), sizeof(RecordingFrame));
+		if (!m_file) return false;
+		step = header.step;
+
+		columns.assign(m_names.size(), {});
+		flags.assign(m_names.size(), RECORDING_KEYFRAME);
+		std::vector<uint8_t> encoded, planes;
+		for (uint32_t i = 0; i < header.columns; i++) {
+			RecordingColumn column;
+			m_file.read(reinterpret_cast<char*>(&column), sizeof(RecordingColumn));
+			encoded.resize(column.encodedSize);
+			m_file.read(reinterpret_cast<char*>(encoded.data()), encoded.size());
+			if (!m_file || column.field >= m_names.size()) return false;
+			if (!runLengthDecode(encoded.data(), encoded.size(), planes, column.words * sizeof(GLuint))) return false;
+
+			columns[column.field] = unshuffle(planes, column.words);
+			flags[column.field] = column.flags;
+		}
+		return true;
+	}
+
+	bool FieldRecording::read(size_t frame, uint64_t& step, std::vector<std::vector<GLuint>>& columns) {
+		if (frame >= m_index.size()) {
+			Console::error("FieldRecording") << "frame " << frame << " out of range (" << m_index.size() << " frames)" << Console::endl;
+			return false;
+		}
+
+		//decode forward from the keyframe, or from the last decoded frame when it is in the same chunk
+		size_t keyframe = frame / m_header.keyframeInterval * m_header.keyframeInterval;
+		size_t first = (m_stateFrame != size_t(-1) && m_stateFrame >= keyframe && m_stateFrame < frame) ? m_stateFrame + 1 : keyframe;
+		if (m_stateFrame == frame) first = frame + 1;
+
+		std::vector<std::vector<GLuint>> deltas;
+		std::vector<uint32_t> flags;
+		for (size_t f = first; f <= frame; f++) {
+			if (!readFrame(f, step, deltas, flags)) {
+				Console::error("FieldRecording") << "frame " << f << " is corrupted" << Console::endl;
+				m_stateFrame = size_t(-1);
+				return false;
+			}
+			m_state.resize(deltas.size());
+			for (size_t i = 0; i < deltas.size(); i++) {
+				bool key = (flags[i] & RECORDING_KEYFRAME) || m_state[i].size() != deltas[i].size();
+				deltaDecode(deltas[i], key ? std::vector<GLuint>() : m_state[i], flags[i] & RECORDING_QUANTIZED);
+				m_state[i].swap(deltas[i]);
+			}
+			m_stateFrame = f;
+		}
+
+		if (first > frame) {
+			m_file.seekg(std::streamoff(m_index[frame]));
+			m_file.read(reinterpret_cast<char*>(&step), sizeof(uint64_t));
+		}
+		columns = m_state;
+		return true;
+	}
+
+	std::vector<float> FieldRecording::readFloats(size_t frame, const std::string& field) {
+		std::vector<float> values;
+		int index = fieldIndex(field);
+		if (index < 0) {
+			Console::error("FieldRecording") << field << " is not recorded" << Console::endl;
+			return values;
+		}
+
+		uint64_t step;
+		std::vector<std::vector<GLuint>> columns;
+		if (!read(frame, step, columns)) return values;
+
+		const std::vector<GLuint>& words = columns[index];
+		values.resize(words.size());
+		float quantization = m_quantization[index];
+		for (size_t i = 0; i < words.size(); i++) {
+			if (quantization > 0) values[i] = float(double(GLint(words[i])) * quantization);
+			else memcpy(&values[i], &words[i], sizeof(float));
+		}
+		return values;
+	}
+}
@@ -1,9 +1,13 @@
 #include "pch.h"
 #include "merlin/physics/isoSurface.h"
 #include "merlin/graphics/ressourceManager.h"
+#include "merlin/utils/gpuPrimitives.h"
+#include "merlin/utils/gpuProfiler.h"
+#include "merlin/memory/memoryTracker.h"
 
 namespace Merlin {
 	IsoSurface::IsoSurface(const std::string& name, glm::ivec3 volumeSize) {
+        MERLIN_MEMORY_SCOPE("IsoSurface " + name);
         m_volume = Texture3D::create(volume_size.x, volume_size.y, volume_size.z, 4, 32);
 
         allocateBuffers();
@@ -28,10 +32,13 @@ namespace Merlin {
 
 
     void IsoSurface::compute() {
+        MERLIN_GPU_ZONE("IsoSurface::compute");
         buffer_vertices->setBindingPoint(0);
         buffer_normals->setBindingPoint(1);
         buffer_triangle_table->setBindingPoint(2);
         buffer_configuration_table->setBindingPoint(3);
+        buffer_triangle_count->setBindingPoint(4);
+        buffer_triangle_count->clear(); //triangles are appended from 0
 
         m_volume->bindImage(0);
 
@@ -39,7 +46,11 @@ namespace Merlin {
         marchingCubes->use();
         marchingCubes->setFloat("u_isolevel", m_isoLevel); //-1, 1
         marchingCubes->dispatch();
-        marchingCubes->barrier();
+        //the triangle count is read by the drawArgs kernel, the vertices by the mesh draw
+        marchingCubes->barrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+        //the mesh draws 3 vertices per generated triangle, the count never leaves the GPU
+        GPUPrimitives::instance().drawArgs(*buffer_triangle_count, *buffer_draw_args, false, 0, 0, 3);
     }
 
     void IsoSurface::setVolumeTexture(Texture3D_Ptr volume) {
@@ -52,6 +63,7 @@ namespace Merlin {
 
 
     void IsoSurface::allocateBuffers() {
+        MERLIN_MEMORY_SCOPE("IsoSurface buffers");
         {
             static const int triangle_table[256][16] = {
                 {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
@@ -382,7 +394,11 @@ namespace Merlin {
             glVertexArrayAttribBinding(vao->id(), 1, 1);
         }
 
+        buffer_triangle_count = SSBO<GLuint>::create("buffer_triangle_count", 1, BufferUsage::DynamicCopy);
+        buffer_draw_args = SSBO<GLuint>::create("buffer_draw_args", std::vector<GLuint>{ 0, 1, 0, 0 }, BufferUsage::DynamicCopy); //DrawArraysIndirectCommand, empty until compute()
+
         m_mesh = createShared<Mesh>("mc", vao, max_number_of_vertices);
+        m_mesh->setIndirectArgs(buffer_draw_args);
         //m_mesh->useVertexColors(false);
         //m_mesh->useFlatShading(true);
     }
@@ -390,9 +406,7 @@ namespace Merlin {
     void IsoSurface::loadDefaultShaders() {
         if (!default_marchingCubes) {
             default_marchingCubes = ComputeShader::create("mc", "assets/common/shaders/mc.comp");
-            glm::ivec3 pWkgSize = glm::ivec3(8, 8, 8); //Number of thread per workgroup
-            glm::ivec3 pWkgCount = (volume_size + pWkgSize - glm::ivec3(1)) / pWkgSize; //Total number of workgroup needed
-            default_marchingCubes->SetWorkgroupLayout(pWkgCount);
+            default_marchingCubes->SetDomain(glm::uvec3(volume_size)); //one thread per cell
         }
         
         /*
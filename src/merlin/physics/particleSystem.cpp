@@ -2,6 +2,9 @@
 #include "merlin/physics/particleSystem.h"
 #include "merlin/utils/primitives.h"
 #include "merlin/graphics/ressourceManager.h"
+#include "merlin/physics/checkpoint.h"
+#include "merlin/utils/gpuPrimitives.h"
+#include "merlin/memory/memoryTracker.h"
 
 namespace Merlin{
 
@@ -17,42 +20,88 @@ namespace Merlin{
 		
 		switch (m_displayMode) {
 		case ParticleSystemDisplayMode::MESH:
-			if(m_geometry) m_geometry->drawInstanced(m_active_instancesCount);
+			drawGeometry();
 			break;
 		case ParticleSystemDisplayMode::POINT_SPRITE :
 			glEnable(GL_PROGRAM_POINT_SIZE);
-			if (m_geometry) m_geometry->drawInstanced(m_active_instancesCount);
+			drawGeometry();
 			glDisable(GL_PROGRAM_POINT_SIZE);
 			break;
 		case ParticleSystemDisplayMode::POINT_SPRITE_SHADED:
 			glEnable(GL_PROGRAM_POINT_SIZE);
 			glEnable(0x8861);//Point shading
-			if (m_geometry) m_geometry->drawInstanced(m_active_instancesCount);
+			drawGeometry();
 			glDisable(GL_PROGRAM_POINT_SIZE);
 			glDisable(0x8861);
 			break;
 		}
 	} //draw the mesh
 
+	void ParticleSystem::drawGeometry() const {
+		if (!m_geometry) return;
+		if (m_activeCounter) m_geometry->drawIndirect(*m_drawArgs);
+		else m_geometry->drawInstanced(m_active_instancesCount);
+	}
+
 	void ParticleSystem::setInstancesCount(size_t count) {
+		MERLIN_MEMORY_SCOPE("ParticleSystem " + m_name);
 		if (count == m_instancesCount) return;
-		if(m_fields.size() != 0) Console::warn() << "(Performance) Buffers of the particle system are being resized dynamically" << Console::endl;
 		m_active_instancesCount = m_instancesCount = count;
 		
+		//fields keep their content, storage only grows geometrically
 		for (auto field : m_fields) {
 			field.second->resizeBuffer(count * field.second->type());
 		}
+
+		//one thread per particle, the workgroup count follows the local size of each program
+		for (auto& program : m_programs) {
+			program.second->SetDomain(m_instancesCount);
+		}
 	}
 
 	void ParticleSystem::setActiveInstancesCount(size_t count){
-		if (count <= m_instancesCount)
+		if (count <= m_instancesCount) {
 			m_active_instancesCount = count;
+			m_activeCounter = nullptr;
+		}
 		else {
 			Console::error() << "Active instance count is greater than the total instance count" << Console::endl;
 		}
 		
 	}
 
+	void ParticleSystem::setActiveCounter(AbstractBufferObject_Ptr counter, GLuint index) {
+		MERLIN_MEMORY_SCOPE("ParticleSystem " + m_name);
+		m_activeCounter = counter;
+		m_activeCounterIndex = index;
+		if (!counter) return;
+		if (!m_drawArgs) m_drawArgs = SSBO<GLuint>::create(m_name + "_draw_args", sizeof(DrawElementsIndirectCommand) / sizeof(GLuint), BufferUsage::DynamicCopy);
+		if (!m_dispatchArgs) m_dispatchArgs = SSBO<GLuint>::create(m_name + "_dispatch_args", sizeof(DispatchIndirectCommand) / sizeof(GLuint), BufferUsage::DynamicCopy);
+	}
+
+	void ParticleSystem::updateDrawArgs() const {
+		if (!m_activeCounter || !m_geometry) return;
+		GPUPrimitives::instance().drawArgs(*m_activeCounter, *m_drawArgs, m_geometry->hasIndices(), m_geometry->getElementCount(), m_activeCounterIndex);
+	}
+
+	void ParticleSystem::dispatchActive(ComputeShader& program) {
+		program.use(); //finishes a pending build, the workgroup size is known
+		if (!m_activeCounter) {
+			program.dispatch();
+			return;
+		}
+		glm::uvec3 size = program.workgroupSize();
+		//the particle kernels index by gl_GlobalInvocationID.x only, the groups must fit on one row (no 2D spread)
+		const size_t groupSize = size.x * size.y * size.z;
+		if ((m_instancesCount + groupSize - 1) / groupSize > GPUPrimitives::maxGroupCount()) {
+			Console::error("ParticleSystem") << m_name << " : " << m_instancesCount << " instances need more than " << GPUPrimitives::maxGroupCount() << " workgroups along x, the kernels would skip the instances past the first row" << Console::endl;
+			GLCORE_ASSERT(false, "ParticleSystem", "dispatchActive exceeds the workgroup count along x");
+		}
+		GPUPrimitives::instance().dispatchArgs(*m_activeCounter, *m_dispatchArgs, size.x * size.y * size.z, m_activeCounterIndex);
+		program.use(); //the arguments kernel was bound
+		program.dispatchIndirect(*m_dispatchArgs);
+	}
+
 
 	AbstractBufferObject_Ptr ParticleSystem::getField(const std::string& name) const {
 		if (hasField(name)) {
@@ -85,6 +134,28 @@ namespace Merlin{
 		}
 	}
 
+	void ParticleSystem::addField(const std::string& name, FieldFormat format) {
+		MERLIN_MEMORY_SCOPE("ParticleSystem " + m_name);
+		if (hasField(name)) {
+			Console::warn("ParticleSystem") << name << "has been overwritten" << Console::endl;
+		}
+
+		//storage only defines the element size, values are packed by the format
+		AbstractBufferObject_Ptr field;
+		switch (format.storageSize()) {
+		case 4: field = SSBO<GLuint>::create(name, m_instancesCount); break;
+		case 8: field = SSBO<glm::uvec2>::create(name, m_instancesCount); break;
+		default: field = SSBO<glm::uvec4>::create(name, m_instancesCount); break;
+		}
+		m_fields[name] = field;
+		m_formats[name] = format;
+		for (auto& injected : m_injected) injected.second.erase(name);
+
+		if (hasLink(m_currentProgram)) {
+			link(m_currentProgram, name);
+		}
+	}
+
 	void ParticleSystem::addBuffer(AbstractBufferObject_Ptr buf){
 		if (hasBuffer(buf->name())) {
 			Console::warn("ParticleSystem") << buf->name() << "has been overwritten" << Console::endl;
@@ -103,6 +174,16 @@ namespace Merlin{
 		return m_buffers.find(name) != m_buffers.end();
 	}
 
+	bool ParticleSystem::hasFieldFormat(const std::string& name) const {
+		return m_formats.find(name) != m_formats.end();
+	}
+
+	const FieldFormat& ParticleSystem::getFieldFormat(const std::string& name) const {
+		static const FieldFormat fp32;
+		auto it = m_formats.find(name);
+		return it != m_formats.end() ? it->second : fp32;
+	}
+
 	void ParticleSystem::clearField(const std::string& name) {
 		if (hasField(name)) {
 			m_fields[name]->clearBuffer();
@@ -118,7 +199,8 @@ namespace Merlin{
 	}
 
 	void ParticleSystem::writeField(const std::string& name, GLsizei typesize,  void* data){
-		if (hasField(name)) {
+		if (hasFieldFormat(name)) writePackedField(name, static_cast<const float*>(data), m_instancesCount * typesize / sizeof(float));
+		else if (hasField(name)) {
 			if (m_fields[name]->elements() < m_instancesCount) {
 				//Console::error("ParticleSystem") << "Field hasn't been allocated" << Console::endl;
 				m_fields[name]->allocateBuffer(m_instancesCount * typesize, data, BufferUsage::StaticDraw);
@@ -126,6 +208,35 @@ namespace Merlin{
 		}else Console::error("ParticleSystem") << name << " is not registered in the particle system." << Console::endl;
 	}
 
+	void ParticleSystem::writePackedField(const std::string& name, const float* values, size_t floats) {
+		const FieldFormat& format = m_formats.at(name);
+		if (floats % format.components() != 0) {
+			Console::error("ParticleSystem") << name << " holds " << format.components() << " components per particle, data size does not match" << Console::endl;
+			return;
+		}
+
+		size_t count = floats / format.components();
+		std::vector<GLubyte> storage(count * format.storageSize());
+		format.pack(values, storage.data(), count);
+
+		AbstractBufferObject_Ptr field = m_fields[name];
+		if (field->elements() < count) field->allocateBuffer(storage.size(), storage.data(), BufferUsage::StaticDraw);
+		else field->writeBuffer(storage.size(), storage.data());
+	}
+
+	std::vector<float> ParticleSystem::readPackedField(const std::string& name) {
+		const FieldFormat& format = m_formats.at(name);
+		AbstractBufferObject_Ptr field = m_fields[name];
+
+		size_t count = field->size() / format.storageSize();
+		std::vector<GLubyte> storage(count * format.storageSize());
+		field->readBuffer(storage.size(), storage.data());
+
+		std::vector<float> values(count * format.components());
+		format.unpack(storage.data(), values.data(), count);
+		return values;
+	}
+
 	void ParticleSystem::writeBuffer(const std::string& name, GLsizei typesize, GLsizei elements, void* data) {
 		if (hasBuffer(name)) {
 			if (m_buffers[name]->elements() < elements) {
@@ -136,6 +247,68 @@ namespace Merlin{
 		}else Console::error("ParticleSystem") << name << " is not registered in the particle system." << Console::endl;
 	}
 
+	void ParticleSystem::saveCheckpoint(const std::string& path) {
+		//the copies are queued behind the dispatches already issued, the simulation can keep stepping
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		Checkpoint_Ptr checkpoint = createShared<Checkpoint>(path, m_instancesCount, m_active_instancesCount);
+		for (auto& field : m_fields) {
+			checkpoint->addBuffer(CheckpointEntryKind::FIELD, *field.second, hasFieldFormat(field.first) ? &m_formats.at(field.first) : nullptr);
+		}
+		for (auto& buffer : m_buffers) {
+			checkpoint->addBuffer(CheckpointEntryKind::BUFFER, *buffer.second);
+		}
+		for (auto& link : m_links) {
+			checkpoint->addLink(link.first, link.second);
+		}
+		CheckpointWriter::instance().submit(checkpoint);
+	}
+
+	bool ParticleSystem::loadCheckpoint(const std::string& path) {
+		MERLIN_MEMORY_SCOPE("ParticleSystem " + m_name + " checkpoint");
+		CheckpointFile file;
+		if (!file.open(path)) return false;
+
+		setInstancesCount(size_t(file.header().instancesCount));
+		setActiveInstancesCount(size_t(file.header().activeInstancesCount));
+
+		for (uint32_t i = 0; i < file.entryCount(); i++) {
+			const CheckpointEntry& entry = file.entry(i);
+			std::string name = file.name(entry);
+
+			if (entry.kind == CheckpointEntryKind::LINK) {
+				for (const std::string& linked : file.links(entry)) link(name, linked);
+				continue;
+			}
+
+			bool isField = entry.kind == CheckpointEntryKind::FIELD;
+			bool quantized = entry.precision != CHECKPOINT_NOT_QUANTIZED;
+			std::map<std::string, AbstractBufferObject_Ptr>& storage = isField ? m_fields : m_buffers;
+
+			if (quantized && (!hasFieldFormat(name) || getFieldFormat(name).precision() != FieldPrecision(entry.precision) || getFieldFormat(name).components() != entry.components)) {
+				addField(name, FieldFormat(FieldPrecision(entry.precision), entry.components));
+			}
+			else if (storage.find(name) == storage.end()) {
+				//unknown entries are restored as raw storage, shaders only see the block layout
+				AbstractBufferObject_Ptr buffer = SSBO<GLubyte>::create(name, 0);
+				buffer->setType(entry.typeSize);
+				if (isField) addField(buffer);
+				else addBuffer(buffer);
+			}
+
+			AbstractBufferObject_Ptr buffer = storage[name];
+			if (buffer->type() != entry.typeSize) {
+				Console::warn("ParticleSystem") << name << " element size changed (" << buffer->type() << " bytes, " << entry.typeSize << " in the checkpoint)" << Console::endl;
+				buffer->setType(entry.typeSize);
+			}
+			buffer->resizeBuffer(GLsizeiptr(entry.size));
+			if (entry.size > 0) buffer->writeBuffer(0, GLsizeiptr(entry.size), file.data(entry));
+		}
+
+		Console::info("ParticleSystem") << name() << " restored from " << path << " (" << m_instancesCount << " particles)" << Console::endl;
+		return true;
+	}
+
 	void ParticleSystem::addProgram(ComputeShader_Ptr program) {
 		if (hasProgram(program->name())) {
 			Console::warn("ParticleSystem") << program->name() << "has been overwritten" << Console::endl;
@@ -144,9 +317,7 @@ namespace Merlin{
 		m_programs[program->name()] = program;
 		m_currentProgram = program->name();
 
-		GLuint pWkgSize = 64; //Number of thread per workgroup
-		GLuint pWkgCount = (m_instancesCount + pWkgSize - 1) / pWkgSize; //Total number of workgroup needed
-		program->SetWorkgroupLayout(pWkgCount);
+		program->SetDomain(m_instancesCount); //one thread per particle
 	}
 
 	bool ParticleSystem::hasProgram(const std::string& name) const {
@@ -171,6 +342,34 @@ namespace Merlin{
 			m_links[shader] = std::set<std::string>();
 		}
 		m_links[shader].insert(field);
+
+		if (hasFieldFormat(field)) {
+			Shared<ShaderBase> program = findProgram(shader);
+			if (program) injectFields(program); //recompile now rather than at the first solveLink, uniforms set after linking are kept
+		}
+	}
+
+	Shared<ShaderBase> ParticleSystem::findProgram(const std::string& name) const {
+		if (hasProgram(name)) return m_programs.at(name);
+		if (m_shader && m_shader->name() == name) return m_shader;
+		return nullptr;
+	}
+
+	void ParticleSystem::injectFields(Shared<ShaderBase> shader) {
+		if (!hasLink(shader->name())) return;
+
+		std::set<std::string>& injected = m_injected[shader->name()];
+		bool changed = false;
+		for (auto& entry : m_links[shader->name()]) {
+			if (!hasFieldFormat(entry) || injected.count(entry)) continue;
+			changed |= shader->inject("field:" + entry, m_formats[entry].accessors(entry));
+			injected.insert(entry);
+		}
+
+		if (changed) {
+			Console::trace("ParticleSystem") << "recompiling " << shader->name() << " with the quantized field accessors" << Console::endl;
+			shader->recompile();
+		}
 	}
 
 	bool ParticleSystem::hasLink(const std::string& shader) const{
@@ -194,6 +393,7 @@ namespace Merlin{
 	}
 
 	void ParticleSystem::solveLink(Shared<ShaderBase> shader) {
+		injectFields(shader);
 		if (hasLink(shader->name())) {
 			for (auto& entry : m_links[shader->name()]) {
 				if(hasField(entry))
@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "merlin/scene/light.h"
 #include "merlin/core/core.h"
+#include "merlin/memory/memoryTracker.h"
 
 namespace Merlin {
 
@@ -12,6 +13,15 @@ namespace Merlin {
 		m_shadowResolution = res;
 	}
 
+	void Light::pack(LightData& data) {
+		data.ambient = ambient();
+		data.diffuse = diffuse();
+		data.specular = specular();
+		data.attenuation = attenuation();
+		data.type = static_cast<GLint>(type());
+		data.castShadow = 0;
+	}
+
 	void DirectionalLight::attach(int id, Shader& shader) {
 		std::string base = "lights[" + std::to_string(id) + "]";
 		shader.setVec3(base + ".ambient", ambient());
@@ -29,6 +39,15 @@ namespace Merlin {
 		}
 	}
 
+	void DirectionalLight::pack(LightData& data) {
+		Light::pack(data);
+		data.direction = glm::vec3(getRenderTransform() * glm::vec4(direction(), 0.0f));
+		if (m_shadowMap && m_castShadow) {
+			data.castShadow = 1;
+			data.lightSpaceMatrix = m_lightSpaceMatrix;
+		}
+	}
+
 	void DirectionalLight::setShadowResolution(GLuint res) {
 		m_shadowResolution = res;
 		if (m_shadowMap) {
@@ -71,6 +90,7 @@ namespace Merlin {
 	}
 
 	void DirectionalLight::generateShadowMap() {
+		MERLIN_MEMORY_SCOPE("DirectionalLight shadow map");
 		if (!m_shadowMap) {
 			m_shadowMap = Texture2D::create(m_shadowResolution, m_shadowResolution, TextureType::SHADOW);
 			m_shadowMap->bind();
@@ -111,6 +131,16 @@ namespace Merlin {
 		}
 	}
 
+	void PointLight::pack(LightData& data) {
+		Light::pack(data);
+		data.position = glm::vec3(getRenderTransform() * glm::vec4(position(), 1.0f));
+		if (m_shadowMap && m_castShadow) {
+			data.castShadow = 1;
+			data.lightSpaceMatrix = m_lightSpaceMatrix;
+			data.far_plane = 25.0f;
+		}
+	}
+
 	void PointLight::setShadowResolution(GLuint res) {
 		m_shadowResolution = res;
 		if (m_shadowMap) {
@@ -133,6 +163,7 @@ namespace Merlin {
 
 
 	void PointLight::generateShadowMap() {
+		MERLIN_MEMORY_SCOPE("PointLight shadow map");
 		if (!m_shadowMap) {
 			m_shadowMap = CubeMap::create(m_shadowResolution, m_shadowResolution, TextureType::SHADOW);
 			m_shadowMap->bind();
@@ -205,6 +236,12 @@ namespace Merlin {
 		//shader.setVec3(base + ".position", glm::vec3(getRenderTransform() * glm::vec4(glm::vec3(0,0,1000000), 1.0f)));
 	}
 
+	void AmbientLight::pack(LightData& data) {
+		Light::pack(data);
+		data.diffuse = glm::vec3(0);
+		data.specular = glm::vec3(0);
+	}
+
 	void SpotLight::attach(int id, Shader& shader) {
 		std::string base = "lights[" + std::to_string(id) + "]";
 		shader.setVec3(base + ".ambient", ambient());
@@ -223,6 +260,17 @@ namespace Merlin {
 		}
 	}
 
+	void SpotLight::pack(LightData& data) {
+		Light::pack(data);
+		data.position = glm::vec3(getRenderTransform() * glm::vec4(position(), 1.0f)); //point
+		data.direction = glm::vec3(getRenderTransform() * glm::vec4(direction(), 0.0f)); //pure vector
+		data.cutOff = cutOff();
+		if (m_shadowMap && m_castShadow) {
+			data.castShadow = 1;
+			data.lightSpaceMatrix = m_lightSpaceMatrix;
+		}
+	}
+
 	void SpotLight::setShadowResolution(GLuint res) {
 		m_shadowResolution = res;
 		if (m_shadowMap) {
@@ -248,6 +296,7 @@ namespace Merlin {
 	}
 
 	void SpotLight::generateShadowMap() {
+		MERLIN_MEMORY_SCOPE("SpotLight shadow map");
 		if (!m_shadowMap) {
 			m_shadowMap = Texture2D::create(m_shadowResolution, m_shadowResolution, TextureType::SHADOW);
 			m_shadowMap->bind();
@@ -0,0 +1,202 @@
+#include "pch.h"
+#include "merlin/shaders/computeGraph.h"
+#include "merlin/core/log.h"
+
+#include <unordered_map>
+
+namespace Merlin {
+
+	GLbitfield barrierBit(ResourceUsage usage) {
+		switch (usage) {
+		case ResourceUsage::IMAGE: return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+		case ResourceUsage::TEXTURE: return GL_TEXTURE_FETCH_BARRIER_BIT;
+		case ResourceUsage::UNIFORM: return GL_UNIFORM_BARRIER_BIT;
+		case ResourceUsage::ATOMIC_COUNTER: return GL_ATOMIC_COUNTER_BARRIER_BIT;
+		case ResourceUsage::INDIRECT: return GL_COMMAND_BARRIER_BIT;
+		case ResourceUsage::VERTEX: return GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+		case ResourceUsage::INDEX: return GL_ELEMENT_ARRAY_BARRIER_BIT;
+		case ResourceUsage::TRANSFER: return GL_BUFFER_UPDATE_BARRIER_BIT;
+		default: return GL_SHADER_STORAGE_BARRIER_BIT;
+		}
+	}
+
+	static std::string barrierName(GLbitfield bits) {
+		static const std::pair<GLbitfield, const char*> names[] = {
+			{ GL_SHADER_STORAGE_BARRIER_BIT, "storage" }, { GL_SHADER_IMAGE_ACCESS_BARRIER_BIT, "image" },
+			{ GL_TEXTURE_FETCH_BARRIER_BIT, "texture" }, { GL_UNIFORM_BARRIER_BIT, "uniform" },
+			{ GL_ATOMIC_COUNTER_BARRIER_BIT, "atomic" }, { GL_COMMAND_BARRIER_BIT, "command" },
+			{ GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT, "vertex" }, { GL_ELEMENT_ARRAY_BARRIER_BIT, "index" },
+			{ GL_BUFFER_UPDATE_BARRIER_BIT, "update" }
+		};
+		std::string name;
+		for (const auto& bit : names) if (bits & bit.first) name += (name.empty() ? "" : " | ") + std::string(bit.second);
+		return name;
+	}
+
+	// -----------
+
+	ComputePass::ComputePass(const std::string& name, ComputeShader_Ptr shader) : m_name(name), m_shader(shader) {}
+
+	ComputePass& ComputePass::access(const void* resource, AbstractBufferObject* buffer, ResourceUsage usage, bool read, bool write) {
+		m_accesses.push_back({ resource, buffer, usage, read, write });
+		if (m_graph) m_graph->invalidate();
+		return *this;
+	}
+
+	ComputePass& ComputePass::reads(AbstractBufferObject& buffer, ResourceUsage usage) { return access(&buffer, &buffer, usage, true, false); }
+	ComputePass& ComputePass::writes(AbstractBufferObject& buffer, ResourceUsage usage) { return access(&buffer, &buffer, usage, false, true); }
+	ComputePass& ComputePass::readsWrites(AbstractBufferObject& buffer, ResourceUsage usage) { return access(&buffer, &buffer, usage, true, true); }
+	ComputePass& ComputePass::reads(TextureBase& texture, ResourceUsage usage) { return access(&texture, nullptr, usage, true, false); }
+	ComputePass& ComputePass::writes(TextureBase& texture, ResourceUsage usage) { return access(&texture, nullptr, usage, false, true); }
+	ComputePass& ComputePass::readsWrites(TextureBase& texture, ResourceUsage usage) { return access(&texture, nullptr, usage, true, true); }
+
+	ComputePass& ComputePass::setup(std::function<void(ComputeShader&)> callback) {
+		m_setup = callback;
+		return *this;
+	}
+
+	ComputePass& ComputePass::layout(glm::uvec3 groups) {
+		m_layout = groups;
+		return *this;
+	}
+
+	ComputePass& ComputePass::run(std::function<void(ComputeShader&)> callback) {
+		m_run = callback;
+		return *this;
+	}
+
+	void ComputePass::execute() {
+		ComputeShader& shader = *m_shader;
+		shader.use();
+
+		//attach() is cached by the binding point manager, declared buffers are attached on every replay
+		for (const Access& access : m_accesses) {
+			if (!access.buffer || access.usage == ResourceUsage::INDIRECT || access.usage == ResourceUsage::TRANSFER) continue;
+			if (shader.blockIndex(access.buffer->name(), access.buffer->target()) != -1) shader.attach(*access.buffer);
+		}
+
+		if (m_setup) m_setup(shader);
+		if (m_run) m_run(shader);
+		else if (m_layout.x != 0) shader.dispatch(m_layout.x, m_layout.y, m_layout.z);
+		else shader.dispatch();
+	}
+
+	// -----------
+
+	ComputeGraph::ComputeGraph(const std::string& name) : m_name(name) {}
+
+	Shared<ComputeGraph> ComputeGraph::create(const std::string& name) {
+		return createShared<ComputeGraph>(name);
+	}
+
+	ComputePass& ComputeGraph::addPass(const std::string& name, ComputeShader_Ptr shader) {
+		Shared<ComputePass> pass = createShared<ComputePass>(name, shader);
+		pass->m_graph = this;
+		m_passes.push_back(pass);
+		m_recorded = false;
+		return *pass;
+	}
+
+	void ComputeGraph::addStages(StagedComputeShader_Ptr shader, std::function<void(ComputePass&, GLuint stage)> declare) {
+		for (GLuint stage = 0; stage < shader->getStageCount(); stage++) {
+			ComputePass& pass = addPass(shader->name() + "[" + std::to_string(stage) + "]", shader);
+			pass.setup([stage](ComputeShader& program) { program.setUInt("stage", stage); });
+			if (declare) declare(pass, stage);
+		}
+	}
+
+	void ComputeGraph::output(AbstractBufferObject& buffer, ResourceUsage usage) {
+		m_outputs.push_back({ &buffer, usage });
+		m_recorded = false;
+	}
+
+	void ComputeGraph::output(TextureBase& texture, ResourceUsage usage) {
+		m_outputs.push_back({ &texture, usage });
+		m_recorded = false;
+	}
+
+	void ComputeGraph::clear() {
+		m_passes.clear();
+		m_outputs.clear();
+		m_barriers.clear();
+		m_finalBarrier = 0;
+		m_barrierCount = 0;
+		m_recorded = false;
+	}
+
+	void ComputeGraph::record() {
+		struct State {
+			bool written = false;	//by a pass of the graph
+			GLbitfield visible = 0;	//barrier bits issued since the last write
+			bool read = false;		//read since the last barrier, a write has to wait for it
+		};
+		std::unordered_map<const void*, State> states;
+
+		//replayed until the barriers don't change : the writes of the previous replay are pending at the first pass
+		std::vector<GLbitfield> barriers;
+		for (int replay = 0; replay < 4; replay++) {
+			std::vector<GLbitfield> previous = barriers;
+			barriers.assign(m_passes.size(), 0);
+
+			for (size_t i = 0; i < m_passes.size(); i++) {
+				GLbitfield need = 0;
+				for (const ComputePass::Access& access : m_passes[i]->m_accesses) {
+					State& state = states[access.resource];
+					const GLbitfield bit = barrierBit(access.usage);
+					if (state.written && (access.read || access.write)) need |= bit & ~state.visible; //RAW and WAW
+					if (access.write && state.read) need |= bit; //WAR, the earlier reads must be done
+				}
+
+				if (need) {
+					for (auto& entry : states) {
+						entry.second.visible |= need;
+						entry.second.read = false;
+					}
+				}
+				barriers[i] = need;
+
+				for (const ComputePass::Access& access : m_passes[i]->m_accesses) {
+					State& state = states[access.resource];
+					if (access.read) state.read = true;
+					if (access.write) {
+						state.written = true;
+						state.visible = 0;
+					}
+				}
+			}
+			if (replay > 0 && barriers == previous) break;
+		}
+
+		m_finalBarrier = 0;
+		for (const Output& output : m_outputs) {
+			auto state = states.find(output.resource);
+			if (state != states.end() && state->second.written) m_finalBarrier |= barrierBit(output.usage) & ~state->second.visible;
+		}
+
+		m_barriers = barriers;
+		m_barrierCount = (m_finalBarrier != 0);
+		for (GLbitfield bits : m_barriers) m_barrierCount += (bits != 0);
+		m_recorded = true;
+		LOG_TRACE("ComputeGraph") << m_name << " recorded : " << m_passes.size() << " passes, " << m_barrierCount << " barriers" << Console::endl;
+	}
+
+	void ComputeGraph::execute(GLuint iterations) {
+		if (!m_recorded) record();
+		for (GLuint it = 0; it < iterations; it++) {
+			for (size_t i = 0; i < m_passes.size(); i++) {
+				if (m_barriers[i]) glMemoryBarrier(m_barriers[i]);
+				m_passes[i]->execute();
+			}
+		}
+		if (m_finalBarrier) glMemoryBarrier(m_finalBarrier);
+	}
+
+	void ComputeGraph::print() const {
+		Console::info("ComputeGraph") << m_name << (m_recorded ? "" : " (not recorded)") << Console::endl;
+		for (size_t i = 0; i < m_passes.size(); i++) {
+			if (i < m_barriers.size() && m_barriers[i]) Console::print() << "  barrier " << barrierName(m_barriers[i]) << Console::endl;
+			Console::print() << "  " << m_passes[i]->name() << " (" << m_passes[i]->shader().name() << ")" << Console::endl;
+		}
+		if (m_finalBarrier) Console::print() << "  barrier " << barrierName(m_finalBarrier) << " (outputs)" << Console::endl;
+	}
+}
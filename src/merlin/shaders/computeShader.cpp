@@ -1,12 +1,16 @@
 #include "pch.h"
 #include "merlin/shaders/computeShader.h"
 #include "merlin/core/log.h"
+#include "merlin/shaders/shaderCache.h"
+#include "merlin/utils/gpuProfiler.h"
 
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <cerrno>
 #include <vector>
+#include <filesystem>
+#include <unordered_map>
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -63,11 +67,22 @@ namespace Merlin {
 
 	void ComputeShader::dispatch(GLuint x, GLuint y, GLuint z) {
 		//Console::trace("ComputeShader") << "dispatch: " << int(x) << "x" << int(y) << "x" << int(z) << Console::endl;
+		if (!isCompiled() && isPending()) use(); //first use of a program still building
 		if (!isCompiled()) { Console::error("ComputeShader") << m_name << " is not Compiled" << Console::endl; return; }
+		MERLIN_GPU_ZONE(m_name);
 		glDispatchCompute(x, y, z);
 	}
 
+	void ComputeShader::dispatchIndirect(const AbstractBufferObject& args, GLintptr offset) {
+		if (!isCompiled() && isPending()) use(); //first use of a program still building
+		if (!isCompiled()) { Console::error("ComputeShader") << m_name << " is not Compiled" << Console::endl; return; }
+		MERLIN_GPU_ZONE(m_name);
+		args.bindAs(GL_DISPATCH_INDIRECT_BUFFER);
+		glDispatchComputeIndirect(args.offset() + offset);
+	}
+
 	void ComputeShader::dispatch() {
+		if (m_domain.x != 0 && isCompiled() && m_layoutGeneration != generation()) updateLayout(); //permutation switched
 		dispatch(m_wkgrpLayout.x, m_wkgrpLayout.y, m_wkgrpLayout.z);
 	}
 
@@ -81,50 +96,196 @@ namespace Merlin {
 
 	void ComputeShader::SetWorkgroupLayout(GLuint x, GLuint y, GLuint z) {
 		m_wkgrpLayout = glm::uvec3(x, y, z);
+		m_domain = glm::uvec3(0);
 	}
 
 	void ComputeShader::SetWorkgroupLayout(glm::uvec3 layout) {
 		m_wkgrpLayout = layout;
+		m_domain = glm::uvec3(0);
 	}
 
-	
+	void ComputeShader::SetDomain(GLuint width, GLuint height, GLuint layers) {
+		SetDomain(glm::uvec3(width, height, layers));
+	}
 
-	void ComputeShader::compile() {
-		if (m_compiled) {
-			Console::error() << "Shader is already compiled" << Console::endl;
-			return;
+	void ComputeShader::SetDomain(glm::uvec3 domain) {
+		m_domain = glm::max(domain, glm::uvec3(1));
+		updateLayout();
+	}
+
+	void ComputeShader::updateLayout() {
+		glm::uvec3 size = workgroupSize();
+		m_wkgrpLayout = (m_domain + size - glm::uvec3(1)) / size;
+		m_layoutGeneration = generation();
+	}
+
+	glm::uvec3 ComputeShader::workgroupSize() const {
+		if (!isCompiled()) return m_localSize.x != 0 ? m_localSize : glm::uvec3(1);
+		GLint size[3] = { 1, 1, 1 };
+		glGetProgramiv(id(), GL_COMPUTE_WORK_GROUP_SIZE, size);
+		return glm::uvec3(size[0], size[1], size[2]);
+	}
+
+	void ComputeShader::setWorkgroupSize(glm::uvec3 size) {
+		m_localSize = glm::max(size, glm::uvec3(1));
+		//the kernel may size its shared memory from these
+		inject("workgroup", "#define WORKGROUP_SIZE_X " + std::to_string(m_localSize.x) + "\n"
+			+ "#define WORKGROUP_SIZE_Y " + std::to_string(m_localSize.y) + "\n"
+			+ "#define WORKGROUP_SIZE_Z " + std::to_string(m_localSize.z));
+	}
+
+	// -----------
+
+	//device and kernel key -> fastest local size, one "key x y z" line per kernel
+	static std::string tuningPath() {
+		return (std::filesystem::path(ShaderCache::instance().directory()) / "workgroups.txt").string();
+	}
+
+	static std::unordered_map<uint64_t, glm::uvec3>& tunedSizes() {
+		static std::unordered_map<uint64_t, glm::uvec3> sizes;
+		static bool loaded = false;
+		if (!loaded) {
+			loaded = true;
+			std::ifstream file(tuningPath());
+			std::string key;
+			glm::uvec3 size;
+			while (file >> key >> size.x >> size.y >> size.z) sizes[std::stoull(key, nullptr, 16)] = size;
 		}
+		return sizes;
+	}
 
-		m_compiled = true;
-		m_shaderID = glCreateShader(GL_COMPUTE_SHADER);
+	static void saveTunedSizes() {
+		std::error_code error;
+		std::filesystem::create_directories(ShaderCache::instance().directory(), error);
+		std::ofstream file(tuningPath(), std::ios::trunc);
+		for (const auto& entry : tunedSizes()) {
+			char key[32];
+			snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(entry.first));
+			file << key << " " << entry.second.x << " " << entry.second.y << " " << entry.second.z << "\n";
+		}
+		if (!file) Console::warn("ComputeShader") << "cannot write " << tuningPath() << Console::endl;
+	}
 
-		precompileSrc(m_shaderSrc);
+	uint64_t ComputeShader::tuningKey() {
+		//source, constants and defines, the local size itself left out
+		std::string workgroup;
+		auto injection = m_injections.find("workgroup");
+		if (injection != m_injections.end()) {
+			workgroup = injection->second;
+			m_injections.erase(injection);
+			m_permutationDirty = true;
+		}
+		uint64_t permutation = permutationKey();
+		if (!workgroup.empty()) inject("workgroup", workgroup);
 
+		int dimensions = m_domain.z > 1 ? 3 : m_domain.y > 1 ? 2 : 1;
+		return ShaderCache::instance().key({ std::to_string(m_sourceKey), std::to_string(permutation), std::to_string(dimensions) });
+	}
 
-		GLint Result = GL_FALSE;
-		int InfoLogLength;
+	glm::uvec3 ComputeShader::autotune(const std::vector<glm::uvec3>& candidates, std::function<void()> run) {
+		if (m_domain.x == 0) {
+			Console::error("ComputeShader") << m_name << " : call SetDomain before autotune" << Console::endl;
+			return workgroupSize();
+		}
 
-		m_compiled = compileShader(name(), m_shaderSrc, m_shaderID);
+		const uint64_t key = tuningKey();
+		auto known = tunedSizes().find(key);
+		if (known != tunedSizes().end()) {
+			setWorkgroupSize(known->second);
+			use();
+			updateLayout();
+			return workgroupSize();
+		}
 
-		// Link the program
-		//printf("Linking program\n");
-		setID(glCreateProgram());
-		glAttachShader(id(), m_shaderID);
-		glLinkProgram(id());
+		std::vector<glm::uvec3> sizes = candidates;
+		if (sizes.empty()) {
+			if (m_domain.z > 1) sizes = { {4, 4, 4}, {8, 4, 4}, {8, 8, 4}, {8, 8, 8}, {16, 8, 4}, {16, 8, 8} };
+			else if (m_domain.y > 1) sizes = { {8, 8, 1}, {16, 8, 1}, {16, 16, 1}, {32, 8, 1}, {32, 16, 1}, {32, 32, 1} };
+			else sizes = { {32, 1, 1}, {64, 1, 1}, {128, 1, 1}, {256, 1, 1}, {512, 1, 1}, {1024, 1, 1} };
+		}
 
-		// Check the program
-		glGetProgramiv(id(), GL_LINK_STATUS, &Result);
-		glGetProgramiv(id(), GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0) {
-			std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-			glGetProgramInfoLog(id(), InfoLogLength, NULL, &ProgramErrorMessage[0]);
-			Console::error() << &ProgramErrorMessage[0] << Console::endl;
-			m_compiled = false;
+		GLint maxInvocations = 0, maxSize[3] = { 0, 0, 0 };
+		glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+		for (int i = 0; i < 3; i++) glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, i, &maxSize[i]);
+
+		static constexpr int repeats = 5;
+		GLuint query = 0;
+		glGenQueries(1, &query);
+
+		glm::uvec3 best = workgroupSize();
+		GLuint64 bestTime = ~GLuint64(0);
+		for (const glm::uvec3& size : sizes) {
+			if (GLint(size.x * size.y * size.z) > maxInvocations || GLint(size.x) > maxSize[0] || GLint(size.y) > maxSize[1] || GLint(size.z) > maxSize[2]) continue;
+
+			setWorkgroupSize(size);
+			use(); //builds the permutation
+			if (!isCompiled() || workgroupSize() != size) continue;
+			updateLayout();
+
+			auto execute = [&]() {
+				if (run) run();
+				else dispatch();
+				glMemoryBarrier(GL_ALL_BARRIER_BITS);
+			};
+			execute(); //warm up
+
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			for (int i = 0; i < repeats; i++) execute();
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed); //tuning is an explicit step, waiting is fine
+			Console::trace("ComputeShader") << m_name << " " << size.x << "x" << size.y << "x" << size.z << " : " << elapsed / (repeats * 1000.0) << " us" << Console::endl;
+			if (elapsed < bestTime) {
+				bestTime = elapsed;
+				best = size;
+			}
 		}
-		Console::success("ComputeShader") << "shader " << m_name << " compiled succesfully" << Console::endl;
-		glDetachShader(id(), m_shaderID);
-		glDeleteShader(m_shaderID);
+		glDeleteQueries(1, &query);
+
+		setWorkgroupSize(best);
 		use();
+		updateLayout();
+		if (bestTime != ~GLuint64(0)) {
+			tunedSizes()[key] = best;
+			saveTunedSizes();
+			Console::info("ComputeShader") << m_name << " tuned to " << best.x << "x" << best.y << "x" << best.z << " (" << bestTime / (repeats * 1000.0) << " us per dispatch)" << Console::endl;
+		}
+		return workgroupSize();
+	}
+
+	// -----------
+
+	
+
+	void ComputeShader::compile() {
+		if (m_compiled && permutationKey() == m_permutation) {
+			Console::error() << "Shader is already compiled" << Console::endl;
+			return;
+		}
+		ShaderBase::compile();
+	}
+
+	void ComputeShader::reload() {
+		if (m_path == "") return;
+		const std::string path = m_path;
+		readFile(path);
+		compileAsync();
+	}
+
+	std::vector<ShaderStage> ComputeShader::prepareStages() {
+		precompileSrc(m_shaderSrc);
+
+		if (m_localSize.x != 0) {
+			//layout(local_size_x = ..., ...) in; replaced by the chosen size
+			size_t pos = m_shaderSrc.find("local_size_x");
+			size_t begin = pos == std::string::npos ? pos : m_shaderSrc.rfind("layout", pos);
+			size_t end = pos == std::string::npos ? pos : m_shaderSrc.find(';', pos);
+			if (begin != std::string::npos && end != std::string::npos)
+				m_shaderSrc.replace(begin, end + 1 - begin, "layout(local_size_x = " + std::to_string(m_localSize.x) + ", local_size_y = "
+					+ std::to_string(m_localSize.y) + ", local_size_z = " + std::to_string(m_localSize.z) + ") in;");
+		}
+		return { { GL_COMPUTE_SHADER, "Compute", m_shaderSrc } };
 	}
 
 	void ComputeShader::compileFromFile(const std::string& file_path) {
@@ -133,17 +294,24 @@ namespace Merlin {
 	}
 
 	void ComputeShader::compileFromSrc(const std::string& src) {
+		invalidatePermutations();
 		m_shaderSrc = src;
+		m_sourceKey = ShaderCache::instance().key({ m_shaderSrc });
 		compile();
 	}
 
 	void ComputeShader::readFile(const std::string& file_path) {
 
 		m_shaderSrc = "";
+		m_dependencies.clear();
+		invalidatePermutations(); //built from the previous sources
+		m_path = file_path;
 
 		// Read vertexFile and fragmentFile and store the strings
 		LOG_INFO() << "Importing Compue shader source... : " << file_path << Console::endl;
-		m_shaderSrc = readSrc(file_path);
+		m_shaderSrc = readSrc(file_path, &m_dependencies);
+		m_sourceKey = ShaderCache::instance().key({ m_shaderSrc });
+		ShaderCompiler::instance().watch(*this);
 	}
 
 
@@ -192,9 +360,10 @@ namespace Merlin {
 	}
 	void StagedComputeShader::step() {
 		setUInt("stage", m_stage);
-		dispatch(m_wkgrpLayout.x, m_wkgrpLayout.y, m_wkgrpLayout.z);
+		dispatch();
+		//the stages don't declare their accesses, a storage barrier is assumed between each of them
+		//ComputeGraph::addStages derives the barriers (and skips the useless ones) from declared accesses instead
 		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-		glFinish();
 		m_stage++;
 	}
 	void StagedComputeShader::execute(GLuint i) {
@@ -25,7 +25,7 @@ namespace Merlin {
 	PhongShader::PhongShader(std::string n,
 		const std::string vpath,
 		const std::string fpath,
-		const std::string gpath, bool compile) : Shader(n, vpath, fpath, gpath) {
+		const std::string gpath, bool compile) : Shader(n, vpath, fpath, gpath, compile) {
 
 		supportEnvironment(true);
 		supportLights(true);
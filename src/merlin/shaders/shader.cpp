@@ -42,16 +42,13 @@ namespace Merlin {
 
 	void Shader::destroy() {
 		LOG_TRACE("Shader") << "Destructing Shader " << id() << " deleted. " << Console::endl;
-		if (m_compiled != 0) {
-
-			vertexShaderID = 0;
-			fragmentShaderID = 0;
-			geometryShaderID = 0;
-		}
 	}
-	
-	void Shader::compile() {
-		compileFromSrc(VertexShaderSrc, FragmentShaderSrc, GeomShaderSrc);
+
+	void Shader::reload() {
+		if (m_vertexPath == "" || m_fragmentPath == "") return;
+		const std::string vertex = m_vertexPath, fragment = m_fragmentPath, geometry = m_geometryPath;
+		readFile(vertex, fragment, geometry);
+		compileAsync();
 	}
 	
 	void Shader::compileFromFile(const std::string& vertex_file_path,
@@ -69,87 +66,51 @@ namespace Merlin {
 		VertexShaderSrc = "";
 		FragmentShaderSrc = "";
 		GeomShaderSrc = "";
+		m_dependencies.clear();
+		invalidatePermutations(); //built from the previous sources
+
+		m_vertexPath = vertex_file_path;
+		m_fragmentPath = fragment_file_path;
+		m_geometryPath = geometry_file_path;
 
 		// Read vertexFile and fragmentFile and store the strings
 		LOG_INFO() << "Importing Vertex shader source... : " << vertex_file_path << Console::endl;
-		VertexShaderSrc = readSrc(vertex_file_path);
+		VertexShaderSrc = readSrc(vertex_file_path, &m_dependencies);
 
 		LOG_INFO() << "Importing Fragment shader source... : " << fragment_file_path << Console::endl;
-		FragmentShaderSrc = readSrc(fragment_file_path);
+		FragmentShaderSrc = readSrc(fragment_file_path, &m_dependencies);
 
 		if (geometry_file_path != "") {
 			LOG_INFO() << "Importing Geometry shader source... : " << geometry_file_path << Console::endl;
-			GeomShaderSrc = readSrc(geometry_file_path);
+			GeomShaderSrc = readSrc(geometry_file_path, &m_dependencies);
 		}
+
+		ShaderCompiler::instance().watch(*this);
 	}
 
 
 	void Shader::compileFromSrc(const std::string& vSrc,
 								const std::string& fSrc,
 								const std::string& gSrc) {
-		m_compiled = true;
-
-		LOG_TRACE() << "Creating shaders... : " << Console::endl;
-		vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-		fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-		if (GeomShaderSrc != "")
-			geometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
-
+		invalidatePermutations();
 		VertexShaderSrc = vSrc;
 		FragmentShaderSrc = fSrc;
 		GeomShaderSrc = gSrc;
+		compile();
+	}
 
+	std::vector<ShaderStage> Shader::prepareStages() {
 		precompileSrc(VertexShaderSrc);
 		precompileSrc(FragmentShaderSrc);
 		precompileSrc(GeomShaderSrc);
 
-		// Compile Vertex Shader
-		compileShader("Vertex", VertexShaderSrc, vertexShaderID);
-		compileShader("Fragment", FragmentShaderSrc, fragmentShaderID);
-		if (GeomShaderSrc != "")
-			compileShader("Geometry", GeomShaderSrc, geometryShaderID);
-
-		setID(glCreateProgram());
-
-		LOG_INFO("Shader") << "Creating program n " << id() << "..." << Console::endl;
-
-		glAttachShader(id(), vertexShaderID);
-		glAttachShader(id(), fragmentShaderID);
-		if (GeomShaderSrc != "")
-			glAttachShader(id(), geometryShaderID);
-
-		glLinkProgram(id());
-
-		// Check the program
-		GLint Result = GL_FALSE;
-		int InfoLogLength;
-
-		glGetProgramiv(id(), GL_LINK_STATUS, &Result);
-		glGetProgramiv(id(), GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0) {
-			std::vector<char> ProgramErrorMessage(int(InfoLogLength) + 1);
-			glGetProgramInfoLog(id(), InfoLogLength, NULL, &ProgramErrorMessage[0]);
-			LOG_ERROR() << &ProgramErrorMessage[0];
-			LOG_ERROR("Shader") << "Shader : " << name() << " program linkage failed." << Console::endl;
-			m_compiled = false;
-		}
-
-		if (Result == GL_FALSE) Console::error("Shader") << "Shader " << id() << " not linked" << Console::endl;
-		else LOG_OK("Shader") << "Shader program : " << name() << "  successfully created." << Console::endl;
-
-
-		glDetachShader(id(), vertexShaderID);
-		glDetachShader(id(), fragmentShaderID);
-
+		std::vector<ShaderStage> stages = {
+			{ GL_VERTEX_SHADER, "Vertex", VertexShaderSrc },
+			{ GL_FRAGMENT_SHADER, "Fragment", FragmentShaderSrc }
+		};
 		if (GeomShaderSrc != "")
-			glDetachShader(id(), geometryShaderID);
-
-		glDeleteShader(vertexShaderID);
-		glDeleteShader(fragmentShaderID);
-		if (GeomShaderSrc != "")
-			glDeleteShader(geometryShaderID);
-
-		use();
+			stages.push_back({ GL_GEOMETRY_SHADER, "Geometry", GeomShaderSrc });
+		return stages;
 	}
 
 }
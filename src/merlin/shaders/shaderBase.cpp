@@ -2,17 +2,19 @@
 #include "merlin/shaders/shaderBase.h"
 #include "merlin/core/log.h"
 #include "merlin/memory/bindingPointManager.h"
+#include "merlin/shaders/shaderPreprocessor.h"
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <cerrno>
-#include <regex> // Include the <regex> header for regular expressions
 
 #include <glm/gtc/type_ptr.hpp>
 
 namespace Merlin {
 
 	int ShaderBase::shader_instances = 0;
+	GLuint ShaderBase::s_generations = 0;
 
 	ShaderBase::ShaderBase(ShaderType type) {
 		shader_instances++;
@@ -27,150 +29,241 @@ namespace Merlin {
 	}
 
 	ShaderBase::~ShaderBase() {
+		ShaderCompiler::onShaderDestroyed(*this);
 		destroy();
 	}
 
+	static void deleteProgram(GLuint program) {
+		BindingPointManager::onProgramDeleted(program);
+		glDeleteProgram(program);
+	}
+
 	void ShaderBase::destroy() {
 		LOG_TRACE("ShaderBase") << "Shader " << m_programID << " deleted. " << Console::endl;
+		for (const auto& permutation : m_permutations)
+			if (permutation.second != m_programID) deleteProgram(permutation.second);
+		m_permutations.clear();
 		if (m_compiled != 0) {
-			glDeleteProgram(m_programID);
+			deleteProgram(m_programID);
 			m_programID = 0;
 		}
 	}
 
 	void ShaderBase::use() const {
 		//LOG_TRACE("Shader") << "Using program : " << m_programID << Console::endl;
+		if (m_permutationDirty && m_compiled && permutationKey() != m_permutation) {
+			//constants or defines changed since the program was built : switch to their permutation, built at its first use
+			ShaderBase& self = const_cast<ShaderBase&>(*this);
+			if (!self.selectPermutation()) {
+				if (m_type == ShaderType::GRAPHICS) self.compileAsync(); //drawn with the previous permutation meanwhile
+				else self.compile();
+			}
+		}
 		if (!isCompiled()) {
-			//LOG_ERROR("Shader") << "Failed to bind shader. Program is not compiled" << Console::endl;
-			return;
+			//a solver step can't be skipped, compute programs still building are waited for
+			if (m_type != ShaderType::GRAPHICS && isPending()) ShaderCompiler::instance().finish(*this);
+			if (!isCompiled()) return;
 		}
 		glUseProgram(m_programID);
 	}
 
 	void ShaderBase::attach(AbstractBufferObject& buf) {
-		int block_index = glGetProgramResourceIndex(m_programID, GL_SHADER_STORAGE_BLOCK, buf.name().c_str());
-		if (block_index == -1) Console::error("ShaderBase") << "Block " << buf.name() << " not found in shader '" << m_name << "'. Did you bind it properly ?" << Console::endl;
+		attach(buf, buf.name());
+	}
+
+	void ShaderBase::attach(AbstractBufferObject& buf, const std::string& blockName) {
+		const bool uniformBlock = buf.target() == BufferTarget::Uniform_Buffer;
+		const bool known = (uniformBlock ? m_uniformBlockIndices : m_blockIndices).count(blockName) != 0;
+		GLint block_index = blockIndex(blockName, buf.target());
+
+		//first attach since the link, check the C++ element type against the runtime array of the block
+		if (!known && !uniformBlock && block_index != -1 && buf.type() > 1) {
+			BlockLayout layout = getBlockLayout(blockName);
+			if (layout.stride() > 0 && !layout.validate(buf.type()))
+				Console::error("ShaderBase") << "Buffer " << buf.name() << " does not match its block layout in shader '" << m_name << "'" << Console::endl;
+		}
+
+		if (block_index == -1) Console::error("ShaderBase") << "Block " << blockName << " not found in shader '" << m_name << "'. Did you bind it properly ?" << Console::endl;
 		else {
+			//redundant binds and block bindings are filtered by the manager, attaching every frame is cheap
 			BindingPointManager& manager = BindingPointManager::instance();
-			auto bindingPoint = manager.allocateBindingPoint(buf.target(), buf.id());
-			buf.bind();
+			auto bindingPoint = manager.allocateBindingPoint(buf.target(), buf.id(), buf.offset());
 			buf.setBindingPoint(bindingPoint);
-			Console::trace("ShaderBase") << buf.name() << "( block index " << block_index << ") is now bound to " << name() << " using binding point " << bindingPoint << Console::endl;
-			glShaderStorageBlockBinding(m_programID, block_index, bindingPoint);//Do this explicitly in your shader !
-			buf.unbind();
+			manager.bindBlock(m_programID, block_index, bindingPoint, buf.target());//Do this explicitly in your shader !
 		}
 	}
 
+	GLint ShaderBase::blockIndex(const std::string& blockName, BufferTarget target) const {
+		if (!isCompiled()) return -1;
+		const bool uniformBlock = target == BufferTarget::Uniform_Buffer;
+		auto& indices = uniformBlock ? m_uniformBlockIndices : m_blockIndices;
+		auto cached = indices.find(blockName);
+		if (cached != indices.end()) return cached->second;
+
+		GLuint index = glGetProgramResourceIndex(m_programID, uniformBlock ? GL_UNIFORM_BLOCK : GL_SHADER_STORAGE_BLOCK, blockName.c_str());
+		return indices[blockName] = index == GL_INVALID_INDEX ? -1 : GLint(index);
+	}
+
 	void ShaderBase::detach(AbstractBufferObject& buf){
 		buf.releaseBindingPoint();
 	}
 
-	//TODO : bind the shaders automatically before setting uniforms.
-	GLuint ShaderBase::getUniformLocation(const char* uniform) const{
-		if (!isCompiled()) return 0;
-		GLuint uniLoc = glGetUniformLocation(m_programID, uniform);
-		if (uniLoc == -1) LOG_WARN("Shader") << "(" << m_name << ") Invalid Uniform name : " << uniform << ", (or wrong binded shader)" << Console::endl;
-		return uniLoc;
+	BlockLayout ShaderBase::getBlockLayout(const std::string& blockName) const {
+		if (!isCompiled()) return BlockLayout();
+		return BlockLayout::reflect(m_programID, blockName);
 	}
 
+	void ShaderBase::reflectUniforms() {
+		m_uniformLocations.clear();
+		m_missingUniforms.clear();
+		if (m_programID == 0) return;
+
+		//default block uniforms only, members of uniform blocks have no location
+		GLint count = 0;
+		glGetProgramInterfaceiv(m_programID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+		const GLenum properties[3] = { GL_NAME_LENGTH, GL_LOCATION, GL_ARRAY_SIZE };
+		std::vector<char> buffer;
+		for (GLint i = 0; i < count; i++) {
+			GLint values[3] = { 0, -1, 0 };
+			glGetProgramResourceiv(m_programID, GL_UNIFORM, i, 3, properties, 3, nullptr, values);
+			if (values[1] < 0) continue;
+
+			buffer.resize(std::max(values[0], 1));
+			glGetProgramResourceName(m_programID, GL_UNIFORM, i, GLsizei(buffer.size()), nullptr, buffer.data());
+			std::string uniform(buffer.data());
+			m_uniformLocations[uniform] = values[1];
 
-	void ShaderBase::setUInt(const std::string name, GLuint value) const {
-		if (!isCompiled()) return;
-		int uniformLocation = getUniformLocation(name.c_str());
-		glUniform1ui(uniformLocation, value);
+			//arrays are reported as name[0], the bare name refers to the first element too
+			if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0) {
+				m_uniformLocations[uniform.substr(0, uniform.size() - 3)] = values[1];
+			}
+		}
 	}
 
-	void ShaderBase::setInt(const std::string name, GLint value) const {
-		if (!isCompiled()) return;
-		int uniformLocation = getUniformLocation(name.c_str());
-		glUniform1i(uniformLocation, value);
+	GLint ShaderBase::getUniformLocation(const std::string& uniform) const {
+		if (!isCompiled()) return -1;
+		auto cached = m_uniformLocations.find(uniform);
+		if (cached != m_uniformLocations.end()) return cached->second;
+
+		//not reported by the introspection (array elements, struct members) : queried once, misses included
+		GLint location = glGetUniformLocation(m_programID, uniform.c_str());
+		m_uniformLocations[uniform] = location;
+		if (location == -1 && m_missingUniforms.insert(uniform).second)
+			LOG_WARN("Shader") << "(" << m_name << ") Invalid Uniform name : " << uniform << " (inactive or optimized out), further misses are not reported" << Console::endl;
+		return location;
 	}
 
-	void ShaderBase::setFloat(const std::string name, GLfloat value) const {
-		if (!isCompiled()) return;
-		int uniformLocation = getUniformLocation(name.c_str());
-		glUniform1f(uniformLocation, value);
+	GLint ShaderBase::getUniformLocation(const char* uniform) const {
+		return getUniformLocation(std::string(uniform));
 	}
 
-	void ShaderBase::setDouble(const std::string name, GLdouble value) const {
-		if (!isCompiled()) return;
-		int uniformLocation = getUniformLocation(name.c_str());
-		glUniform1d(uniformLocation, value);
+	bool ShaderBase::hasUniform(const std::string& uniform) const {
+		if (!isCompiled()) return false;
+		auto cached = m_uniformLocations.find(uniform);
+		if (cached != m_uniformLocations.end()) return cached->second != -1;
+		return glGetUniformLocation(m_programID, uniform.c_str()) != -1;
 	}
 
-	void ShaderBase::setMat4(const std::string name, glm::mat4 mat) const {
-		if (!isCompiled()) return;
-		glUniformMatrix4fv(getUniformLocation(name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+	//set before the first program is ready (background build) : kept and applied once it's swapped in
+	void ShaderBase::defer(const std::string& name, std::function<void()> apply) const {
+		m_deferredUniforms[name] = std::move(apply);
 	}
 
-	void ShaderBase::setMat3(const std::string name, glm::mat3 mat) const {
-		if (!isCompiled()) return;
-		glUniformMatrix3fv(getUniformLocation(name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+	//glProgramUniform* : the program doesn't have to be bound, a -1 location is ignored by GL
+
+	void ShaderBase::setUInt(const std::string& name, GLuint value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setUInt(name, value); });
+		glProgramUniform1ui(m_programID, getUniformLocation(name), value);
 	}
 
-	void ShaderBase::setVec4(const std::string name, glm::vec4 value) const {
-		if (!isCompiled()) return;
-		glUniform4fv(getUniformLocation(name.c_str()), 1, glm::value_ptr(value));
+	void ShaderBase::setInt(const std::string& name, GLint value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setInt(name, value); });
+		glProgramUniform1i(m_programID, getUniformLocation(name), value);
 	}
 
-	void ShaderBase::setIVec4(const std::string name, glm::ivec4 value) const {
-		if (!isCompiled()) return;
-		glUniform4i(getUniformLocation(name.c_str()), value.x, value.y, value.z, value.w);
+	void ShaderBase::setFloat(const std::string& name, GLfloat value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setFloat(name, value); });
+		glProgramUniform1f(m_programID, getUniformLocation(name), value);
 	}
 
-	void ShaderBase::setUVec4(const std::string name, glm::uvec4 value) const {
-		if (!isCompiled()) return;
-		glUniform4ui(getUniformLocation(name.c_str()), value.x, value.y, value.z, value.w);
+	void ShaderBase::setDouble(const std::string& name, GLdouble value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setDouble(name, value); });
+		glProgramUniform1d(m_programID, getUniformLocation(name), value);
 	}
 
-	void ShaderBase::setDVec4(const std::string name, glm::dvec4 value) const {
-		if (!isCompiled()) return;
-		glUniform4d(getUniformLocation(name.c_str()), value.x, value.y, value.z, value.w);
+	void ShaderBase::setMat4(const std::string& name, const glm::mat4& mat) const {
+		if (!isCompiled()) return defer(name, [this, name, mat] { setMat4(name, mat); });
+		glProgramUniformMatrix4fv(m_programID, getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(mat));
 	}
 
-	void ShaderBase::setVec3(const std::string name, glm::vec3 value) const {
-		if (!isCompiled()) return;
-		glUniform3fv(getUniformLocation(name.c_str()), 1, glm::value_ptr(value));
+	void ShaderBase::setMat3(const std::string& name, const glm::mat3& mat) const {
+		if (!isCompiled()) return defer(name, [this, name, mat] { setMat3(name, mat); });
+		glProgramUniformMatrix3fv(m_programID, getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(mat));
 	}
 
-	void ShaderBase::setIVec3(const std::string name, glm::ivec3 value) const {
-		if (!isCompiled()) return;
-		glUniform3i(getUniformLocation(name.c_str()), value.x, value.y, value.z);
+	void ShaderBase::setVec4(const std::string& name, const glm::vec4& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setVec4(name, value); });
+		glProgramUniform4fv(m_programID, getUniformLocation(name), 1, glm::value_ptr(value));
 	}
 
-	void ShaderBase::setUVec3(const std::string name, glm::uvec3 value) const {
-		if (!isCompiled()) return;
-		glUniform3ui(getUniformLocation(name.c_str()), value.x, value.y, value.z);
+	void ShaderBase::setIVec4(const std::string& name, const glm::ivec4& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setIVec4(name, value); });
+		glProgramUniform4i(m_programID, getUniformLocation(name), value.x, value.y, value.z, value.w);
 	}
 
-	void ShaderBase::setDVec3(const std::string name, glm::dvec3 value) const {
-		if (!isCompiled()) return;
-		glUniform3d(getUniformLocation(name.c_str()), value.x, value.y, value.z);
+	void ShaderBase::setUVec4(const std::string& name, const glm::uvec4& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setUVec4(name, value); });
+		glProgramUniform4ui(m_programID, getUniformLocation(name), value.x, value.y, value.z, value.w);
 	}
 
-	void ShaderBase::setVec2(const std::string name, glm::vec2 value) const {
-		if (!isCompiled()) return;
-		glUniform2fv(getUniformLocation(name.c_str()), 1, glm::value_ptr(value));
+	void ShaderBase::setDVec4(const std::string& name, const glm::dvec4& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setDVec4(name, value); });
+		glProgramUniform4d(m_programID, getUniformLocation(name), value.x, value.y, value.z, value.w);
 	}
 
-	void ShaderBase::setIVec2(const std::string name, glm::ivec2 value) const {
-		if (!isCompiled()) return;
-		glUniform2i(getUniformLocation(name.c_str()), value.x, value.y);
+	void ShaderBase::setVec3(const std::string& name, const glm::vec3& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setVec3(name, value); });
+		glProgramUniform3fv(m_programID, getUniformLocation(name), 1, glm::value_ptr(value));
 	}
 
-	void ShaderBase::setUVec2(const std::string name, glm::uvec2 value) const {
-		if (!isCompiled()) return;
-		glUniform2ui(getUniformLocation(name.c_str()), value.x, value.y);
+	void ShaderBase::setIVec3(const std::string& name, const glm::ivec3& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setIVec3(name, value); });
+		glProgramUniform3i(m_programID, getUniformLocation(name), value.x, value.y, value.z);
 	}
 
-	void ShaderBase::setDVec2(const std::string name, glm::dvec2 value) const {
-		if (!isCompiled()) return;
-		glUniform2d(getUniformLocation(name.c_str()), value.x, value.y);
+	void ShaderBase::setUVec3(const std::string& name, const glm::uvec3& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setUVec3(name, value); });
+		glProgramUniform3ui(m_programID, getUniformLocation(name), value.x, value.y, value.z);
 	}
 
-	void ShaderBase::setIntArray(const std::string name, GLint* values, uint32_t count) const {
-		if (!isCompiled()) return;
-		glUniform2iv( getUniformLocation(name.c_str()), count, values);
+	void ShaderBase::setDVec3(const std::string& name, const glm::dvec3& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setDVec3(name, value); });
+		glProgramUniform3d(m_programID, getUniformLocation(name), value.x, value.y, value.z);
+	}
+
+	void ShaderBase::setVec2(const std::string& name, const glm::vec2& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setVec2(name, value); });
+		glProgramUniform2fv(m_programID, getUniformLocation(name), 1, glm::value_ptr(value));
+	}
+
+	void ShaderBase::setIVec2(const std::string& name, const glm::ivec2& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setIVec2(name, value); });
+		glProgramUniform2i(m_programID, getUniformLocation(name), value.x, value.y);
+	}
+
+	void ShaderBase::setUVec2(const std::string& name, const glm::uvec2& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setUVec2(name, value); });
+		glProgramUniform2ui(m_programID, getUniformLocation(name), value.x, value.y);
+	}
+
+	void ShaderBase::setDVec2(const std::string& name, const glm::dvec2& value) const {
+		if (!isCompiled()) return defer(name, [this, name, value] { setDVec2(name, value); });
+		glProgramUniform2d(m_programID, getUniformLocation(name), value.x, value.y);
+	}
+
+	void ShaderBase::setIntArray(const std::string& name, const GLint* values, uint32_t count) const {
+		if (!isCompiled()) return defer(name, [this, name, copy = std::vector<GLint>(values, values + count)] { setIntArray(name, copy.data(), uint32_t(copy.size())); });
+		glProgramUniform1iv(m_programID, getUniformLocation(name), count, values);
 	}
 
 	// -----------
@@ -180,19 +273,19 @@ namespace Merlin {
 	}
 
 	void ShaderBase::setConstUInt(const std::string name, GLuint value) {
-		m_constants[name] = "const uint " + name + " = " + std::to_string(value);
+		setConstant(name, "const uint " + name + " = " + std::to_string(value));
 	}
 
 	void ShaderBase::setConstInt(const std::string name, GLint value) {
-		m_constants[name] = "const int " + name + " = " + std::to_string(value);
+		setConstant(name, "const int " + name + " = " + std::to_string(value));
 	}
 
 	void ShaderBase::setConstFloat(const std::string name, GLfloat value) {
-		m_constants[name] = "const float " + name + " = " + std::to_string(value);
+		setConstant(name, "const float " + name + " = " + std::to_string(value));
 	}
 
 	void ShaderBase::setConstDouble(const std::string name, GLdouble value) {
-		m_constants[name] = "const double " + name + " = " + std::to_string(value);
+		setConstant(name, "const double " + name + " = " + std::to_string(value));
 	}
 
 	void ShaderBase::setConstMat4(const std::string name, glm::mat4 mat) {
@@ -202,7 +295,7 @@ namespace Merlin {
 			for (int j = 0; j < 4; j++)
 				value += std::to_string(float(mat[i][j])) + ((i + j * 4 < 15) ? "," : "");
 
-		m_constants[name] = "const mat4 " + name + " = " + value;
+		setConstant(name, "const mat4 " + name + " = " + value);
 	}
 
 	void ShaderBase::setConstMat3(const std::string name, glm::mat3 mat) {
@@ -212,7 +305,7 @@ namespace Merlin {
 			for (int j = 0; j < 4; j++)
 				value += std::to_string(float(mat[i][j])) + ((i + j * 4 < 15) ? "," : "");
 
-		m_constants[name] = "const mat3 " + name + " = " + value;
+		setConstant(name, "const mat3 " + name + " = " + value);
 	}
 
 	void ShaderBase::setConstDMat3(const std::string name, glm::dmat3 mat) {
@@ -222,7 +315,7 @@ namespace Merlin {
 			for (int j = 0; j < 4; j++)
 				value += std::to_string(double(mat[i][j])) + ((i + j * 4 < 15) ? "," : "");
 
-		m_constants[name] = "const dmat3 " + name + " = " + value;
+		setConstant(name, "const dmat3 " + name + " = " + value);
 	}
 
 	void ShaderBase::setConstDMat4(const std::string name, glm::dmat4 mat) {
@@ -232,7 +325,7 @@ namespace Merlin {
 			for (int j = 0; j < 4; j++)
 				value += std::to_string(double(mat[i][j])) + ((i + j * 4 < 15) ? "," : "");
 
-		m_constants[name] = "const dmat4 " + name + " = " + value;
+		setConstant(name, "const dmat4 " + name + " = " + value);
 	}
 
 
@@ -243,7 +336,7 @@ namespace Merlin {
 		for (int i = 0; i < 4; i++)
 				value += std::to_string(float(vec[i])) + ((i < 3) ? "," : "");
 
-		m_constants[name] = "const vec4 " + name + " = vec4(" + value + ")";
+		setConstant(name, "const vec4 " + name + " = vec4(" + value + ")");
 	}
 
 	void ShaderBase::setConstIVec4(const std::string name, glm::ivec4 vec) {
@@ -252,7 +345,7 @@ namespace Merlin {
 		for (int i = 0; i < 4; i++)
 			value += std::to_string(int(vec[i])) + ((i < 3) ? "," : "");
 
-		m_constants[name] = "const ivec4 " + name + " = ivec4(" + value + ")";
+		setConstant(name, "const ivec4 " + name + " = ivec4(" + value + ")");
 	}
 
 	void ShaderBase::setConstUVec4(const std::string name, glm::uvec4 vec) {
@@ -261,7 +354,7 @@ namespace Merlin {
 		for (int i = 0; i < 4; i++)
 			value += std::to_string(GLuint(vec[i])) + ((i < 3) ? "," : "");
 
-		m_constants[name] = "const uvec4 " + name + " = uvec4(" + value + ")";
+		setConstant(name, "const uvec4 " + name + " = uvec4(" + value + ")");
 	}
 
 	void ShaderBase::setConstDVec4(const std::string name, glm::dvec4 vec) {
@@ -270,7 +363,7 @@ namespace Merlin {
 		for (int i = 0; i < 4; i++)
 			value += std::to_string(GLuint(vec[i])) + ((i < 3) ? "," : "");
 
-		m_constants[name] = "const dvec4 " + name + " = dvec4(" + value + ")";
+		setConstant(name, "const dvec4 " + name + " = dvec4(" + value + ")");
 	}
 
 	void ShaderBase::setConstVec3(const std::string name, glm::vec3 vec) {
@@ -279,7 +372,7 @@ namespace Merlin {
 		for (int i = 0; i < 3; i++)
 			value += std::to_string(float(vec[i])) + ((i < 2) ? "," : "");
 
-		m_constants[name] = "const vec3 " + name + " = vec3(" + value + ")";
+		setConstant(name, "const vec3 " + name + " = vec3(" + value + ")");
 	}
 
 	void ShaderBase::setConstIVec3(const std::string name, glm::ivec3 vec) {
@@ -288,7 +381,7 @@ namespace Merlin {
 		for (int i = 0; i < 3; i++)
 			value += std::to_string(int(vec[i])) + ((i < 2) ? "," : "");
 
-		m_constants[name] = "const ivec3 " + name + " = ivec3(" + value + ")";
+		setConstant(name, "const ivec3 " + name + " = ivec3(" + value + ")");
 	}
 
 	void ShaderBase::setConstUVec3(const std::string name, glm::uvec3 vec) {
@@ -297,7 +390,7 @@ namespace Merlin {
 		for (int i = 0; i < 3; i++)
 			value += std::to_string(GLuint(vec[i])) + ((i < 2) ? "," : "");
 
-		m_constants[name] = "const uvec3 " + name + " = uvec3(" + value + ")";
+		setConstant(name, "const uvec3 " + name + " = uvec3(" + value + ")");
 	}
 
 	void ShaderBase::setConstDVec3(const std::string name, glm::dvec3 vec) {
@@ -306,7 +399,7 @@ namespace Merlin {
 		for (int i = 0; i < 3; i++)
 			value += std::to_string(GLuint(vec[i])) + ((i < 2) ? "," : "");
 
-		m_constants[name] = "const dvec3 " + name + " = dvec3(" + value + ")";
+		setConstant(name, "const dvec3 " + name + " = dvec3(" + value + ")");
 	}
 
 	void ShaderBase::setConstVec2(const std::string name, glm::vec2 vec)  {
@@ -315,7 +408,7 @@ namespace Merlin {
 		for (int i = 0; i < 2; i++)
 			value += std::to_string(float(vec[i])) + ((i < 1) ? "," : "");
 
-		m_constants[name] = "const vec2 " + name + " = vec2(" + value + ")";
+		setConstant(name, "const vec2 " + name + " = vec2(" + value + ")");
 	}
 
 	void ShaderBase::setConstIVec2(const std::string name, glm::ivec2 vec) {
@@ -324,7 +417,7 @@ namespace Merlin {
 		for (int i = 0; i < 2; i++)
 			value += std::to_string(float(vec[i])) + ((i < 1) ? "," : "");
 
-		m_constants[name] = "const ivec2 " + name + " = ivec2(" + value + ")";
+		setConstant(name, "const ivec2 " + name + " = ivec2(" + value + ")");
 	}
 
 	void ShaderBase::setConstUVec2(const std::string name, glm::uvec2 vec) {
@@ -333,7 +426,7 @@ namespace Merlin {
 		for (int i = 0; i < 2; i++)
 			value += std::to_string(GLuint(vec[i])) + ((i < 1) ? "," : "");
 
-		m_constants[name] = "const uvec2 " + name + " = uvec2(" + value + ")";
+		setConstant(name, "const uvec2 " + name + " = uvec2(" + value + ")");
 	}
 
 	void ShaderBase::setConstDVec2(const std::string name, glm::dvec2 vec) {
@@ -342,112 +435,184 @@ namespace Merlin {
 		for (int i = 0; i < 2; i++)
 			value += std::to_string(GLuint(vec[i])) + ((i < 1) ? "," : "");
 
-		m_constants[name] = "const dvec2 " + name + " = dvec2(" + value + ")";
+		setConstant(name, "const dvec2 " + name + " = dvec2(" + value + ")");
+	}
+
+	void ShaderBase::setConstant(const std::string& name, const std::string& declaration) {
+		auto it = m_constants.find(name);
+		if (it != m_constants.end() && it->second == declaration) return;
+		m_constants[name] = declaration;
+		m_permutationDirty = true;
 	}
 
 	void ShaderBase::define(const std::string& name, const std::string& value) {
+		auto it = m_defines.find(name);
+		if (it != m_defines.end() && it->second == value) return;
 		m_defines[name] = value;
+		m_permutationDirty = true;
 	}
 
+	bool ShaderBase::inject(const std::string& key, const std::string& code) {
+		auto it = m_injections.find(key);
+		if (it != m_injections.end() && it->second == code) return false;
+		m_injections[key] = code;
+		m_permutationDirty = true;
+		return true;
+	}
 
+	//FNV-1a 64 bits, the separators keep ("ab", "c") and ("a", "bc") apart
+	static uint64_t hashString(const std::string& str, uint64_t hash) {
+		for (char c : str) {
+			hash ^= uint8_t(c);
+			hash *= 1099511628211ull;
+		}
+		hash ^= 0xFF;
+		return hash * 1099511628211ull;
+	}
 
+	uint64_t ShaderBase::permutationKey() const {
+		if (!m_permutationDirty) return m_permutationKey;
 
-	// -----------
+		//unordered maps, hashed in name order
+		uint64_t hash = 14695981039346656037ull;
+		for (const auto* map : { &m_constants, &m_defines }) {
+			std::vector<std::pair<std::string, std::string>> entries(map->begin(), map->end());
+			std::sort(entries.begin(), entries.end());
+			for (const auto& entry : entries) hash = hashString(entry.second, hashString(entry.first, hash));
+			hash = hashString("", hash);
+		}
+		for (const auto& injection : m_injections) hash = hashString(injection.second, hashString(injection.first, hash));
 
-// Function to remove single-line comments (//...)
-	std::string removeSingleLineComments(const std::string& content) {
-		std::regex singleLineCommentRegex(R"(//.*)");
-		return std::regex_replace(content, singleLineCommentRegex, "");
-	}
-
-	// Function to remove multi-line comments (/*...*/)
-	std::string removeMultiLineComments(const std::string& content) {
-		std::string result = content;
-		size_t start_pos = 0;
-		while ((start_pos = result.find("/*", start_pos)) != std::string::npos) {
-			size_t end_pos = result.find("*/", start_pos + 2);
-			if (end_pos != std::string::npos) {
-				end_pos += 2; // Move past the end of the comment
-				result.erase(start_pos, end_pos - start_pos);
-			}
+		m_permutationKey = hash;
+		m_permutationDirty = false;
+		return hash;
+	}
+
+	bool ShaderBase::selectPermutation() {
+		uint64_t key = permutationKey();
+		auto it = m_permutations.find(key);
+		if (it == m_permutations.end()) return false;
+		activate(it->second, key);
+		return true;
+	}
+
+	void ShaderBase::clearPermutations() {
+		for (auto it = m_permutations.begin(); it != m_permutations.end();) {
+			if (it->second == m_programID) ++it;
 			else {
-				// If there is no closing */, remove till end of the string
-				result.erase(start_pos);
-				break;
+				deleteProgram(it->second);
+				it = m_permutations.erase(it);
 			}
 		}
-		return result;
 	}
 
-	// Function to read and process the shader file content
-	std::string ShaderBase::readSrc(const std::string& filename) {
-		std::ifstream in(filename, std::ios::binary);
-		if (in) {
-			std::string content;
-			in.seekg(0, std::ios::end);
-			content.resize(in.tellg());
-			in.seekg(0, std::ios::beg);
-			in.read(&content[0], content.size());
-			in.close();
+	void ShaderBase::invalidatePermutations() {
+		clearPermutations();
+		m_permutations.clear(); //the active program is kept until its replacement is swapped in
+		m_permutation = 0;
+	}
 
-			// Find and replace include statements
-			std::regex includeRegex(R"(#include\s+\"([^"]+)\")");
-			std::smatch includeMatch;
+	void ShaderBase::recompile() {
+		//the program of the current permutation is built again, the other ones are kept
+		auto it = m_permutations.find(permutationKey());
+		if (it != m_permutations.end()) {
+			if (it->second != m_programID) deleteProgram(it->second);
+			m_permutations.erase(it);
+		}
+		ShaderCompiler::instance().compile(*this);
+	}
 
-			std::string path = filename.substr(0, filename.find_last_of('/'));
+	void ShaderBase::compile() {
+		if (selectPermutation()) return; //already built with these constants and defines
+		ShaderCompiler::instance().compile(*this);
+	}
 
-			content = removeSingleLineComments(content);
-			content = removeMultiLineComments(content);
+	void ShaderBase::compileAsync() {
+		ShaderCompiler::instance().submit(*this);
+	}
 
-			while (std::regex_search(content, includeMatch, includeRegex)) {
-				std::string includeFile = includeMatch[1].str();
-				std::string absPath = path + "/" + includeFile;
+	void ShaderBase::swapProgram(GLuint program, uint64_t key) {
+		auto it = m_permutations.find(key);
+		if (it != m_permutations.end() && it->second != m_programID) deleteProgram(it->second); //rebuilt
+		m_permutations[key] = program;
 
-				std::string includeContent = readSrc(absPath); // Recursive call to load included file's content
-				content = std::regex_replace(content, includeRegex, includeContent, std::regex_constants::format_first_only);
-			}
+		//a build finishing after the constants changed again is kept for later
+		if (!m_compiled || key == permutationKey()) activate(program, key);
+	}
 
-			return content;
-		}
-		else {
-			std::cerr << "Can't read file " << filename << std::endl;
-			return "error";
+	void ShaderBase::activate(GLuint program, uint64_t key) {
+		m_permutation = key;
+		if (m_compiled && m_programID == program) return;
+
+		if (m_compiled && m_programID != 0) {
+			ShaderCompiler::transferState(m_programID, program);
+			bool kept = false;
+			for (const auto& permutation : m_permutations) kept |= permutation.second == m_programID;
+			if (!kept) deleteProgram(m_programID);
 		}
+		setID(program);
+		m_compiled = true;
+		reflectUniforms();
+
+		//the values set while the first build was pending, later programs get them through transferState
+		std::unordered_map<std::string, std::function<void()>> deferred = std::move(m_deferredUniforms);
+		m_deferredUniforms.clear();
+		for (const auto& uniform : deferred) uniform.second();
+	}
+
+
+
+	// -----------
+
+	// Includes are expanded by the ShaderPreprocessor, see shaderPreprocessor.h
+	std::string ShaderBase::readSrc(const std::string& filename, std::vector<std::string>* dependencies) {
+		return ShaderPreprocessor::instance().load(filename, dependencies);
 	}
 
 
+	static const std::string s_injectionBegin = "//merlin:injection begin\n";
+	static const std::string s_injectionEnd = "//merlin:injection end\n";
+
 	void ShaderBase::precompileSrc(std::string& src){
-		src = removeSingleLineComments(src);
-		src = removeMultiLineComments(src);
+		//sources are precompiled in place, drop the code injected by a previous compilation first
+		size_t begin = src.find(s_injectionBegin);
+		size_t end = src.find(s_injectionEnd);
+		if (begin != std::string::npos && end != std::string::npos && end > begin) {
+			end += s_injectionEnd.size();
+			if (src.compare(end, 6, "#line ") == 0) end = std::min(src.find('\n', end), src.size() - 1) + 1; //numbering restored after the injection
+			src.erase(begin, end - begin);
+		}
+
+		src = ShaderPreprocessor::stripComments(src);
 		src = updateConstants(src);
 		src = updateDefines(src);
-
-		;
+		src = updateInjections(src);
 	}
 
-	bool ShaderBase::compileShader(const std::string& name,const std::string& src, GLuint id) {
-		bool result = true;
-		GLint Result = GL_FALSE;
-		int InfoLogLength;
+	std::string ShaderBase::updateInjections(const std::string& originalSrc) {
+		if (m_injections.empty() || originalSrc.empty()) return originalSrc;
 
-		// Compile Shader
-		const char* SrcPointer = src.c_str();
-		glShaderSource(id, 1, &SrcPointer, NULL);
-		glCompileShader(id);
+		std::string code;
+		for (const auto& injection : m_injections) code += injection.second + "\n";
 
-		// Check Shader
-		glGetShaderiv(id, GL_COMPILE_STATUS, &Result);
-		glGetShaderiv(id, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0) {
-			std::vector<char> ShaderErrorMessage(int(InfoLogLength) + 1);
-			glGetShaderInfoLog(id, InfoLogLength, NULL, &ShaderErrorMessage[0]);
-			LOG_ERROR("Shader") << &ShaderErrorMessage[0] << Console::endl;
-			LOG_ERROR("Shader") << name << " shader compilation failed." << Console::endl;
-			result = false;
+		//after the #version line and the #extension (and #line) directives following it
+		std::string src = originalSrc;
+		size_t pos = src.find("#version");
+		if (pos == std::string::npos) pos = 0;
+		else {
+			pos = src.find('\n', pos);
+			pos = pos == std::string::npos ? src.size() : pos + 1;
+		}
+		while (true) {
+			size_t line = src.find_first_not_of(" \t\r\n", pos);
+			if (line == std::string::npos || (src.compare(line, 10, "#extension") != 0 && src.compare(line, 6, "#line ") != 0)) break;
+			size_t next = src.find('\n', line);
+			pos = next == std::string::npos ? src.size() : next + 1;
 		}
-		else LOG_OK("Shader") << name << " shader compilation sucessful." << Console::endl;
 
-		return result;
+		//the injected lines must not shift the numbering of the original code
+		src.insert(pos, s_injectionBegin + code + s_injectionEnd + ShaderPreprocessor::lineDirective(src, pos));
+		return src;
 	}
 
 	std::string ShaderBase::updateConstants(const std::string& originalSrc){
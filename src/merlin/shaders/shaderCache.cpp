@@ -0,0 +1,171 @@
+#include "pch.h"
+#include "merlin/shaders/shaderCache.h"
+
+#include <cstring>
+#include <filesystem>
+
+namespace Merlin {
+
+	static constexpr char SHADER_CACHE_MAGIC[4] = { 'M', 'R', 'L', 'B' };
+	static constexpr uint32_t SHADER_CACHE_VERSION = 1;
+
+	struct ShaderCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint64_t driver;
+		uint32_t format;
+		uint32_t length;
+	};
+
+	//FNV-1a 64 bits
+	static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	bool ShaderCache::isEnabled() {
+		if (!m_checked) {
+			GLint formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			m_supported = formats > 0;
+			m_checked = true;
+			if (!m_supported) Console::warn("ShaderCache") << "the driver exposes no program binary format, shaders are always compiled" << Console::endl;
+		}
+		return m_enabled && m_supported;
+	}
+
+	uint64_t ShaderCache::driverHash() {
+		if (m_driverHash == 0) {
+			std::string driver;
+			for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+				const char* value = reinterpret_cast<const char*>(glGetString(name));
+				driver += std::string(value ? value : "") + "\n";
+			}
+			m_driverHash = hashBytes(driver.data(), driver.size());
+		}
+		return m_driverHash;
+	}
+
+	uint64_t ShaderCache::key(const std::vector<std::string>& sources) {
+		uint64_t hash = driverHash();
+		for (const std::string& source : sources) {
+			uint64_t length = source.size(); //stage boundaries are part of the key
+			hash = hashBytes(&length, sizeof(uint64_t), hash);
+			hash = hashBytes(source.data(), source.size(), hash);
+		}
+		return hash;
+	}
+
+	std::string ShaderCache::path(uint64_t key) const {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+		return (std::filesystem::path(m_directory) / name).string();
+	}
+
+	bool ShaderCache::load(GLuint program, uint64_t key) {
+		if (!isEnabled()) return false;
+
+		std::ifstream file(path(key), std::ios::binary);
+		if (!file) {
+			m_stats.misses++;
+			return false;
+		}
+
+		ShaderCacheHeader header;
+		file.read(reinterpret_cast<char*>(&header), sizeof(ShaderCacheHeader));
+		std::vector<char> binary;
+		bool valid = bool(file) && memcmp(header.magic, SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC)) == 0
+			&& header.version == SHADER_CACHE_VERSION && header.key == key && header.driver == driverHash();
+		if (valid) {
+			binary.resize(header.length);
+			file.read(binary.data(), binary.size());
+			valid = bool(file);
+		}
+		file.close();
+
+		GLint linked = GL_FALSE;
+		if (valid) {
+			glProgramBinary(program, GLenum(header.format), binary.data(), GLsizei(binary.size()));
+			glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		}
+
+		if (linked != GL_TRUE) {
+			//the program stays usable, the caller compiles and links the sources as usual
+			Console::warn("ShaderCache") << "cached binary " << path(key) << " was rejected, recompiling" << Console::endl;
+			std::error_code error;
+			std::filesystem::remove(path(key), error);
+			m_stats.rejected++;
+			m_stats.misses++;
+			return false;
+		}
+
+		m_stats.hits++;
+		return true;
+	}
+
+	void ShaderCache::prepare(GLuint program) {
+		if (isEnabled()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	void ShaderCache::store(GLuint program, uint64_t key) {
+		if (!isEnabled()) return;
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) return;
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(program, length, &length, &format, binary.data());
+
+		std::error_code error;
+		std::filesystem::create_directories(m_directory, error);
+
+		ShaderCacheHeader header;
+		memcpy(header.magic, SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC));
+		header.version = SHADER_CACHE_VERSION;
+		header.key = key;
+		header.driver = driverHash();
+		header.format = format;
+		header.length = uint32_t(length);
+
+		//written aside and renamed, a crash never leaves a truncated binary behind
+		std::string destination = path(key);
+		std::string temporary = destination + ".tmp";
+		{
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(&header), sizeof(ShaderCacheHeader));
+			file.write(binary.data(), length);
+			if (!file) {
+				Console::warn("ShaderCache") << "cannot write " << temporary << Console::endl;
+				return;
+			}
+		}
+		std::filesystem::rename(temporary, destination, error);
+		if (error) {
+			Console::warn("ShaderCache") << "cannot write " << destination << " : " << error.message() << Console::endl;
+			return;
+		}
+		m_stats.stored++;
+	}
+
+	void ShaderCache::clear() {
+		std::error_code error;
+		size_t removed = 0;
+		for (auto& entry : std::filesystem::directory_iterator(m_directory, error)) {
+			if (entry.path().extension() == ".bin" && std::filesystem::remove(entry.path(), error)) removed++;
+		}
+		Console::info("ShaderCache") << removed << " cached binaries removed from " << m_directory << Console::endl;
+	}
+
+	void ShaderCache::printStats() const {
+		size_t lookups = m_stats.hits + m_stats.misses;
+		Console::info("ShaderCache") << m_stats.hits << " hits, " << m_stats.misses << " misses (" << m_stats.rejected << " rejected), "
+			<< m_stats.stored << " stored" << (lookups ? ", hit rate " + std::to_string(100 * m_stats.hits / lookups) + "%" : "") << Console::endl;
+	}
+}
@@ -0,0 +1,472 @@
+#include "pch.h"
+#include "merlin/shaders/shaderCompiler.h"
+#include "merlin/shaders/shaderBase.h"
+#include "merlin/shaders/shaderCache.h"
+#include "merlin/shaders/shaderPreprocessor.h"
+#include "merlin/memory/bindingPointManager.h"
+#include "merlin/core/log.h"
+#include "merlin/utils/cpuProfiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+#include <GLFW/glfw3.h>
+
+namespace Merlin {
+
+	//KHR/ARB_parallel_shader_compile are not exposed by the loader
+	static constexpr GLenum COMPLETION_STATUS = 0x91B1; //GL_COMPLETION_STATUS_KHR (same value for ARB)
+	typedef void (GLAD_API_PTR* MaxShaderCompilerThreadsProc)(GLuint count);
+
+	static bool hasExtension(const char* name) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++) {
+			const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+			if (extension && strcmp(extension, name) == 0) return true;
+		}
+		return false;
+	}
+
+	//component type and count of a default block uniform, matrices are columns x rows
+	struct UniformFormat {
+		char base = 'i'; //f, i, u, d
+		int components = 1;
+		int columns = 0; //0 for scalars and vectors
+	};
+
+	static UniformFormat uniformFormat(GLenum type) {
+		switch (type) {
+		case GL_FLOAT: return { 'f', 1 };
+		case GL_FLOAT_VEC2: return { 'f', 2 };
+		case GL_FLOAT_VEC3: return { 'f', 3 };
+		case GL_FLOAT_VEC4: return { 'f', 4 };
+		case GL_DOUBLE: return { 'd', 1 };
+		case GL_DOUBLE_VEC2: return { 'd', 2 };
+		case GL_DOUBLE_VEC3: return { 'd', 3 };
+		case GL_DOUBLE_VEC4: return { 'd', 4 };
+		case GL_UNSIGNED_INT: return { 'u', 1 };
+		case GL_UNSIGNED_INT_VEC2: return { 'u', 2 };
+		case GL_UNSIGNED_INT_VEC3: return { 'u', 3 };
+		case GL_UNSIGNED_INT_VEC4: return { 'u', 4 };
+		case GL_INT_VEC2: case GL_BOOL_VEC2: return { 'i', 2 };
+		case GL_INT_VEC3: case GL_BOOL_VEC3: return { 'i', 3 };
+		case GL_INT_VEC4: case GL_BOOL_VEC4: return { 'i', 4 };
+		case GL_FLOAT_MAT2: return { 'f', 4, 2 };
+		case GL_FLOAT_MAT3: return { 'f', 9, 3 };
+		case GL_FLOAT_MAT4: return { 'f', 16, 4 };
+		case GL_DOUBLE_MAT2: return { 'd', 4, 2 };
+		case GL_DOUBLE_MAT3: return { 'd', 9, 3 };
+		case GL_DOUBLE_MAT4: return { 'd', 16, 4 };
+		default: return { 'i', 1 }; //int, bool, samplers and images
+		}
+	}
+
+	static void copyUniform(GLuint from, GLint src, GLuint to, GLint dst, const UniformFormat& format) {
+		GLfloat f[16]; GLint i[4]; GLuint u[4]; GLdouble d[16];
+		switch (format.base) {
+		case 'f':
+			glGetUniformfv(from, src, f);
+			if (format.columns == 2) glProgramUniformMatrix2fv(to, dst, 1, GL_FALSE, f);
+			else if (format.columns == 3) glProgramUniformMatrix3fv(to, dst, 1, GL_FALSE, f);
+			else if (format.columns == 4) glProgramUniformMatrix4fv(to, dst, 1, GL_FALSE, f);
+			else if (format.components == 1) glProgramUniform1fv(to, dst, 1, f);
+			else if (format.components == 2) glProgramUniform2fv(to, dst, 1, f);
+			else if (format.components == 3) glProgramUniform3fv(to, dst, 1, f);
+			else glProgramUniform4fv(to, dst, 1, f);
+			break;
+		case 'd':
+			glGetUniformdv(from, src, d);
+			if (format.columns == 2) glProgramUniformMatrix2dv(to, dst, 1, GL_FALSE, d);
+			else if (format.columns == 3) glProgramUniformMatrix3dv(to, dst, 1, GL_FALSE, d);
+			else if (format.columns == 4) glProgramUniformMatrix4dv(to, dst, 1, GL_FALSE, d);
+			else if (format.components == 1) glProgramUniform1dv(to, dst, 1, d);
+			else if (format.components == 2) glProgramUniform2dv(to, dst, 1, d);
+			else if (format.components == 3) glProgramUniform3dv(to, dst, 1, d);
+			else glProgramUniform4dv(to, dst, 1, d);
+			break;
+		case 'u':
+			glGetUniformuiv(from, src, u);
+			if (format.components == 1) glProgramUniform1uiv(to, dst, 1, u);
+			else if (format.components == 2) glProgramUniform2uiv(to, dst, 1, u);
+			else if (format.components == 3) glProgramUniform3uiv(to, dst, 1, u);
+			else glProgramUniform4uiv(to, dst, 1, u);
+			break;
+		default:
+			glGetUniformiv(from, src, i);
+			if (format.components == 1) glProgramUniform1iv(to, dst, 1, i);
+			else if (format.components == 2) glProgramUniform2iv(to, dst, 1, i);
+			else if (format.components == 3) glProgramUniform3iv(to, dst, 1, i);
+			else glProgramUniform4iv(to, dst, 1, i);
+			break;
+		}
+	}
+
+	//uniform values and block bindings set on the previous program, matched by name
+	void ShaderCompiler::transferState(GLuint from, GLuint to) {
+		GLint count = 0;
+		glGetProgramInterfaceiv(from, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+		const GLenum properties[4] = { GL_NAME_LENGTH, GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE };
+		std::vector<char> buffer;
+		for (GLint r = 0; r < count; r++) {
+			GLint values[4] = { 0, -1, 0, 1 };
+			glGetProgramResourceiv(from, GL_UNIFORM, r, 4, properties, 4, nullptr, values);
+			if (values[1] < 0) continue; //member of a uniform block
+
+			buffer.resize(std::max(values[0], 1));
+			glGetProgramResourceName(from, GL_UNIFORM, r, GLsizei(buffer.size()), nullptr, buffer.data());
+			std::string uniform(buffer.data());
+			UniformFormat format = uniformFormat(GLenum(values[2]));
+
+			if (values[3] <= 1) {
+				GLint location = glGetUniformLocation(to, uniform.c_str());
+				if (location != -1) copyUniform(from, values[1], to, location, format);
+				continue;
+			}
+
+			std::string base = uniform.substr(0, uniform.rfind('['));
+			for (GLint e = 0; e < values[3]; e++) {
+				std::string element = base + "[" + std::to_string(e) + "]";
+				GLint src = glGetUniformLocation(from, element.c_str());
+				GLint dst = glGetUniformLocation(to, element.c_str());
+				if (src != -1 && dst != -1) copyUniform(from, src, to, dst, format);
+			}
+		}
+
+		BindingPointManager& manager = BindingPointManager::instance();
+		for (auto block : { std::make_pair(GL_SHADER_STORAGE_BLOCK, BufferTarget::Shader_Storage_Buffer), std::make_pair(GL_UNIFORM_BLOCK, BufferTarget::Uniform_Buffer) }) {
+			glGetProgramInterfaceiv(from, block.first, GL_ACTIVE_RESOURCES, &count);
+			for (GLint r = 0; r < count; r++) {
+				const GLenum blockProperties[2] = { GL_NAME_LENGTH, GL_BUFFER_BINDING };
+				GLint values[2] = { 0, 0 };
+				glGetProgramResourceiv(from, block.first, r, 2, blockProperties, 2, nullptr, values);
+				buffer.resize(std::max(values[0], 1));
+				glGetProgramResourceName(from, block.first, r, GLsizei(buffer.size()), nullptr, buffer.data());
+				GLuint index = glGetProgramResourceIndex(to, block.first, buffer.data());
+				if (index != GL_INVALID_INDEX) manager.bindBlock(to, index, GLuint(values[1]), block.second);
+			}
+		}
+	}
+
+	static void printLog(const std::string& name, const std::string& log, bool failed) {
+		if (log.empty()) return;
+		if (failed) LOG_ERROR("Shader") << ShaderPreprocessor::instance().mapLog(log) << Console::endl;
+		else LOG_WARN("Shader") << "(" << name << ") " << ShaderPreprocessor::instance().mapLog(log) << Console::endl;
+	}
+
+	ShaderCompiler::~ShaderCompiler() {
+		s_alive = false;
+		shutdown();
+	}
+
+	void ShaderCompiler::initialize() {
+		if (m_mode != ShaderCompilerMode::UNINITIALIZED) return;
+
+		const char* extension = hasExtension("GL_KHR_parallel_shader_compile") ? "glMaxShaderCompilerThreadsKHR"
+			: hasExtension("GL_ARB_parallel_shader_compile") ? "glMaxShaderCompilerThreadsARB" : nullptr;
+		if (extension) {
+			MaxShaderCompilerThreadsProc maxThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(glfwGetProcAddress(extension));
+			if (maxThreads) maxThreads(0xFFFFFFFF); //as many threads as the driver wants
+			m_mode = ShaderCompilerMode::PARALLEL;
+			Console::info("ShaderCompiler") << "programs are built by the driver threads (parallel_shader_compile)" << Console::endl;
+			return;
+		}
+
+		//hidden window owning a context shared with the current one
+		GLFWwindow* current = glfwGetCurrentContext();
+		if (current) {
+			glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+			m_context = glfwCreateWindow(1, 1, "ShaderCompiler", nullptr, current);
+			glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+			glfwMakeContextCurrent(current);
+		}
+
+		if (m_context) {
+			m_mode = ShaderCompilerMode::WORKER;
+			m_thread = std::thread(&ShaderCompiler::run, this);
+			Console::info("ShaderCompiler") << "programs are built by a worker thread on a shared context" << Console::endl;
+		}
+		else {
+			m_mode = ShaderCompilerMode::SYNCHRONOUS;
+			Console::warn("ShaderCompiler") << "no parallel compilation available, programs are built on the main thread" << Console::endl;
+		}
+	}
+
+	void ShaderCompiler::shutdown() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_condition.notify_all();
+		if (m_thread.joinable()) m_thread.join();
+		if (m_context) glfwDestroyWindow(m_context);
+		m_context = nullptr;
+		if (m_mode == ShaderCompilerMode::WORKER) m_mode = ShaderCompilerMode::SYNCHRONOUS; //later builds run on the main thread
+	}
+
+	Shared<ShaderCompiler::Build> ShaderCompiler::begin(ShaderBase& shader, bool async) {
+		initialize();
+
+		Shared<Build> build = createShared<Build>();
+		build->shader = &shader;
+		build->start = glfwGetTime();
+		build->permutation = shader.permutationKey();
+		build->stages = shader.prepareStages();
+		if (build->stages.empty()) {
+			Console::error("ShaderCompiler") << "shader " << shader.name() << " has no source to compile" << Console::endl;
+			return nullptr;
+		}
+
+		std::vector<std::string> sources;
+		for (const ShaderStage& stage : build->stages) sources.push_back(stage.src);
+
+		ShaderCache& cache = ShaderCache::instance();
+		build->key = cache.key(sources);
+		build->program = glCreateProgram();
+		if (cache.load(build->program, build->key)) {
+			build->cached = true;
+			build->linked = true;
+			return build;
+		}
+
+		if (async && m_mode == ShaderCompilerMode::WORKER) {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queue.push_back(build);
+			}
+			m_condition.notify_one();
+			return build;
+		}
+
+		link(*build);
+		//the driver threads report the completion, other modes linked on this thread
+		if (!async || m_mode != ShaderCompilerMode::PARALLEL) build->linked = true;
+		return build;
+	}
+
+	void ShaderCompiler::link(Build& build) {
+		for (const ShaderStage& stage : build.stages) {
+			GLuint id = glCreateShader(stage.type);
+			const char* src = stage.src.c_str();
+			glShaderSource(id, 1, &src, NULL);
+			glCompileShader(id);
+			glAttachShader(build.program, id);
+			build.shaders.push_back(id);
+		}
+		ShaderCache::instance().prepare(build.program);
+		glLinkProgram(build.program);
+	}
+
+	void ShaderCompiler::run() {
+		CPUProfiler::instance().setThreadName("ShaderCompiler");
+		glfwMakeContextCurrent(m_context);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true) {
+			m_condition.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+			if (m_stop) break;
+
+			Shared<Build> build = m_queue.front();
+			m_queue.pop_front();
+			lock.unlock();
+
+			{
+				MERLIN_PROFILE_SCOPE("ShaderCompiler::link");
+				link(*build);
+				GLint status = GL_FALSE;
+				glGetProgramiv(build->program, GL_LINK_STATUS, &status); //waits for the link on this thread
+				glFinish(); //the objects are complete before the main context uses them
+			}
+
+			lock.lock();
+			build->linked = true;
+			m_linked.notify_all();
+		}
+		lock.unlock();
+		glfwMakeContextCurrent(nullptr);
+	}
+
+	bool ShaderCompiler::isComplete(const Build& build) const {
+		if (build.linked) return true;
+		if (m_mode != ShaderCompilerMode::PARALLEL) return false;
+		GLint done = GL_FALSE;
+		glGetProgramiv(build.program, COMPLETION_STATUS, &done);
+		return done == GL_TRUE;
+	}
+
+	void ShaderCompiler::finish(Build& build) {
+		if (!build.linked && m_mode == ShaderCompilerMode::WORKER) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_linked.wait(lock, [&build] { return build.linked.load(); });
+		}
+		complete(build); //the status queries block until the driver threads are done
+	}
+
+	void ShaderCompiler::complete(Build& build) {
+		ShaderBase* shader = build.shader;
+		const std::string name = shader ? shader->name() : "";
+
+		bool linked = true;
+		if (!build.cached) {
+			for (size_t i = 0; i < build.shaders.size(); i++) {
+				GLint status = GL_FALSE, length = 0;
+				glGetShaderiv(build.shaders[i], GL_COMPILE_STATUS, &status);
+				glGetShaderiv(build.shaders[i], GL_INFO_LOG_LENGTH, &length);
+				if (shader && length > 1) {
+					std::vector<char> log(length + 1, '\0');
+					glGetShaderInfoLog(build.shaders[i], length, NULL, log.data());
+					printLog(name, log.data(), status != GL_TRUE);
+				}
+				if (status != GL_TRUE && shader) LOG_ERROR("Shader") << name << " : " << build.stages[i].name << " shader compilation failed." << Console::endl;
+			}
+
+			GLint status = GL_FALSE, length = 0;
+			glGetProgramiv(build.program, GL_LINK_STATUS, &status);
+			glGetProgramiv(build.program, GL_INFO_LOG_LENGTH, &length);
+			if (shader && length > 1) {
+				std::vector<char> log(length + 1, '\0');
+				glGetProgramInfoLog(build.program, length, NULL, log.data());
+				printLog(name, log.data(), status != GL_TRUE);
+			}
+			linked = status == GL_TRUE;
+
+			for (GLuint id : build.shaders) {
+				glDetachShader(build.program, id);
+				glDeleteShader(id);
+			}
+			build.shaders.clear();
+		}
+
+		if (!shader) {
+			glDeleteProgram(build.program);
+			return;
+		}
+
+		if (!linked) {
+			glDeleteProgram(build.program);
+			m_stats.failed++;
+			Console::error("Shader") << "Shader program : " << name << " program linkage failed" << (shader->isCompiled() ? ", the previous program is kept." : ".") << Console::endl;
+			return;
+		}
+
+		if (!build.cached) ShaderCache::instance().store(build.program, build.key);
+		shader->swapProgram(build.program, build.permutation);
+		m_stats.built++;
+
+		int ms = int((glfwGetTime() - build.start) * 1000.0);
+		LOG_OK("Shader") << "Shader program : " << name << (build.cached ? " loaded from the binary cache" : " successfully created") << " (" << ms << " ms)." << Console::endl;
+	}
+
+	void ShaderCompiler::compile(ShaderBase& shader) {
+		cancel(shader); //superseded
+		Shared<Build> build = begin(shader, false);
+		if (!build) return;
+		complete(*build);
+		shader.use();
+	}
+
+	void ShaderCompiler::submit(ShaderBase& shader) {
+		cancel(shader);
+		Shared<Build> build = begin(shader, true);
+		if (build) m_builds.push_back(build);
+	}
+
+	void ShaderCompiler::finish(const ShaderBase& shader) {
+		for (auto it = m_builds.begin(); it != m_builds.end(); ++it) {
+			if ((*it)->shader != &shader) continue;
+			Shared<Build> build = *it;
+			m_builds.erase(it);
+			finish(*build);
+			return;
+		}
+	}
+
+	void ShaderCompiler::poll() {
+		const bool building = !m_builds.empty();
+		for (auto it = m_builds.begin(); it != m_builds.end();) {
+			if (!isComplete(**it)) {
+				++it;
+				continue;
+			}
+			Shared<Build> build = *it;
+			it = m_builds.erase(it);
+			complete(*build);
+		}
+		if (building && m_builds.empty()) ShaderCache::instance().printStats();
+
+		if (m_hotReload && !m_watched.empty()) {
+			double now = glfwGetTime();
+			if (now - m_lastCheck >= m_watchInterval) {
+				m_lastCheck = now;
+				checkFiles();
+			}
+		}
+	}
+
+	void ShaderCompiler::wait() {
+		while (!m_builds.empty()) {
+			Shared<Build> build = m_builds.front();
+			m_builds.erase(m_builds.begin());
+			finish(*build);
+		}
+	}
+
+	bool ShaderCompiler::isPending(const ShaderBase& shader) const {
+		for (const Shared<Build>& build : m_builds) if (build->shader == &shader) return true;
+		return false;
+	}
+
+	void ShaderCompiler::cancel(const ShaderBase& shader) {
+		for (Shared<Build>& build : m_builds) {
+			if (build->shader != &shader) continue;
+			build->shader = nullptr; //objects deleted once the build completes
+			m_stats.cancelled++;
+		}
+	}
+
+	void ShaderCompiler::onShaderDestroyed(const ShaderBase& shader) {
+		if (!s_alive) return;
+		ShaderCompiler& compiler = instance();
+		compiler.cancel(shader);
+		compiler.m_watched.erase(const_cast<ShaderBase*>(&shader));
+	}
+
+	void ShaderCompiler::watch(ShaderBase& shader) {
+		std::vector<std::string>& files = m_watched[&shader];
+		files = shader.dependencies();
+		for (const std::string& file : files) {
+			if (m_times.count(file)) continue;
+			std::error_code error;
+			auto time = std::filesystem::last_write_time(file, error);
+			m_times[file] = error ? std::filesystem::file_time_type::min() : time;
+		}
+	}
+
+	void ShaderCompiler::checkFiles() {
+		std::unordered_set<std::string> modified;
+		for (auto& entry : m_times) {
+			std::error_code error;
+			auto time = std::filesystem::last_write_time(entry.first, error);
+			if (error || time == entry.second) continue;
+			entry.second = time;
+			modified.insert(entry.first);
+			ShaderPreprocessor::instance().invalidate(entry.first);
+		}
+		if (modified.empty()) return;
+
+		//reload() watches the shader again, collected first
+		std::vector<ShaderBase*> shaders;
+		for (const auto& watched : m_watched) {
+			for (const std::string& file : watched.second) {
+				if (!modified.count(file)) continue;
+				shaders.push_back(watched.first);
+				break;
+			}
+		}
+
+		for (ShaderBase* shader : shaders) {
+			Console::info("ShaderCompiler") << "source of " << shader->name() << " modified, rebuilding" << Console::endl;
+			m_stats.reloads++;
+			shader->reload();
+		}
+	}
+}
@@ -0,0 +1,268 @@
+#include "pch.h"
+#include "merlin/shaders/shaderPreprocessor.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <string_view>
+
+namespace Merlin {
+
+	static std::string normalize(const std::string& path) {
+		return std::filesystem::path(path).lexically_normal().generic_string();
+	}
+
+	static std::string_view trim(std::string_view s) {
+		size_t begin = s.find_first_not_of(" \t\r");
+		if (begin == std::string_view::npos) return {};
+		size_t end = s.find_last_not_of(" \t\r");
+		return s.substr(begin, end - begin + 1);
+	}
+
+	//"#  name  rest" -> name, rest is what follows it
+	static std::string_view directive(std::string_view line, std::string_view& rest) {
+		line = trim(line);
+		if (line.empty() || line[0] != '#') return {};
+		line = trim(line.substr(1));
+		size_t end = 0;
+		while (end < line.size() && (std::isalnum(static_cast<unsigned char>(line[end])) || line[end] == '_')) end++;
+		rest = trim(line.substr(end));
+		return line.substr(0, end);
+	}
+
+	std::string ShaderPreprocessor::stripComments(const std::string& src) {
+		std::string out;
+		out.reserve(src.size());
+		size_t i = 0;
+		while (i < src.size()) {
+			if (src[i] == '/' && i + 1 < src.size() && src[i + 1] == '/') {
+				while (i < src.size() && src[i] != '\n') i++;
+			}
+			else if (src[i] == '/' && i + 1 < src.size() && src[i + 1] == '*') {
+				i += 2;
+				while (i < src.size() && !(src[i] == '*' && i + 1 < src.size() && src[i + 1] == '/')) {
+					if (src[i] == '\n') out += '\n';
+					i++;
+				}
+				i = std::min(i + 2, src.size());
+			}
+			else out += src[i++];
+		}
+		return out;
+	}
+
+	std::string ShaderPreprocessor::lineDirective(const std::string& src, size_t pos) {
+		pos = std::min(pos, src.size());
+
+		//last #line directive before pos, at the start of a line
+		size_t found = pos;
+		while (found > 0) {
+			found = src.rfind("#line ", found - 1);
+			if (found == std::string::npos || found == 0 || src[found - 1] == '\n') break;
+		}
+
+		if (found == std::string::npos || found >= pos) {
+			size_t line = std::count(src.begin(), src.begin() + pos, '\n') + 1;
+			return "#line " + std::to_string(line) + "\n";
+		}
+
+		unsigned long line = 0, source = 0;
+		int fields = sscanf(src.c_str() + found, "#line %lu %lu", &line, &source);
+		size_t next = src.find('\n', found);
+		if (next == std::string::npos || next >= pos) next = pos;
+		else next++;
+		line += std::count(src.begin() + next, src.begin() + pos, '\n');
+		return "#line " + std::to_string(line) + (fields == 2 ? " " + std::to_string(source) : "") + "\n";
+	}
+
+	void ShaderPreprocessor::addIncludeDirectory(const std::string& directory) {
+		std::string dir = normalize(directory);
+		if (std::find(m_directories.begin(), m_directories.end(), dir) == m_directories.end()) m_directories.push_back(dir);
+	}
+
+	void ShaderPreprocessor::invalidate(const std::string& path) {
+		m_files.erase(normalize(path));
+	}
+
+	void ShaderPreprocessor::clearCache() {
+		m_files.clear(); //source numbers are kept, logs of older programs still map
+	}
+
+	const std::string& ShaderPreprocessor::fileName(GLuint source) const {
+		return source < m_sources.size() ? m_sources[source] : m_sources[0];
+	}
+
+	std::string ShaderPreprocessor::resolve(const std::string& include, const std::string& from) const {
+		std::error_code error;
+		std::filesystem::path file(include);
+		if (file.is_absolute()) return std::filesystem::exists(file, error) ? normalize(include) : "";
+
+		std::filesystem::path local = std::filesystem::path(from).parent_path() / file;
+		if (std::filesystem::exists(local, error)) return normalize(local.string());
+		for (const std::string& directory : m_directories) {
+			std::filesystem::path candidate = std::filesystem::path(directory) / file;
+			if (std::filesystem::exists(candidate, error)) return normalize(candidate.string());
+		}
+		return "";
+	}
+
+	const ShaderPreprocessor::File* ShaderPreprocessor::fetch(const std::string& path) {
+		std::error_code error;
+		auto time = std::filesystem::last_write_time(path, error);
+		if (error) return nullptr;
+
+		auto cached = m_files.find(path);
+		if (cached != m_files.end() && cached->second.time == time) {
+			m_stats.hits++;
+			return &cached->second;
+		}
+
+		std::ifstream in(path, std::ios::binary);
+		if (!in) return nullptr;
+		std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		m_stats.misses++;
+
+		File& file = m_files[path];
+		file.path = path;
+		file.time = time;
+		file.text = createShared<const std::string>(stripComments(content));
+		file.once = false;
+
+		auto number = std::find(m_sources.begin(), m_sources.end(), path);
+		if (number == m_sources.end()) {
+			file.source = GLuint(m_sources.size());
+			m_sources.push_back(path);
+		}
+		else file.source = GLuint(number - m_sources.begin());
+
+		//#pragma once, or a guard (#ifndef X, #define X ... #endif) wrapping the whole file
+		std::vector<std::string_view> lines;
+		std::string_view text(*file.text);
+		for (size_t pos = 0; pos < text.size();) {
+			size_t end = std::min(text.find('\n', pos), text.size());
+			std::string_view line = trim(text.substr(pos, end - pos));
+			if (!line.empty()) lines.push_back(line);
+			pos = end + 1;
+		}
+
+		std::string_view rest, guard;
+		int depth = 0;
+		bool guarded = lines.size() >= 3 && directive(lines[0], guard) == "ifndef" && !guard.empty()
+			&& directive(lines[1], rest) == "define" && rest.substr(0, rest.find_first_of(" \t")) == guard;
+		for (size_t i = 0; i < lines.size(); i++) {
+			std::string_view word = directive(lines[i], rest);
+			if (word == "pragma" && rest.substr(0, 4) == "once") file.once = true;
+			if (!guarded) continue;
+			if (word == "if" || word == "ifdef" || word == "ifndef") depth++;
+			else if (word == "endif" && --depth == 0 && i + 1 != lines.size()) guarded = false; //the guard closes before the end
+		}
+		file.once = file.once || guarded;
+		return &file;
+	}
+
+	void ShaderPreprocessor::expand(const File& file, bool main, std::string& out, std::unordered_set<GLuint>& included, std::vector<GLuint>& stack, std::vector<std::string>* dependencies) {
+		Shared<const std::string> text = file.text; //stays valid if the file is read again while expanding
+		std::string_view src(*text);
+		const std::string source = std::to_string(file.source);
+		stack.push_back(file.source);
+		if (dependencies && std::find(dependencies->begin(), dependencies->end(), file.path) == dependencies->end()) dependencies->push_back(file.path);
+
+		size_t lineNumber = 1;
+		for (size_t pos = 0; pos < src.size(); lineNumber++) {
+			size_t end = std::min(src.find('\n', pos), src.size());
+			std::string_view line = src.substr(pos, end - pos);
+			pos = end + 1;
+
+			std::string_view rest;
+			std::string_view word = directive(line, rest);
+
+			if (word == "include") {
+				std::string name;
+				if (rest.size() >= 2 && (rest[0] == '"' || rest[0] == '<')) {
+					size_t close = rest.find(rest[0] == '"' ? '"' : '>', 1);
+					if (close != std::string_view::npos) name = std::string(rest.substr(1, close - 1));
+				}
+
+				std::string path = name.empty() ? "" : resolve(name, file.path);
+				const File* child = path.empty() ? nullptr : fetch(path);
+				if (!child) {
+					Console::error("ShaderPreprocessor") << file.path << "(" << lineNumber << ") : cannot open include " << std::string(rest) << Console::endl;
+					out += "\n";
+				}
+				else if (std::find(stack.begin(), stack.end(), child->source) != stack.end()) {
+					Console::error("ShaderPreprocessor") << file.path << "(" << lineNumber << ") : recursive include of " << child->path << Console::endl;
+					out += "\n";
+				}
+				else if (child->once && !included.insert(child->source).second) {
+					out += "\n"; //already expanded in this source
+				}
+				else {
+					out += "#line 1 " + std::to_string(child->source) + "\n";
+					expand(*child, false, out, included, stack, dependencies);
+					out += "#line " + std::to_string(lineNumber + 1) + " " + source + "\n";
+				}
+				continue;
+			}
+
+			if (word == "pragma" && rest.substr(0, 4) == "once") {
+				out += "\n";
+				continue;
+			}
+
+			if (word == "version") {
+				//the #line directive can't precede #version, the main file is numbered from the next line
+				if (main) out.append(line).append("\n#line " + std::to_string(lineNumber + 1) + " " + source);
+				out += "\n";
+				continue;
+			}
+
+			out.append(line);
+			out += "\n";
+		}
+		stack.pop_back();
+	}
+
+	std::string ShaderPreprocessor::load(const std::string& path, std::vector<std::string>* dependencies) {
+		const File* file = fetch(normalize(path));
+		if (!file) {
+			if (dependencies) dependencies->push_back(normalize(path)); //watched anyway, the file may show up later
+			Console::error("ShaderPreprocessor") << "Can't read file " << path << Console::endl;
+			return "error";
+		}
+
+		std::string out;
+		out.reserve(file->text->size());
+		std::unordered_set<GLuint> included;
+		std::vector<GLuint> stack;
+		if (file->once) included.insert(file->source);
+		expand(*file, true, out, included, stack, dependencies);
+		return out;
+	}
+
+	std::string ShaderPreprocessor::mapLog(const std::string& log) const {
+		//"0(12) : error ..." (NVIDIA), "ERROR: 0:12: ..." (AMD), "0:12(5): error: ..." (Mesa, Intel)
+		std::string out;
+		out.reserve(log.size());
+		size_t pos = 0;
+		while (pos < log.size()) {
+			size_t end = log.find('\n', pos);
+			end = end == std::string::npos ? log.size() : end + 1;
+			std::string line = log.substr(pos, end - pos);
+			pos = end;
+
+			size_t start = 0;
+			size_t colon = line.find(": ");
+			if (colon != std::string::npos && colon > 0 && std::all_of(line.begin(), line.begin() + colon, [](char c) { return std::isalpha(static_cast<unsigned char>(c)); }))
+				start = colon + 2;
+
+			size_t digits = start;
+			while (digits < line.size() && std::isdigit(static_cast<unsigned char>(line[digits]))) digits++;
+			if (digits > start && digits + 1 < line.size() && (line[digits] == '(' || line[digits] == ':') && std::isdigit(static_cast<unsigned char>(line[digits + 1]))) {
+				unsigned long source = std::stoul(line.substr(start, digits - start));
+				if (source > 0 && source < m_sources.size()) line.replace(start, digits - start, m_sources[source]);
+			}
+			out += line;
+		}
+		return out;
+	}
+}
@@ -62,6 +62,7 @@ namespace Merlin {
         for (unsigned int i = 0; i < 6; i++) {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, m_internalFormat, m_width, m_height, 0, m_format, m_dataType, nullptr);
         }
+        trackMemory(6);
     }
 
     void CubeMap::allocate(GLuint width, GLuint height, GLenum format, GLenum internalFormat, GLenum type) {
@@ -75,6 +76,7 @@ namespace Merlin {
         for (unsigned int i = 0; i < 6; i++) {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, m_internalFormat, width, height, 0, m_format, m_dataType, nullptr);
         }
+        trackMemory(6);
         Console::print() << "t";
     }
 
@@ -86,6 +88,7 @@ namespace Merlin {
         for (unsigned int i = 0; i < 6; i++) {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, m_internalFormat, width, height, 0, m_format, m_dataType, nullptr);
         }
+        trackMemory(6);
     }
 
     Shared<CubeMap> CubeMap::create(GLuint width, GLuint height, TextureType t){
@@ -159,6 +162,7 @@ namespace Merlin {
                 stbi_image_free(data.bytes);
             }
         }
+        trackMemory(6);
     }
 
 }
\ No newline at end of file
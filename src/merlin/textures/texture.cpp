@@ -6,6 +6,7 @@
 #include "merlin/utils/util.h"
 #include "merlin/utils/textureLoader.h"
 #include "merlin/core/log.h"
+#include "merlin/memory/memoryTracker.h"
 
 #include <stb_image_write.h>
 
@@ -14,12 +15,20 @@ namespace Merlin {
 	TextureBase::TextureBase(GLenum target, TextureType t, TextureClass c) : m_type(t), m_class(c), m_Target(target), m_format(GL_RGB), m_internalFormat(GL_RGB8) {
 		//Set the target based on the number of samples
 		glGenTextures(1, &m_TextureID);
+		MemoryTracker::instance().track(this, MemoryCategory::TEXTURE, m_TextureID, [this]() { return typeToString() + " " + std::to_string(m_width) + "x" + std::to_string(m_height) + (m_depth > 1 ? "x" + std::to_string(m_depth) : ""); });
 	}
 
 	TextureBase::~TextureBase() {
+		MemoryTracker::onRelease(this);
 		glDeleteTextures(1, &m_TextureID);
 	}
 
+	void TextureBase::trackMemory(GLuint layers, bool mipmaps) const {
+		size_t bytes = size_t(m_width) * size_t(m_height) * size_t(std::max(m_depth, GLuint(1))) * layers * MemoryTracker::bytesPerTexel(m_internalFormat);
+		if (mipmaps) bytes += bytes / 3;
+		MemoryTracker::instance().update(this, m_TextureID, bytes);
+	}
+
 	void TextureBase::bind() {
 		// Activate the appropriate texture unit (offsetting from Texture0 using the m_unit)
 		glActiveTexture(GL_TEXTURE0 + m_unit);
@@ -236,6 +245,7 @@ namespace Merlin {
 		m_internalFormat = internalFormat;
 
 		glTexImage2D(GL_TEXTURE_2D, 0, m_internalFormat, width, height, 0, m_format, type, nullptr);
+		trackMemory();
 	}
 
 	void Texture2D::resize(GLuint width, GLuint height, GLuint depth) {
@@ -244,6 +254,7 @@ namespace Merlin {
 		m_height = height;
 
 		glTexImage2D(GL_TEXTURE_2D, 0, m_internalFormat, width, height, 0, m_format, m_dataType, nullptr);
+		trackMemory();
 	}
 
 	void Texture2D::loadFromData(const ImageData& data)	{
@@ -277,6 +288,7 @@ namespace Merlin {
 		// upload the texture data
 		glTexImage2D(GL_TEXTURE_2D, 0, m_internalFormat, m_width, m_height, 0, m_format, m_dataType, data.bytes);
 		generateMipmap();
+		trackMemory(1, true);
 	}
 
 	void Texture2D::loadFromFile(const std::string& path){
@@ -433,6 +445,7 @@ namespace Merlin {
 		}
 
 		glTexImage3D(GL_TEXTURE_3D, 0, m_internalFormat, m_width, m_height, m_depth, 0, m_format, m_dataType, nullptr);
+		trackMemory();
 	}
 
 	void Texture3D::resize(GLuint width, GLuint height, GLuint depth) {
@@ -443,6 +456,7 @@ namespace Merlin {
 		m_dataType = GL_FLOAT;
 
 		glTexImage3D(GL_TEXTURE_3D, 0, m_internalFormat, m_width, m_height, m_depth, 0, m_format, m_dataType, nullptr);
+		trackMemory();
 	}
 
 	Shared<Texture3D> Texture3D::create(GLuint width, GLuint height, GLuint depth, GLuint channels, GLuint bits) {
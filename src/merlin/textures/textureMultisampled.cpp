@@ -30,6 +30,7 @@ namespace Merlin {
 		}
 
 		glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, m_samples, m_internalFormat, m_width, m_height, GL_TRUE);
+		trackMemory(m_samples);
 
 	}
 
@@ -39,6 +40,7 @@ namespace Merlin {
 		m_height = height;
 
 		glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, m_samples, m_internalFormat, m_width, m_height, GL_TRUE);
+		trackMemory(m_samples);
 	}
 
 	Shared<TextureMultisampled2D> TextureMultisampled2D::create(GLuint width, GLuint height, GLuint samples, TextureType t){
@@ -0,0 +1,233 @@
+#include "pch.h"
+#include "merlin/utils/cpuProfiler.h"
+#include "merlin/utils/gpuProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+namespace Merlin {
+
+	static std::string escapeJSON(const std::string& str) {
+		std::string out;
+		for (char c : str) {
+			if (c == '"' || c == '\\') out += '\\';
+			out += c;
+		}
+		return out;
+	}
+
+	CPUProfiler::ThreadBuffer& CPUProfiler::buffer() {
+		static thread_local ThreadBuffer* local = nullptr;
+		if (local) return *local;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::shared_ptr<ThreadBuffer> created = std::make_shared<ThreadBuffer>();
+		created->id = GLuint(m_threads.size());
+		m_threads.push_back(created);
+		m_threadNames.push_back("Thread " + std::to_string(created->id));
+		local = created.get();
+		return *local;
+	}
+
+	void CPUProfiler::setThreadName(const std::string& name) {
+		GLuint id = buffer().id;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_threadNames[id] = name;
+	}
+
+	std::string CPUProfiler::threadName(GLuint thread) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return thread < m_threadNames.size() ? m_threadNames[thread] : "";
+	}
+
+	std::vector<std::string> CPUProfiler::threadNames() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_threadNames;
+	}
+
+	const char* CPUProfiler::intern(const std::string& name) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_interned.insert(name).first->c_str(); //nodes never move
+	}
+
+	CPUZone::CPUZone(const char* name) : m_name(name) {
+		CPUProfiler& profiler = CPUProfiler::instance();
+		if (!profiler.m_enabled) {
+			m_name = nullptr;
+			return;
+		}
+		profiler.buffer().depth++;
+		m_start = GPUProfiler::now();
+	}
+
+	CPUZone::~CPUZone() {
+		if (!m_name) return;
+		const int64_t end = GPUProfiler::now();
+		CPUProfiler::ThreadBuffer& buffer = CPUProfiler::instance().buffer();
+		buffer.depth--;
+		std::lock_guard<std::mutex> lock(buffer.mutex);
+		buffer.events.push_back({ m_name, buffer.id, buffer.depth, m_start, end });
+	}
+
+	void CPUProfiler::newFrame() {
+		const int64_t now = GPUProfiler::now();
+		if (m_frameStart == 0) m_frameStart = now;
+
+		CPUFrameRecord record;
+		record.frame = m_frame++;
+		record.start = m_frameStart;
+		record.end = now;
+		m_frameStart = now;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (const auto& thread : m_threads) {
+				std::lock_guard<std::mutex> events(thread->mutex);
+				record.zones.insert(record.zones.end(), thread->events.begin(), thread->events.end());
+				thread->events.clear(); //keeps the capacity, the threads don't allocate in steady state
+			}
+		}
+		std::sort(record.zones.begin(), record.zones.end(), [](const CPUZoneRecord& a, const CPUZoneRecord& b) {
+			return a.thread != b.thread ? a.thread < b.thread : a.start < b.start;
+		});
+
+		std::unordered_map<std::string_view, std::pair<double, size_t>> frame;
+		for (const CPUZoneRecord& zone : record.zones) {
+			auto& entry = frame[zone.name];
+			entry.first += (zone.end - zone.start) / 1e6;
+			entry.second++;
+		}
+		for (const auto& entry : frame) {
+			CPUZoneStats& stats = m_stats[entry.first];
+			stats.average = stats.calls == 0 ? entry.second.first : stats.average + (entry.second.first - stats.average) * AVERAGE_WEIGHT;
+			stats.last = entry.second.first;
+			stats.max = std::max(stats.max, entry.second.first);
+			stats.calls = entry.second.second;
+		}
+
+		if (m_history.size() >= HISTORY_SIZE) m_history.erase(m_history.begin());
+		m_history.push_back(float((record.end - record.start) / 1e6));
+		if (m_frames.size() >= HISTORY_SIZE) m_frames.pop_front();
+		m_frames.push_back(std::move(record));
+	}
+
+	void CPUProfiler::onImGuiRender(bool* open) {
+		if (!ImGui::Begin("CPU Profiler", open)) {
+			ImGui::End();
+			return;
+		}
+
+		ImGui::Checkbox("Enabled", &m_enabled);
+		ImGui::SameLine();
+		if (ImGui::Button("Export trace")) exportChromeTrace("trace.json");
+
+		if (m_frames.empty()) {
+			ImGui::TextUnformatted("No frame recorded yet");
+			ImGui::End();
+			return;
+		}
+
+		const CPUFrameRecord& frame = m_frames.back();
+		const double frameTime = (frame.end - frame.start) / 1e6;
+		ImGui::Text("Frame %zu : %.3f ms", frame.frame, frameTime);
+		ImGui::PlotLines("CPU (ms)", m_history.data(), int(m_history.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+		//timeline of the last frame, one row per nesting level of each thread
+		const std::vector<std::string> threads = threadNames();
+		std::vector<GLuint> rows(threads.size(), 0);
+		for (const CPUZoneRecord& zone : frame.zones) rows[zone.thread] = std::max(rows[zone.thread], zone.depth + 1);
+		std::vector<GLuint> firstRow(rows.size(), 0);
+		GLuint totalRows = 0;
+		for (size_t thread = 0; thread < rows.size(); thread++) {
+			firstRow[thread] = totalRows;
+			totalRows += rows[thread];
+		}
+
+		const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+		const float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+		const double span = double(std::max<int64_t>(frame.end - frame.start, 1));
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+		ImGui::InvisibleButton("cpu_timeline", ImVec2(width, rowHeight * std::max(totalRows, 1u)));
+		const bool hovered = ImGui::IsItemHovered();
+		const ImVec2 mouse = ImGui::GetMousePos();
+
+		ImDrawList* draw = ImGui::GetWindowDrawList();
+		for (const CPUZoneRecord& zone : frame.zones) {
+			//zones started in the previous frame are clipped to the frame
+			const float x0 = origin.x + float(std::max<int64_t>(zone.start - frame.start, 0) / span * width);
+			const float x1 = std::max(x0 + 1.0f, origin.x + float(std::min<int64_t>(zone.end - frame.start, frame.end - frame.start) / span * width));
+			const float y0 = origin.y + (firstRow[zone.thread] + zone.depth) * rowHeight;
+			const float y1 = y0 + rowHeight - 1.0f;
+
+			draw->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), ImColor::HSV(std::fmod((std::hash<std::string_view>()(zone.name) % 1024) * 0.618034f, 1.0f), 0.5f, 0.8f));
+			if (ImGui::CalcTextSize(zone.name).x < x1 - x0 - 4.0f) draw->AddText(ImVec2(x0 + 2.0f, y0), IM_COL32(0, 0, 0, 255), zone.name);
+			if (hovered && mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1)
+				ImGui::SetTooltip("%s (%s) : %.3f ms", zone.name, threads[zone.thread].c_str(), (zone.end - zone.start) / 1e6);
+		}
+
+		//zones sorted by their running average, share of the last frame
+		std::vector<std::pair<std::string_view, const CPUZoneStats*>> order;
+		for (const auto& entry : m_stats) order.push_back({ entry.first, &entry.second });
+		std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.second->average > b.second->average; });
+
+		if (ImGui::BeginTable("cpu_profiler_zones", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable)) {
+			ImGui::TableSetupColumn("Zone");
+			ImGui::TableSetupColumn("Average (ms)");
+			ImGui::TableSetupColumn("Last (ms)");
+			ImGui::TableSetupColumn("Max (ms)");
+			ImGui::TableSetupColumn("Calls");
+			ImGui::TableSetupColumn("Frame (%)");
+			ImGui::TableHeadersRow();
+
+			for (const auto& entry : order) {
+				const CPUZoneStats& stats = *entry.second;
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::TextUnformatted(entry.first.data(), entry.first.data() + entry.first.size());
+				ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.average);
+				ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.last);
+				ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.max);
+				ImGui::TableNextColumn(); ImGui::Text("%zu", stats.calls);
+				ImGui::TableNextColumn(); ImGui::Text("%.1f", frameTime > 0 ? 100.0 * stats.last / frameTime : 0.0);
+			}
+			ImGui::EndTable();
+		}
+		ImGui::End();
+	}
+
+	bool CPUProfiler::exportChromeTrace(const std::string& path, bool gpu) const {
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			Console::error("CPUProfiler") << "cannot open " << path << Console::endl;
+			return false;
+		}
+
+		const GPUProfiler& gpuProfiler = GPUProfiler::instance();
+		int64_t origin = m_frames.empty() ? 0 : m_frames.front().start;
+		if (gpu && !gpuProfiler.frames().empty()) origin = m_frames.empty() ? gpuProfiler.frames().front().start : std::min(origin, gpuProfiler.frames().front().start);
+
+		bool first = false;
+		file << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+		file << "{ \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": { \"name\": \"merlin\" } }";
+		if (gpu) gpuProfiler.writeTraceEvents(file, origin, first); //tid 0, the CPU threads follow
+
+		const std::vector<std::string> threads = threadNames();
+		for (size_t thread = 0; thread < threads.size(); thread++)
+			file << ",\n{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread + 1 << ", \"args\": { \"name\": \"" << escapeJSON(threads[thread]) << "\" } }";
+
+		file << std::fixed << std::setprecision(3);
+		for (const CPUFrameRecord& frame : m_frames) {
+			for (const CPUZoneRecord& zone : frame.zones) {
+				file << ",\n{ \"name\": \"" << escapeJSON(zone.name) << "\", \"cat\": \"cpu\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << zone.thread + 1
+					<< ", \"ts\": " << (zone.start - origin) / 1e3
+					<< ", \"dur\": " << (zone.end - zone.start) / 1e3
+					<< ", \"args\": { \"frame\": " << frame.frame << " } }";
+			}
+		}
+		file << "\n] }\n";
+		Console::info("CPUProfiler") << "trace exported to " << path << Console::endl;
+		return true;
+	}
+}
@@ -0,0 +1,324 @@
+#include "pch.h"
+#include "merlin/utils/gpuPrimitives.h"
+#include "merlin/memory/memoryTracker.h"
+
+#include <random>
+#include <chrono>
+
+namespace Merlin {
+
+	static const char* glslType(ScalarType type) {
+		switch (type) {
+		case ScalarType::INT: return "int";
+		case ScalarType::FLOAT: return "float";
+		default: return "uint";
+		}
+	}
+
+	static std::string reduceOptions(ScalarType type, ReduceOp op) {
+		std::string identity;
+		switch (op) {
+		case ReduceOp::MIN:
+			identity = type == ScalarType::FLOAT ? "uintBitsToFloat(0x7F800000u)" : type == ScalarType::INT ? "2147483647" : "0xFFFFFFFFu";
+			return "#define OP(a, b) min(a, b)\n#define IDENTITY " + identity + "\n";
+		case ReduceOp::MAX:
+			identity = type == ScalarType::FLOAT ? "uintBitsToFloat(0xFF800000u)" : type == ScalarType::INT ? "(-2147483647 - 1)" : "0u";
+			return "#define OP(a, b) max(a, b)\n#define IDENTITY " + identity + "\n";
+		default:
+			return "#define OP(a, b) ((a) + (b))\n#define IDENTITY T(0)\n";
+		}
+	}
+
+	static std::string reduceName(ReduceOp op) {
+		switch (op) {
+		case ReduceOp::MIN: return "min";
+		case ReduceOp::MAX: return "max";
+		default: return "sum";
+		}
+	}
+
+	ComputeShader_Ptr GPUPrimitives::kernel(const std::string& file, const std::string& entry, ScalarType type, const std::string& options, GLuint items) {
+		std::string key = entry + "." + glslType(type) + "." + options;
+		auto it = m_kernels.find(key);
+		if (it != m_kernels.end()) return it->second;
+
+		std::string name = "primitives." + entry + "." + glslType(type);
+		ComputeShader_Ptr shader = ComputeShader::create(name, "./assets/common/shaders/" + file, false);
+		shader->inject("primitives", "#define " + entry + "\n"
+			+ "#define T " + glslType(type) + "\n"
+			+ "#define WORKGROUP_SIZE " + std::to_string(WORKGROUP_SIZE) + "\n"
+			+ "#define ITEMS_PER_THREAD " + std::to_string(items) + "\n"
+			+ options);
+		shader->compile();
+		if (!shader->isCompiled()) Console::error("GPUPrimitives") << "cannot compile the " << name << " kernel" << Console::endl;
+
+		m_kernels[key] = shader;
+		return shader;
+	}
+
+	SSBO<GLuint>& GPUPrimitives::scratch(const std::string& name, GLuint count) {
+		SSBO_Ptr<GLuint>& buffer = m_scratch[name];
+		//the content is never kept between calls, grow by recreating instead of copying
+		if (!buffer || buffer->elements() < count) {
+			MERLIN_MEMORY_SCOPE("GPUPrimitives scratch");
+			buffer = SSBO<GLuint>::create("primitives_" + name, std::max(count, 1u), BufferUsage::DynamicCopy);
+		}
+		return *buffer;
+	}
+
+	GLuint GPUPrimitives::maxGroupCount() {
+		static const GLuint count = [] {
+			GLint value = 0;
+			glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &value);
+			return GLuint(std::max(value, 65535)); //65535 is the guaranteed minimum
+		}();
+		return count;
+	}
+
+	void GPUPrimitives::dispatch(ComputeShader& shader, GLuint groups, GLuint count) {
+		//larger inputs are spread on a 2D grid, the kernels flatten the index with groupCount
+		GLuint x = std::min(groups, maxGroupCount());
+		GLuint y = (groups + x - 1) / x;
+
+		shader.setUInt("count", count);
+		shader.setUInt("groupCount", groups);
+		shader.dispatch(x, y);
+		shader.barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	void GPUPrimitives::scan(AbstractBufferObject& input, AbstractBufferObject& output, GLuint count, ScalarType type, bool inclusive) {
+		if (count == 0) return;
+		scanLevel(input, output, count, type, inclusive, 0);
+	}
+
+	void GPUPrimitives::scanLevel(AbstractBufferObject& input, AbstractBufferObject& output, GLuint count, ScalarType type, bool inclusive, GLuint level) {
+		const GLuint tile = WORKGROUP_SIZE * SCAN_ITEMS;
+		GLuint groups = (count + tile - 1) / tile;
+		SSBO<GLuint>& sums = scratch("scan_sums" + std::to_string(level), groups);
+
+		ComputeShader_Ptr local = kernel("scan.comp", "SCAN_LOCAL", type, inclusive ? "#define INCLUSIVE\n" : "", SCAN_ITEMS);
+		local->use();
+		local->attach(input, "scan_input");
+		local->attach(output, "scan_output");
+		local->attach(sums, "scan_sums");
+		dispatch(*local, groups, count);
+		if (groups == 1) return;
+
+		//tile totals are scanned recursively (1024x fewer elements per level) then added back
+		scanLevel(sums, sums, groups, type, false, level + 1);
+
+		ComputeShader_Ptr add = kernel("scan.comp", "SCAN_ADD", type, "", SCAN_ITEMS);
+		add->use();
+		add->attach(output, "scan_output");
+		add->attach(sums, "scan_sums");
+		dispatch(*add, groups, count);
+	}
+
+	void GPUPrimitives::reduce(AbstractBufferObject& input, AbstractBufferObject& result, GLuint count, ScalarType type, ReduceOp op) {
+		if (count == 0) return;
+		const GLuint tile = WORKGROUP_SIZE * REDUCE_ITEMS;
+		ComputeShader_Ptr shader = kernel("reduce.comp", "REDUCE", type, reduceOptions(type, op), REDUCE_ITEMS);
+		shader->use();
+
+		//partial results ping-pong between two scratch buffers until a single group is left
+		AbstractBufferObject* source = &input;
+		GLuint pass = 0;
+		while (true) {
+			GLuint groups = (count + tile - 1) / tile;
+			AbstractBufferObject* target = groups == 1 ? &result : &scratch("reduce" + std::to_string(pass % 2), groups);
+			shader->attach(*source, "reduce_input");
+			shader->attach(*target, "reduce_output");
+			dispatch(*shader, groups, count);
+			if (groups == 1) break;
+			source = target;
+			count = groups;
+			pass++;
+		}
+	}
+
+	void GPUPrimitives::sort(AbstractBufferObject& keys, AbstractBufferObject* values, GLuint count, ScalarType keyType, GLuint keyBits) {
+		if (count <= 1) return;
+		const GLuint tile = WORKGROUP_SIZE * SORT_ITEMS;
+		GLuint groups = (count + tile - 1) / tile;
+		GLuint passes = std::min((keyBits + 3) / 4, 8u);
+
+		std::string options = keyType == ScalarType::FLOAT ? "#define KEY_FLOAT\n" : keyType == ScalarType::INT ? "#define KEY_INT\n" : "";
+		ComputeShader_Ptr countKernel = kernel("radixsort.comp", "RADIX_COUNT", keyType, options, SORT_ITEMS);
+		ComputeShader_Ptr scatterKernel = kernel("radixsort.comp", "RADIX_SCATTER", keyType, options + (values ? "#define HAS_VALUES\n" : ""), SORT_ITEMS);
+
+		SSBO<GLuint>& histogram = scratch("radix_histogram", groups * 16);
+		AbstractBufferObject* keysIn = &keys;
+		AbstractBufferObject* keysOut = &scratch("radix_keys", count);
+		AbstractBufferObject* valuesIn = values;
+		AbstractBufferObject* valuesOut = values ? &scratch("radix_values", count) : nullptr;
+
+		for (GLuint pass = 0; pass < passes; pass++) {
+			countKernel->use();
+			countKernel->setUInt("shift", pass * 4);
+			countKernel->attach(*keysIn, "radix_keys_in");
+			countKernel->attach(histogram, "radix_histogram");
+			dispatch(*countKernel, groups, count);
+
+			//digit major histogram : the exclusive scan gives the first destination of each (digit, tile)
+			scan(histogram, histogram, groups * 16, ScalarType::UINT, false);
+
+			scatterKernel->use();
+			scatterKernel->setUInt("shift", pass * 4);
+			scatterKernel->attach(*keysIn, "radix_keys_in");
+			scatterKernel->attach(*keysOut, "radix_keys_out");
+			scatterKernel->attach(histogram, "radix_histogram");
+			if (values) {
+				scatterKernel->attach(*valuesIn, "radix_values_in");
+				scatterKernel->attach(*valuesOut, "radix_values_out");
+			}
+			dispatch(*scatterKernel, groups, count);
+
+			std::swap(keysIn, keysOut);
+			std::swap(valuesIn, valuesOut);
+		}
+
+		//odd number of passes, the sorted data is in the scratch buffers
+		if (keysIn != &keys) {
+			glCopyNamedBufferSubData(keysIn->id(), keys.id(), keysIn->offset(), keys.offset(), GLsizeiptr(count) * sizeof(GLuint));
+			if (values) glCopyNamedBufferSubData(valuesIn->id(), values->id(), valuesIn->offset(), values->offset(), GLsizeiptr(count) * sizeof(GLuint));
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+		}
+	}
+
+	void GPUPrimitives::compact(AbstractBufferObject& input, AbstractBufferObject& flags, AbstractBufferObject& output, GLuint count, ScalarType type) {
+		if (!m_counter) {
+			MERLIN_MEMORY_SCOPE("GPUPrimitives scratch");
+			m_counter = SSBO<GLuint>::create("primitives_counter", 1, BufferUsage::DynamicCopy);
+		}
+		if (count == 0) {
+			m_counter->clear();
+			return;
+		}
+
+		SSBO<GLuint>& offsets = scratch("compact_offsets", count);
+		scan(flags, offsets, count, ScalarType::UINT, false);
+
+		ComputeShader_Ptr shader = kernel("compact.comp", "COMPACT", type);
+		shader->use();
+		shader->attach(input, "compact_input");
+		shader->attach(flags, "compact_flags");
+		shader->attach(offsets, "compact_offsets");
+		shader->attach(output, "compact_output");
+		shader->attach(*m_counter, "compact_count");
+		dispatch(*shader, (count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, count);
+	}
+
+	void GPUPrimitives::dispatchArgs(AbstractBufferObject& counter, AbstractBufferObject& args, GLuint groupSize, GLuint counterIndex, GLuint scale) {
+		ComputeShader_Ptr shader = kernel("indirect.comp", "DISPATCH_ARGS", ScalarType::UINT);
+		shader->use();
+		shader->setUInt("counterIndex", counterIndex);
+		shader->setUInt("scale", scale);
+		shader->setUInt("groupSize", std::max(groupSize, 1u));
+		shader->setUInt("maxGroups", maxGroupCount());
+		shader->attach(counter, "indirect_counter");
+		shader->attach(args, "indirect_args");
+		shader->dispatch(1);
+		shader->barrier(GL_COMMAND_BARRIER_BIT);
+	}
+
+	void GPUPrimitives::drawArgs(AbstractBufferObject& counter, AbstractBufferObject& args, bool indexed, GLuint elementCount, GLuint counterIndex, GLuint scale) {
+		ComputeShader_Ptr shader = kernel("indirect.comp", "DRAW_ARGS", ScalarType::UINT);
+		shader->use();
+		shader->setUInt("counterIndex", counterIndex);
+		shader->setUInt("scale", scale);
+		shader->setUInt("elementCount", elementCount);
+		shader->setInt("indexed", indexed);
+		shader->attach(counter, "indirect_counter");
+		shader->attach(args, "indirect_args");
+		shader->dispatch(1);
+		shader->barrier(GL_COMMAND_BARRIER_BIT);
+	}
+
+	std::vector<PrimitiveBenchmarkResult> benchmarkGPUPrimitives(const std::vector<GLuint>& sizes, GLuint iterations) {
+		std::vector<PrimitiveBenchmarkResult> results;
+		GPUPrimitives& gpu = GPUPrimitives::instance();
+		iterations = std::max(iterations, 1u);
+
+		GLint64 maxBlockSize = 0;
+		glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+
+		GLuint query = 0;
+		glGenQueries(1, &query);
+		auto time = [&](const std::function<void()>& run) {
+			run(); //warm up, compiles the kernels and allocates the scratch buffers
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			for (GLuint i = 0; i < iterations; i++) run();
+			glEndQuery(GL_TIME_ELAPSED);
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			return elapsed / 1e6 / iterations;
+		};
+		auto record = [&](const std::string& primitive, GLuint count, double ms, bool valid) {
+			PrimitiveBenchmarkResult result;
+			result.primitive = primitive;
+			result.count = count;
+			result.milliseconds = ms;
+			result.throughput = ms > 0 ? count / (ms * 1e3) : 0;
+			result.valid = valid;
+			results.push_back(result);
+		};
+
+		std::mt19937 rng(42);
+		for (GLuint count : sizes) {
+			if (GLint64(count) * sizeof(GLuint) > maxBlockSize) {
+				Console::warn("GPUPrimitives") << "skipping " << count << " elements, larger than the maximum storage block size" << Console::endl;
+				continue;
+			}
+
+			std::vector<GLuint> data(count), flags(count), indices(count);
+			std::uniform_int_distribution<GLuint> dist;
+			for (GLuint i = 0; i < count; i++) {
+				data[i] = dist(rng);
+				flags[i] = data[i] & 1u;
+				indices[i] = i;
+			}
+
+			SSBO<GLuint> input("bench_input", data, BufferUsage::DynamicCopy);
+			SSBO<GLuint> output("bench_output", count, BufferUsage::DynamicCopy);
+			SSBO<GLuint> flagBuffer("bench_flags", flags, BufferUsage::DynamicCopy);
+
+			//scan
+			double ms = time([&]() { gpu.exclusiveScan(input, output, count); });
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			record("exclusive scan", count, ms, output.read() == CPUPrimitives::exclusiveScan(data));
+
+			//reduction
+			GLuint sum = 0;
+			ms = time([&]() { sum = gpu.sum(input, count); });
+			record("reduce (sum)", count, ms, sum == CPUPrimitives::reduce(data, ReduceOp::SUM));
+
+			//compaction
+			GLuint kept = 0;
+			ms = time([&]() { kept = gpu.compact(input, flagBuffer, output, count); });
+			std::vector<GLuint> expected = CPUPrimitives::compact(data, flags);
+			record("compaction", count, ms, kept == expected.size() && output.read(0, kept) == expected);
+
+			//key-value sort, the keys are restored before each run so every run sorts random keys
+			SSBO<GLuint> keys("bench_keys", count, BufferUsage::DynamicCopy);
+			SSBO<GLuint> values("bench_values", count, BufferUsage::DynamicCopy);
+			ms = time([&]() {
+				glCopyNamedBufferSubData(input.id(), keys.id(), 0, 0, GLsizeiptr(count) * sizeof(GLuint));
+				gpu.sort(keys, values, count);
+			});
+			values.write(indices);
+			glCopyNamedBufferSubData(input.id(), keys.id(), 0, 0, GLsizeiptr(count) * sizeof(GLuint));
+			gpu.sort(keys, values, count);
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			std::vector<GLuint> sortedKeys = data, sortedValues = indices;
+			CPUPrimitives::sort(sortedKeys, &sortedValues);
+			record("radix sort (key-value)", count, ms, keys.read() == sortedKeys && values.read() == sortedValues);
+		}
+		glDeleteQueries(1, &query);
+
+		for (const PrimitiveBenchmarkResult& result : results) {
+			Console::info("GPUPrimitives") << result.primitive << "\t" << result.count << " elements\t" << result.milliseconds << " ms\t"
+				<< result.throughput << " Melem/s\t" << (result.valid ? "ok" : "MISMATCH") << Console::endl;
+		}
+		return results;
+	}
+}
@@ -0,0 +1,267 @@
+#include "pch.h"
+#include "merlin/utils/gpuProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+namespace Merlin {
+
+	static constexpr size_t CALIBRATION_INTERVAL = 300; //frames, drift between the CPU and GPU clocks
+
+	static std::string escapeJSON(const std::string& str) {
+		std::string out;
+		for (char c : str) {
+			if (c == '"' || c == '\\') out += '\\';
+			out += c;
+		}
+		return out;
+	}
+
+	int64_t GPUProfiler::now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void GPUProfiler::initialize() {
+		m_thread = std::this_thread::get_id();
+		m_initialized = true;
+		calibrate();
+		m_pools[m_current].offset = m_offset;
+		m_pools[m_current].frame = m_frame;
+	}
+
+	void GPUProfiler::calibrate() {
+		GLint64 gpu = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpu); //GL time once the previous commands reached the GPU, their execution is not waited for
+		m_offset = now() - gpu;
+		m_calibrated = m_frame;
+	}
+
+	void GPUProfiler::shutdown() {
+		for (FramePool& pool : m_pools) {
+			if (!pool.queries.empty()) glDeleteQueries(GLsizei(pool.queries.size()), pool.queries.data());
+			pool = FramePool();
+		}
+		m_stack.clear();
+		m_initialized = false;
+	}
+
+	GLuint GPUProfiler::query(FramePool& pool) {
+		if (pool.used == pool.queries.size()) {
+			GLuint id = 0;
+			glGenQueries(1, &id);
+			pool.queries.push_back(id);
+		}
+		return pool.used++;
+	}
+
+	GLuint GPUProfiler::nameId(const std::string& name) {
+		auto it = m_ids.find(name);
+		if (it != m_ids.end()) return it->second;
+		GLuint id = GLuint(m_names.size());
+		m_names.push_back(name);
+		m_stats.emplace_back();
+		m_ids[name] = id;
+		return id;
+	}
+
+	bool GPUProfiler::begin(const std::string& name) {
+		if (!m_enabled) return false;
+		if (!m_initialized) initialize();
+		else if (std::this_thread::get_id() != m_thread) return false;
+
+		FramePool& pool = m_pools[m_current];
+		PendingZone zone = { nameId(name), GLuint(m_stack.size()), query(pool), 0 };
+		glQueryCounter(pool.queries[zone.begin], GL_TIMESTAMP);
+		m_stack.push_back(GLuint(pool.zones.size()));
+		pool.zones.push_back(zone);
+		return true;
+	}
+
+	void GPUProfiler::end() {
+		if (m_stack.empty()) return; //closed by newFrame
+		FramePool& pool = m_pools[m_current];
+		PendingZone& zone = pool.zones[m_stack.back()];
+		m_stack.pop_back();
+		zone.end = query(pool);
+		glQueryCounter(pool.queries[zone.end], GL_TIMESTAMP);
+	}
+
+	void GPUProfiler::newFrame() {
+		if (!m_initialized) return;
+		while (!m_stack.empty()) end(); //zones left open end with the frame
+
+		m_pools[m_current].pending = m_pools[m_current].used > 0;
+		m_frame++;
+
+		//oldest first, the timestamps of a frame are never available before the ones of the previous frames
+		for (GLuint i = 1; i <= FRAME_LATENCY; i++) {
+			FramePool& pool = m_pools[(m_current + i) % FRAME_LATENCY];
+			if (pool.pending && !collect(pool)) break;
+		}
+
+		m_current = (m_current + 1) % FRAME_LATENCY;
+		FramePool& pool = m_pools[m_current];
+		if (pool.pending) m_dropped++; //the GPU is FRAME_LATENCY frames behind, the results are dropped rather than waited for
+		if (m_frame - m_calibrated >= CALIBRATION_INTERVAL) calibrate();
+
+		pool.pending = false;
+		pool.used = 0;
+		pool.zones.clear();
+		pool.frame = m_frame;
+		pool.offset = m_offset;
+	}
+
+	bool GPUProfiler::collect(FramePool& pool) {
+		GLint available = 0;
+		glGetQueryObjectiv(pool.queries[pool.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return false;
+		pool.pending = false;
+
+		std::vector<GLuint64> times(pool.used);
+		for (GLuint i = 0; i < pool.used; i++) glGetQueryObjectui64v(pool.queries[i], GL_QUERY_RESULT, &times[i]);
+
+		GPUFrameRecord record;
+		record.frame = pool.frame;
+		record.start = std::numeric_limits<int64_t>::max();
+		record.end = std::numeric_limits<int64_t>::min();
+		record.zones.reserve(pool.zones.size());
+
+		std::vector<double> elapsed(m_names.size(), 0.0);
+		std::vector<size_t> calls(m_names.size(), 0);
+		for (const PendingZone& zone : pool.zones) {
+			GPUZoneRecord result;
+			result.name = zone.name;
+			result.depth = zone.depth;
+			result.start = int64_t(times[zone.begin]) + pool.offset;
+			result.end = std::max(int64_t(times[zone.end]) + pool.offset, result.start);
+			record.start = std::min(record.start, result.start);
+			record.end = std::max(record.end, result.end);
+			record.zones.push_back(result);
+
+			elapsed[zone.name] += (result.end - result.start) / 1e6;
+			calls[zone.name]++;
+		}
+
+		for (size_t id = 0; id < m_names.size(); id++) {
+			if (calls[id] == 0) continue;
+			GPUZoneStats& stats = m_stats[id];
+			stats.average = stats.calls == 0 ? elapsed[id] : stats.average + (elapsed[id] - stats.average) * AVERAGE_WEIGHT;
+			stats.last = elapsed[id];
+			stats.max = std::max(stats.max, elapsed[id]);
+			stats.calls = calls[id];
+			stats.frame = pool.frame;
+		}
+
+		if (m_history.size() >= HISTORY_SIZE) m_history.erase(m_history.begin());
+		m_history.push_back(float((record.end - record.start) / 1e6));
+		if (m_frames.size() >= HISTORY_SIZE) m_frames.pop_front();
+		m_frames.push_back(std::move(record));
+		return true;
+	}
+
+	void GPUProfiler::onImGuiRender(bool* open) {
+		if (!ImGui::Begin("GPU Profiler", open)) {
+			ImGui::End();
+			return;
+		}
+
+		ImGui::Checkbox("Enabled", &m_enabled);
+		ImGui::SameLine();
+		if (ImGui::Button("Export trace")) exportChromeTrace("gpu_trace.json");
+
+		if (m_frames.empty()) {
+			ImGui::TextUnformatted("No frame read back yet");
+			ImGui::End();
+			return;
+		}
+
+		const GPUFrameRecord& frame = m_frames.back();
+		ImGui::Text("Frame %zu : %.3f ms (read back %zu frames later, %zu dropped)", frame.frame, (frame.end - frame.start) / 1e6, m_frame - frame.frame, m_dropped);
+		ImGui::PlotLines("GPU (ms)", m_history.data(), int(m_history.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+		//timeline of the last frame read back, one row per nesting level
+		GLuint levels = 1;
+		for (const GPUZoneRecord& zone : frame.zones) levels = std::max(levels, zone.depth + 1);
+		const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+		const float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+		const double span = double(std::max<int64_t>(frame.end - frame.start, 1));
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+		ImGui::InvisibleButton("gpu_timeline", ImVec2(width, rowHeight * levels));
+		const bool hovered = ImGui::IsItemHovered();
+		const ImVec2 mouse = ImGui::GetMousePos();
+
+		ImDrawList* draw = ImGui::GetWindowDrawList();
+		for (const GPUZoneRecord& zone : frame.zones) {
+			const float x0 = origin.x + float((zone.start - frame.start) / span * width);
+			const float x1 = std::max(x0 + 1.0f, origin.x + float((zone.end - frame.start) / span * width));
+			const float y0 = origin.y + zone.depth * rowHeight;
+			const float y1 = y0 + rowHeight - 1.0f;
+			const std::string& name = m_names[zone.name];
+
+			draw->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), ImColor::HSV(std::fmod(zone.name * 0.618034f, 1.0f), 0.5f, 0.8f));
+			if (ImGui::CalcTextSize(name.c_str()).x < x1 - x0 - 4.0f) draw->AddText(ImVec2(x0 + 2.0f, y0), IM_COL32(0, 0, 0, 255), name.c_str());
+			if (hovered && mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1)
+				ImGui::SetTooltip("%s : %.3f ms", name.c_str(), (zone.end - zone.start) / 1e6);
+		}
+
+		//zones sorted by their running average
+		std::vector<GLuint> order;
+		for (GLuint id = 0; id < m_stats.size(); id++) if (m_stats[id].calls > 0) order.push_back(id);
+		std::sort(order.begin(), order.end(), [&](GLuint a, GLuint b) { return m_stats[a].average > m_stats[b].average; });
+
+		if (ImGui::BeginTable("gpu_profiler_zones", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable)) {
+			ImGui::TableSetupColumn("Zone");
+			ImGui::TableSetupColumn("Average (ms)");
+			ImGui::TableSetupColumn("Last (ms)");
+			ImGui::TableSetupColumn("Max (ms)");
+			ImGui::TableSetupColumn("Calls");
+			ImGui::TableHeadersRow();
+
+			for (GLuint id : order) {
+				const GPUZoneStats& stats = m_stats[id];
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::TextUnformatted(m_names[id].c_str());
+				ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.average);
+				ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.last);
+				ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.max);
+				ImGui::TableNextColumn(); ImGui::Text("%zu", stats.calls);
+			}
+			ImGui::EndTable();
+		}
+		ImGui::End();
+	}
+
+	void GPUProfiler::writeTraceEvents(std::ostream& out, int64_t origin, bool& first) const {
+		out << (first ? "" : ",\n") << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": { \"name\": \"GPU\" } }";
+		first = false;
+
+		out << std::fixed << std::setprecision(3);
+		for (const GPUFrameRecord& frame : m_frames) {
+			for (const GPUZoneRecord& zone : frame.zones) {
+				out << ",\n{ \"name\": \"" << escapeJSON(m_names[zone.name]) << "\", \"cat\": \"gpu\", \"ph\": \"X\", \"pid\": 1, \"tid\": 0"
+					<< ", \"ts\": " << (zone.start - origin) / 1e3
+					<< ", \"dur\": " << (zone.end - zone.start) / 1e3
+					<< ", \"args\": { \"frame\": " << frame.frame << " } }";
+			}
+		}
+	}
+
+	bool GPUProfiler::exportChromeTrace(const std::string& path) const {
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			Console::error("GPUProfiler") << "cannot open " << path << Console::endl;
+			return false;
+		}
+
+		bool first = true;
+		file << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+		writeTraceEvents(file, m_frames.empty() ? 0 : m_frames.front().start, first);
+		file << "\n] }\n";
+		Console::info("GPUProfiler") << "GPU trace exported to " << path << Console::endl;
+		return true;
+	}
+}
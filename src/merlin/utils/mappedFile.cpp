@@ -0,0 +1,161 @@
+#include "pch.h"
+#include "merlin/utils/mappedFile.h"
+
+#ifndef GLCORE_PLATFORM_WINDOWS
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace Merlin {
+
+	//the mapping can be used from any thread, errors are reported by the return values and logged by the caller
+
+	MappedFile::~MappedFile() {
+		close();
+	}
+
+#ifdef GLCORE_PLATFORM_WINDOWS
+
+	bool MappedFile::open(const std::string& path) {
+		close();
+		m_path = path;
+
+		m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE) {
+			m_file = nullptr;
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+			close();
+			return false;
+		}
+		m_size = size_t(size.QuadPart);
+
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping) m_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!m_data) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	bool MappedFile::create(const std::string& path, size_t size) {
+		close();
+		m_path = path;
+		if (size == 0) return false;
+
+		m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE) {
+			m_file = nullptr;
+			return false;
+		}
+
+		//the mapping extends the file to its size
+		LARGE_INTEGER large;
+		large.QuadPart = LONGLONG(size);
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, large.HighPart, large.LowPart, nullptr);
+		if (m_mapping) m_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size));
+		if (!m_data) {
+			close();
+			return false;
+		}
+		m_size = size;
+		m_writable = true;
+		return true;
+	}
+
+	bool MappedFile::flush() {
+		if (!m_data || !m_writable) return false;
+		return FlushViewOfFile(m_data, m_size) && FlushFileBuffers(m_file);
+	}
+
+	void MappedFile::close() {
+		if (m_data) UnmapViewOfFile(m_data);
+		if (m_mapping) CloseHandle(m_mapping);
+		if (m_file) CloseHandle(m_file);
+		m_data = nullptr;
+		m_mapping = nullptr;
+		m_file = nullptr;
+		m_size = 0;
+		m_writable = false;
+	}
+
+	size_t MappedFile::pageSize() {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return size_t(info.dwPageSize);
+	}
+
+#else
+
+	bool MappedFile::open(const std::string& path) {
+		close();
+		m_path = path;
+
+		m_file = ::open(path.c_str(), O_RDONLY);
+		if (m_file < 0) return false;
+
+		struct stat info;
+		if (fstat(m_file, &info) != 0 || info.st_size == 0) {
+			close();
+			return false;
+		}
+		m_size = size_t(info.st_size);
+
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_file, 0);
+		if (data == MAP_FAILED) {
+			close();
+			return false;
+		}
+		m_data = static_cast<uint8_t*>(data);
+		madvise(data, m_size, MADV_SEQUENTIAL);
+		return true;
+	}
+
+	bool MappedFile::create(const std::string& path, size_t size) {
+		close();
+		m_path = path;
+		if (size == 0) return false;
+
+		m_file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (m_file < 0 || ftruncate(m_file, off_t(size)) != 0) {
+			close();
+			return false;
+		}
+
+		void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+		if (data == MAP_FAILED) {
+			close();
+			return false;
+		}
+		m_data = static_cast<uint8_t*>(data);
+		m_size = size;
+		m_writable = true;
+		return true;
+	}
+
+	bool MappedFile::flush() {
+		if (!m_data || !m_writable) return false;
+		return msync(m_data, m_size, MS_SYNC) == 0;
+	}
+
+	void MappedFile::close() {
+		if (m_data) munmap(m_data, m_size);
+		if (m_file >= 0) ::close(m_file);
+		m_data = nullptr;
+		m_file = -1;
+		m_size = 0;
+		m_writable = false;
+	}
+
+	size_t MappedFile::pageSize() {
+		return size_t(sysconf(_SC_PAGESIZE));
+	}
+
+#endif
+}
@@ -4,6 +4,7 @@
 #include "merlin/scene/model.h"
 #include "merlin/memory/ibo.h"
 #include "merlin/memory/vertex.h"
+#include "merlin/utils/cpuProfiler.h"
 
 
 #include <assimp/Importer.hpp>
@@ -137,6 +138,7 @@ namespace Merlin {
         if (!mesh->HasNormals()) {
             newMesh->computeNormals();
         }
+        newMesh->setVertexFormat(VertexFormat::AUTO);
         //newMesh->calculateNormals();
         if (material) {
             newMesh->setMaterial(material);
@@ -157,6 +159,7 @@ namespace Merlin {
 
     // Load a model from the specified file and return a pointer to a new Mesh object
     Shared<Mesh> ModelLoader::loadMesh(const std::string& file_path) {
+        MERLIN_PROFILE_SCOPE("ModelLoader::loadMesh");
 
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(file_path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -174,6 +177,7 @@ namespace Merlin {
                 }
                 // create a Mesh object using the parsed vertex and index data
                 auto mesh = Mesh::create(getFileName(file_path), vertices, indices);
+                mesh->setVertexFormat(VertexFormat::AUTO);
                 //mesh->calculateNormals();
 
                 return mesh;
@@ -189,6 +193,7 @@ namespace Merlin {
 
 	// Load a model from the specified file and return a pointer to a new Mesh object
     Shared<Model> ModelLoader::loadModel(const std::string& file_path) {
+        MERLIN_PROFILE_SCOPE("ModelLoader::loadModel");
 
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(file_path.c_str(), aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -206,6 +211,7 @@ namespace Merlin {
                 }
                 // create a Mesh object using the parsed vertex and index data
                 auto mesh = Mesh::create(getFileName(file_path) + "_mesh", vertices, indices);
+                mesh->setVertexFormat(VertexFormat::AUTO);
                 //mesh->calculateNormals();
 
                 return Model::create(getFileName(file_path), mesh);
@@ -380,6 +386,7 @@ namespace Merlin {
 
     // Parse an OBJ file and extract the data
     bool ModelLoader::parseOBJ(const std::string& file_path, Vertices& vertices, Indices& indices) {
+        MERLIN_PROFILE_SCOPE("ModelLoader::parseOBJ");
         // Open the OBJ file
         std::ifstream infile(file_path, std::ios::binary);
         if (!infile) {
@@ -466,6 +473,7 @@ namespace Merlin {
     }
 
     bool ModelLoader::parseSTL(const std::string& filepath, Vertices& vertices, Indices& indices) {
+        MERLIN_PROFILE_SCOPE("ModelLoader::parseSTL");
         // Open the file for reading
         std::ifstream file(filepath, std::ios::binary);
 
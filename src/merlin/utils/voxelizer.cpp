@@ -2,6 +2,7 @@
 #include "merlin/utils/voxelizer.h"
 #include "merlin/memory/bindingPointManager.h"
 #include "merlin/shaders/computeShader.h"
+#include "merlin/memory/memoryTracker.h"
 
 namespace Merlin {
 
@@ -92,8 +93,10 @@ namespace Merlin {
 		if(bb_size.z == 0) bb_size.z += vox_size;
 
 		GLuint voxThread = ceil(bb_size.x / vox_size) * ceil(bb_size.y / vox_size) * ceil(bb_size.z / vox_size); //Total number of bin (thread)
-		SSBO_Ptr<GLint> voxBuffer = SSBO<GLint>::create("voxel_buffer", voxThread); //full grid
-		SSBO_Ptr<Facet> facetBuffer = SSBO<Facet>::create("vertex_buffer", facets.size(), facets.data()); //full grid
+		//temporary buffers, sub-allocated to avoid creating GL buffers on every call
+		MERLIN_MEMORY_SCOPE("Voxelizer");
+		SSBO_Ptr<GLint> voxBuffer = SSBO<GLint>::create("voxel_buffer", voxThread, BufferArena::defaultArena()); //full grid
+		SSBO_Ptr<Facet> facetBuffer = SSBO<Facet>::create("vertex_buffer", facets, BufferArena::defaultArena()); //full grid
 
 		if (!m_voxelize) m_voxelize = ComputeShader::create("voxelize", "./assets/common/shaders/voxelize.comp");
 
@@ -109,11 +112,9 @@ namespace Merlin {
 		m_voxelize->setUInt("voxelCount", voxThread);
 		m_voxelize->setFloat("surface_thickness", thickness);
 
-		GLuint pWkgSize = 64;
-		GLuint pWkgCount = (voxThread + pWkgSize - 1) / pWkgSize; //Total number of workgroup needed
-
-		m_voxelize->dispatch(pWkgCount);
-		m_voxelize->barrier();
+		m_voxelize->SetDomain(voxThread); //one thread per voxel
+		m_voxelize->dispatch();
+		m_voxelize->barrier(GL_BUFFER_UPDATE_BARRIER_BIT); //only read back
 
 		facetBuffer->releaseBindingPoint();
 		voxBuffer->releaseBindingPoint();